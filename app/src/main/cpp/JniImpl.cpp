@@ -22,11 +22,15 @@
  * SOFTWARE.
  */
 
+#include "engine/TraceRecorder.h"
 #include "engine/util/LogUtil.h"
 #include "jni.h"
 #include "processors/Processor.h"
+#include <android/asset_manager_jni.h>
+#include <android/hardware_buffer_jni.h>
 #include <android/native_window_jni.h>
 #include <stdexcept>
+#include <unistd.h>
 
 #define JCMCPRV(rettype, name)                                                 \
   extern "C" JNIEXPORT rettype JNICALL                                         \
@@ -37,10 +41,16 @@ Processor *castToProcessor(jlong handle) {
 }
 
 JCMCPRV(jlong, nativeInit)
-(JNIEnv *env, jobject thiz, jobject asset_manager) {
+(JNIEnv *env, jobject thiz, jobject asset_manager, jstring cache_dir) {
   auto *assetManager = AAssetManager_fromJava(env, asset_manager);
   assert(assetManager != nullptr);
-  auto sample = Processor::create(assetManager);
+  std::string pipelineCachePath;
+  if (cache_dir != nullptr) {
+    const char *cacheDir = env->GetStringUTFChars(cache_dir, nullptr);
+    pipelineCachePath = std::string(cacheDir) + "/pipeline_cache.bin";
+    env->ReleaseStringUTFChars(cache_dir, cacheDir);
+  }
+  auto sample = Processor::create(assetManager, pipelineCachePath);
   return static_cast<jlong>(reinterpret_cast<uintptr_t>(sample.release()));
 }
 
@@ -76,18 +86,206 @@ JCMCPRV(void, nativeStopLoopRender)
   castToProcessor(handle)->stopLoopRender();
 }
 
+JCMCPRV(void, nativeSetRenderPolicy)
+(JNIEnv *env, jobject thiz, jlong handle, jboolean onNewContentOnly,
+ jfloat maxFrameRate) {
+  castToProcessor(handle)->setRenderPolicy(onNewContentOnly == JNI_TRUE,
+                                           maxFrameRate);
+}
+
 JCMCPRV(void, nativePrepareHardwareBuffer)
-(JNIEnv *env, jobject thiz, jlong handle, jobject buffer, jint orientation) {
+(JNIEnv *env, jobject thiz, jlong handle, jobject buffer, jint orientation,
+ jint fenceFd, jlong timestampNs) {
   AHardwareBuffer *nativeBuffer =
       AHardwareBuffer_fromHardwareBuffer(env, buffer);
   if (!nativeBuffer) {
     __android_log_print(ANDROID_LOG_INFO, "Vulkan",
                         "Unable to obtain native HardwareBuffer.");
+    if (fenceFd >= 0) {
+      close(fenceFd);
+    }
     return;
   }
 
   castToProcessor(handle)->prepareHardwareBuffer(env, nativeBuffer,
-                                                 orientation);
+                                                 orientation, fenceFd,
+                                                 timestampNs);
+}
+
+JCMCPRV(jboolean, nativeGetNV21FromHardwareBuffer)
+(JNIEnv *env, jobject thiz, jlong handle, jobject buffer, jobject output) {
+  AHardwareBuffer *nativeBuffer =
+      AHardwareBuffer_fromHardwareBuffer(env, buffer);
+  // The NV21 is written into the direct buffer's memory, no JNI copy
+  void *outputData = env->GetDirectBufferAddress(output);
+  const jlong outputSize = env->GetDirectBufferCapacity(output);
+  if (!nativeBuffer || outputData == nullptr || outputSize < 0) {
+    __android_log_print(ANDROID_LOG_INFO, "Vulkan",
+                        "Unable to obtain native HardwareBuffer or output.");
+    return JNI_FALSE;
+  }
+
+  return castToProcessor(handle)->getNV21FromHardwareBuffer(
+             env, nativeBuffer, outputData, static_cast<size_t>(outputSize))
+             ? JNI_TRUE
+             : JNI_FALSE;
+}
+
+JCMCPRV(jint, nativeLoadLut)
+(JNIEnv *env, jobject thiz, jlong handle, jstring path, jstring cache_path) {
+  const char *lutPath = env->GetStringUTFChars(path, nullptr);
+  std::string cachePath;
+  if (cache_path != nullptr) {
+    const char *cachePathChars = env->GetStringUTFChars(cache_path, nullptr);
+    cachePath = cachePathChars;
+    env->ReleaseStringUTFChars(cache_path, cachePathChars);
+  }
+  const int id = castToProcessor(handle)->loadLut(lutPath, cachePath);
+  env->ReleaseStringUTFChars(path, lutPath);
+  return id;
+}
+
+JCMCPRV(void, nativeSelectLut)
+(JNIEnv *env, jobject thiz, jlong handle, jint id) {
+  castToProcessor(handle)->selectLut(id);
+}
+
+JCMCPRV(void, nativeSetLutTetrahedral)
+(JNIEnv *env, jobject thiz, jlong handle, jboolean tetrahedral) {
+  castToProcessor(handle)->setLutTetrahedral(tetrahedral == JNI_TRUE);
+}
+
+JCMCPRV(jlongArray, nativeGetFrameStats)
+(JNIEnv *env, jobject thiz, jlong handle) {
+  uint64_t published, consumed, dropped;
+  if (!castToProcessor(handle)->getFrameStats(&published, &consumed,
+                                              &dropped)) {
+    return nullptr;
+  }
+  const jlong stats[3] = {static_cast<jlong>(published),
+                          static_cast<jlong>(consumed),
+                          static_cast<jlong>(dropped)};
+  jlongArray result = env->NewLongArray(3);
+  if (result != nullptr) {
+    env->SetLongArrayRegion(result, 0, 3, stats);
+  }
+  return result;
+}
+
+JCMCPRV(jboolean, nativeSetGpuProfiling)
+(JNIEnv *env, jobject thiz, jlong handle, jboolean enabled) {
+  return castToProcessor(handle)->setGpuProfiling(enabled == JNI_TRUE)
+             ? JNI_TRUE
+             : JNI_FALSE;
+}
+
+JCMCPRV(jobjectArray, nativeGetGpuPassStats)
+(JNIEnv *env, jobject thiz, jlong handle) {
+  std::vector<vks::GpuProfiler::PassStats> stats;
+  if (!castToProcessor(handle)->getGpuPassStats(&stats)) {
+    return nullptr;
+  }
+  jclass statsClass = env->FindClass(
+      "com/gain/android_camera_vulkan/NativeVulkan$GpuPassStats");
+  if (statsClass == nullptr) {
+    return nullptr;
+  }
+  jmethodID constructor =
+      env->GetMethodID(statsClass, "<init>", "(Ljava/lang/String;IDDD)V");
+  jobjectArray result = env->NewObjectArray(static_cast<jsize>(stats.size()),
+                                            statsClass, nullptr);
+  if (constructor == nullptr || result == nullptr) {
+    return nullptr;
+  }
+  for (size_t i = 0; i < stats.size(); i++) {
+    jstring name = env->NewStringUTF(stats[i].name.c_str());
+    jobject passStats = env->NewObject(
+        statsClass, constructor, name, static_cast<jint>(stats[i].samples),
+        stats[i].minMs, stats[i].avgMs, stats[i].p99Ms);
+    env->SetObjectArrayElement(result, static_cast<jsize>(i), passStats);
+    env->DeleteLocalRef(passStats);
+    env->DeleteLocalRef(name);
+  }
+  return result;
+}
+
+JCMCPRV(jobjectArray, nativeGetLatencyStats)
+(JNIEnv *env, jobject thiz, jlong handle) {
+  std::vector<LatencyTracker::Stats> stats;
+  if (!castToProcessor(handle)->getLatencyStats(&stats)) {
+    return nullptr;
+  }
+  jclass statsClass = env->FindClass(
+      "com/gain/android_camera_vulkan/NativeVulkan$LatencyStats");
+  if (statsClass == nullptr) {
+    return nullptr;
+  }
+  jmethodID constructor =
+      env->GetMethodID(statsClass, "<init>", "(Ljava/lang/String;JDDDDD)V");
+  jobjectArray result = env->NewObjectArray(static_cast<jsize>(stats.size()),
+                                            statsClass, nullptr);
+  if (constructor == nullptr || result == nullptr) {
+    return nullptr;
+  }
+  for (size_t i = 0; i < stats.size(); i++) {
+    jstring stage =
+        env->NewStringUTF(LatencyTracker::stageName(stats[i].stage));
+    jobject stageStats = env->NewObject(
+        statsClass, constructor, stage, static_cast<jlong>(stats[i].count),
+        stats[i].minMs, stats[i].p50Ms, stats[i].p90Ms, stats[i].p99Ms,
+        stats[i].maxMs);
+    env->SetObjectArrayElement(result, static_cast<jsize>(i), stageStats);
+    env->DeleteLocalRef(stageStats);
+    env->DeleteLocalRef(stage);
+  }
+  return result;
+}
+
+JCMCPRV(jboolean, nativeStartTrace)
+(JNIEnv *env, jobject thiz, jstring path) {
+  const char *tracePath = env->GetStringUTFChars(path, nullptr);
+  if (tracePath == nullptr) {
+    return JNI_FALSE;
+  }
+  const bool started = gain::TraceRecorder::shared().start(tracePath);
+  env->ReleaseStringUTFChars(path, tracePath);
+  return started ? JNI_TRUE : JNI_FALSE;
+}
+
+JCMCPRV(jboolean, nativeSetFrameReadback)
+(JNIEnv *env, jobject thiz, jlong handle, jboolean enabled) {
+  return castToProcessor(handle)->setFrameReadback(enabled == JNI_TRUE)
+             ? JNI_TRUE
+             : JNI_FALSE;
+}
+
+JCMCPRV(jintArray, nativeReadLatestFrame)
+(JNIEnv *env, jobject thiz, jlong handle, jobject output) {
+  // The pixels are copied straight into the direct buffer's memory
+  void *outputData = env->GetDirectBufferAddress(output);
+  const jlong outputSize = env->GetDirectBufferCapacity(output);
+  if (outputData == nullptr || outputSize < 0) {
+    return nullptr;
+  }
+  Processor::FrameInfo info;
+  if (!castToProcessor(handle)->readLatestFrame(
+          outputData, static_cast<size_t>(outputSize), &info)) {
+    return nullptr;
+  }
+  const jint frame[4] = {static_cast<jint>(info.width),
+                         static_cast<jint>(info.height),
+                         static_cast<jint>(info.rowPitch),
+                         static_cast<jint>(info.format)};
+  jintArray result = env->NewIntArray(4);
+  if (result != nullptr) {
+    env->SetIntArrayRegion(result, 0, 4, frame);
+  }
+  return result;
+}
+
+JCMCPRV(void, nativeStopTrace)
+(JNIEnv *env, jobject thiz) {
+  gain::TraceRecorder::shared().stop();
 }
 
 JCMCPRV(void, nativeOnWindowSizeChanged)
@@ -0,0 +1,74 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "FrameMailbox.h"
+
+namespace gain {
+FrameMailbox::Frame &FrameMailbox::Frame::operator=(Frame &&other) noexcept {
+  if (this != &other) {
+    reset();
+    buffer = other.releaseBuffer();
+    fence = std::move(other.fence);
+    orientation = other.orientation;
+    originNs = other.originNs;
+  }
+  return *this;
+}
+
+void FrameMailbox::Frame::reset() {
+  if (buffer != nullptr) {
+    AHardwareBuffer_release(buffer);
+    buffer = nullptr;
+  }
+  fence.reset();
+}
+
+void FrameMailbox::publish(Frame frame) {
+  mSlots[mBack] = std::move(frame);
+  // Release: the consumer sees the slot content once it sees the index.
+  // Acquire: the slot coming back was emptied by the consumer.
+  const uint8_t previous =
+      mMiddle.exchange(mBack | kFresh, std::memory_order_acq_rel);
+  mBack = previous & kIndexMask;
+  mPublished.fetch_add(1, std::memory_order_relaxed);
+
+  if (previous & kFresh) {
+    // Never consumed, give the buffer back to the camera right away
+    mSlots[mBack].reset();
+    mDropped.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+bool FrameMailbox::consume(Frame *frame) {
+  if (!(mMiddle.load(std::memory_order_relaxed) & kFresh)) {
+    return false;
+  }
+  // Only this thread clears kFresh, the slot swapped in is still fresh
+  const uint8_t previous = mMiddle.exchange(mFront, std::memory_order_acq_rel);
+  mFront = previous & kIndexMask;
+  *frame = std::move(mSlots[mFront]);
+  mConsumed.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+} // namespace gain
@@ -0,0 +1,130 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef GAINVULKANSAMPLE_FRAMEMAILBOX_H
+#define GAINVULKANSAMPLE_FRAMEMAILBOX_H
+
+#include "SyncFence.h"
+#include "platform/HardwareBuffer.h"
+#include <atomic>
+#include <cstdint>
+
+namespace gain {
+// Hands the newest camera frame from the thread the ImageReader delivers
+// frames on to the render thread. Frames the render thread had no time for
+// are dropped instead of queued, so a slow GPU frame never holds back the
+// camera's buffer queue.
+//
+// Triple buffered: the producer fills its own slot and swaps it with the
+// shared middle slot, the consumer swaps its own slot with the middle slot
+// when that holds a new frame. Each side does a single atomic exchange and
+// never waits for the other. One producer and one consumer thread only.
+class FrameMailbox {
+public:
+  // A camera frame. Holds a reference of buffer, released on destruction.
+  struct Frame {
+    Frame() = default;
+
+    // Takes over a reference of buffer
+    Frame(AHardwareBuffer *buffer, SyncFence fence, int orientation,
+          int64_t originNs = 0)
+        : buffer(buffer), fence(std::move(fence)), orientation(orientation),
+          originNs(originNs) {}
+
+    Frame(Frame &&other) noexcept { *this = std::move(other); }
+
+    Frame &operator=(Frame &&other) noexcept;
+
+    Frame(const Frame &) = delete;
+    Frame &operator=(const Frame &) = delete;
+
+    ~Frame() { reset(); }
+
+    // Release the buffer and close the fence
+    void reset();
+
+    // Give up the buffer reference without releasing it
+    AHardwareBuffer *releaseBuffer() {
+      AHardwareBuffer *released = buffer;
+      buffer = nullptr;
+      return released;
+    }
+
+    AHardwareBuffer *buffer = nullptr;
+    // Producer fence of buffer, invalid if it was ready when handed in
+    SyncFence fence;
+    int orientation = 0;
+    // Time the frame's latency is measured from, see
+    // LatencyTracker::frameOrigin
+    int64_t originNs = 0;
+  };
+
+  FrameMailbox() = default;
+
+  FrameMailbox(const FrameMailbox &) = delete;
+  FrameMailbox &operator=(const FrameMailbox &) = delete;
+
+  // Producer side. Makes frame the newest one, dropping the previous newest
+  // frame if it was never consumed.
+  void publish(Frame frame);
+
+  // Consumer side. Moves the newest frame published since the last call into
+  // frame, returns false if there is none.
+  bool consume(Frame *frame);
+
+  uint64_t publishedCount() const {
+    return mPublished.load(std::memory_order_relaxed);
+  }
+  uint64_t consumedCount() const {
+    return mConsumed.load(std::memory_order_relaxed);
+  }
+  // Frames replaced by a newer one before the consumer got to them
+  uint64_t droppedCount() const {
+    return mDropped.load(std::memory_order_relaxed);
+  }
+
+private:
+  // Set in mMiddle while the middle slot holds a frame not consumed yet
+  static constexpr uint8_t kFresh = 0x4;
+  static constexpr uint8_t kIndexMask = 0x3;
+
+  Frame mSlots[3];
+
+  // Slot the producer fills next, producer thread only
+  uint8_t mBack = 0;
+  // Slot the consumer handed out last, consumer thread only
+  uint8_t mFront = 2;
+
+  // Shared slot index and kFresh, apart from the slots both threads use
+  alignas(64) std::atomic<uint8_t> mMiddle{1};
+
+  // Written by the producer
+  alignas(64) std::atomic<uint64_t> mPublished{0};
+  std::atomic<uint64_t> mDropped{0};
+  // Written by the consumer
+  alignas(64) std::atomic<uint64_t> mConsumed{0};
+};
+} // namespace gain
+
+#endif // GAINVULKANSAMPLE_FRAMEMAILBOX_H
@@ -0,0 +1,178 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "LatencyTracker.h"
+
+#include <algorithm>
+#include <cmath>
+#include <time.h>
+
+namespace gain {
+namespace {
+class BoottimeClock : public LatencyClock {
+public:
+  int64_t nowNs() const override {
+    timespec now;
+    clock_gettime(CLOCK_BOOTTIME, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+  }
+};
+
+// Older sensor timestamps are taken for another clock base rather than for
+// a frame that old
+constexpr int64_t kMaxSensorAgeNs = 1000000000;
+} // namespace
+
+const LatencyClock &LatencyClock::boottime() {
+  static const BoottimeClock clock;
+  return clock;
+}
+
+uint32_t LatencyHistogram::indexOf(uint64_t micros) {
+  if (micros < 2 * kSubBucketHalf) {
+    return static_cast<uint32_t>(micros);
+  }
+  const uint32_t msb = 63 - __builtin_clzll(micros);
+  const uint32_t bucket = msb - (kSubBucketBits - 1);
+  return bucket * kSubBucketHalf + static_cast<uint32_t>(micros >> bucket);
+}
+
+uint64_t LatencyHistogram::highestValueAt(uint32_t index) {
+  if (index < 2 * kSubBucketHalf) {
+    return index;
+  }
+  const uint32_t bucket = index / kSubBucketHalf - 1;
+  const uint64_t subBucket = index - bucket * kSubBucketHalf;
+  return ((subBucket + 1) << bucket) - 1;
+}
+
+void LatencyHistogram::record(uint64_t micros) {
+  micros = std::min(micros, kMaxMicros);
+  mCounts[indexOf(micros)]++;
+  mCount++;
+  mMin = std::min(mMin, micros);
+  mMax = std::max(mMax, micros);
+}
+
+void LatencyHistogram::add(const LatencyHistogram &other) {
+  for (size_t i = 0; i < mCounts.size(); i++) {
+    mCounts[i] += other.mCounts[i];
+  }
+  mCount += other.mCount;
+  mMin = std::min(mMin, other.mMin);
+  mMax = std::max(mMax, other.mMax);
+}
+
+void LatencyHistogram::clear() {
+  mCounts.fill(0);
+  mCount = 0;
+  mMin = UINT64_MAX;
+  mMax = 0;
+}
+
+uint64_t LatencyHistogram::percentile(double percent) const {
+  if (mCount == 0) {
+    return 0;
+  }
+  const uint64_t rank = std::max<uint64_t>(
+      1, static_cast<uint64_t>(std::ceil(percent / 100.0 * mCount)));
+  uint64_t seen = 0;
+  for (uint32_t i = 0; i < mCounts.size(); i++) {
+    seen += mCounts[i];
+    if (seen >= rank) {
+      return std::clamp(highestValueAt(i), min(), mMax);
+    }
+  }
+  return mMax;
+}
+
+const char *LatencyTracker::stageName(Stage stage) {
+  switch (stage) {
+  case Stage::Ingest:
+    return "ingest";
+  case Stage::Acquire:
+    return "acquire";
+  case Stage::Submit:
+    return "submit";
+  case Stage::Present:
+    return "present";
+  case Stage::GpuComplete:
+    return "gpu complete";
+  default:
+    return "unknown";
+  }
+}
+
+int64_t LatencyTracker::frameOrigin(int64_t sensorTimestampNs) const {
+  const int64_t now = mClock.nowNs();
+  if (sensorTimestampNs <= 0 || sensorTimestampNs > now ||
+      now - sensorTimestampNs > kMaxSensorAgeNs) {
+    return now;
+  }
+  return sensorTimestampNs;
+}
+
+void LatencyTracker::record(Stage stage, int64_t originNs) {
+  const int64_t now = mClock.nowNs();
+  const uint64_t micros =
+      static_cast<uint64_t>(std::max<int64_t>(now - originNs, 0)) / 1000;
+  const int64_t sliceIndex = now / (kSliceSeconds * 1000000000);
+
+  std::lock_guard<std::mutex> lock(mMutex);
+  Slice &slice =
+      mSlices[static_cast<size_t>(stage)][sliceIndex % kSliceCount];
+  if (slice.index != sliceIndex) {
+    slice.histogram.clear();
+    slice.index = sliceIndex;
+  }
+  slice.histogram.record(micros);
+}
+
+std::vector<LatencyTracker::Stats> LatencyTracker::stats() const {
+  const int64_t sliceIndex = mClock.nowNs() / (kSliceSeconds * 1000000000);
+
+  std::vector<Stats> stats;
+  LatencyHistogram window;
+  std::lock_guard<std::mutex> lock(mMutex);
+  for (size_t stage = 0; stage < mSlices.size(); stage++) {
+    window.clear();
+    for (const Slice &slice : mSlices[stage]) {
+      if (slice.index > sliceIndex - kSliceCount) {
+        window.add(slice.histogram);
+      }
+    }
+
+    Stats stageStats;
+    stageStats.stage = static_cast<Stage>(stage);
+    stageStats.count = window.count();
+    stageStats.minMs = window.min() / 1000.0;
+    stageStats.p50Ms = window.percentile(50.0) / 1000.0;
+    stageStats.p90Ms = window.percentile(90.0) / 1000.0;
+    stageStats.p99Ms = window.percentile(99.0) / 1000.0;
+    stageStats.maxMs = window.max() / 1000.0;
+    stats.push_back(stageStats);
+  }
+  return stats;
+}
+} // namespace gain
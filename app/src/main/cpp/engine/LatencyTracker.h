@@ -0,0 +1,176 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef GAINVULKANSAMPLE_LATENCYTRACKER_H
+#define GAINVULKANSAMPLE_LATENCYTRACKER_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace gain {
+// Time source of the latency stamps
+class LatencyClock {
+public:
+  virtual ~LatencyClock() = default;
+
+  virtual int64_t nowNs() const = 0;
+
+  // CLOCK_BOOTTIME, the clock of camera sensor timestamps whose source is
+  // SENSOR_INFO_TIMESTAMP_SOURCE_REALTIME
+  static const LatencyClock &boottime();
+};
+
+// Moves only when told to, so latencies can be checked exactly on a Linux
+// host without a camera
+class SyntheticClock : public LatencyClock {
+public:
+  explicit SyntheticClock(int64_t startNs = 0) : mNowNs(startNs) {}
+
+  int64_t nowNs() const override {
+    return mNowNs.load(std::memory_order_relaxed);
+  }
+
+  void set(int64_t ns) { mNowNs.store(ns, std::memory_order_relaxed); }
+
+  void advance(int64_t ns) {
+    mNowNs.fetch_add(ns, std::memory_order_relaxed);
+  }
+
+private:
+  std::atomic<int64_t> mNowNs;
+};
+
+// Counts of microsecond values in log linear buckets, like HdrHistogram:
+// each power of two range is split into 64 buckets, so values are kept to
+// within 1/64 of their size from 1us up to kMaxMicros.
+class LatencyHistogram {
+public:
+  static constexpr uint64_t kMaxMicros = (uint64_t(1) << 24) - 1;
+
+  // Values above kMaxMicros count as kMaxMicros
+  void record(uint64_t micros);
+
+  void add(const LatencyHistogram &other);
+
+  void clear();
+
+  uint64_t count() const { return mCount; }
+  uint64_t min() const { return mCount ? mMin : 0; }
+  uint64_t max() const { return mMax; }
+
+  // Smallest value that percent of the values are at or below, to the
+  // histogram's precision. 0 if the histogram is empty.
+  uint64_t percentile(double percent) const;
+
+private:
+  static constexpr uint32_t kSubBucketBits = 7;
+  static constexpr uint32_t kSubBucketHalf = 1 << (kSubBucketBits - 1);
+  // Power of two ranges above the first 2^kSubBucketBits values
+  static constexpr uint32_t kBucketCount = 24 - kSubBucketBits + 1;
+
+  static uint32_t indexOf(uint64_t micros);
+  // Largest value counted in the bucket at index
+  static uint64_t highestValueAt(uint32_t index);
+
+  std::array<uint32_t, (kBucketCount + 1) * kSubBucketHalf> mCounts{};
+  uint64_t mCount = 0;
+  uint64_t mMin = UINT64_MAX;
+  uint64_t mMax = 0;
+};
+
+// How old camera frames are when they pass each stage of the engine,
+// measured from the sensor timestamp. Keeps a histogram per stage over the
+// last kWindowSeconds. Stages can be recorded and stats read from any
+// thread.
+class LatencyTracker {
+public:
+  enum class Stage {
+    // Handed to the engine by the camera callback
+    Ingest,
+    // Taken by the render thread, with a swap chain image to draw into
+    Acquire,
+    // Its commands submitted to the queue
+    Submit,
+    // Queued for presentation
+    Present,
+    // Finished by the GPU, as seen by a thread waiting on its fence
+    GpuComplete,
+    Count
+  };
+
+  static const char *stageName(Stage stage);
+
+  struct Stats {
+    Stage stage;
+    uint64_t count = 0;
+    double minMs = 0.0;
+    double p50Ms = 0.0;
+    double p90Ms = 0.0;
+    double p99Ms = 0.0;
+    double maxMs = 0.0;
+  };
+
+  static constexpr int64_t kWindowSeconds = 10;
+
+  // clock must outlive the tracker
+  explicit LatencyTracker(const LatencyClock &clock = LatencyClock::boottime())
+      : mClock(clock) {}
+
+  const LatencyClock &clock() const { return mClock; }
+
+  // The time a frame with the given sensor timestamp is measured from: the
+  // timestamp if it is on the tracker's clock, otherwise now. Timestamps of
+  // sensors with an unknown time source have another base and are replaced.
+  int64_t frameOrigin(int64_t sensorTimestampNs) const;
+
+  // The frame measured from originNs has reached stage now
+  void record(Stage stage, int64_t originNs);
+
+  // Per stage, over the last kWindowSeconds
+  std::vector<Stats> stats() const;
+
+private:
+  // The window is made of slices, the oldest one is cleared and reused when
+  // time moves past it
+  static constexpr int64_t kSliceSeconds = 2;
+  static constexpr int64_t kSliceCount = kWindowSeconds / kSliceSeconds;
+
+  struct Slice {
+    int64_t index = -1;
+    LatencyHistogram histogram;
+  };
+
+  const LatencyClock &mClock;
+
+  std::array<std::array<Slice, kSliceCount>,
+             static_cast<size_t>(Stage::Count)>
+      mSlices;
+  mutable std::mutex mMutex;
+};
+} // namespace gain
+
+#endif // GAINVULKANSAMPLE_LATENCYTRACKER_H
@@ -0,0 +1,114 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "RenderLoop.h"
+
+#include <LogUtil.h>
+
+namespace gain {
+void RenderLoop::setPolicy(Policy policy, float maxFrameRate) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  mPolicy = policy;
+  mMinFrameInterval =
+      maxFrameRate > 0.0f
+          ? std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<float>(1.0f / maxFrameRate))
+          : Clock::duration::zero();
+  // A loop asleep under the old policy may have to draw now
+  mWake.notify_all();
+}
+
+void RenderLoop::run(const std::function<void(uint32_t events)> &drawFrame) {
+  std::unique_lock<std::mutex> lock(mMutex);
+  if (mRunning) {
+    LOGCATE("RenderLoop: already running");
+    return;
+  }
+  mRunning = true;
+  mStopRequested = false;
+  mLoopThread = std::this_thread::get_id();
+  mEvents |= kRedraw;
+
+  Clock::time_point lastFrame;
+  while (!mStopRequested) {
+    mWake.wait(lock, [this] {
+      return mStopRequested || mEvents != 0 ||
+             mPolicy == Policy::Continuous;
+    });
+    if (mStopRequested) {
+      break;
+    }
+
+    // Events posted while pacing are drawn with this frame
+    const Clock::time_point nextFrame = lastFrame + mMinFrameInterval;
+    if (Clock::now() < nextFrame &&
+        mWake.wait_until(lock, nextFrame, [this] { return mStopRequested; })) {
+      break;
+    }
+
+    const uint32_t events = mEvents;
+    mEvents = 0;
+    lastFrame = Clock::now();
+    lock.unlock();
+    drawFrame(events);
+    lock.lock();
+  }
+
+  mRunning = false;
+  mEvents = 0;
+  mLoopThread = std::thread::id();
+  mStopped.notify_all();
+}
+
+bool RenderLoop::post(uint32_t events) {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mRunning) {
+      return false;
+    }
+    mEvents |= events;
+  }
+  mWake.notify_one();
+  return true;
+}
+
+void RenderLoop::stop() {
+  std::unique_lock<std::mutex> lock(mMutex);
+  if (!mRunning) {
+    return;
+  }
+  mStopRequested = true;
+  mWake.notify_all();
+  if (mLoopThread == std::this_thread::get_id()) {
+    // Called from drawFrame, run() returns after it
+    return;
+  }
+  mStopped.wait(lock, [this] { return !mRunning; });
+}
+
+bool RenderLoop::isRunning() const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mRunning;
+}
+} // namespace gain
@@ -0,0 +1,105 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef GAINVULKANSAMPLE_RENDERLOOP_H
+#define GAINVULKANSAMPLE_RENDERLOOP_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace gain {
+// Drives the frames of a render thread. The thread sleeps until something
+// worth drawing happened, instead of presenting the same camera frame over
+// and over, and frames are paced to a maximum rate.
+//
+//   // render thread
+//   loop.run([&](uint32_t events) { draw(); });
+//   // any thread
+//   loop.post(RenderLoop::kNewFrame);
+//   loop.stop();
+class RenderLoop {
+public:
+  // Reasons to draw, posted as a bit mask
+  enum Event : uint32_t {
+    // A new camera frame is waiting
+    kNewFrame = 1u << 0,
+    // The window changed size
+    kResize = 1u << 1,
+    // A setting that changes the output, e.g. the selected LUT
+    kConfigChanged = 1u << 2,
+    // Draw again without new content, e.g. when the loop starts
+    kRedraw = 1u << 3,
+  };
+
+  enum class Policy {
+    // Draw as fast as the max frame rate and the swap chain allow
+    Continuous,
+    // Only draw when an event was posted
+    OnNewContent,
+  };
+
+  RenderLoop() = default;
+
+  RenderLoop(const RenderLoop &) = delete;
+  RenderLoop &operator=(const RenderLoop &) = delete;
+
+  // maxFrameRate 0 does not limit the rate. Takes effect with the next frame.
+  void setPolicy(Policy policy, float maxFrameRate = 0.0f);
+
+  // Run the loop on the calling thread until stop(). drawFrame gets the
+  // events posted since the previous frame, 0 if there were none.
+  void run(const std::function<void(uint32_t events)> &drawFrame);
+
+  // Wake the loop for events. Returns false, dropping the events, if no
+  // loop is running.
+  bool post(uint32_t events);
+
+  // Make run() return once the frame being drawn is done. Blocks until it
+  // has, unless called from drawFrame.
+  void stop();
+
+  bool isRunning() const;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  mutable std::mutex mMutex;
+  std::condition_variable mWake;
+  std::condition_variable mStopped;
+
+  uint32_t mEvents = 0;
+  Policy mPolicy = Policy::OnNewContent;
+  Clock::duration mMinFrameInterval = Clock::duration::zero();
+
+  bool mRunning = false;
+  bool mStopRequested = false;
+  std::thread::id mLoopThread;
+};
+} // namespace gain
+
+#endif // GAINVULKANSAMPLE_RENDERLOOP_H
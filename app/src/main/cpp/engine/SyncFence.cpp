@@ -0,0 +1,97 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "SyncFence.h"
+
+#include <LogUtil.h>
+
+#include <cerrno>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace gain {
+void SyncFence::reset(int fd) {
+  if (mFd >= 0) {
+    close(mFd);
+  }
+  mFd = fd;
+}
+
+bool SyncFence::wait(int timeoutMs) const {
+  if (mFd < 0) {
+    return true;
+  }
+
+  // Both sync files and eventfds become readable once signaled
+  pollfd pfd = {mFd, POLLIN, 0};
+  int ret;
+  do {
+    ret = poll(&pfd, 1, timeoutMs);
+  } while (ret < 0 && (errno == EINTR || errno == EAGAIN));
+
+  if (ret == 0) {
+    return false;
+  }
+  if (ret < 0) {
+    LOGCATE("SyncFence: waiting on fd %d failed, errno %d", mFd, errno);
+    return false;
+  }
+  // poll() itself succeeded here, errno says nothing about the fd
+  if (pfd.revents & (POLLERR | POLLNVAL)) {
+    LOGCATE("SyncFence: fd %d reported revents 0x%x", mFd,
+            static_cast<unsigned>(pfd.revents));
+    return false;
+  }
+  return true;
+}
+
+bool SyncFence::importToSemaphore(vk::Device device, vk::Semaphore semaphore) {
+  if (mFd < 0) {
+    return false;
+  }
+
+  vk::ImportSemaphoreFdInfoKHR importInfo{};
+  importInfo.semaphore = semaphore;
+  importInfo.flags = vk::SemaphoreImportFlagBits::eTemporary;
+  importInfo.handleType = vk::ExternalSemaphoreHandleTypeFlagBits::eSyncFd;
+  importInfo.fd = mFd;
+  if (device.importSemaphoreFdKHR(&importInfo) != vk::Result::eSuccess) {
+    return false;
+  }
+
+  // The driver owns the descriptor now
+  mFd = -1;
+  return true;
+}
+
+bool SyncFence::signal() const {
+  const uint64_t value = 1;
+  return mFd >= 0 && write(mFd, &value, sizeof(value)) == sizeof(value);
+}
+
+SyncFence SyncFence::createSignalable() {
+  return SyncFence(eventfd(0, EFD_CLOEXEC));
+}
+} // namespace gain
@@ -0,0 +1,98 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef GAINVULKANSAMPLE_SYNCFENCE_H
+#define GAINVULKANSAMPLE_SYNCFENCE_H
+
+#include <vulkan/vulkan.hpp>
+
+namespace gain {
+// Owns a sync file descriptor, e.g. the acquire fence the camera producer
+// attaches to a buffer. The buffer content is only valid once the fence has
+// signaled.
+//
+// The preferred way to honor the fence is importToSemaphore, which lets the
+// GPU wait for it and keeps the render thread running. wait() blocks on the
+// CPU instead and is the fallback for drivers that can't import sync fds.
+//
+// Any pollable descriptor works with wait(). createSignalable() builds one on
+// an eventfd so the fence handling can be exercised on Linux, where there is
+// no camera producer to hand out real sync files.
+class SyncFence {
+public:
+  SyncFence() = default;
+
+  // Takes ownership of fd. A negative fd means there is nothing to wait for.
+  explicit SyncFence(int fd) : mFd(fd) {}
+
+  SyncFence(SyncFence &&other) noexcept : mFd(other.release()) {}
+
+  SyncFence &operator=(SyncFence &&other) noexcept {
+    reset(other.release());
+    return *this;
+  }
+
+  SyncFence(const SyncFence &) = delete;
+  SyncFence &operator=(const SyncFence &) = delete;
+
+  ~SyncFence() { reset(); }
+
+  bool isValid() const { return mFd >= 0; }
+
+  int get() const { return mFd; }
+
+  // Give up ownership of the descriptor without closing it.
+  int release() {
+    int fd = mFd;
+    mFd = -1;
+    return fd;
+  }
+
+  // Close the owned descriptor and take ownership of fd.
+  void reset(int fd = -1);
+
+  // Block until the fence has signaled. A negative timeout waits forever.
+  // Returns false on timeout or error.
+  bool wait(int timeoutMs = -1) const;
+
+  // Import the fence into semaphore as a temporary payload, so the next queue
+  // submission waiting on semaphore waits for the fence on the GPU. On success
+  // the descriptor belongs to the driver and this fence becomes invalid, on
+  // failure it is left untouched.
+  bool importToSemaphore(vk::Device device, vk::Semaphore semaphore);
+
+  // Signal a fence made by createSignalable.
+  bool signal() const;
+
+  // Create an unsignaled fence backed by an eventfd, which stands in for a
+  // producer sync file where none is available. It can be waited on but not
+  // imported into a semaphore.
+  static SyncFence createSignalable();
+
+private:
+  int mFd = -1;
+};
+} // namespace gain
+
+#endif // GAINVULKANSAMPLE_SYNCFENCE_H
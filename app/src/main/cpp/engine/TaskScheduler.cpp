@@ -0,0 +1,425 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "TaskScheduler.h"
+
+#include <LogUtil.h>
+#include <TraceRecorder.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iterator>
+#include <pthread.h>
+#include <sched.h>
+
+namespace gain {
+namespace {
+// The scheduler and worker the calling thread belongs to, if any
+thread_local TaskScheduler *tScheduler = nullptr;
+thread_local uint32_t tWorkerIndex = 0;
+
+// Little for the cores with the lowest maximum frequency, Big for the rest.
+// All Any if the frequencies are unknown or the same for every core.
+std::vector<CoreHint> detectCoreClasses(uint32_t cpuCount) {
+  std::vector<CoreHint> classes(cpuCount, CoreHint::Any);
+  std::vector<uint32_t> maxFrequencies(cpuCount);
+  for (uint32_t cpu = 0; cpu < cpuCount; ++cpu) {
+    char path[96];
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%u/cpufreq/cpuinfo_max_freq", cpu);
+    FILE *file = fopen(path, "r");
+    if (file == nullptr) {
+      return classes;
+    }
+    const bool parsed = fscanf(file, "%u", &maxFrequencies[cpu]) == 1;
+    fclose(file);
+    if (!parsed) {
+      return classes;
+    }
+  }
+
+  const auto range =
+      std::minmax_element(maxFrequencies.begin(), maxFrequencies.end());
+  if (*range.first == *range.second) {
+    return classes;
+  }
+  for (uint32_t cpu = 0; cpu < cpuCount; ++cpu) {
+    classes[cpu] = maxFrequencies[cpu] == *range.first ? CoreHint::Little
+                                                       : CoreHint::Big;
+  }
+  return classes;
+}
+
+// Name the thread for systrace and keep it on the cores of its class. The
+// scheduler may still move it between cores of the same class.
+void setupWorkerThread(uint32_t index, CoreHint coreClass,
+                       const std::vector<CoreHint> &classes) {
+  char name[16];
+  snprintf(name, sizeof(name), "VkWorker%u", index);
+  pthread_setname_np(pthread_self(), name);
+
+  if (coreClass == CoreHint::Any) {
+    return;
+  }
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  for (uint32_t cpu = 0; cpu < classes.size(); ++cpu) {
+    if (classes[cpu] == coreClass) {
+      CPU_SET(cpu, &cpus);
+    }
+  }
+  if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0) {
+    LOGCATI("TaskScheduler: can't pin worker %u, running unpinned", index);
+  }
+}
+} // namespace
+
+TaskScheduler &TaskScheduler::shared() {
+  static TaskScheduler scheduler;
+  return scheduler;
+}
+
+TaskScheduler::TaskScheduler(uint32_t workerCount) {
+  const uint32_t cpuCount = std::max(1u, std::thread::hardware_concurrency());
+  if (workerCount == 0) {
+    workerCount = cpuCount;
+  }
+  const std::vector<CoreHint> classes = detectCoreClasses(cpuCount);
+
+  // All workers exist before the first thread looks for jobs to steal
+  for (uint32_t i = 0; i < workerCount; ++i) {
+    mWorkers.push_back(std::make_unique<Worker>());
+    mWorkers.back()->coreClass = classes[i % cpuCount];
+  }
+  for (uint32_t i = 0; i < workerCount; ++i) {
+    mWorkers[i]->thread = std::thread([this, i, classes] {
+      setupWorkerThread(i, mWorkers[i]->coreClass, classes);
+      workerLoop(i);
+    });
+  }
+
+  const auto bigCores =
+      std::count(classes.begin(), classes.end(), CoreHint::Big);
+  const auto littleCores =
+      std::count(classes.begin(), classes.end(), CoreHint::Little);
+  LOGCATI("TaskScheduler: %u workers, %u big and %u little cores", workerCount,
+          static_cast<uint32_t>(bigCores), static_cast<uint32_t>(littleCores));
+}
+
+TaskScheduler::~TaskScheduler() {
+  {
+    std::lock_guard<std::mutex> lock(mSleepMutex);
+    mStopping = true;
+  }
+  mWake.notify_all();
+  for (auto &worker : mWorkers) {
+    worker->thread.join();
+  }
+
+  // Jobs whose core class had no worker left, e.g. submitted by a task
+  // running during shutdown. Those may submit more.
+  bool ranJob;
+  do {
+    ranJob = false;
+    for (auto &worker : mWorkers) {
+      while (!worker->jobs.empty()) {
+        Job job = std::move(worker->jobs.front());
+        worker->jobs.pop_front();
+        job.task();
+        ranJob = true;
+      }
+    }
+  } while (ranJob);
+}
+
+void TaskScheduler::submit(Task task, CoreHint hint) {
+  Job job;
+  job.task = std::move(task);
+  job.hint = hint;
+  enqueue(std::move(job));
+}
+
+void TaskScheduler::enqueue(Job job) {
+  const CoreHint hint = job.hint;
+
+  // Keep nested work on the submitting worker, its data is in that core's
+  // cache
+  Worker *worker = nullptr;
+  if (tScheduler == this) {
+    Worker *own = mWorkers[tWorkerIndex].get();
+    if (hint == CoreHint::Any || hint == own->coreClass) {
+      worker = own;
+    }
+  }
+  if (worker == nullptr) {
+    worker = pickWorker(&job.hint);
+  }
+  {
+    std::lock_guard<std::mutex> lock(worker->mutex);
+    worker->jobs.push_back(std::move(job));
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mSleepMutex);
+    mSubmitEpoch++;
+  }
+  // A job with a hint can't be taken by every worker
+  if (hint == CoreHint::Any) {
+    mWake.notify_one();
+  } else {
+    mWake.notify_all();
+  }
+}
+
+void TaskScheduler::parallelFor(int begin, int end, int grain,
+                                const std::function<void(int, int)> &body) {
+  if (end <= begin) {
+    return;
+  }
+  const int64_t count = end - begin;
+  // A few ranges per thread, so the ones done early steal from the others
+  const int64_t maxRanges = (static_cast<int64_t>(workerCount()) + 1) * 4;
+  const int64_t ranges =
+      std::min(std::max<int64_t>(count / std::max(grain, 1), 1), maxRanges);
+  if (ranges == 1) {
+    body(begin, end);
+    return;
+  }
+
+  auto rangeStart = [&](int64_t range) {
+    return begin + static_cast<int>(count * range / ranges);
+  };
+  TaskGroup group(*this);
+  for (int64_t range = 1; range < ranges; ++range) {
+    const int first = rangeStart(range);
+    const int last = rangeStart(range + 1);
+    group.run([&body, first, last] { body(first, last); });
+  }
+  body(begin, rangeStart(1));
+  group.wait();
+}
+
+void TaskScheduler::workerLoop(uint32_t index) {
+  tScheduler = this;
+  tWorkerIndex = index;
+
+  for (;;) {
+    // Read before looking for a job, a submit after that changes it
+    uint64_t epoch;
+    bool stopping;
+    {
+      std::lock_guard<std::mutex> lock(mSleepMutex);
+      epoch = mSubmitEpoch;
+      stopping = mStopping;
+    }
+
+    Job job;
+    if (takeJob(&job, nullptr)) {
+      TRACE_SCOPE("Task");
+      job.task();
+      continue;
+    }
+    if (stopping) {
+      return;
+    }
+
+    std::unique_lock<std::mutex> lock(mSleepMutex);
+    mWake.wait(lock, [&] { return mStopping || mSubmitEpoch != epoch; });
+  }
+}
+
+bool TaskScheduler::takeJob(Job *job, const TaskGroup *group) {
+  Worker *own = nullptr;
+  CoreHint coreClass = CoreHint::Any;
+  uint32_t start = mNextWorker.load(std::memory_order_relaxed);
+  if (tScheduler == this) {
+    own = mWorkers[tWorkerIndex].get();
+    coreClass = own->coreClass;
+    start = tWorkerIndex + 1;
+
+    // Newest first, it is the most likely to be in the cache. Every job on
+    // the own deque fits the worker's class.
+    std::lock_guard<std::mutex> lock(own->mutex);
+    for (auto it = own->jobs.rbegin(); it != own->jobs.rend(); ++it) {
+      if (group == nullptr || it->group == group) {
+        *job = std::move(*it);
+        own->jobs.erase(std::next(it).base());
+        return true;
+      }
+    }
+  }
+
+  // Steal the oldest job this thread may run, those tend to be the largest
+  const uint32_t workerCount = this->workerCount();
+  for (uint32_t i = 0; i < workerCount; ++i) {
+    Worker *victim = mWorkers[(start + i) % workerCount].get();
+    if (victim == own) {
+      continue;
+    }
+    std::lock_guard<std::mutex> lock(victim->mutex);
+    for (auto it = victim->jobs.begin(); it != victim->jobs.end(); ++it) {
+      if ((it->hint == CoreHint::Any || it->hint == coreClass) &&
+          (group == nullptr || it->group == group)) {
+        *job = std::move(*it);
+        victim->jobs.erase(it);
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+bool TaskScheduler::runPendingJob(const TaskGroup *group) {
+  Job job;
+  if (!takeJob(&job, group)) {
+    return false;
+  }
+  TRACE_SCOPE("Task");
+  job.task();
+  return true;
+}
+
+TaskScheduler::Worker *TaskScheduler::pickWorker(CoreHint *hint) {
+  const uint32_t workerCount = this->workerCount();
+  const uint32_t start = mNextWorker.fetch_add(1, std::memory_order_relaxed);
+  for (uint32_t i = 0; i < workerCount; ++i) {
+    Worker *worker = mWorkers[(start + i) % workerCount].get();
+    if (*hint == CoreHint::Any || worker->coreClass == *hint) {
+      return worker;
+    }
+  }
+  // No core of that class, any worker will do
+  *hint = CoreHint::Any;
+  return mWorkers[start % workerCount].get();
+}
+
+void TaskGroup::run(TaskScheduler::Task task, CoreHint hint) {
+  mPending.fetch_add(1);
+  TaskScheduler::Job job;
+  job.task = [this, task = std::move(task)] {
+    task();
+    finish();
+  };
+  job.hint = hint;
+  job.group = this;
+  mScheduler.enqueue(std::move(job));
+}
+
+void TaskGroup::finish() {
+  // Under the lock, so wait() can't return and destroy the group before
+  // the notification is out
+  std::lock_guard<std::mutex> lock(mMutex);
+  if (mPending.fetch_sub(1) == 1) {
+    mDone.notify_all();
+  }
+}
+
+void TaskGroup::wait() {
+  while (mPending.load() != 0) {
+    if (mScheduler.runPendingJob(this)) {
+      continue;
+    }
+    // Nothing of this group to help with right now. The remaining tasks may
+    // still queue work, so check back shortly instead of sleeping until they
+    // are done.
+    std::unique_lock<std::mutex> lock(mMutex);
+    mDone.wait_for(lock, std::chrono::milliseconds(1),
+                   [this] { return mPending.load() == 0; });
+  }
+  std::lock_guard<std::mutex> lock(mMutex);
+}
+
+TaskGraph::Node TaskGraph::add(TaskScheduler::Task task, CoreHint hint) {
+  NodeInfo node;
+  node.task = std::move(task);
+  node.hint = hint;
+  mNodes.push_back(std::move(node));
+  return static_cast<Node>(mNodes.size() - 1);
+}
+
+void TaskGraph::precede(Node before, Node after) {
+  assert(before < mNodes.size() && after < mNodes.size());
+  mNodes[before].successors.push_back(after);
+  mNodes[after].dependencies++;
+}
+
+bool TaskGraph::run(TaskScheduler &scheduler) {
+  if (!isAcyclic()) {
+    LOGCATE("TaskGraph: the dependencies have a cycle");
+    return false;
+  }
+
+  std::unique_ptr<std::atomic<uint32_t>[]> pending(
+      new std::atomic<uint32_t>[mNodes.size()]);
+  for (size_t i = 0; i < mNodes.size(); ++i) {
+    pending[i].store(mNodes[i].dependencies);
+  }
+
+  TaskGroup group(scheduler);
+  for (Node node = 0; node < mNodes.size(); ++node) {
+    if (mNodes[node].dependencies == 0) {
+      start(node, group, pending.get());
+    }
+  }
+  group.wait();
+  return true;
+}
+
+void TaskGraph::start(Node node, TaskGroup &group,
+                      std::atomic<uint32_t> *pending) {
+  group.run(
+      [this, node, &group, pending] {
+        mNodes[node].task();
+        for (Node successor : mNodes[node].successors) {
+          if (pending[successor].fetch_sub(1) == 1) {
+            start(successor, group, pending);
+          }
+        }
+      },
+      mNodes[node].hint);
+}
+
+bool TaskGraph::isAcyclic() const {
+  std::vector<uint32_t> dependencies(mNodes.size());
+  std::vector<Node> ready;
+  for (Node node = 0; node < mNodes.size(); ++node) {
+    dependencies[node] = mNodes[node].dependencies;
+    if (dependencies[node] == 0) {
+      ready.push_back(node);
+    }
+  }
+  size_t visited = 0;
+  while (!ready.empty()) {
+    const Node node = ready.back();
+    ready.pop_back();
+    visited++;
+    for (Node successor : mNodes[node].successors) {
+      if (--dependencies[successor] == 0) {
+        ready.push_back(successor);
+      }
+    }
+  }
+  return visited == mNodes.size();
+}
+} // namespace gain
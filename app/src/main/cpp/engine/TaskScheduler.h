@@ -0,0 +1,200 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef GAINVULKANSAMPLE_TASKSCHEDULER_H
+#define GAINVULKANSAMPLE_TASKSCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gain {
+// Where a task prefers to run on big.LITTLE CPUs. Big is for work on the
+// frame's critical path, Little for background work like writing caches.
+// Hints are ignored on CPUs whose cores all run at the same speed.
+enum class CoreHint { Any, Big, Little };
+
+class TaskGroup;
+
+// Work stealing pool for the CPU side of the engines: color conversion,
+// pipeline compilation, table parsing. Every worker has a deque of its own,
+// pops the newest task from it and steals the oldest from the others when it
+// runs dry. Tasks submitted from a worker stay on that worker, so nested
+// parallelism keeps its data in the core's cache.
+//
+// Threads waiting on a TaskGroup run the group's queued tasks meanwhile, so
+// waiting from inside a task does not deadlock the pool. They leave other
+// work alone, a render thread waiting for a conversion must not pick up a
+// pipeline compile.
+class TaskScheduler {
+public:
+  using Task = std::function<void()>;
+
+  // The process wide pool with a worker per core
+  static TaskScheduler &shared();
+
+  // workerCount 0 creates a worker per core
+  explicit TaskScheduler(uint32_t workerCount = 0);
+
+  // Runs the tasks still queued, then joins the workers
+  ~TaskScheduler();
+
+  TaskScheduler(const TaskScheduler &) = delete;
+  TaskScheduler &operator=(const TaskScheduler &) = delete;
+
+  uint32_t workerCount() const {
+    return static_cast<uint32_t>(mWorkers.size());
+  }
+
+  // Run task on a worker, without a way to wait for it. See TaskGroup.
+  void submit(Task task, CoreHint hint = CoreHint::Any);
+
+  // Call body(first, last) on consecutive ranges covering [begin, end) of
+  // at least grain items each, and wait for all of them. The calling thread
+  // takes part.
+  void parallelFor(int begin, int end, int grain,
+                   const std::function<void(int, int)> &body);
+
+private:
+  friend class TaskGroup;
+
+  struct Job {
+    Task task;
+    CoreHint hint = CoreHint::Any;
+    // The group the job belongs to, nullptr for submit()
+    const TaskGroup *group = nullptr;
+  };
+
+  struct Worker {
+    std::mutex mutex;
+    std::deque<Job> jobs;
+    // Big or Little if the worker is pinned to those cores
+    CoreHint coreClass = CoreHint::Any;
+    std::thread thread;
+  };
+
+  void enqueue(Job job);
+
+  void workerLoop(uint32_t index);
+
+  // Take a job the calling thread may run, only one of group unless that is
+  // nullptr. Workers pop their own deque first, other threads only take jobs
+  // without a hint.
+  bool takeJob(Job *job, const TaskGroup *group);
+
+  // Run one queued job of group if there is one
+  bool runPendingJob(const TaskGroup *group);
+
+  // A worker whose class matches hint, round robin. Resets hint to Any if
+  // there is none.
+  Worker *pickWorker(CoreHint *hint);
+
+  std::vector<std::unique_ptr<Worker>> mWorkers;
+  std::atomic<uint32_t> mNextWorker{0};
+
+  // Bumped on every submit, so a worker about to sleep notices jobs queued
+  // while it was looking for one
+  std::mutex mSleepMutex;
+  std::condition_variable mWake;
+  uint64_t mSubmitEpoch = 0;
+  bool mStopping = false;
+};
+
+// Tasks that can be waited for together:
+//
+//   TaskGroup group;
+//   group.run([&] { convert(top); });
+//   group.run([&] { convert(bottom); });
+//   group.wait();
+//
+// The destructor waits for tasks still running.
+class TaskGroup {
+public:
+  explicit TaskGroup(TaskScheduler &scheduler = TaskScheduler::shared())
+      : mScheduler(scheduler) {}
+
+  ~TaskGroup() { wait(); }
+
+  TaskGroup(const TaskGroup &) = delete;
+  TaskGroup &operator=(const TaskGroup &) = delete;
+
+  void run(TaskScheduler::Task task, CoreHint hint = CoreHint::Any);
+
+  // Block until every task run so far has finished, running the group's
+  // queued tasks meanwhile
+  void wait();
+
+private:
+  void finish();
+
+  TaskScheduler &mScheduler;
+  std::atomic<uint32_t> mPending{0};
+  std::mutex mMutex;
+  std::condition_variable mDone;
+};
+
+// Tasks with dependencies between them. Built once, can be run any number of
+// times:
+//
+//   TaskGraph graph;
+//   auto parse = graph.add(parseTable);
+//   auto upload = graph.add(uploadTable);
+//   graph.precede(parse, upload);
+//   graph.run();
+class TaskGraph {
+public:
+  using Node = uint32_t;
+
+  Node add(TaskScheduler::Task task, CoreHint hint = CoreHint::Any);
+
+  // after starts once before has finished
+  void precede(Node before, Node after);
+
+  // Run every task once its dependencies are done and wait for all of them.
+  // Returns false without running anything if the dependencies have a cycle.
+  bool run(TaskScheduler &scheduler = TaskScheduler::shared());
+
+private:
+  struct NodeInfo {
+    TaskScheduler::Task task;
+    CoreHint hint = CoreHint::Any;
+    std::vector<Node> successors;
+    uint32_t dependencies = 0;
+  };
+
+  void start(Node node, TaskGroup &group, std::atomic<uint32_t> *pending);
+
+  bool isAcyclic() const;
+
+  std::vector<NodeInfo> mNodes;
+};
+} // namespace gain
+
+#endif // GAINVULKANSAMPLE_TASKSCHEDULER_H
@@ -0,0 +1,274 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "TraceRecorder.h"
+
+#include <LogUtil.h>
+#include <algorithm>
+#include <chrono>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace gain {
+namespace {
+uint64_t nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Names are literals of ours, but keep the file valid whatever they hold
+void writeJsonString(FILE *file, const char *string) {
+  fputc('"', file);
+  for (const char *c = string; *c != '\0'; c++) {
+    if (*c == '"' || *c == '\\') {
+      fputc('\\', file);
+      fputc(*c, file);
+    } else if (static_cast<unsigned char>(*c) < 0x20) {
+      fprintf(file, "\\u%04x", *c);
+    } else {
+      fputc(*c, file);
+    }
+  }
+  fputc('"', file);
+}
+} // namespace
+
+// Single producer, single consumer ring. The thread owning it writes events
+// and advances head, the flush thread reads them and advances tail.
+struct TraceRecorder::ThreadBuffer {
+  // A power of two, 256KB per thread
+  static constexpr uint64_t kCapacity = 8192;
+
+  std::unique_ptr<Event[]> events{new Event[kCapacity]};
+  std::atomic<uint64_t> head{0};
+  std::atomic<uint64_t> tail{0};
+  // Set when the thread exits, its ring is removed once drained
+  std::atomic<bool> exited{false};
+
+  uint32_t tid = 0;
+  std::string threadName;
+  // Whether the thread's name was written to the current trace. Flush
+  // thread only.
+  bool described = false;
+};
+
+std::atomic<bool> TraceRecorder::sRecording{false};
+
+TraceRecorder &TraceRecorder::shared() {
+  static TraceRecorder recorder;
+  return recorder;
+}
+
+TraceRecorder::~TraceRecorder() { stop(); }
+
+bool TraceRecorder::start(const std::string &path) {
+  std::lock_guard<std::mutex> controlLock(mControlMutex);
+  if (recording()) {
+    return false;
+  }
+
+  FILE *file = fopen(path.c_str(), "w");
+  if (file == nullptr) {
+    LOGCATE("TraceRecorder: can't create %s", path.c_str());
+    return false;
+  }
+
+  {
+    // Drop what was recorded after the last trace stopped
+    std::lock_guard<std::mutex> lock(mBuffersMutex);
+    mBuffers.erase(std::remove_if(mBuffers.begin(), mBuffers.end(),
+                                  [](const auto &buffer) {
+                                    return buffer->exited.load(
+                                        std::memory_order_acquire);
+                                  }),
+                   mBuffers.end());
+    for (auto &buffer : mBuffers) {
+      buffer->tail.store(buffer->head.load(std::memory_order_acquire),
+                         std::memory_order_release);
+      buffer->described = false;
+    }
+  }
+
+  mFile = file;
+  mFirstEvent = true;
+  fputs("{\"traceEvents\":[\n", mFile);
+  mDropped.store(0, std::memory_order_relaxed);
+  mStopFlush = false;
+  mFlushThread = std::thread(&TraceRecorder::flushLoop, this);
+  sRecording.store(true, std::memory_order_release);
+  LOGCATI("TraceRecorder: recording to %s", path.c_str());
+  return true;
+}
+
+void TraceRecorder::stop() {
+  std::lock_guard<std::mutex> controlLock(mControlMutex);
+  if (!recording()) {
+    return;
+  }
+  sRecording.store(false, std::memory_order_release);
+
+  {
+    std::lock_guard<std::mutex> lock(mFlushMutex);
+    mStopFlush = true;
+  }
+  mFlushCondition.notify_one();
+  // The flush thread drains once more before it exits
+  mFlushThread.join();
+
+  fputs("\n],\"displayTimeUnit\":\"ms\"}\n", mFile);
+  fclose(mFile);
+  mFile = nullptr;
+  LOGCATI("TraceRecorder: stopped, %llu events dropped",
+          static_cast<unsigned long long>(droppedCount()));
+}
+
+void TraceRecorder::record(EventType type, const char *name, int64_t value) {
+  if (!recording()) {
+    return;
+  }
+  ThreadBuffer *buffer = threadBuffer();
+  const uint64_t head = buffer->head.load(std::memory_order_relaxed);
+  if (head - buffer->tail.load(std::memory_order_acquire) ==
+      ThreadBuffer::kCapacity) {
+    mDropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  buffer->events[head & (ThreadBuffer::kCapacity - 1)] = {nowNs(), name, value,
+                                                          type};
+  buffer->head.store(head + 1, std::memory_order_release);
+}
+
+TraceRecorder::ThreadBuffer *TraceRecorder::threadBuffer() {
+  // Shared with mBuffers, so the flush thread can drain the ring after the
+  // thread has exited
+  struct Holder {
+    std::shared_ptr<ThreadBuffer> buffer;
+    ~Holder() {
+      if (buffer) {
+        buffer->exited.store(true, std::memory_order_release);
+      }
+    }
+  };
+  static thread_local Holder holder;
+
+  if (!holder.buffer) {
+    auto buffer = std::make_shared<ThreadBuffer>();
+    buffer->tid = static_cast<uint32_t>(syscall(SYS_gettid));
+    char name[16] = {};
+    if (pthread_getname_np(pthread_self(), name, sizeof(name)) == 0) {
+      buffer->threadName = name;
+    }
+    std::lock_guard<std::mutex> lock(mBuffersMutex);
+    mBuffers.push_back(buffer);
+    holder.buffer = std::move(buffer);
+  }
+  return holder.buffer.get();
+}
+
+void TraceRecorder::flushLoop() {
+  pthread_setname_np(pthread_self(), "VkTraceFlush");
+
+  // Often enough to keep the rings from filling up at a few thousand events
+  // per frame
+  constexpr auto kFlushInterval = std::chrono::milliseconds(50);
+
+  std::unique_lock<std::mutex> lock(mFlushMutex);
+  while (!mStopFlush) {
+    mFlushCondition.wait_for(lock, kFlushInterval,
+                             [this]() { return mStopFlush; });
+    lock.unlock();
+    drain();
+    lock.lock();
+  }
+}
+
+void TraceRecorder::drain() {
+  // Writing the file must not block threads registering their ring
+  std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+  {
+    std::lock_guard<std::mutex> lock(mBuffersMutex);
+    buffers = mBuffers;
+  }
+
+  const int pid = getpid();
+  for (auto &buffer : buffers) {
+    const uint64_t tail = buffer->tail.load(std::memory_order_relaxed);
+    const uint64_t head = buffer->head.load(std::memory_order_acquire);
+    if (tail == head) {
+      continue;
+    }
+
+    if (!buffer->described && !buffer->threadName.empty()) {
+      fprintf(mFile,
+              "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+              "\"tid\":%u,\"args\":{\"name\":",
+              mFirstEvent ? "" : ",\n", pid, buffer->tid);
+      writeJsonString(mFile, buffer->threadName.c_str());
+      fputs("}}", mFile);
+      mFirstEvent = false;
+    }
+    buffer->described = true;
+
+    for (uint64_t i = tail; i < head; i++) {
+      writeEvent(pid, *buffer,
+                 buffer->events[i & (ThreadBuffer::kCapacity - 1)]);
+    }
+    buffer->tail.store(head, std::memory_order_release);
+  }
+  fflush(mFile);
+
+  std::lock_guard<std::mutex> lock(mBuffersMutex);
+  mBuffers.erase(
+      std::remove_if(mBuffers.begin(), mBuffers.end(),
+                     [](const auto &buffer) {
+                       return buffer->exited.load(std::memory_order_acquire) &&
+                              buffer->tail.load(std::memory_order_relaxed) ==
+                                  buffer->head.load(std::memory_order_acquire);
+                     }),
+      mBuffers.end());
+}
+
+void TraceRecorder::writeEvent(int pid, const ThreadBuffer &buffer,
+                               const Event &event) {
+  static const char *const kPhases[] = {"B", "E", "C", "i"};
+
+  fprintf(mFile, "%s{\"name\":", mFirstEvent ? "" : ",\n");
+  mFirstEvent = false;
+  writeJsonString(mFile, event.name);
+  // Microseconds, the unit of the format
+  fprintf(mFile, ",\"ph\":\"%s\",\"ts\":%llu.%03u,\"pid\":%d,\"tid\":%u",
+          kPhases[static_cast<int>(event.type)],
+          static_cast<unsigned long long>(event.timeNs / 1000),
+          static_cast<unsigned>(event.timeNs % 1000), pid, buffer.tid);
+  if (event.type == EventType::Counter) {
+    fprintf(mFile, ",\"args\":{\"value\":%lld}",
+            static_cast<long long>(event.value));
+  } else if (event.type == EventType::Instant) {
+    fputs(",\"s\":\"t\"", mFile);
+  }
+  fputc('}', mFile);
+}
+} // namespace gain
@@ -0,0 +1,192 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef GAINVULKANSAMPLE_TRACERECORDER_H
+#define GAINVULKANSAMPLE_TRACERECORDER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace gain {
+// CPU timeline of all threads, written as a Chrome JSON trace that
+// chrome://tracing and the Perfetto UI open. Every thread records into a
+// ring buffer of its own without locks or allocations, a background thread
+// drains the rings into the file. Timestamps are steady clock nanoseconds,
+// so they line up with systrace and Perfetto's own tracks.
+//
+// Events are recorded with the TRACE_* macros below, which compile to
+// nothing unless VK_ENGINE_TRACING is defined. While no trace is being
+// recorded they cost a relaxed atomic load.
+class TraceRecorder {
+public:
+  static TraceRecorder &shared();
+
+  ~TraceRecorder();
+
+  TraceRecorder(const TraceRecorder &) = delete;
+  TraceRecorder &operator=(const TraceRecorder &) = delete;
+
+  // Start writing events to the file at path. False if a trace is already
+  // being recorded or the file can't be created.
+  bool start(const std::string &path);
+
+  // Write the remaining events and close the file
+  void stop();
+
+  static bool recording() {
+    return sRecording.load(std::memory_order_relaxed);
+  }
+
+  // Events of the calling thread. name must outlive the trace, e.g. a
+  // string literal.
+  void begin(const char *name) { record(EventType::Begin, name, 0); }
+  void end(const char *name) { record(EventType::End, name, 0); }
+  void counter(const char *name, int64_t value) {
+    record(EventType::Counter, name, value);
+  }
+  void instant(const char *name) { record(EventType::Instant, name, 0); }
+
+  // Events lost because a thread's ring was full, since start
+  uint64_t droppedCount() const {
+    return mDropped.load(std::memory_order_relaxed);
+  }
+
+private:
+  enum class EventType : uint8_t { Begin, End, Counter, Instant };
+
+  struct Event {
+    uint64_t timeNs;
+    const char *name;
+    int64_t value;
+    EventType type;
+  };
+
+  struct ThreadBuffer;
+
+  TraceRecorder() = default;
+
+  void record(EventType type, const char *name, int64_t value);
+
+  // The calling thread's ring, registered on first use
+  ThreadBuffer *threadBuffer();
+
+  void flushLoop();
+
+  // Write the events recorded so far
+  void drain();
+
+  void writeEvent(int pid, const ThreadBuffer &buffer, const Event &event);
+
+  static std::atomic<bool> sRecording;
+
+  std::atomic<uint64_t> mDropped{0};
+
+  // Rings of all threads that have recorded. Rings of exited threads are
+  // removed once drained.
+  std::vector<std::shared_ptr<ThreadBuffer>> mBuffers;
+  std::mutex mBuffersMutex;
+
+  // Serializes start and stop
+  std::mutex mControlMutex;
+
+  // Owned by the flush thread while recording
+  FILE *mFile = nullptr;
+  bool mFirstEvent = true;
+
+  std::thread mFlushThread;
+  bool mStopFlush = false;
+  std::mutex mFlushMutex;
+  std::condition_variable mFlushCondition;
+};
+
+// Records a begin event on construction and the end on destruction
+class TraceScope {
+public:
+  explicit TraceScope(const char *name)
+      : mName(TraceRecorder::recording() ? name : nullptr) {
+    if (mName) {
+      TraceRecorder::shared().begin(mName);
+    }
+  }
+
+  ~TraceScope() {
+    if (mName) {
+      TraceRecorder::shared().end(mName);
+    }
+  }
+
+  TraceScope(const TraceScope &) = delete;
+  TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+  const char *const mName;
+};
+} // namespace gain
+
+#ifdef VK_ENGINE_TRACING
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+// Time the rest of the enclosing block
+#define TRACE_SCOPE(name)                                                      \
+  gain::TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_FUNCTION() TRACE_SCOPE(__func__)
+
+// Track value over time, e.g. a queue length
+#define TRACE_COUNTER(name, value)                                             \
+  do {                                                                         \
+    if (gain::TraceRecorder::recording()) {                                    \
+      gain::TraceRecorder::shared().counter(name,                              \
+                                            static_cast<int64_t>(value));      \
+    }                                                                          \
+  } while (0)
+
+// Mark a point in time
+#define TRACE_INSTANT(name)                                                    \
+  do {                                                                         \
+    if (gain::TraceRecorder::recording()) {                                    \
+      gain::TraceRecorder::shared().instant(name);                             \
+    }                                                                          \
+  } while (0)
+#else
+#define TRACE_SCOPE(name)                                                      \
+  do {                                                                         \
+  } while (0)
+#define TRACE_FUNCTION() TRACE_SCOPE(nullptr)
+#define TRACE_COUNTER(name, value)                                             \
+  do {                                                                         \
+  } while (0)
+#define TRACE_INSTANT(name)                                                    \
+  do {                                                                         \
+  } while (0)
+#endif
+
+#endif // GAINVULKANSAMPLE_TRACERECORDER_H
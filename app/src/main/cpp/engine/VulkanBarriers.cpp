@@ -0,0 +1,362 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "VulkanBarriers.h"
+
+#include <LogUtil.h>
+
+namespace vks {
+namespace {
+using Stage = vk::PipelineStageFlagBits2KHR;
+using Access = vk::AccessFlagBits2KHR;
+
+const vk::AccessFlags2KHR kWriteAccess =
+    Access::eShaderWrite | Access::eColorAttachmentWrite |
+    Access::eDepthStencilAttachmentWrite | Access::eTransferWrite |
+    Access::eHostWrite | Access::eMemoryWrite;
+
+// The usages only use stages and accesses that exist in both versions of
+// the API, whose bits have the same values
+vk::PipelineStageFlags legacyStages(vk::PipelineStageFlags2KHR stages) {
+  return vk::PipelineStageFlags(static_cast<VkPipelineStageFlags>(
+      static_cast<VkPipelineStageFlags2KHR>(stages)));
+}
+
+vk::AccessFlags legacyAccess(vk::AccessFlags2KHR access) {
+  return vk::AccessFlags(
+      static_cast<VkAccessFlags>(static_cast<VkAccessFlags2KHR>(access)));
+}
+
+vk::PipelineStageFlags2KHR stages2(vk::PipelineStageFlags stages) {
+  return vk::PipelineStageFlags2KHR(static_cast<VkPipelineStageFlags2KHR>(
+      static_cast<VkPipelineStageFlags>(stages)));
+}
+
+vk::AccessFlags2KHR access2(vk::AccessFlags access) {
+  return vk::AccessFlags2KHR(
+      static_cast<VkAccessFlags2KHR>(static_cast<VkAccessFlags>(access)));
+}
+
+// Families whose half of an ownership transfer is recorded outside of the
+// device's queues
+bool isExternalFamily(uint32_t queueFamily) {
+  return queueFamily == VK_QUEUE_FAMILY_EXTERNAL ||
+         queueFamily == VK_QUEUE_FAMILY_FOREIGN_EXT;
+}
+} // namespace
+
+ResourceState ResourceState::afterBarrier(vk::ImageLayout layout,
+                                          vk::PipelineStageFlags stages,
+                                          vk::AccessFlags access,
+                                          uint32_t queueFamily) {
+  ResourceState state;
+  state.layout = layout;
+  // Like a layout transition of advance, later uses chain after stages
+  state.writeStages = stages2(stages);
+  state.readStages = stages2(stages);
+  state.visibleStages = stages2(stages);
+  state.visibleAccess = access2(access);
+  state.queueFamily = queueFamily;
+  return state;
+}
+
+UsageScope usageScope(ResourceUsage usage) {
+  switch (usage) {
+  case ResourceUsage::Undefined:
+    return {{}, {}, vk::ImageLayout::eUndefined, false};
+  case ResourceUsage::TransferSrc:
+    return {Stage::eTransfer, Access::eTransferRead,
+            vk::ImageLayout::eTransferSrcOptimal, false};
+  case ResourceUsage::TransferDst:
+    return {Stage::eTransfer, Access::eTransferWrite,
+            vk::ImageLayout::eTransferDstOptimal, true};
+  case ResourceUsage::VertexBuffer:
+    return {Stage::eVertexInput, Access::eVertexAttributeRead,
+            vk::ImageLayout::eUndefined, false};
+  case ResourceUsage::UniformRead:
+    return {Stage::eVertexShader | Stage::eFragmentShader,
+            Access::eUniformRead, vk::ImageLayout::eUndefined, false};
+  case ResourceUsage::SampledFragment:
+    return {Stage::eFragmentShader, Access::eShaderRead,
+            vk::ImageLayout::eShaderReadOnlyOptimal, false};
+  case ResourceUsage::SampledCompute:
+    return {Stage::eComputeShader, Access::eShaderRead,
+            vk::ImageLayout::eShaderReadOnlyOptimal, false};
+  case ResourceUsage::StorageReadCompute:
+    return {Stage::eComputeShader, Access::eShaderRead,
+            vk::ImageLayout::eGeneral, false};
+  case ResourceUsage::StorageWriteCompute:
+    return {Stage::eComputeShader, Access::eShaderWrite,
+            vk::ImageLayout::eGeneral, true};
+  case ResourceUsage::ColorAttachment:
+    return {Stage::eColorAttachmentOutput,
+            Access::eColorAttachmentRead | Access::eColorAttachmentWrite,
+            vk::ImageLayout::eColorAttachmentOptimal, true};
+  case ResourceUsage::DepthStencilAttachment:
+    return {Stage::eEarlyFragmentTests | Stage::eLateFragmentTests,
+            Access::eDepthStencilAttachmentRead |
+                Access::eDepthStencilAttachmentWrite,
+            vk::ImageLayout::eDepthStencilAttachmentOptimal, true};
+  case ResourceUsage::Present:
+    // The presentation engine waits on a semaphore, nothing to make visible
+    return {{}, {}, vk::ImageLayout::ePresentSrcKHR, false};
+  case ResourceUsage::HostRead:
+    return {Stage::eHost, Access::eHostRead, vk::ImageLayout::eGeneral,
+            false};
+  case ResourceUsage::HostWrite:
+    return {Stage::eHost, Access::eHostWrite, vk::ImageLayout::eGeneral,
+            true};
+  }
+  return {{}, {}, vk::ImageLayout::eUndefined, false};
+}
+
+vk::ImageAspectFlags formatAspectMask(vk::Format format) {
+  switch (format) {
+  case vk::Format::eD16Unorm:
+  case vk::Format::eX8D24UnormPack32:
+  case vk::Format::eD32Sfloat:
+    return vk::ImageAspectFlagBits::eDepth;
+  case vk::Format::eD16UnormS8Uint:
+  case vk::Format::eD24UnormS8Uint:
+  case vk::Format::eD32SfloatS8Uint:
+    return vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil;
+  default:
+    return vk::ImageAspectFlagBits::eColor;
+  }
+}
+
+bool BarrierBatch::advance(ResourceState &state, ResourceUsage usage,
+                           bool hasLayout, uint32_t queueFamily,
+                           Dependency *dependency, uint32_t *srcQueueFamily,
+                           uint32_t *dstQueueFamily) {
+  if (usage == ResourceUsage::Undefined) {
+    // The content is not needed anymore, the next use starts from scratch
+    state = ResourceState{};
+    return false;
+  }
+
+  const UsageScope next = usageScope(usage);
+  const bool layoutChange = hasLayout && state.layout != next.layout;
+  bool ownershipTransfer = queueFamily != VK_QUEUE_FAMILY_IGNORED &&
+                           state.queueFamily != VK_QUEUE_FAMILY_IGNORED &&
+                           queueFamily != state.queueFamily;
+  if (ownershipTransfer && !isExternalFamily(state.queueFamily) &&
+      !isExternalFamily(queueFamily)) {
+    // Only one half would be recorded, the queues would not be in sync
+    LOGCATE("BarrierBatch: can't transfer ownership from queue family %u to "
+            "%u, only to or from an external family",
+            state.queueFamily, queueFamily);
+    assert(false);
+    ownershipTransfer = false;
+  }
+  *srcQueueFamily = VK_QUEUE_FAMILY_IGNORED;
+  *dstQueueFamily = VK_QUEUE_FAMILY_IGNORED;
+  if (ownershipTransfer) {
+    *srcQueueFamily = state.queueFamily;
+    *dstQueueFamily = queueFamily;
+  }
+  if (queueFamily != VK_QUEUE_FAMILY_IGNORED) {
+    state.queueFamily = queueFamily;
+  }
+
+  bool needed;
+  if (next.writes || layoutChange || ownershipTransfer) {
+    // Wait for the earlier reads and writes. Only writes have anything to
+    // make available.
+    dependency->srcStages = state.writeStages | state.readStages;
+    dependency->srcAccess = state.writeAccess;
+    dependency->dstStages = next.stages;
+    dependency->dstAccess = next.access;
+    needed = layoutChange || ownershipTransfer ||
+             dependency->srcStages != vk::PipelineStageFlags2KHR();
+
+    // A layout transition is a write of its own, later uses chain after it
+    // at next.stages
+    state.writeStages = next.stages;
+    state.writeAccess = next.writes ? next.access & kWriteAccess
+                                    : vk::AccessFlags2KHR();
+    state.readStages = next.writes ? vk::PipelineStageFlags2KHR()
+                                   : next.stages;
+    state.visibleStages = next.writes ? vk::PipelineStageFlags2KHR()
+                                      : next.stages;
+    state.visibleAccess = next.writes ? vk::AccessFlags2KHR() : next.access;
+  } else {
+    // A read needs a barrier only if the last write is not visible to it
+    // yet. Reads after reads need none.
+    const bool visible = !(next.stages & ~state.visibleStages) &&
+                         !(next.access & ~state.visibleAccess);
+    needed = state.writeStages != vk::PipelineStageFlags2KHR() && !visible;
+    dependency->srcStages = state.writeStages;
+    dependency->srcAccess = state.writeAccess;
+    dependency->dstStages = next.stages;
+    dependency->dstAccess = next.access;
+
+    state.readStages |= next.stages;
+    if (needed) {
+      state.visibleStages |= next.stages;
+      state.visibleAccess |= next.access;
+    }
+  }
+
+  if (hasLayout) {
+    state.layout = next.layout;
+  }
+  return needed;
+}
+
+void BarrierBatch::image(vk::Image image,
+                         const vk::ImageSubresourceRange &range,
+                         ResourceState &state, ResourceUsage usage,
+                         uint32_t queueFamily) {
+  const vk::ImageLayout oldLayout = state.layout;
+  Dependency dependency;
+  uint32_t srcQueueFamily, dstQueueFamily;
+  if (!advance(state, usage, true, queueFamily, &dependency, &srcQueueFamily,
+               &dstQueueFamily)) {
+    return;
+  }
+
+  vk::ImageMemoryBarrier2KHR barrier{};
+  barrier.srcStageMask = dependency.srcStages;
+  barrier.srcAccessMask = dependency.srcAccess;
+  barrier.dstStageMask = dependency.dstStages;
+  barrier.dstAccessMask = dependency.dstAccess;
+  barrier.oldLayout = oldLayout;
+  barrier.newLayout = state.layout;
+  barrier.srcQueueFamilyIndex = srcQueueFamily;
+  barrier.dstQueueFamilyIndex = dstQueueFamily;
+  barrier.image = image;
+  barrier.subresourceRange = range;
+  mImageBarriers.push_back(barrier);
+}
+
+void BarrierBatch::buffer(vk::Buffer buffer, ResourceState &state,
+                          ResourceUsage usage, vk::DeviceSize offset,
+                          vk::DeviceSize size) {
+  Dependency dependency;
+  uint32_t srcQueueFamily, dstQueueFamily;
+  if (!advance(state, usage, false, VK_QUEUE_FAMILY_IGNORED, &dependency,
+               &srcQueueFamily, &dstQueueFamily)) {
+    return;
+  }
+
+  vk::BufferMemoryBarrier2KHR barrier{};
+  barrier.srcStageMask = dependency.srcStages;
+  barrier.srcAccessMask = dependency.srcAccess;
+  barrier.dstStageMask = dependency.dstStages;
+  barrier.dstAccessMask = dependency.dstAccess;
+  barrier.srcQueueFamilyIndex = srcQueueFamily;
+  barrier.dstQueueFamilyIndex = dstQueueFamily;
+  barrier.buffer = buffer;
+  barrier.offset = offset;
+  barrier.size = size;
+  mBufferBarriers.push_back(barrier);
+}
+
+void BarrierBatch::image(const vk::ImageMemoryBarrier &barrier,
+                         vk::PipelineStageFlags srcStages,
+                         vk::PipelineStageFlags dstStages) {
+  vk::ImageMemoryBarrier2KHR barrier2{};
+  barrier2.srcStageMask = stages2(srcStages);
+  barrier2.srcAccessMask = access2(barrier.srcAccessMask);
+  barrier2.dstStageMask = stages2(dstStages);
+  barrier2.dstAccessMask = access2(barrier.dstAccessMask);
+  barrier2.oldLayout = barrier.oldLayout;
+  barrier2.newLayout = barrier.newLayout;
+  barrier2.srcQueueFamilyIndex = barrier.srcQueueFamilyIndex;
+  barrier2.dstQueueFamilyIndex = barrier.dstQueueFamilyIndex;
+  barrier2.image = barrier.image;
+  barrier2.subresourceRange = barrier.subresourceRange;
+  mImageBarriers.push_back(barrier2);
+}
+
+void BarrierBatch::record(vk::CommandBuffer cmd) {
+  if (empty()) {
+    return;
+  }
+
+  if (mSynchronization2) {
+    vk::DependencyInfoKHR dependencyInfo{};
+    dependencyInfo.imageMemoryBarrierCount =
+        static_cast<uint32_t>(mImageBarriers.size());
+    dependencyInfo.pImageMemoryBarriers = mImageBarriers.data();
+    dependencyInfo.bufferMemoryBarrierCount =
+        static_cast<uint32_t>(mBufferBarriers.size());
+    dependencyInfo.pBufferMemoryBarriers = mBufferBarriers.data();
+    cmd.pipelineBarrier2KHR(&dependencyInfo);
+  } else {
+    // One call has one pair of stage masks, the union of all barriers'
+    vk::PipelineStageFlags2KHR srcStages, dstStages;
+    std::vector<vk::ImageMemoryBarrier> imageBarriers;
+    imageBarriers.reserve(mImageBarriers.size());
+    for (const auto &barrier2 : mImageBarriers) {
+      srcStages |= barrier2.srcStageMask;
+      dstStages |= barrier2.dstStageMask;
+      vk::ImageMemoryBarrier barrier{};
+      barrier.srcAccessMask = legacyAccess(barrier2.srcAccessMask);
+      barrier.dstAccessMask = legacyAccess(barrier2.dstAccessMask);
+      barrier.oldLayout = barrier2.oldLayout;
+      barrier.newLayout = barrier2.newLayout;
+      barrier.srcQueueFamilyIndex = barrier2.srcQueueFamilyIndex;
+      barrier.dstQueueFamilyIndex = barrier2.dstQueueFamilyIndex;
+      barrier.image = barrier2.image;
+      barrier.subresourceRange = barrier2.subresourceRange;
+      imageBarriers.push_back(barrier);
+    }
+    std::vector<vk::BufferMemoryBarrier> bufferBarriers;
+    bufferBarriers.reserve(mBufferBarriers.size());
+    for (const auto &barrier2 : mBufferBarriers) {
+      srcStages |= barrier2.srcStageMask;
+      dstStages |= barrier2.dstStageMask;
+      vk::BufferMemoryBarrier barrier{};
+      barrier.srcAccessMask = legacyAccess(barrier2.srcAccessMask);
+      barrier.dstAccessMask = legacyAccess(barrier2.dstAccessMask);
+      barrier.srcQueueFamilyIndex = barrier2.srcQueueFamilyIndex;
+      barrier.dstQueueFamilyIndex = barrier2.dstQueueFamilyIndex;
+      barrier.buffer = barrier2.buffer;
+      barrier.offset = barrier2.offset;
+      barrier.size = barrier2.size;
+      bufferBarriers.push_back(barrier);
+    }
+
+    // Without synchronization2 empty stage masks are not allowed
+    vk::PipelineStageFlags legacySrc = legacyStages(srcStages);
+    if (!legacySrc) {
+      legacySrc = vk::PipelineStageFlagBits::eTopOfPipe;
+    }
+    vk::PipelineStageFlags legacyDst = legacyStages(dstStages);
+    if (!legacyDst) {
+      legacyDst = vk::PipelineStageFlagBits::eBottomOfPipe;
+    }
+    cmd.pipelineBarrier(legacySrc, legacyDst, vk::DependencyFlags(), 0,
+                        nullptr, static_cast<uint32_t>(bufferBarriers.size()),
+                        bufferBarriers.data(),
+                        static_cast<uint32_t>(imageBarriers.size()),
+                        imageBarriers.data());
+  }
+
+  mImageBarriers.clear();
+  mBufferBarriers.clear();
+}
+} // namespace vks
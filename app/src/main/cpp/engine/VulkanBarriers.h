@@ -0,0 +1,156 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef GAINVULKANSAMPLE_VULKANBARRIERS_H
+#define GAINVULKANSAMPLE_VULKANBARRIERS_H
+
+#include <vector>
+
+#include "VulkanDeviceWrapper.hpp"
+
+namespace vks {
+// How a resource is used between two barriers. Each usage stands for the
+// pipeline stages, accesses and image layout of that use, so barriers are
+// derived from what the resource was used for and what it is used for next
+// instead of being spelled out by hand.
+enum class ResourceUsage {
+  // Content is discarded, only valid as the state of a new resource
+  Undefined,
+  TransferSrc,
+  TransferDst,
+  VertexBuffer,
+  // Uniform buffer read by the vertex and fragment shaders
+  UniformRead,
+  SampledFragment,
+  SampledCompute,
+  StorageReadCompute,
+  StorageWriteCompute,
+  ColorAttachment,
+  DepthStencilAttachment,
+  Present,
+  HostRead,
+  HostWrite,
+};
+
+// Stages, accesses and image layout of a ResourceUsage
+struct UsageScope {
+  vk::PipelineStageFlags2KHR stages;
+  vk::AccessFlags2KHR access;
+  vk::ImageLayout layout;
+  bool writes;
+};
+
+UsageScope usageScope(ResourceUsage usage);
+
+// Aspects of a whole image of format, for barriers and views
+vk::ImageAspectFlags formatAspectMask(vk::Format format);
+
+// What is known about a resource at the current point of the command stream,
+// advanced by BarrierBatch as barriers are added
+struct ResourceState {
+  vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+  // Stages and accesses of the last write, or of the last layout transition
+  // which has no access to make available
+  vk::PipelineStageFlags2KHR writeStages;
+  vk::AccessFlags2KHR writeAccess;
+  // Stages that read since the last write, a write has to wait for them
+  vk::PipelineStageFlags2KHR readStages;
+  // Stages and accesses the last write is already visible to
+  vk::PipelineStageFlags2KHR visibleStages;
+  vk::AccessFlags2KHR visibleAccess;
+  // Family that owns the resource, VK_QUEUE_FAMILY_IGNORED if none took
+  // ownership explicitly
+  uint32_t queueFamily = VK_QUEUE_FAMILY_IGNORED;
+
+  // State after a barrier recorded by hand, which transitioned to layout and
+  // made the resource visible to access at stages
+  static ResourceState afterBarrier(vk::ImageLayout layout,
+                                    vk::PipelineStageFlags stages,
+                                    vk::AccessFlags access,
+                                    uint32_t queueFamily);
+};
+
+// Collects image and buffer barriers and records them with a single
+// pipeline barrier. Uses vkCmdPipelineBarrier2 if VK_KHR_synchronization2 is
+// enabled, otherwise the stage masks of all barriers are merged into one
+// vkCmdPipelineBarrier.
+class BarrierBatch {
+public:
+  explicit BarrierBatch(bool synchronization2)
+      : mSynchronization2(synchronization2) {}
+
+  explicit BarrierBatch(const VulkanDeviceWrapper &deviceWrapper)
+      : BarrierBatch(deviceWrapper.synchronization2Supported) {}
+
+  // Add the barrier needed before image, in state, is used for usage and
+  // advance state. Nothing is added if the use needs no barrier, e.g. a read
+  // after a read in the same layout. With queueFamily other than the owning
+  // family the barrier is one half of an ownership transfer: the acquire
+  // from VK_QUEUE_FAMILY_EXTERNAL or VK_QUEUE_FAMILY_FOREIGN_EXT, or the
+  // release to one of them. Their owner records the other half. Transfers
+  // between two families of the device would need a release recorded on the
+  // source queue and are not supported.
+  void image(vk::Image image, const vk::ImageSubresourceRange &range,
+             ResourceState &state, ResourceUsage usage,
+             uint32_t queueFamily = VK_QUEUE_FAMILY_IGNORED);
+
+  // Same for a buffer, whose layout is ignored
+  void buffer(vk::Buffer buffer, ResourceState &state, ResourceUsage usage,
+              vk::DeviceSize offset = 0, vk::DeviceSize size = VK_WHOLE_SIZE);
+
+  // Add a barrier as is, e.g. one that was queued before its destination
+  // stage was known
+  void image(const vk::ImageMemoryBarrier &barrier,
+             vk::PipelineStageFlags srcStages,
+             vk::PipelineStageFlags dstStages);
+
+  bool empty() const {
+    return mImageBarriers.empty() && mBufferBarriers.empty();
+  }
+
+  // Record everything added into cmd and start a new batch
+  void record(vk::CommandBuffer cmd);
+
+private:
+  struct Dependency {
+    vk::PipelineStageFlags2KHR srcStages;
+    vk::AccessFlags2KHR srcAccess;
+    vk::PipelineStageFlags2KHR dstStages;
+    vk::AccessFlags2KHR dstAccess;
+  };
+
+  // Computes the dependency from state to usage and advances state. Returns
+  // false if no barrier is needed.
+  static bool advance(ResourceState &state, ResourceUsage usage,
+                      bool hasLayout, uint32_t queueFamily,
+                      Dependency *dependency, uint32_t *srcQueueFamily,
+                      uint32_t *dstQueueFamily);
+
+  const bool mSynchronization2;
+  std::vector<vk::ImageMemoryBarrier2KHR> mImageBarriers;
+  std::vector<vk::BufferMemoryBarrier2KHR> mBufferBarriers;
+};
+} // namespace vks
+
+#endif // GAINVULKANSAMPLE_VULKANBARRIERS_H
@@ -53,17 +53,14 @@ bool Buffer::initialize(vk::BufferUsageFlags usage,
   vk::MemoryRequirements memoryRequirements;
   mContext->logicalDevice.getBufferMemoryRequirements(mBuffer,
                                                       &memoryRequirements);
-  const auto memoryTypeIndex =
-      mContext->getMemoryType(memoryRequirements.memoryTypeBits, properties);
-  const vk::MemoryAllocateInfo allocateInfo{memoryRequirements.size,
-                                            memoryTypeIndex};
-  CALL_VK(
-      mContext->logicalDevice.allocateMemory(&allocateInfo, nullptr, &mMemory));
-
-  mContext->logicalDevice.bindBufferMemory(mBuffer, mMemory, 0);
+  mAllocation = mContext->allocator->allocate(
+      memoryRequirements, properties, vks::MemoryAllocator::Tiling::eLinear);
+  if (!mAllocation) {
+    return false;
+  }
 
-  vks::debug::setDeviceMemoryName(mContext->logicalDevice, mMemory,
-                                  "VulkanResources-Buffer::initialize-mMemory");
+  mContext->logicalDevice.bindBufferMemory(mBuffer, mAllocation.memory,
+                                           mAllocation.offset);
 
   return true;
 }
@@ -75,9 +72,10 @@ bool Buffer::initialize(vk::BufferUsageFlags usage,
  * @param size Size of the data to copy in machine units
  *
  */
-void Buffer::copyFrom(const void *data, vk::DeviceSize size) {
+void Buffer::copyFrom(const void *data, vk::DeviceSize size,
+                      vk::DeviceSize offset) {
   assert(mapped);
-  memcpy(mapped, data, size);
+  memcpy(static_cast<uint8_t *>(mapped) + offset, data, size);
 }
 
 /**
@@ -91,21 +89,20 @@ void Buffer::copyFrom(const void *data, vk::DeviceSize size) {
  * @return vk::Result of the buffer mapping call
  */
 vk::Result Buffer::map(vk::DeviceSize size, vk::DeviceSize offset) {
-  return mContext->logicalDevice.mapMemory(mMemory, offset, size,
-                                           vk::MemoryMapFlagBits{0}, &mapped);
+  // Host visible memory is mapped by the allocator for its whole lifetime
+  if (mAllocation.mapped == nullptr) {
+    return vk::Result::eErrorMemoryMapFailed;
+  }
+  mapped = static_cast<uint8_t *>(mAllocation.mapped) + offset;
+  return vk::Result::eSuccess;
 }
 
 /**
  * Unmap a mapped memory range
  *
- * @note Does not return a result as vkUnmapMemory can't fail
+ * @note Only drops the pointer, the allocator keeps the memory mapped
  */
-void Buffer::unmap() {
-  if (mapped) {
-    mContext->logicalDevice.unmapMemory(mMemory);
-    mapped = nullptr;
-  }
-}
+void Buffer::unmap() { mapped = nullptr; }
 
 /**
  * Flush a memory range of the buffer to make it visible to the device
@@ -120,9 +117,9 @@ void Buffer::unmap() {
  */
 vk::Result Buffer::flush(vk::DeviceSize size, vk::DeviceSize offset) {
   vk::MappedMemoryRange mappedRange = {};
-  mappedRange.memory = mMemory;
-  mappedRange.offset = offset;
-  mappedRange.size = size;
+  mappedRange.memory = mAllocation.memory;
+  mappedRange.offset = mAllocation.offset + offset;
+  mappedRange.size = size == VK_WHOLE_SIZE ? mAllocation.size - offset : size;
   return mContext->logicalDevice.flushMappedMemoryRanges(1, &mappedRange);
 }
 
@@ -139,9 +136,9 @@ vk::Result Buffer::flush(vk::DeviceSize size, vk::DeviceSize offset) {
  */
 vk::Result Buffer::invalidate(vk::DeviceSize size, vk::DeviceSize offset) {
   vk::MappedMemoryRange mappedRange = {};
-  mappedRange.memory = mMemory;
-  mappedRange.offset = offset;
-  mappedRange.size = size;
+  mappedRange.memory = mAllocation.memory;
+  mappedRange.offset = mAllocation.offset + offset;
+  mappedRange.size = size == VK_WHOLE_SIZE ? mAllocation.size - offset : size;
   return mContext->logicalDevice.invalidateMappedMemoryRanges(1, &mappedRange);
 }
 } // namespace vks
\ No newline at end of file
@@ -52,17 +52,18 @@ public:
       mContext->logicalDevice.destroyBuffer(mBuffer, nullptr);
     }
 
-    if (mMemory) {
-      mContext->logicalDevice.freeMemory(mMemory, nullptr);
-    }
+    mContext->allocator->free(mAllocation);
   }
 
   vk::Buffer getBufferHandle() const { return mBuffer; }
 
-  vk::DeviceMemory getMemoryHandle() const { return mMemory; }
+  vk::DeviceMemory getMemoryHandle() const { return mAllocation.memory; }
 
   vk::DescriptorBufferInfo getDescriptor() const { return {mBuffer, 0, mSize}; }
 
+  // Host address of the mapped range, nullptr if the buffer is not mapped
+  void *getMappedData() const { return mapped; }
+
   vk::Result flush(vk::DeviceSize size = VK_WHOLE_SIZE,
                    vk::DeviceSize offset = 0);
 
@@ -71,7 +72,8 @@ public:
 
   void unmap();
 
-  void copyFrom(const void *data, vk::DeviceSize size);
+  void copyFrom(const void *data, vk::DeviceSize size,
+                vk::DeviceSize offset = 0);
 
   vk::Result invalidate(vk::DeviceSize size = VK_WHOLE_SIZE,
                         vk::DeviceSize offset = 0);
@@ -86,7 +88,7 @@ private:
 
   // Managed handles
   vk::Buffer mBuffer = nullptr;
-  vk::DeviceMemory mMemory = nullptr;
+  vks::Allocation mAllocation;
   void *mapped = nullptr;
   /** @brief Usage flags to be filled by external source at buffer creation (to
    * query at some later point) */
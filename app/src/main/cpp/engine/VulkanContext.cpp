@@ -28,13 +28,16 @@
 #include "includes/cube_data.h"
 #include <array>
 #include <cmath>
+#include <cstring>
 #include <optional>
 
 // Instantiate the default dispatcher
 VULKAN_HPP_DEFAULT_DISPATCH_LOADER_DYNAMIC_STORAGE
 
-bool VulkanContext::create(AAssetManager *assetManager) {
+bool VulkanContext::create(gain::AssetManager *assetManager,
+                           const std::string &pipelineCachePath) {
   mAssetManager = assetManager;
+  mPipelineCachePath = pipelineCachePath;
   getDeviceConfig();
   bool ret =
       createInstance() && pickPhysicalDeviceAndQueueFamily() && createDevice();
@@ -44,10 +47,7 @@ bool VulkanContext::create(AAssetManager *assetManager) {
 
 void VulkanContext::getDeviceConfig() {
   // Screen density
-  AConfiguration *config = AConfiguration_new();
-  AConfiguration_fromAssetManager(config, mAssetManager);
-  mScreenDensity = AConfiguration_getDensity(config);
-  AConfiguration_delete(config);
+  mScreenDensity = gain::getScreenDensity(mAssetManager);
 }
 
 bool VulkanContext::createInstance() {
@@ -68,7 +68,12 @@ bool VulkanContext::createInstance() {
       VK_KHR_EXTERNAL_SEMAPHORE_CAPABILITIES_EXTENSION_NAME,
       VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME,
       VK_KHR_SURFACE_EXTENSION_NAME,
+#ifdef __ANDROID__
       VK_KHR_ANDROID_SURFACE_EXTENSION_NAME,
+#else
+      // Host builds present to a headless surface, see VulkanSwapChain
+      VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME,
+#endif
       VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME,
   };
   if (vks::debug::debuggable) {
@@ -138,10 +143,14 @@ bool VulkanContext::pickPhysicalDeviceAndQueueFamily(
 bool VulkanContext::createDevice(vk::QueueFlags requestedQueueTypes) {
   // Required device extensions
   // These extensions are required to import an AHardwareBuffer to Vulkan.
+  // Host builds upload the content of their stand-in buffers instead, see
+  // platform/HardwareBuffer.h.
   std::vector<const char *> deviceExtensions = {
       VK_KHR_EXTERNAL_MEMORY_EXTENSION_NAME,
+#ifdef __ANDROID__
       VK_EXT_QUEUE_FAMILY_FOREIGN_EXTENSION_NAME,
       VK_ANDROID_EXTERNAL_MEMORY_ANDROID_HARDWARE_BUFFER_EXTENSION_NAME,
+#endif
       VK_KHR_SWAPCHAIN_EXTENSION_NAME,
       VK_KHR_GET_MEMORY_REQUIREMENTS_2_EXTENSION_NAME,
       VK_KHR_SAMPLER_YCBCR_CONVERSION_EXTENSION_NAME,
@@ -152,6 +161,38 @@ bool VulkanContext::createDevice(vk::QueueFlags requestedQueueTypes) {
       VK_KHR_DEDICATED_ALLOCATION_EXTENSION_NAME,
   };
 
+  // Optional, only used to report pipeline cache hits
+  mPipelineCreationFeedback = mDeviceWrapper->extensionSupported(
+      VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+  if (mPipelineCreationFeedback) {
+    deviceExtensions.push_back(
+        VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+  }
+
+  // Optional, lets uploads signal their completion without a fence per batch
+  if (mDeviceWrapper->extensionSupported(
+          VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME)) {
+    deviceExtensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+  }
+
+  // Optional, barriers carry their own stage masks instead of sharing one
+  if (mDeviceWrapper->extensionSupported(
+          VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME)) {
+    deviceExtensions.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+  }
+
+  // Optional, lets compute engines write straight into caller memory
+  if (mDeviceWrapper->extensionSupported(
+          VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME)) {
+    deviceExtensions.push_back(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+    vk::PhysicalDeviceExternalMemoryHostPropertiesEXT hostProperties{};
+    vk::PhysicalDeviceProperties2KHR properties2{};
+    properties2.pNext = &hostProperties;
+    physicalDevice().getProperties2KHR(&properties2);
+    mDeviceWrapper->hostPointerImportAlignment =
+        hostProperties.minImportedHostPointerAlignment;
+  }
+
   vk::PhysicalDeviceFeatures enabledFeatures{};
 
   mDeviceWrapper->createLogicalDevice(enabledFeatures, deviceExtensions,
@@ -161,22 +202,170 @@ bool VulkanContext::createDevice(vk::QueueFlags requestedQueueTypes) {
       mDeviceWrapper->queueFamilyIndices.graphics, 0, &mGraphicsQueue);
   mDeviceWrapper->logicalDevice.getQueue(
       mDeviceWrapper->queueFamilyIndices.compute, 0, &mComputeQueue);
+  mDeviceWrapper->logicalDevice.getQueue(
+      mDeviceWrapper->queueFamilyIndices.transfer, 0, &mTransferQueue);
+
+  // Producer fences (e.g. the camera's) arrive as sync fds
+  vk::PhysicalDeviceExternalSemaphoreInfo externalSemaphoreInfo{};
+  externalSemaphoreInfo.handleType =
+      vk::ExternalSemaphoreHandleTypeFlagBits::eSyncFd;
+  vk::ExternalSemaphoreProperties externalSemaphoreProperties{};
+  physicalDevice().getExternalSemaphorePropertiesKHR(
+      &externalSemaphoreInfo, &externalSemaphoreProperties);
+  mDeviceWrapper->syncFdImportSupported =
+      static_cast<bool>(externalSemaphoreProperties.externalSemaphoreFeatures &
+                        vk::ExternalSemaphoreFeatureFlagBits::eImportable);
 
   createPipelineCache();
 
-  return true;
+  mUploadManager = vks::UploadManager::create(mDeviceWrapper, mTransferQueue,
+                                              mGraphicsQueue);
+
+  return mUploadManager != nullptr;
 }
 
 void VulkanContext::createPipelineCache() {
+  // Data of another driver or device is at best ignored by the driver, so it
+  // is only passed on if the header matches this device
+  std::vector<char> data;
+  if (!mPipelineCachePath.empty() &&
+      gain::readFile(mPipelineCachePath, data)) {
+    if (!isPipelineCacheCompatible(data)) {
+      LOGCATI("Ignoring incompatible pipeline cache %s",
+              mPipelineCachePath.c_str());
+      data.clear();
+    }
+  } else {
+    data.clear();
+  }
+
   vk::PipelineCacheCreateInfo pipelineCacheCreateInfo = {};
-  CALL_VK(device().createPipelineCache(&pipelineCacheCreateInfo, nullptr,
-                                       &mPipelineCache));
+  pipelineCacheCreateInfo.initialDataSize = data.size();
+  pipelineCacheCreateInfo.pInitialData = data.data();
+  vk::Result result = device().createPipelineCache(&pipelineCacheCreateInfo,
+                                                   nullptr, &mPipelineCache);
+  if (result != vk::Result::eSuccess && !data.empty()) {
+    // Matching header but rejected content, start over with an empty cache
+    LOGCATE("Pipeline cache %s rejected by the driver",
+            mPipelineCachePath.c_str());
+    data.clear();
+    pipelineCacheCreateInfo.initialDataSize = 0;
+    pipelineCacheCreateInfo.pInitialData = nullptr;
+    result = device().createPipelineCache(&pipelineCacheCreateInfo, nullptr,
+                                          &mPipelineCache);
+  }
+  CALL_VK(result);
+  mPipelineCacheStats.loadedBytes = data.size();
+}
+
+bool VulkanContext::isPipelineCacheCompatible(
+    const std::vector<char> &data) const {
+  // Layout of VkPipelineCacheHeaderVersionOne, read field by field because
+  // the file may be truncated or come from another ABI
+  struct {
+    uint32_t headerSize;
+    uint32_t headerVersion;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+  } header;
+  static_assert(sizeof(header) == 16 + VK_UUID_SIZE,
+                "pipeline cache header must not be padded");
+  if (data.size() < sizeof(header)) {
+    return false;
+  }
+  memcpy(&header, data.data(), sizeof(header));
+
+  const auto &properties = mDeviceWrapper->properties;
+  return header.headerSize >= sizeof(header) &&
+         header.headerSize <= data.size() &&
+         header.headerVersion ==
+             static_cast<uint32_t>(vk::PipelineCacheHeaderVersion::eOne) &&
+         header.vendorID == properties.vendorID &&
+         header.deviceID == properties.deviceID &&
+         memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID.data(),
+                VK_UUID_SIZE) == 0;
+}
+
+vk::Result
+VulkanContext::createGraphicsPipeline(const vk::GraphicsPipelineCreateInfo &info,
+                                      vk::Pipeline *pipeline) {
+  vk::GraphicsPipelineCreateInfo createInfo = info;
+  vk::PipelineCreationFeedbackEXT feedback{};
+  vk::PipelineCreationFeedbackCreateInfoEXT feedbackInfo{};
+  if (mPipelineCreationFeedback) {
+    feedbackInfo.pPipelineCreationFeedback = &feedback;
+    feedbackInfo.pNext = createInfo.pNext;
+    createInfo.pNext = &feedbackInfo;
+  }
+
+  const vk::Result result = device().createGraphicsPipelines(
+      mPipelineCache, 1, &createInfo, nullptr, pipeline);
+
+  if (result == vk::Result::eSuccess) {
+    countPipelineCacheFeedback(feedback);
+  }
+  return result;
+}
+
+vk::Result
+VulkanContext::createComputePipeline(const vk::ComputePipelineCreateInfo &info,
+                                     vk::Pipeline *pipeline) {
+  vk::ComputePipelineCreateInfo createInfo = info;
+  vk::PipelineCreationFeedbackEXT feedback{};
+  vk::PipelineCreationFeedbackCreateInfoEXT feedbackInfo{};
+  if (mPipelineCreationFeedback) {
+    feedbackInfo.pPipelineCreationFeedback = &feedback;
+    feedbackInfo.pNext = createInfo.pNext;
+    createInfo.pNext = &feedbackInfo;
+  }
+
+  const vk::Result result = device().createComputePipelines(
+      mPipelineCache, 1, &createInfo, nullptr, pipeline);
+
+  if (result == vk::Result::eSuccess) {
+    countPipelineCacheFeedback(feedback);
+  }
+  return result;
+}
+
+void VulkanContext::countPipelineCacheFeedback(
+    const vk::PipelineCreationFeedbackEXT &feedback) {
+  if (!(feedback.flags & vk::PipelineCreationFeedbackFlagBitsEXT::eValid)) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mPipelineCacheStatsMutex);
+  if (feedback.flags &
+      vk::PipelineCreationFeedbackFlagBitsEXT::eApplicationPipelineCacheHit) {
+    mPipelineCacheStats.hits++;
+  } else {
+    mPipelineCacheStats.misses++;
+  }
+}
+
+bool VulkanContext::savePipelineCache() {
+  if (mPipelineCachePath.empty() || !mPipelineCache) {
+    return false;
+  }
+
+  size_t size = 0;
+  CALL_VK(device().getPipelineCacheData(mPipelineCache, &size, nullptr));
+  std::vector<char> data(size);
+  CALL_VK(device().getPipelineCacheData(mPipelineCache, &size, data.data()));
+
+  LOGCATI("Saving pipeline cache: %zu bytes, loaded %zu, hits %u, misses %u",
+          size, mPipelineCacheStats.loadedBytes, mPipelineCacheStats.hits,
+          mPipelineCacheStats.misses);
+  return gain::writeFileAtomic(mPipelineCachePath, data.data(), size);
 }
 
 VulkanContext::~VulkanContext() {
   device().waitIdle();
 
+  mUploadManager.reset();
+
   if (mPipelineCache) {
+    savePipelineCache();
     device().destroyPipelineCache(mPipelineCache);
   }
 
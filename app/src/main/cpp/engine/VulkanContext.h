@@ -27,12 +27,12 @@
 
 #include "VulkanDeviceWrapper.hpp"
 #include "VulkanSwapChain.h"
-#include <android/asset_manager_jni.h>
-#include <android/bitmap.h>
-#include <android/configuration.h>
-#include <android/hardware_buffer_jni.h>
+#include "VulkanUploadManager.h"
+#include "platform/Platform.h"
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <string>
 #include <vector>
 #include <vulkan/vulkan_raii.hpp>
 #define GLM_FORCE_RADIANS
@@ -46,15 +46,21 @@ class VulkanContext {
 private:
   void getDeviceConfig();
   void createPipelineCache();
+  bool isPipelineCacheCompatible(const std::vector<char> &data) const;
+  void countPipelineCacheFeedback(
+      const vk::PipelineCreationFeedbackEXT &feedback);
 
 public:
-  bool create(AAssetManager *assetManager);
+  // pipelineCachePath is the file the pipeline cache is loaded from and saved
+  // to, e.g. in the app's cache directory. Empty to keep it in memory only.
+  bool create(gain::AssetManager *assetManager,
+              const std::string &pipelineCachePath = "");
   // Prefer VulkanContext::create
   VulkanContext() : mInstance(nullptr), mPipelineCache(nullptr) {}
 
   virtual ~VulkanContext();
 
-  AAssetManager *mAssetManager;
+  gain::AssetManager *mAssetManager;
 
   uint32_t mScreenDensity;
 
@@ -71,9 +77,39 @@ public:
     // TODO 三种队列都要提供获取方式
     return mGraphicsQueue;
   }
+  // Queue of the transfer-only family, the graphics queue if there is none
+  vk::Queue transferQueue() const { return mTransferQueue; }
   vk::PipelineCache pipelineCache() const { return mPipelineCache; }
   vk::CommandPool commandPool() const { return mDeviceWrapper->commandPool; }
-  AAssetManager *_AAssetManager() const { return mAssetManager; }
+  gain::AssetManager *assetManager() const { return mAssetManager; }
+  // Uploads of static data into device local buffers and images
+  vks::UploadManager *uploadManager() const { return mUploadManager.get(); }
+
+  struct PipelineCacheStats {
+    // Bytes of cache data loaded from disk, 0 if there was no usable file
+    size_t loadedBytes = 0;
+    // Pipelines found in / missing from the cache. Only counted if the device
+    // supports VK_EXT_pipeline_creation_feedback.
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+  };
+  const PipelineCacheStats &pipelineCacheStats() const {
+    return mPipelineCacheStats;
+  }
+
+  // Create a graphics pipeline through the pipeline cache and count whether
+  // the cache had it, see pipelineCacheStats. Pipelines can be created on
+  // several threads at once.
+  vk::Result createGraphicsPipeline(const vk::GraphicsPipelineCreateInfo &info,
+                                    vk::Pipeline *pipeline);
+
+  // Same for a compute pipeline
+  vk::Result createComputePipeline(const vk::ComputePipelineCreateInfo &info,
+                                   vk::Pipeline *pipeline);
+
+  // Write the pipeline cache to the file given to create. Call once the
+  // pipelines are built, the cache is also saved on destruction.
+  bool savePipelineCache();
 
 protected:
   // Initialization
@@ -83,7 +119,8 @@ protected:
                                            vk::QueueFlagBits::eCompute);
   bool createDevice(
       vk::QueueFlags requestedQueueTypes = vk::QueueFlagBits::eGraphics |
-                                           vk::QueueFlagBits::eCompute);
+                                           vk::QueueFlagBits::eCompute |
+                                           vk::QueueFlagBits::eTransfer);
 
   uint32_t getQueueFamilyIndex(vk::QueueFlagBits queueFlags) const;
 
@@ -97,8 +134,15 @@ protected:
   vk::Queue mGraphicsQueue = nullptr;
   vk::Queue mComputeQueue = nullptr;
   vk::Queue mPresentQueue = nullptr;
+  vk::Queue mTransferQueue = nullptr;
+
+  std::unique_ptr<vks::UploadManager> mUploadManager;
 
   vk::PipelineCache mPipelineCache = nullptr;
+  std::string mPipelineCachePath;
+  PipelineCacheStats mPipelineCacheStats;
+  std::mutex mPipelineCacheStatsMutex;
+  bool mPipelineCreationFeedback = false;
 };
 
 #endif // GAINVULKANSAMPLE_VULKANCONTEXTBASE_H
@@ -26,11 +26,13 @@
 #pragma once
 
 #include "VulkanDebug.h"
+#include "VulkanMemoryAllocator.h"
 #include <LogUtil.h>
 #include <algorithm>
 #include <assert.h>
 #include <cstring>
 #include <exception>
+#include <string>
 #include <vector>
 #include <vulkan/vulkan.hpp>
 
@@ -43,12 +45,26 @@ struct VulkanDeviceWrapper {
   vk::PhysicalDeviceFeatures enabledFeatures;
   vk::PhysicalDeviceMemoryProperties memoryProperties;
   std::vector<vk::QueueFamilyProperties> queueFamilyProperties;
+  std::vector<std::string> supportedExtensions;
   vk::CommandPool commandPool = VK_NULL_HANDLE;
+  // Memory of buffers and images, created with the logical device
+  std::unique_ptr<MemoryAllocator> allocator;
   uint32_t workGroupSize = 0;
+  // Whether sync fds can be imported into semaphores, see gain::SyncFence
+  bool syncFdImportSupported = false;
+  // Whether timeline semaphores are enabled, see VK_KHR_timeline_semaphore
+  bool timelineSemaphoreSupported = false;
+  // Whether VK_KHR_synchronization2 is enabled, see vks::BarrierBatch
+  bool synchronization2Supported = false;
+  // Alignment of host pointers imported as device memory, 0 if
+  // VK_EXT_external_memory_host is not enabled
+  vk::DeviceSize hostPointerImportAlignment = 0;
 
   struct {
     uint32_t graphics;
     uint32_t compute;
+    // A transfer-only family if the device has one, graphics otherwise
+    uint32_t transfer;
   } queueFamilyIndices;
 
   operator vk::Device() { return logicalDevice; };
@@ -77,6 +93,32 @@ struct VulkanDeviceWrapper {
     queueFamilyProperties.resize(queueFamilyCount);
     physicalDevice.getQueueFamilyProperties(&queueFamilyCount,
                                             queueFamilyProperties.data());
+
+    // Get list of supported extensions
+    uint32_t extCount = 0;
+    CALL_VK(physicalDevice.enumerateDeviceExtensionProperties(
+        nullptr, &extCount, nullptr));
+    if (extCount > 0) {
+      std::vector<vk::ExtensionProperties> extensions(extCount);
+      CALL_VK(physicalDevice.enumerateDeviceExtensionProperties(
+          nullptr, &extCount, extensions.data()));
+      for (const auto &ext : extensions) {
+        supportedExtensions.push_back(ext.extensionName);
+      }
+    }
+  }
+
+  /**
+   * Check if an extension is supported by the (physical device)
+   *
+   * @param extension Name of the extension to check
+   *
+   * @return True if the extension is supported (present in the list read at
+   * device creation time)
+   */
+  bool extensionSupported(const std::string &extension) const {
+    return std::find(supportedExtensions.begin(), supportedExtensions.end(),
+                     extension) != supportedExtensions.end();
   }
 
   /**
@@ -88,6 +130,7 @@ struct VulkanDeviceWrapper {
     if (commandPool) {
       logicalDevice.destroyCommandPool(commandPool, nullptr);
     }
+    allocator.reset();
     if (logicalDevice) {
       logicalDevice.destroy(nullptr);
     }
@@ -179,6 +222,22 @@ struct VulkanDeviceWrapper {
       }
     }
 
+    // Dedicated queue for transfer
+    // Try to find a queue family index that supports transfer but not graphics
+    // and compute
+    if (queueFlags & vk::QueueFlagBits::eTransfer) {
+      for (uint32_t i = 0;
+           i < static_cast<uint32_t>(queueFamilyProperties.size()); i++) {
+        if ((queueFamilyProperties[i].queueFlags & queueFlags) &&
+            (!(queueFamilyProperties[i].queueFlags &
+               vk::QueueFlagBits::eGraphics)) &&
+            (!(queueFamilyProperties[i].queueFlags &
+               vk::QueueFlagBits::eCompute))) {
+          return i;
+        }
+      }
+    }
+
     // For other queue types or if no separate compute queue is present, return
     // the first one to support the requested flags
     for (uint32_t i = 0;
@@ -280,6 +339,25 @@ struct VulkanDeviceWrapper {
       queueFamilyIndices.compute = queueFamilyIndices.graphics;
     }
 
+    // Dedicated transfer queue. Graphics and compute families support
+    // transfers as well, so only a transfer-only family is worth a queue of
+    // its own.
+    queueFamilyIndices.transfer = queueFamilyIndices.graphics;
+    if (requestedQueueTypes & vk::QueueFlagBits::eTransfer) {
+      const uint32_t transfer =
+          getQueueFamilyIndex(vk::QueueFlagBits::eTransfer);
+      const auto flags = queueFamilyProperties[transfer].queueFlags;
+      if (!(flags & vk::QueueFlagBits::eGraphics) &&
+          !(flags & vk::QueueFlagBits::eCompute)) {
+        queueFamilyIndices.transfer = transfer;
+        vk::DeviceQueueCreateInfo queueInfo{};
+        queueInfo.queueFamilyIndex = queueFamilyIndices.transfer;
+        queueInfo.queueCount = 1;
+        queueInfo.pQueuePriorities = &defaultQueuePriority;
+        queueCreateInfos.push_back(queueInfo);
+      }
+    }
+
     // Create the logical device representation
     std::vector<const char *> deviceExtensions(enabledExtensions);
     deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
@@ -304,22 +382,54 @@ struct VulkanDeviceWrapper {
                             return strcmp(extension, enabled_extension) == 0;
                           }) != enabledExtensions.end();
     };
+    // The feature structs are chained into deviceCreateInfo, so they have to
+    // live until the device is created
+    vk::PhysicalDeviceFeatures2KHR enabledFeatures2{};
+    enabledFeatures2.features = enabledFeatures;
+    vk::PhysicalDeviceSamplerYcbcrConversionFeaturesKHR
+        samplerYcbcrConversionFeature{};
+    vk::PhysicalDeviceTimelineSemaphoreFeaturesKHR timelineSemaphoreFeature{};
+    vk::PhysicalDeviceSynchronization2FeaturesKHR synchronization2Feature{};
+    auto chainFeature = [&](auto &feature) {
+      feature.pNext = enabledFeatures2.pNext;
+      enabledFeatures2.pNext = &feature;
+      deviceCreateInfo.pNext = &enabledFeatures2;
+      deviceCreateInfo.pEnabledFeatures = nullptr;
+    };
     if (isEnabled(VK_KHR_SAMPLER_YCBCR_CONVERSION_EXTENSION_NAME)) {
-      vk::PhysicalDeviceSamplerYcbcrConversionFeaturesKHR
-          samplerYcbcrConversionFeature = {
-              VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SAMPLER_YCBCR_CONVERSION_FEATURES,
-              nullptr};
-      vk::PhysicalDeviceFeatures2KHR enabledFeatures{};
-      enabledFeatures.pNext = &samplerYcbcrConversionFeature;
       samplerYcbcrConversionFeature.samplerYcbcrConversion = VK_TRUE;
-      deviceCreateInfo.pNext = &enabledFeatures;
-      deviceCreateInfo.pEnabledFeatures = nullptr;
+      chainFeature(samplerYcbcrConversionFeature);
+    }
+    if (isEnabled(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME)) {
+      // The extension may be exposed without the feature
+      vk::PhysicalDeviceTimelineSemaphoreFeaturesKHR supported{};
+      vk::PhysicalDeviceFeatures2KHR features2{};
+      features2.pNext = &supported;
+      physicalDevice.getFeatures2KHR(&features2);
+      if (supported.timelineSemaphore) {
+        timelineSemaphoreFeature.timelineSemaphore = VK_TRUE;
+        chainFeature(timelineSemaphoreFeature);
+        timelineSemaphoreSupported = true;
+      }
+    }
+    if (isEnabled(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME)) {
+      vk::PhysicalDeviceSynchronization2FeaturesKHR supported{};
+      vk::PhysicalDeviceFeatures2KHR features2{};
+      features2.pNext = &supported;
+      physicalDevice.getFeatures2KHR(&features2);
+      if (supported.synchronization2) {
+        synchronization2Feature.synchronization2 = VK_TRUE;
+        chainFeature(synchronization2Feature);
+        synchronization2Supported = true;
+      }
     }
 
     vk::Result result =
         physicalDevice.createDevice(&deviceCreateInfo, nullptr, &logicalDevice);
 
     if (result == vk::Result::eSuccess) {
+      allocator = std::make_unique<MemoryAllocator>(physicalDevice,
+                                                    logicalDevice);
       if (queueFamilyIndices.graphics != VK_QUEUE_FAMILY_IGNORED) {
         commandPool = createCommandPool(queueFamilyIndices.graphics);
       } else {
@@ -0,0 +1,94 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "VulkanFenceWatcher.h"
+
+#include <LogUtil.h>
+#include <algorithm>
+#include <pthread.h>
+
+namespace vks {
+FenceWatcher::FenceWatcher(vk::Device device) : mDevice(device) {
+  mThread = std::thread([this] {
+    pthread_setname_np(pthread_self(), "VkFenceWatcher");
+    run();
+  });
+}
+
+FenceWatcher::~FenceWatcher() {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStopping = true;
+  }
+  mChanged.notify_all();
+  mThread.join();
+}
+
+void FenceWatcher::watch(vk::Fence fence, Callback callback) {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mEntries.push_back(Entry{fence, std::move(callback)});
+  }
+  mChanged.notify_all();
+}
+
+void FenceWatcher::release(vk::Fence fence) {
+  std::unique_lock<std::mutex> lock(mMutex);
+  mChanged.wait(lock, [&] { return !isWatched(fence); });
+}
+
+bool FenceWatcher::isWatched(vk::Fence fence) const {
+  return std::any_of(mEntries.begin(), mEntries.end(),
+                     [fence](const Entry &entry) {
+                       return entry.fence == fence;
+                     });
+}
+
+void FenceWatcher::run() {
+  std::unique_lock<std::mutex> lock(mMutex);
+  for (;;) {
+    mChanged.wait(lock, [this] { return mStopping || !mEntries.empty(); });
+    if (mEntries.empty()) {
+      return;
+    }
+    // The entry stays queued while it is waited for, so release blocks
+    const vk::Fence fence = mEntries.front().fence;
+    Callback callback = std::move(mEntries.front().callback);
+    lock.unlock();
+
+    const vk::Result result =
+        mDevice.waitForFences(1, &fence, VK_TRUE, UINT64_MAX);
+    if (result == vk::Result::eSuccess) {
+      callback();
+    } else {
+      LOGCATE("FenceWatcher: waiting for a fence failed, error %d",
+              static_cast<int>(result));
+    }
+
+    lock.lock();
+    mEntries.pop_front();
+    mChanged.notify_all();
+  }
+}
+} // namespace vks
@@ -0,0 +1,84 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef GAINVULKANSAMPLE_VULKANFENCEWATCHER_H
+#define GAINVULKANSAMPLE_VULKANFENCEWATCHER_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include <vulkan/vulkan.hpp>
+
+namespace vks {
+// Waits for the fences of submissions on a thread of its own and calls back
+// as soon as each one has signaled, so the CPU learns when GPU work is done
+// without polling for it. Fences are waited for in the order they are
+// watched.
+class FenceWatcher {
+public:
+  // Called on the watcher thread
+  using Callback = std::function<void()>;
+
+  explicit FenceWatcher(vk::Device device);
+
+  // Waits for the fences still watched and calls back for them
+  ~FenceWatcher();
+
+  FenceWatcher(const FenceWatcher &) = delete;
+  FenceWatcher &operator=(const FenceWatcher &) = delete;
+
+  // Call callback once fence has signaled. The submission signaling fence
+  // has to be queued already. Nothing is called if the wait fails.
+  void watch(vk::Fence fence, Callback callback);
+
+  // Block until the watcher is done with fence, including its callback.
+  // Call before fence is reset or destroyed.
+  void release(vk::Fence fence);
+
+private:
+  struct Entry {
+    vk::Fence fence;
+    Callback callback;
+  };
+
+  void run();
+
+  // mMutex has to be held
+  bool isWatched(vk::Fence fence) const;
+
+  const vk::Device mDevice;
+  std::mutex mMutex;
+  std::condition_variable mChanged;
+  // The front entry is the one being waited for, it is removed once its
+  // callback has returned
+  std::deque<Entry> mEntries;
+  bool mStopping = false;
+  std::thread mThread;
+};
+} // namespace vks
+
+#endif // GAINVULKANSAMPLE_VULKANFENCEWATCHER_H
@@ -0,0 +1,707 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "VulkanFrameGraph.h"
+
+#include "VulkanDebug.h"
+#include <LogUtil.h>
+#include <algorithm>
+
+namespace vks {
+namespace {
+vk::ImageUsageFlags imageUsageFlags(ResourceUsage usage) {
+  switch (usage) {
+  case ResourceUsage::TransferSrc:
+    return vk::ImageUsageFlagBits::eTransferSrc;
+  case ResourceUsage::TransferDst:
+    return vk::ImageUsageFlagBits::eTransferDst;
+  case ResourceUsage::SampledFragment:
+  case ResourceUsage::SampledCompute:
+    return vk::ImageUsageFlagBits::eSampled;
+  case ResourceUsage::StorageReadCompute:
+  case ResourceUsage::StorageWriteCompute:
+    return vk::ImageUsageFlagBits::eStorage;
+  case ResourceUsage::ColorAttachment:
+    return vk::ImageUsageFlagBits::eColorAttachment;
+  case ResourceUsage::DepthStencilAttachment:
+    return vk::ImageUsageFlagBits::eDepthStencilAttachment;
+  default:
+    return {};
+  }
+}
+
+bool isAttachment(ResourceUsage usage) {
+  return usage == ResourceUsage::ColorAttachment ||
+         usage == ResourceUsage::DepthStencilAttachment;
+}
+} // namespace
+
+FrameGraph::FrameGraph(
+    const std::shared_ptr<vks::VulkanDeviceWrapper> deviceWrapper)
+    : mDeviceWrapper(deviceWrapper) {}
+
+FrameGraph::~FrameGraph() { destroyCompiled(); }
+
+FrameGraph::ResourceId FrameGraph::addResource(const char *name,
+                                               ResourceKind kind,
+                                               const ImageDesc &desc) {
+  Resource resource;
+  resource.name = name;
+  resource.kind = kind;
+  resource.desc = desc;
+  mResources.push_back(std::move(resource));
+  mCompiled = false;
+  return static_cast<ResourceId>(mResources.size() - 1);
+}
+
+FrameGraph::ResourceId FrameGraph::createImage(const char *name,
+                                               const ImageDesc &desc) {
+  return addResource(name, ResourceKind::eTransient, desc);
+}
+
+FrameGraph::ResourceId FrameGraph::importImage(const char *name) {
+  return importImage(name, ImageDesc());
+}
+
+FrameGraph::ResourceId FrameGraph::importImage(const char *name,
+                                               const ImageDesc &desc) {
+  return addResource(name, ResourceKind::eImportedImage, desc);
+}
+
+FrameGraph::ResourceId FrameGraph::importBuffer(const char *name) {
+  return addResource(name, ResourceKind::eImportedBuffer, ImageDesc());
+}
+
+void FrameGraph::setFinalUsage(ResourceId resource, ResourceUsage usage) {
+  mResources[resource].hasFinalUsage = true;
+  mResources[resource].finalUsage = usage;
+  mCompiled = false;
+}
+
+FrameGraph::PassId FrameGraph::addPass(const char *name, PassType type,
+                                       RecordFunction record) {
+  Pass pass;
+  pass.name = name;
+  pass.type = type;
+  pass.record = std::move(record);
+  mPasses.push_back(std::move(pass));
+  mCompiled = false;
+  return static_cast<PassId>(mPasses.size() - 1);
+}
+
+void FrameGraph::addAccess(PassId pass, ResourceId resource,
+                           ResourceUsage usage, bool write) {
+  for (const Access &access : mPasses[pass].accesses) {
+    if (access.resource == resource) {
+      LOGCATE("FrameGraph: %s accesses %s twice",
+              mPasses[pass].name.c_str(), mResources[resource].name.c_str());
+      return;
+    }
+  }
+  mPasses[pass].accesses.push_back({resource, usage, write});
+  mCompiled = false;
+}
+
+void FrameGraph::read(PassId pass, ResourceId resource, ResourceUsage usage) {
+  addAccess(pass, resource, usage, false);
+}
+
+void FrameGraph::write(PassId pass, ResourceId resource,
+                       ResourceUsage usage) {
+  addAccess(pass, resource, usage, true);
+}
+
+void FrameGraph::setClearColor(PassId pass, const vk::ClearColorValue &color) {
+  mPasses[pass].hasClearColor = true;
+  mPasses[pass].clearColor = color;
+  mCompiled = false;
+}
+
+bool FrameGraph::compile() {
+  destroyCompiled();
+
+  cull();
+  mOrder.clear();
+  for (PassId id = 0; id < mPasses.size(); id++) {
+    if (!mPasses[id].culled) {
+      mOrder.push_back(id);
+    }
+  }
+
+  if (!computeLifetimes() || !createTransients()) {
+    destroyCompiled();
+    return false;
+  }
+  for (size_t position = 0; position < mOrder.size(); position++) {
+    Pass &pass = mPasses[mOrder[position]];
+    if (pass.type == PassType::eGraphics &&
+        !createRenderPass(pass, static_cast<int>(position))) {
+      destroyCompiled();
+      return false;
+    }
+  }
+
+  mStats.passCount = static_cast<uint32_t>(mPasses.size());
+  mStats.culledPassCount =
+      static_cast<uint32_t>(mPasses.size() - mOrder.size());
+  LOGCATI("FrameGraph: %u of %u passes culled, %u transient images in %llu "
+          "of %llu bytes, %u of them in %llu lazily allocated bytes, %llu "
+          "bytes per execution not stored",
+          mStats.culledPassCount, mStats.passCount,
+          mStats.transientImageCount,
+          static_cast<unsigned long long>(mStats.aliasedBytes),
+          static_cast<unsigned long long>(mStats.transientBytes),
+          mStats.lazyImageCount,
+          static_cast<unsigned long long>(mStats.lazyBytes),
+          static_cast<unsigned long long>(mStats.skippedStoreBytes));
+  mCompiled = true;
+  return true;
+}
+
+void FrameGraph::cull() {
+  // Reference counting: a pass is needed while something reads what it
+  // writes. Passes whose writes nobody reads are culled, which may leave
+  // the passes they read from unread in turn.
+  for (auto &resource : mResources) {
+    resource.refCount = resource.hasFinalUsage ? 1 : 0;
+    resource.producers.clear();
+  }
+  for (PassId id = 0; id < mPasses.size(); id++) {
+    Pass &pass = mPasses[id];
+    pass.culled = false;
+    pass.refCount = 0;
+    for (const Access &access : pass.accesses) {
+      if (access.write) {
+        pass.refCount++;
+        mResources[access.resource].producers.push_back(id);
+      } else {
+        mResources[access.resource].refCount++;
+      }
+    }
+  }
+
+  std::vector<ResourceId> unread;
+  auto cullPass = [&](Pass &pass) {
+    pass.culled = true;
+    for (const Access &access : pass.accesses) {
+      if (!access.write && --mResources[access.resource].refCount == 0) {
+        unread.push_back(access.resource);
+      }
+    }
+  };
+  // Presenting is the purpose of a frame, present passes are never culled
+  for (auto &pass : mPasses) {
+    if (pass.refCount == 0 && pass.type != PassType::ePresent) {
+      cullPass(pass);
+    }
+  }
+  for (ResourceId id = 0; id < mResources.size(); id++) {
+    if (mResources[id].refCount == 0) {
+      unread.push_back(id);
+    }
+  }
+  while (!unread.empty()) {
+    const ResourceId id = unread.back();
+    unread.pop_back();
+    for (PassId producer : mResources[id].producers) {
+      Pass &pass = mPasses[producer];
+      if (!pass.culled && pass.type != PassType::ePresent &&
+          --pass.refCount == 0) {
+        cullPass(pass);
+      }
+    }
+  }
+}
+
+bool FrameGraph::computeLifetimes() {
+  for (auto &resource : mResources) {
+    resource.first = -1;
+    resource.last = -1;
+    resource.imageUsage = {};
+  }
+  for (auto &pass : mPasses) {
+    pass.firstUses.clear();
+    pass.lastUses.clear();
+  }
+
+  for (size_t position = 0; position < mOrder.size(); position++) {
+    const Pass &pass = mPasses[mOrder[position]];
+    for (const Access &access : pass.accesses) {
+      Resource &resource = mResources[access.resource];
+      if (resource.kind != ResourceKind::eTransient) {
+        continue;
+      }
+      if (resource.first < 0) {
+        if (!access.write) {
+          LOGCATE("FrameGraph: %s reads %s before anything writes it",
+                  pass.name.c_str(), resource.name.c_str());
+          return false;
+        }
+        resource.first = static_cast<int>(position);
+      }
+      resource.last = static_cast<int>(position);
+      resource.imageUsage |= imageUsageFlags(access.usage);
+    }
+  }
+
+  for (ResourceId id = 0; id < mResources.size(); id++) {
+    const Resource &resource = mResources[id];
+    if (resource.first >= 0) {
+      mPasses[mOrder[resource.first]].firstUses.push_back(id);
+      mPasses[mOrder[resource.last]].lastUses.push_back(id);
+    }
+  }
+  return true;
+}
+
+bool FrameGraph::createTransients() {
+  const vk::Device device = mDeviceWrapper->logicalDevice;
+  const auto &allocator = mDeviceWrapper->allocator;
+  mStats = Stats();
+
+  for (auto &resource : mResources) {
+    if (resource.kind != ResourceKind::eTransient || resource.first < 0) {
+      continue;
+    }
+    // Written and read by one render pass only, so its content never has to
+    // leave tile memory
+    const vk::ImageUsageFlags attachmentUsage =
+        vk::ImageUsageFlagBits::eColorAttachment |
+        vk::ImageUsageFlagBits::eDepthStencilAttachment;
+    const bool withinPass = resource.first == resource.last &&
+                            !(resource.imageUsage & ~attachmentUsage);
+
+    vk::ImageCreateInfo imageCreateInfo{};
+    imageCreateInfo.imageType = vk::ImageType::e2D;
+    imageCreateInfo.format = resource.desc.format;
+    imageCreateInfo.extent = vk::Extent3D{resource.desc.extent.width,
+                                          resource.desc.extent.height, 1};
+    imageCreateInfo.mipLevels = 1;
+    imageCreateInfo.arrayLayers = 1;
+    imageCreateInfo.samples = vk::SampleCountFlagBits::e1;
+    imageCreateInfo.tiling = vk::ImageTiling::eOptimal;
+    imageCreateInfo.usage = resource.imageUsage;
+    if (withinPass) {
+      imageCreateInfo.usage |= vk::ImageUsageFlagBits::eTransientAttachment;
+    }
+    imageCreateInfo.sharingMode = vk::SharingMode::eExclusive;
+    imageCreateInfo.initialLayout = vk::ImageLayout::eUndefined;
+    if (device.createImage(&imageCreateInfo, nullptr, &resource.image) !=
+        vk::Result::eSuccess) {
+      LOGCATE("FrameGraph: failed to create %s", resource.name.c_str());
+      return false;
+    }
+    vks::debug::setImageName(device, resource.image, resource.name.c_str());
+    device.getImageMemoryRequirements(resource.image, &resource.requirements);
+    mStats.transientImageCount++;
+    mStats.transientBytes += resource.requirements.size;
+
+    if (withinPass &&
+        allocator->hasMemoryType(
+            resource.requirements.memoryTypeBits,
+            vk::MemoryPropertyFlagBits::eLazilyAllocated)) {
+      resource.lazyAllocation = allocator->allocate(
+          resource.requirements, vk::MemoryPropertyFlagBits::eLazilyAllocated,
+          MemoryAllocator::Tiling::eOptimal);
+      if (resource.lazyAllocation) {
+        device.bindImageMemory(resource.image,
+                               resource.lazyAllocation.memory,
+                               resource.lazyAllocation.offset);
+        mStats.lazyImageCount++;
+        mStats.lazyBytes += resource.requirements.size;
+      }
+    }
+  }
+
+  assignBuckets();
+
+  for (auto &bucket : mBuckets) {
+    bucket.allocation = allocator->allocate(
+        bucket.requirements, vk::MemoryPropertyFlagBits::eDeviceLocal,
+        MemoryAllocator::Tiling::eOptimal);
+    if (!bucket.allocation) {
+      LOGCATE("FrameGraph: failed to allocate %llu bytes of transient memory",
+              static_cast<unsigned long long>(bucket.requirements.size));
+      return false;
+    }
+    mStats.aliasedBytes += bucket.requirements.size;
+
+    for (ResourceId id : bucket.members) {
+      device.bindImageMemory(mResources[id].image, bucket.allocation.memory,
+                             bucket.allocation.offset);
+    }
+  }
+
+  for (auto &resource : mResources) {
+    if (resource.kind != ResourceKind::eTransient || !resource.image) {
+      continue;
+    }
+    vk::ImageViewCreateInfo viewCreateInfo{};
+    viewCreateInfo.image = resource.image;
+    viewCreateInfo.viewType = vk::ImageViewType::e2D;
+    viewCreateInfo.format = resource.desc.format;
+    viewCreateInfo.subresourceRange = {formatAspectMask(resource.desc.format),
+                                       0, 1, 0, 1};
+    if (device.createImageView(&viewCreateInfo, nullptr, &resource.view) !=
+        vk::Result::eSuccess) {
+      LOGCATE("FrameGraph: failed to create the view of %s",
+              resource.name.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+void FrameGraph::assignBuckets() {
+  std::vector<ResourceId> transients;
+  for (ResourceId id = 0; id < mResources.size(); id++) {
+    const Resource &resource = mResources[id];
+    if (resource.kind == ResourceKind::eTransient && resource.image &&
+        !resource.lazyAllocation) {
+      transients.push_back(id);
+    }
+  }
+  // Largest first, so smaller images fill the memory of larger ones
+  std::stable_sort(transients.begin(), transients.end(),
+                   [this](ResourceId a, ResourceId b) {
+                     return mResources[a].requirements.size >
+                            mResources[b].requirements.size;
+                   });
+
+  for (ResourceId id : transients) {
+    Resource &resource = mResources[id];
+    auto overlaps = [&](ResourceId other) {
+      return resource.first <= mResources[other].last &&
+             mResources[other].first <= resource.last;
+    };
+    Bucket *target = nullptr;
+    for (auto &bucket : mBuckets) {
+      if ((bucket.requirements.memoryTypeBits &
+           resource.requirements.memoryTypeBits) != 0 &&
+          std::none_of(bucket.members.begin(), bucket.members.end(),
+                       overlaps)) {
+        target = &bucket;
+        break;
+      }
+    }
+    if (target == nullptr) {
+      mBuckets.emplace_back();
+      target = &mBuckets.back();
+      target->requirements = resource.requirements;
+    }
+    target->requirements.size =
+        std::max(target->requirements.size, resource.requirements.size);
+    target->requirements.alignment = std::max(
+        target->requirements.alignment, resource.requirements.alignment);
+    target->requirements.memoryTypeBits &=
+        resource.requirements.memoryTypeBits;
+    target->members.push_back(id);
+    resource.bucket = static_cast<uint32_t>(target - mBuckets.data());
+  }
+}
+
+bool FrameGraph::createRenderPass(Pass &pass, int position) {
+  std::vector<vk::AttachmentDescription> attachments;
+  std::vector<vk::AttachmentReference> colorReferences;
+  vk::AttachmentReference depthReference;
+  bool hasDepth = false;
+
+  for (const Access &access : pass.accesses) {
+    if (!access.write || !isAttachment(access.usage)) {
+      continue;
+    }
+    const Resource &resource = mResources[access.resource];
+    if (resource.desc.format == vk::Format::eUndefined) {
+      LOGCATE("FrameGraph: %s renders into %s, which has no format",
+              pass.name.c_str(), resource.name.c_str());
+      return false;
+    }
+    // Imported images and transients an earlier pass wrote have content
+    // worth loading, and only those a later pass reads are worth storing
+    const bool transient = resource.kind == ResourceKind::eTransient;
+    const bool hasContent = !transient || resource.first < position;
+    const bool storeContent = !transient || resource.last > position;
+    const vk::ImageLayout layout = usageScope(access.usage).layout;
+
+    vk::AttachmentDescription attachment{};
+    attachment.format = resource.desc.format;
+    attachment.samples = vk::SampleCountFlagBits::e1;
+    attachment.storeOp = storeContent ? vk::AttachmentStoreOp::eStore
+                                      : vk::AttachmentStoreOp::eDontCare;
+    if (!storeContent) {
+      mStats.skippedStoreBytes += resource.requirements.size;
+    }
+    // The barriers around the pass do the layout transitions
+    attachment.initialLayout = layout;
+    attachment.finalLayout = layout;
+
+    attachment.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
+    attachment.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
+
+    vk::ClearValue clearValue;
+    const vk::AttachmentReference reference{
+        static_cast<uint32_t>(attachments.size()), layout};
+    if (access.usage == ResourceUsage::ColorAttachment) {
+      attachment.loadOp = pass.hasClearColor ? vk::AttachmentLoadOp::eClear
+                          : hasContent       ? vk::AttachmentLoadOp::eLoad
+                                             : vk::AttachmentLoadOp::eDontCare;
+      clearValue.color = pass.clearColor;
+      colorReferences.push_back(reference);
+    } else {
+      attachment.loadOp = hasContent ? vk::AttachmentLoadOp::eLoad
+                                     : vk::AttachmentLoadOp::eClear;
+      // Stencil follows depth where the format has it
+      if (formatAspectMask(resource.desc.format) &
+          vk::ImageAspectFlagBits::eStencil) {
+        attachment.stencilLoadOp = attachment.loadOp;
+        attachment.stencilStoreOp = attachment.storeOp;
+      }
+      clearValue.depthStencil = vk::ClearDepthStencilValue{1.0f, 0};
+      depthReference = reference;
+      hasDepth = true;
+    }
+    attachments.push_back(attachment);
+    pass.attachments.push_back(access.resource);
+    pass.clearValues.push_back(clearValue);
+  }
+  if (attachments.empty()) {
+    LOGCATE("FrameGraph: graphics pass %s has no attachments",
+            pass.name.c_str());
+    return false;
+  }
+
+  vk::SubpassDescription subpass{};
+  subpass.pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
+  subpass.colorAttachmentCount =
+      static_cast<uint32_t>(colorReferences.size());
+  subpass.pColorAttachments = colorReferences.data();
+  subpass.pDepthStencilAttachment = hasDepth ? &depthReference : nullptr;
+
+  vk::RenderPassCreateInfo renderPassInfo{};
+  renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+  renderPassInfo.pAttachments = attachments.data();
+  renderPassInfo.subpassCount = 1;
+  renderPassInfo.pSubpasses = &subpass;
+  if (mDeviceWrapper->logicalDevice.createRenderPass(
+          &renderPassInfo, nullptr, &pass.renderPass) !=
+      vk::Result::eSuccess) {
+    LOGCATE("FrameGraph: failed to create the render pass of %s",
+            pass.name.c_str());
+    return false;
+  }
+  vks::debug::setRenderPassName(mDeviceWrapper->logicalDevice,
+                                pass.renderPass, pass.name.c_str());
+  return true;
+}
+
+vk::Extent2D FrameGraph::extent(const Resource &resource) const {
+  if (resource.boundImage != nullptr) {
+    return {resource.boundImage->width(), resource.boundImage->height()};
+  }
+  return resource.desc.extent;
+}
+
+vk::Framebuffer FrameGraph::framebuffer(const Pass &pass) {
+  std::vector<VkImageView> views;
+  for (ResourceId id : pass.attachments) {
+    const Resource &resource = mResources[id];
+    views.push_back(resource.boundImage != nullptr
+                        ? resource.boundImage->getImageViewHandle()
+                        : resource.view);
+  }
+  auto key = std::make_pair(static_cast<VkRenderPass>(pass.renderPass),
+                            std::move(views));
+  auto it = mFramebuffers.find(key);
+  if (it != mFramebuffers.end()) {
+    return it->second;
+  }
+
+  const vk::Extent2D size = extent(mResources[pass.attachments[0]]);
+  std::vector<vk::ImageView> attachments(key.second.begin(),
+                                         key.second.end());
+  vk::FramebufferCreateInfo framebufferInfo{};
+  framebufferInfo.renderPass = pass.renderPass;
+  framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+  framebufferInfo.pAttachments = attachments.data();
+  framebufferInfo.width = size.width;
+  framebufferInfo.height = size.height;
+  framebufferInfo.layers = 1;
+  vk::Framebuffer framebuffer;
+  CALL_VK(mDeviceWrapper->logicalDevice.createFramebuffer(
+      &framebufferInfo, nullptr, &framebuffer));
+  mFramebuffers.emplace(std::move(key), framebuffer);
+  return framebuffer;
+}
+
+void FrameGraph::bindImage(ResourceId resource, gain::Image *image) {
+  mResources[resource].boundImage = image;
+  mResources[resource].image = image->getImageHandle();
+  mResources[resource].view = image->getImageViewHandle();
+}
+
+void FrameGraph::bindImage(ResourceId resource, vk::Image image,
+                           vk::ImageView view, const ResourceState &state) {
+  mResources[resource].boundImage = nullptr;
+  mResources[resource].image = image;
+  mResources[resource].view = view;
+  mResources[resource].state = state;
+}
+
+void FrameGraph::bindBuffer(ResourceId resource, vk::Buffer buffer,
+                            const ResourceState &state) {
+  mResources[resource].buffer = buffer;
+  mResources[resource].state = state;
+}
+
+void FrameGraph::releaseView(vk::ImageView view) {
+  const VkImageView handle = view;
+  for (auto it = mFramebuffers.begin(); it != mFramebuffers.end();) {
+    const std::vector<VkImageView> &views = it->first.second;
+    if (std::find(views.begin(), views.end(), handle) != views.end()) {
+      mDeviceWrapper->logicalDevice.destroyFramebuffer(it->second, nullptr);
+      it = mFramebuffers.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void FrameGraph::transition(BarrierBatch &batch, Resource &resource,
+                            ResourceUsage usage) {
+  if (resource.boundImage != nullptr) {
+    resource.boundImage->transition(batch, usage);
+  } else if (resource.kind == ResourceKind::eImportedBuffer) {
+    batch.buffer(resource.buffer, resource.state, usage);
+  } else {
+    const vk::ImageSubresourceRange range{
+        formatAspectMask(resource.desc.format), 0, 1, 0, 1};
+    batch.image(resource.image, range, resource.state, usage);
+  }
+}
+
+void FrameGraph::execute(vk::CommandBuffer cmd) {
+  if (!mCompiled) {
+    LOGCATE("FrameGraph: execute before compile");
+    return;
+  }
+
+  for (PassId id : mOrder) {
+    Pass &pass = mPasses[id];
+
+    // The memory of a transient was last used by another image of its
+    // bucket, or by the image itself in the previous execution. Its content
+    // is discarded, but the new use has to wait for the old one.
+    for (ResourceId resourceId : pass.firstUses) {
+      Resource &resource = mResources[resourceId];
+      if (resource.bucket != kNoBucket) {
+        resource.state = mBuckets[resource.bucket].tail;
+      }
+      resource.state.layout = vk::ImageLayout::eUndefined;
+      resource.state.queueFamily = VK_QUEUE_FAMILY_IGNORED;
+    }
+
+    if (pass.type != PassType::eImport) {
+      BarrierBatch batch(*mDeviceWrapper);
+      for (const Access &access : pass.accesses) {
+        transition(batch, mResources[access.resource], access.usage);
+      }
+      batch.record(cmd);
+    }
+
+    if (pass.type != PassType::ePresent) {
+      GpuProfileScope scope(mProfiler, cmd, pass.name.c_str());
+      if (pass.type == PassType::eGraphics) {
+        vk::RenderPassBeginInfo beginInfo{};
+        beginInfo.renderPass = pass.renderPass;
+        beginInfo.framebuffer = framebuffer(pass);
+        beginInfo.renderArea.extent = extent(mResources[pass.attachments[0]]);
+        beginInfo.clearValueCount =
+            static_cast<uint32_t>(pass.clearValues.size());
+        beginInfo.pClearValues = pass.clearValues.data();
+        cmd.beginRenderPass(&beginInfo, vk::SubpassContents::eInline);
+      }
+      if (pass.record) {
+        pass.record(cmd);
+      }
+      if (pass.type == PassType::eGraphics) {
+        cmd.endRenderPass();
+      }
+    }
+
+    for (ResourceId resourceId : pass.lastUses) {
+      Resource &resource = mResources[resourceId];
+      if (resource.bucket != kNoBucket) {
+        mBuckets[resource.bucket].tail = resource.state;
+      }
+    }
+  }
+
+  BarrierBatch batch(*mDeviceWrapper);
+  for (auto &resource : mResources) {
+    if (resource.hasFinalUsage && resource.kind != ResourceKind::eTransient) {
+      transition(batch, resource, resource.finalUsage);
+    }
+  }
+  batch.record(cmd);
+}
+
+void FrameGraph::destroyCompiled() {
+  const vk::Device device = mDeviceWrapper->logicalDevice;
+  for (auto &framebuffer : mFramebuffers) {
+    device.destroyFramebuffer(framebuffer.second, nullptr);
+  }
+  mFramebuffers.clear();
+
+  for (auto &pass : mPasses) {
+    if (pass.renderPass) {
+      device.destroyRenderPass(pass.renderPass, nullptr);
+      pass.renderPass = nullptr;
+    }
+    pass.attachments.clear();
+    pass.clearValues.clear();
+  }
+
+  for (auto &resource : mResources) {
+    if (resource.kind != ResourceKind::eTransient) {
+      continue;
+    }
+    if (resource.view) {
+      device.destroyImageView(resource.view, nullptr);
+      resource.view = nullptr;
+    }
+    if (resource.image) {
+      device.destroyImage(resource.image, nullptr);
+      resource.image = nullptr;
+    }
+    mDeviceWrapper->allocator->free(resource.lazyAllocation);
+    resource.bucket = kNoBucket;
+    resource.state = ResourceState();
+  }
+  for (auto &bucket : mBuckets) {
+    mDeviceWrapper->allocator->free(bucket.allocation);
+  }
+  mBuckets.clear();
+  mCompiled = false;
+}
+} // namespace vks
@@ -0,0 +1,274 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef GAINVULKANSAMPLE_VULKANFRAMEGRAPH_H
+#define GAINVULKANSAMPLE_VULKANFRAMEGRAPH_H
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "VulkanBarriers.h"
+#include "VulkanDeviceWrapper.hpp"
+#include "VulkanGpuProfiler.h"
+#include "VulkanImageWrapper.h"
+
+namespace vks {
+// The passes of a frame and the resources they read and write, declared
+// once by an engine instead of hand-built render passes, frame buffers and
+// barriers.
+//
+// compile culls passes whose results nobody uses, creates the transient
+// images and lets those whose lifetimes don't overlap share memory, and
+// creates a render pass for every graphics pass. Attachments nobody reads
+// after their pass are not stored, and transients that only live within one
+// render pass stay in tile memory where the device allows. execute then
+// records the passes in declaration order, which is their dependency order,
+// each behind the barriers its accesses need. Resource states carry over
+// from one execution to the next, so executions on the same queue are
+// ordered as well.
+class FrameGraph {
+public:
+  using ResourceId = uint32_t;
+  using PassId = uint32_t;
+
+  enum class PassType {
+    // Brings imported resources into the graph, e.g. acquires the camera
+    // image. Records no barriers, the callback leaves its writes in their
+    // tracked state.
+    eImport,
+    eCompute,
+    // Runs inside a render pass with the color and depth attachments it
+    // writes
+    eGraphics,
+    eCopy,
+    // Transitions the resource it reads for presenting, has no callback
+    ePresent,
+  };
+
+  using RecordFunction = std::function<void(vk::CommandBuffer cmd)>;
+
+  struct ImageDesc {
+    vk::Format format = vk::Format::eUndefined;
+    vk::Extent2D extent;
+  };
+
+  struct Stats {
+    uint32_t passCount = 0;
+    uint32_t culledPassCount = 0;
+    uint32_t transientImageCount = 0;
+    // Memory the transient images would take without aliasing, and the
+    // memory they take
+    vk::DeviceSize transientBytes = 0;
+    vk::DeviceSize aliasedBytes = 0;
+    // Transients that live within one render pass and are backed by lazily
+    // allocated memory, which tilers never commit. Not part of aliasedBytes.
+    uint32_t lazyImageCount = 0;
+    vk::DeviceSize lazyBytes = 0;
+    // Attachment bytes per execution not written back to memory because
+    // nothing reads them after their pass
+    vk::DeviceSize skippedStoreBytes = 0;
+  };
+
+  explicit FrameGraph(
+      const std::shared_ptr<vks::VulkanDeviceWrapper> deviceWrapper);
+
+  // The GPU must be done with every execution
+  ~FrameGraph();
+
+  // An image created and owned by the graph, only valid between the first
+  // and the last pass that use it
+  ResourceId createImage(const char *name, const ImageDesc &desc);
+
+  // An image owned by the caller, bound before every execution. desc is
+  // only needed if a graphics pass renders into it.
+  ResourceId importImage(const char *name);
+  ResourceId importImage(const char *name, const ImageDesc &desc);
+
+  // A buffer owned by the caller, bound before every execution
+  ResourceId importBuffer(const char *name);
+
+  // Leave the resource in usage after the execution, e.g. HostRead. Passes
+  // that contribute to it are never culled.
+  void setFinalUsage(ResourceId resource, ResourceUsage usage);
+
+  PassId addPass(const char *name, PassType type,
+                 RecordFunction record = nullptr);
+
+  // Declare an access of pass to resource. A pass accesses each resource
+  // once, a write may read as well, e.g. ColorAttachment.
+  void read(PassId pass, ResourceId resource, ResourceUsage usage);
+  void write(PassId pass, ResourceId resource, ResourceUsage usage);
+
+  // Color attachments of the graphics pass are cleared to color instead of
+  // loaded
+  void setClearColor(PassId pass, const vk::ClearColorValue &color);
+
+  // Cull, create the transient images and render passes. Call again after
+  // the declared images changed, e.g. their size, with the GPU idle.
+  bool compile();
+
+  // Bind an imported image for the next executions. The graph tracks the
+  // state of a gain::Image in the image itself.
+  void bindImage(ResourceId resource, gain::Image *image);
+
+  // Raw images start from state, e.g. a swap chain image acquired with a
+  // semaphore the submission waits on at eColorAttachmentOutput
+  void bindImage(ResourceId resource, vk::Image image, vk::ImageView view,
+                 const ResourceState &state);
+
+  void bindBuffer(ResourceId resource, vk::Buffer buffer,
+                  const ResourceState &state = ResourceState());
+
+  // Destroy the frame buffers made with view. Call before a view that was
+  // bound is destroyed, e.g. when an image cache retires an import: frame
+  // buffers are cached by view handle, and the driver may hand the same
+  // handle to a new view. The GPU must be done with the executions that
+  // used them.
+  void releaseView(vk::ImageView view);
+
+  // Record the passes that were not culled into cmd
+  void execute(vk::CommandBuffer cmd);
+
+  // Open a GPU profiler scope named after the pass around every pass
+  void setProfiler(GpuProfiler *profiler) { mProfiler = profiler; }
+
+  bool isCulled(PassId pass) const { return mPasses[pass].culled; }
+
+  const Stats &stats() const { return mStats; }
+
+private:
+  enum class ResourceKind { eTransient, eImportedImage, eImportedBuffer };
+
+  struct Access {
+    ResourceId resource;
+    ResourceUsage usage;
+    bool write;
+  };
+
+  struct Pass {
+    std::string name;
+    PassType type;
+    RecordFunction record;
+    std::vector<Access> accesses;
+    bool hasClearColor = false;
+    vk::ClearColorValue clearColor;
+
+    // Set by compile
+    bool culled = false;
+    uint32_t refCount = 0;
+    vk::RenderPass renderPass = nullptr;
+    std::vector<ResourceId> attachments;
+    std::vector<vk::ClearValue> clearValues;
+    // Transients whose lifetime starts or ends with the pass
+    std::vector<ResourceId> firstUses;
+    std::vector<ResourceId> lastUses;
+  };
+
+  struct Resource {
+    std::string name;
+    ResourceKind kind;
+    ImageDesc desc;
+    bool hasFinalUsage = false;
+    ResourceUsage finalUsage = ResourceUsage::Undefined;
+
+    // Bound or created handles
+    gain::Image *boundImage = nullptr;
+    vk::Image image = nullptr;
+    vk::ImageView view = nullptr;
+    vk::Buffer buffer = nullptr;
+    // Tracked here unless boundImage tracks it
+    ResourceState state;
+
+    // Set by compile
+    uint32_t refCount = 0;
+    // Passes that write the resource
+    std::vector<PassId> producers;
+    // Positions of the first and last pass using it in mOrder
+    int first = -1;
+    int last = -1;
+    vk::ImageUsageFlags imageUsage;
+    vk::MemoryRequirements requirements;
+    uint32_t bucket = kNoBucket;
+    // Lazily allocated memory of its own instead of a bucket
+    vks::Allocation lazyAllocation;
+  };
+
+  // Memory shared by transient images with disjoint lifetimes
+  struct Bucket {
+    vks::Allocation allocation;
+    vk::MemoryRequirements requirements;
+    std::vector<ResourceId> members;
+    // State of the memory after the last use of the member used last
+    ResourceState tail;
+  };
+
+  static constexpr uint32_t kNoBucket = ~0u;
+
+  ResourceId addResource(const char *name, ResourceKind kind,
+                         const ImageDesc &desc);
+
+  void addAccess(PassId pass, ResourceId resource, ResourceUsage usage,
+                 bool write);
+
+  void cull();
+
+  bool computeLifetimes();
+
+  bool createTransients();
+
+  void assignBuckets();
+
+  bool createRenderPass(Pass &pass, int position);
+
+  vk::Framebuffer framebuffer(const Pass &pass);
+
+  vk::Extent2D extent(const Resource &resource) const;
+
+  // Add the barrier resource needs before usage to batch
+  void transition(BarrierBatch &batch, Resource &resource,
+                  ResourceUsage usage);
+
+  // Destroy what compile created
+  void destroyCompiled();
+
+  const std::shared_ptr<vks::VulkanDeviceWrapper> mDeviceWrapper;
+  std::vector<Pass> mPasses;
+  std::vector<Resource> mResources;
+  std::vector<Bucket> mBuckets;
+  // Passes that were not culled, in execution order
+  std::vector<PassId> mOrder;
+  // Frame buffers by render pass and attachment views, until compile or
+  // releaseView
+  std::map<std::pair<VkRenderPass, std::vector<VkImageView>>, vk::Framebuffer>
+      mFramebuffers;
+  GpuProfiler *mProfiler = nullptr;
+  bool mCompiled = false;
+  Stats mStats;
+};
+} // namespace vks
+
+#endif // GAINVULKANSAMPLE_VULKANFRAMEGRAPH_H
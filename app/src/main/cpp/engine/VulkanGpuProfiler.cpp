@@ -0,0 +1,206 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "VulkanGpuProfiler.h"
+
+#include <LogUtil.h>
+#include <algorithm>
+#include <cmath>
+
+namespace vks {
+std::unique_ptr<GpuProfiler>
+GpuProfiler::create(const std::shared_ptr<vks::VulkanDeviceWrapper> deviceWrapper,
+                    uint32_t queueFamilyIndex, uint32_t frameCount,
+                    uint32_t maxScopesPerFrame) {
+  if (queueFamilyIndex >= deviceWrapper->queueFamilyProperties.size()) {
+    return nullptr;
+  }
+  const uint32_t validBits =
+      deviceWrapper->queueFamilyProperties[queueFamilyIndex].timestampValidBits;
+  if (validBits == 0 ||
+      deviceWrapper->properties.limits.timestampPeriod <= 0.0f) {
+    LOGCATI("GpuProfiler: queue family %u has no timestamps",
+            queueFamilyIndex);
+    return nullptr;
+  }
+  auto profiler = std::make_unique<GpuProfiler>(deviceWrapper, validBits,
+                                                frameCount, maxScopesPerFrame);
+  return profiler->initialize() ? std::move(profiler) : nullptr;
+}
+
+GpuProfiler::GpuProfiler(
+    const std::shared_ptr<vks::VulkanDeviceWrapper> deviceWrapper,
+    uint32_t timestampValidBits, uint32_t frameCount,
+    uint32_t maxScopesPerFrame)
+    : mDeviceWrapper(deviceWrapper),
+      mTimestampPeriod(deviceWrapper->properties.limits.timestampPeriod),
+      mTimestampMask(timestampValidBits >= 64
+                         ? UINT64_MAX
+                         : (uint64_t(1) << timestampValidBits) - 1),
+      mMaxScopes(maxScopesPerFrame), mFrames(frameCount) {}
+
+GpuProfiler::~GpuProfiler() {
+  for (auto &frame : mFrames) {
+    if (frame.queryPool) {
+      mDeviceWrapper->logicalDevice.destroyQueryPool(frame.queryPool);
+    }
+  }
+}
+
+bool GpuProfiler::initialize() {
+  vk::QueryPoolCreateInfo queryPoolInfo{};
+  queryPoolInfo.queryType = vk::QueryType::eTimestamp;
+  queryPoolInfo.queryCount = mMaxScopes * 2;
+  for (auto &frame : mFrames) {
+    if (mDeviceWrapper->logicalDevice.createQueryPool(
+            &queryPoolInfo, nullptr, &frame.queryPool) !=
+        vk::Result::eSuccess) {
+      LOGCATE("GpuProfiler: failed to create a query pool");
+      return false;
+    }
+    frame.scopes.reserve(mMaxScopes);
+  }
+  // A timestamp and its availability per query
+  mResults.resize(mMaxScopes * 4);
+  return true;
+}
+
+void GpuProfiler::beginFrame(vk::CommandBuffer cmd, uint32_t frame) {
+  assert(frame < mFrames.size());
+  collect(frame);
+  mCurrentFrame = frame;
+  cmd.resetQueryPool(mFrames[frame].queryPool, 0, mMaxScopes * 2);
+}
+
+uint32_t GpuProfiler::beginScope(vk::CommandBuffer cmd, const char *name) {
+  if (mCurrentFrame == kNoScope) {
+    return kNoScope;
+  }
+  Frame &frame = mFrames[mCurrentFrame];
+  if (frame.scopes.size() == mMaxScopes) {
+    return kNoScope;
+  }
+  const uint32_t scope = static_cast<uint32_t>(frame.scopes.size());
+  frame.scopes.push_back(name);
+  cmd.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, frame.queryPool,
+                     scope * 2);
+  return scope;
+}
+
+void GpuProfiler::endScope(vk::CommandBuffer cmd, uint32_t scope) {
+  if (scope == kNoScope) {
+    return;
+  }
+  cmd.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe,
+                     mFrames[mCurrentFrame].queryPool, scope * 2 + 1);
+}
+
+void GpuProfiler::collect(uint32_t frame) {
+  Frame &slot = mFrames[frame];
+  if (slot.scopes.empty()) {
+    return;
+  }
+
+  // The frame's fence has signaled, so nothing is waited on. Scopes left
+  // open or never submitted come back unavailable and are skipped.
+  const uint32_t queryCount = static_cast<uint32_t>(slot.scopes.size()) * 2;
+  const vk::Result result = mDeviceWrapper->logicalDevice.getQueryPoolResults(
+      slot.queryPool, 0, queryCount, queryCount * 2 * sizeof(uint64_t),
+      mResults.data(), 2 * sizeof(uint64_t),
+      vk::QueryResultFlagBits::e64 |
+          vk::QueryResultFlagBits::eWithAvailability);
+  if (result == vk::Result::eSuccess || result == vk::Result::eNotReady) {
+    for (size_t i = 0; i < slot.scopes.size(); i++) {
+      const uint64_t *begin = &mResults[i * 4];
+      const uint64_t *end = begin + 2;
+      if (begin[1] == 0 || end[1] == 0) {
+        continue;
+      }
+      const uint64_t ticks = (end[0] - begin[0]) & mTimestampMask;
+      addSample(slot.scopes[i], ticks * mTimestampPeriod / 1e6);
+    }
+  }
+  slot.scopes.clear();
+}
+
+void GpuProfiler::addSample(const char *name, double ms) {
+  std::lock_guard<std::mutex> lock(mPassesMutex);
+  auto it = mPassIndices.find(name);
+  if (it == mPassIndices.end()) {
+    it = mPassIndices.emplace(name, mPasses.size()).first;
+    mPasses.push_back({name, {}, 0});
+    mPasses.back().window.reserve(kWindowSize);
+  }
+
+  Pass &pass = mPasses[it->second];
+  if (pass.window.size() < kWindowSize) {
+    pass.window.push_back(static_cast<float>(ms));
+  } else {
+    pass.window[pass.next] = static_cast<float>(ms);
+    pass.next = (pass.next + 1) % kWindowSize;
+  }
+}
+
+std::vector<GpuProfiler::PassStats> GpuProfiler::passStats() const {
+  std::vector<PassStats> stats;
+  std::vector<float> sorted;
+  std::lock_guard<std::mutex> lock(mPassesMutex);
+  stats.reserve(mPasses.size());
+  for (const auto &pass : mPasses) {
+    sorted.assign(pass.window.begin(), pass.window.end());
+    std::sort(sorted.begin(), sorted.end());
+
+    PassStats passStats;
+    passStats.name = pass.name;
+    passStats.samples = static_cast<uint32_t>(sorted.size());
+    double sum = 0.0;
+    for (float ms : sorted) {
+      sum += ms;
+    }
+    passStats.minMs = sorted.front();
+    passStats.avgMs = sum / sorted.size();
+    // Nearest rank
+    const size_t rank = static_cast<size_t>(std::ceil(0.99 * sorted.size()));
+    passStats.p99Ms = sorted[std::max<size_t>(rank, 1) - 1];
+    stats.push_back(std::move(passStats));
+  }
+  return stats;
+}
+
+GpuProfileScope::GpuProfileScope(GpuProfiler *profiler, vk::CommandBuffer cmd,
+                                 const char *name, glm::vec4 color)
+    : mProfiler(profiler), mCmd(cmd) {
+  vks::debug::beginRegion(cmd, name, color);
+  if (mProfiler) {
+    mScope = mProfiler->beginScope(cmd, name);
+  }
+}
+
+GpuProfileScope::~GpuProfileScope() {
+  if (mProfiler) {
+    mProfiler->endScope(mCmd, mScope);
+  }
+  vks::debug::endRegion(mCmd);
+}
+} // namespace vks
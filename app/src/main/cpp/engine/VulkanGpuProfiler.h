@@ -0,0 +1,144 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef GAINVULKANSAMPLE_VULKANGPUPROFILER_H
+#define GAINVULKANSAMPLE_VULKANGPUPROFILER_H
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "VulkanDeviceWrapper.hpp"
+
+namespace vks {
+// Times passes on the GPU with timestamp queries. There is a query pool per
+// frame slot, used round robin like the slot itself. A frame's timestamps
+// are read back without waiting when its slot comes round again, the slot's
+// fence has signaled by then. Every pass keeps a rolling window of its
+// durations, see passStats.
+class GpuProfiler {
+public:
+  // Returned by beginScope if the frame has no queries left
+  static constexpr uint32_t kNoScope = UINT32_MAX;
+
+  struct PassStats {
+    std::string name;
+    // Durations in the window, in milliseconds
+    uint32_t samples = 0;
+    double minMs = 0.0;
+    double avgMs = 0.0;
+    double p99Ms = 0.0;
+  };
+
+  // nullptr if the queue family has no timestamp support
+  static std::unique_ptr<GpuProfiler>
+  create(const std::shared_ptr<vks::VulkanDeviceWrapper> deviceWrapper,
+         uint32_t queueFamilyIndex, uint32_t frameCount,
+         uint32_t maxScopesPerFrame = 32);
+
+  // Prefer GpuProfiler::create
+  GpuProfiler(const std::shared_ptr<vks::VulkanDeviceWrapper> deviceWrapper,
+              uint32_t timestampValidBits, uint32_t frameCount,
+              uint32_t maxScopesPerFrame);
+
+  ~GpuProfiler();
+
+  // Start the timestamps of frame. Everything submitted for the frame's
+  // previous use must have finished, its results are collected here. Records
+  // the reset of the frame's queries into cmd, outside of a render pass.
+  void beginFrame(vk::CommandBuffer cmd, uint32_t frame);
+
+  // Write the start timestamp of a pass named name, which must outlive the
+  // frame, e.g. a string literal. The end may be recorded into a later
+  // command buffer of the same queue.
+  uint32_t beginScope(vk::CommandBuffer cmd, const char *name);
+
+  void endScope(vk::CommandBuffer cmd, uint32_t scope);
+
+  // Rolling statistics of every pass seen so far. Can be called from any
+  // thread.
+  std::vector<PassStats> passStats() const;
+
+private:
+  bool initialize();
+
+  void collect(uint32_t frame);
+
+  void addSample(const char *name, double ms);
+
+  // Durations kept per pass
+  static constexpr uint32_t kWindowSize = 120;
+
+  const std::shared_ptr<vks::VulkanDeviceWrapper> mDeviceWrapper;
+  // Nanoseconds per timestamp tick
+  const double mTimestampPeriod;
+  const uint64_t mTimestampMask;
+  const uint32_t mMaxScopes;
+
+  struct Frame {
+    vk::QueryPool queryPool = nullptr;
+    // Name of each scope written, its queries are 2 * index and the next
+    std::vector<const char *> scopes;
+  };
+  std::vector<Frame> mFrames;
+  // Frame beginScope writes into, kNoScope before the first beginFrame
+  uint32_t mCurrentFrame = kNoScope;
+
+  std::vector<uint64_t> mResults;
+
+  struct Pass {
+    std::string name;
+    std::vector<float> window;
+    // Next window entry to overwrite once the window is full
+    uint32_t next = 0;
+  };
+  std::vector<Pass> mPasses;
+  std::unordered_map<std::string, size_t> mPassIndices;
+  mutable std::mutex mPassesMutex;
+};
+
+// Times cmd's commands from construction to destruction as the pass name,
+// and marks them as a debug region of the same name. profiler may be
+// nullptr, then only the region is recorded.
+class GpuProfileScope {
+public:
+  GpuProfileScope(GpuProfiler *profiler, vk::CommandBuffer cmd,
+                  const char *name,
+                  glm::vec4 color = glm::vec4(0.2f, 0.6f, 1.0f, 1.0f));
+
+  ~GpuProfileScope();
+
+  GpuProfileScope(const GpuProfileScope &) = delete;
+  GpuProfileScope &operator=(const GpuProfileScope &) = delete;
+
+private:
+  GpuProfiler *const mProfiler;
+  const vk::CommandBuffer mCmd;
+  uint32_t mScope = GpuProfiler::kNoScope;
+};
+} // namespace vks
+
+#endif // GAINVULKANSAMPLE_VULKANGPUPROFILER_H
@@ -0,0 +1,125 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "VulkanImageCache.h"
+
+#include <LogUtil.h>
+
+namespace gain {
+ImageCache::ImageCache(
+    const std::shared_ptr<vks::VulkanDeviceWrapper> deviceWrapper,
+    vk::Queue queue, const Image::ImageBasicInfo &imageInfo, uint32_t capacity)
+    : mDeviceWrapper(deviceWrapper), mVkQueue(queue), mImageInfo(imageInfo),
+      mCapacity(std::max<uint32_t>(capacity, 1)) {}
+
+ImageCache::Key ImageCache::makeKey(AHardwareBuffer *buffer) {
+  AHardwareBuffer_Desc desc{};
+  AHardwareBuffer_describe(buffer, &desc);
+  return {buffer, desc.width, desc.height, desc.layers, desc.format,
+          desc.usage};
+}
+
+Image *ImageCache::acquire(AHardwareBuffer *buffer) {
+  const Key key = makeKey(buffer);
+
+  for (auto it = mEntries.begin(); it != mEntries.end(); ++it) {
+    if (it->key.buffer != buffer) {
+      continue;
+    }
+    if (it->key.sameDescription(key)) {
+      // Hit, move the entry to the front of the LRU list
+      mHitCount++;
+      mEntries.splice(mEntries.begin(), mEntries, it);
+      // The producer has written new content since the last use
+      Image *image = mEntries.front().image.get();
+      image->acquireFromForeignQueue(
+          mDeviceWrapper->queueFamilyIndices.graphics);
+      return image;
+    }
+    break;
+  }
+
+  mMissCount++;
+
+  // The shared YCbCr conversion was built for the first buffer's format, a
+  // buffer with a different description needs a fresh set of imports. All
+  // entries share one description, so this also drops a stale entry for
+  // this buffer.
+  if (!mEntries.empty() && !mEntries.back().key.sameDescription(key)) {
+    LOGCATI("ImageCache: buffer description changed, dropping %u imports",
+            size());
+    clear();
+  }
+
+  while (mEntries.size() >= mCapacity) {
+    evictLeastRecentlyUsed();
+  }
+
+  Image::ImageBasicInfo imageInfo = mImageInfo;
+  std::unique_ptr<Image> image;
+  if (mEntries.empty()) {
+    image = Image::createFromAHardwareBuffer(mDeviceWrapper, mVkQueue, buffer,
+                                             imageInfo);
+  } else {
+    image = Image::createFromAHardwareBuffer(mDeviceWrapper, mVkQueue, buffer,
+                                             imageInfo,
+                                             *mEntries.back().image);
+  }
+  if (image == nullptr) {
+    LOGCATE("ImageCache: failed to import AHardwareBuffer %p", buffer);
+    return nullptr;
+  }
+
+  vks::debug::setImageName(mDeviceWrapper->logicalDevice,
+                           image->getImageHandle(), "ImageCache-Image");
+
+  mEntries.push_front({key, std::move(image)});
+  return mEntries.front().image.get();
+}
+
+void ImageCache::evictLeastRecentlyUsed() {
+  if (mEntries.size() == 1) {
+    // Only the sampler owner is left
+    retire(mEntries.begin());
+    return;
+  }
+  // Skip the last entry, the other images borrow its sampler
+  retire(std::prev(mEntries.end(), 2));
+}
+
+void ImageCache::retire(std::list<Entry>::iterator it) {
+  std::unique_ptr<Image> image = std::move(it->image);
+  mEntries.erase(it);
+  if (mRetireCallback) {
+    mRetireCallback(std::move(image));
+  }
+}
+
+void ImageCache::clear() {
+  // Images borrowing the shared sampler have to go before its owner
+  while (!mEntries.empty()) {
+    retire(mEntries.begin());
+  }
+}
+} // namespace gain
@@ -0,0 +1,138 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef GAINVULKANSAMPLE_VULKANIMAGECACHE_H
+#define GAINVULKANSAMPLE_VULKANIMAGECACHE_H
+
+#include "platform/HardwareBuffer.h"
+
+#include <functional>
+#include <list>
+#include <memory>
+
+#include "VulkanDeviceWrapper.hpp"
+#include "VulkanImageWrapper.h"
+
+namespace gain {
+// Keeps the Vulkan images imported from AHardwareBuffers alive across frames.
+//
+// A camera ImageReader cycles through a small, fixed set of buffers, so after
+// the first few frames every buffer has already been imported. Instead of
+// recreating the VkImage, re-importing the memory and rebuilding the view for
+// each frame, the cache keeps one Image per buffer and returns it on the next
+// lookup. Entries are evicted in least recently used order.
+//
+// All cached images share the sampler and YCbCr conversion of the first
+// import, so one immutable sampler can be used for every entry. When a buffer
+// with a different description shows up (e.g. the camera resolution changed)
+// every entry is dropped and the cache starts over.
+//
+// Evicted images may still be in use by the GPU. Set a retire callback to
+// hand them over to a deferred release queue instead of destroying them right
+// away. Images are retired in an order that keeps the shared sampler alive
+// until the last image using it is gone.
+class ImageCache {
+public:
+  using RetireCallback = std::function<void(std::unique_ptr<Image> image)>;
+
+  // An ImageReader holds at most maxImages (3 in CameraCore) buffers, keep one
+  // more entry so that a reallocated buffer does not evict a live one.
+  static constexpr uint32_t kDefaultCapacity = 4;
+
+  ImageCache(const std::shared_ptr<vks::VulkanDeviceWrapper> deviceWrapper,
+             vk::Queue queue, const Image::ImageBasicInfo &imageInfo,
+             uint32_t capacity = kDefaultCapacity);
+
+  ~ImageCache() { clear(); }
+
+  // Return the image bound to buffer, importing it on a miss. The returned
+  // image is owned by the cache and stays valid until it is evicted.
+  Image *acquire(AHardwareBuffer *buffer);
+
+  // Retire every cached image.
+  void clear();
+
+  void setRetireCallback(RetireCallback retireCallback) {
+    mRetireCallback = std::move(retireCallback);
+  }
+
+  // The sampler shared by all cached images, null while the cache is empty.
+  vk::Sampler getSamplerHandle() const {
+    return mEntries.empty() ? nullptr : mEntries.back().image->getSamplerHandle();
+  }
+
+  uint32_t size() const { return static_cast<uint32_t>(mEntries.size()); }
+
+  uint64_t hitCount() const { return mHitCount; }
+
+  uint64_t missCount() const { return mMissCount; }
+
+private:
+  struct Key {
+    AHardwareBuffer *buffer;
+    uint32_t width;
+    uint32_t height;
+    uint32_t layers;
+    uint32_t format;
+    uint64_t usage;
+
+    bool sameDescription(const Key &other) const {
+      return width == other.width && height == other.height &&
+             layers == other.layers && format == other.format &&
+             usage == other.usage;
+    }
+  };
+
+  struct Entry {
+    Key key;
+    std::unique_ptr<Image> image;
+  };
+
+  static Key makeKey(AHardwareBuffer *buffer);
+
+  void evictLeastRecentlyUsed();
+
+  void retire(std::list<Entry>::iterator it);
+
+  const std::shared_ptr<vks::VulkanDeviceWrapper> mDeviceWrapper;
+
+  vk::Queue mVkQueue;
+
+  Image::ImageBasicInfo mImageInfo;
+
+  uint32_t mCapacity;
+
+  // Most recently used entry first. The last entry is the first import and
+  // owns the shared sampler, it is never evicted on its own. The list is
+  // only a handful of entries long, so a linear search beats a hash map.
+  std::list<Entry> mEntries;
+
+  RetireCallback mRetireCallback;
+
+  uint64_t mHitCount = 0;
+  uint64_t mMissCount = 0;
+};
+} // namespace gain
+
+#endif // GAINVULKANSAMPLE_VULKANIMAGECACHE_H
@@ -24,10 +24,7 @@
  */
 
 #include "VulkanImageWrapper.h"
-
-#include <android/bitmap.h>
-#include <android/hardware_buffer_jni.h>
-#include <jni.h>
+#include "cpukernels/CpuKernels.h"
 
 #include <LogUtil.h>
 #include <memory>
@@ -62,6 +59,18 @@ std::unique_ptr<Image> Image::createFromAHardwareBuffer(
   return success ? std::move(image) : nullptr;
 }
 
+std::unique_ptr<Image> Image::createFromAHardwareBuffer(
+    const std::shared_ptr<vks::VulkanDeviceWrapper> deviceWrapper,
+    vk::Queue queue, AHardwareBuffer *buffer, ImageBasicInfo &imageInfo,
+    const Image &samplerSource) {
+  auto image = std::make_unique<Image>(deviceWrapper, queue, imageInfo);
+  image->mSamplerYcbcrConversion = samplerSource.mSamplerYcbcrConversion;
+  image->mSampler = samplerSource.mSampler;
+  image->mOwnsSampler = false;
+  bool success = image->setContentFromHardwareBuffer(buffer);
+  return success ? std::move(image) : nullptr;
+}
+
 bool Image::createDeviceLocalImage() {
   // Create an image
   vk::ImageCreateInfo imageCreateInfo = {};
@@ -97,113 +106,65 @@ bool Image::createDeviceLocalImage() {
     imageMemoryRequirementsInfo2.pNext = &imagePlaneMemoryRequirementsInfo;
     imageMemoryRequirementsInfo2.image = mImage;
 
-    // Get memory requirement for each plane
-    imagePlaneMemoryRequirementsInfo.planeAspect =
-        vk::ImageAspectFlagBits::ePlane0;
-    vk::MemoryRequirements2 memoryRequirements2Plane0 = {
-        VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2};
-    mDeviceWrapper->logicalDevice.getImageMemoryRequirements2(
-        &imageMemoryRequirementsInfo2, &memoryRequirements2Plane0);
-
-    imagePlaneMemoryRequirementsInfo.planeAspect =
-        vk::ImageAspectFlagBits::ePlane1;
-    vk::MemoryRequirements2 memoryRequirements2Plane1 = {
-        VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2};
-    mDeviceWrapper->logicalDevice.getImageMemoryRequirements2(
-        &imageMemoryRequirementsInfo2, &memoryRequirements2Plane1);
-
-    imagePlaneMemoryRequirementsInfo.planeAspect =
-        vk::ImageAspectFlagBits::ePlane2;
-    vk::MemoryRequirements2 memoryRequirements2Plane2 = {
-        VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2};
-    mDeviceWrapper->logicalDevice.getImageMemoryRequirements2(
-        &imageMemoryRequirementsInfo2, &memoryRequirements2Plane2);
-
-    // Allocate memory for each plane
-    vk::MemoryAllocateInfo memoryAllocateInfo = {
-        VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
-
-    memoryAllocateInfo.allocationSize =
-        memoryRequirements2Plane0.memoryRequirements.size;
-    mDeviceWrapper->logicalDevice.allocateMemory(&memoryAllocateInfo, nullptr,
-                                                 &mYMemory);
-
-    memoryAllocateInfo.allocationSize =
-        memoryRequirements2Plane1.memoryRequirements.size;
-    mDeviceWrapper->logicalDevice.allocateMemory(&memoryAllocateInfo, nullptr,
-                                                 &mUMemory);
-
-    memoryAllocateInfo.allocationSize =
-        memoryRequirements2Plane2.memoryRequirements.size;
-    mDeviceWrapper->logicalDevice.allocateMemory(&memoryAllocateInfo, nullptr,
-                                                 &mVMemory);
-
-    // Bind memory for each plane
-    vk::BindImagePlaneMemoryInfo bindImagePlaneMemoryInfoY{};
-    bindImagePlaneMemoryInfoY.planeAspect = vk::ImageAspectFlagBits::ePlane0;
-    vk::BindImageMemoryInfo bindImageMemoryInfoY{};
-    bindImageMemoryInfoY.pNext = &bindImagePlaneMemoryInfoY;
-    bindImageMemoryInfoY.image = mImage;
-    bindImageMemoryInfoY.memory = mYMemory;
-
-    vk::BindImagePlaneMemoryInfo bindImagePlaneMemoryInfoU{};
-    bindImagePlaneMemoryInfoU.planeAspect = vk::ImageAspectFlagBits::ePlane1;
-    vk::BindImageMemoryInfo bindImageMemoryInfoU{};
-    bindImageMemoryInfoU.pNext = &bindImagePlaneMemoryInfoU;
-    bindImageMemoryInfoU.image = mImage;
-    bindImageMemoryInfoU.memory = mUMemory;
-
-    vk::BindImagePlaneMemoryInfo bindImagePlaneMemoryInfoV{};
-    bindImagePlaneMemoryInfoV.planeAspect = vk::ImageAspectFlagBits::ePlane2;
-    vk::BindImageMemoryInfo bindImageMemoryInfoV{};
-    bindImageMemoryInfoV.pNext = &bindImagePlaneMemoryInfoV;
-    bindImageMemoryInfoV.image = mImage;
-    bindImageMemoryInfoV.memory = mVMemory;
-
-    std::vector<vk::BindImageMemoryInfo> bindImageMemoryInfos = {
-        bindImageMemoryInfoY, bindImageMemoryInfoU, bindImageMemoryInfoV};
-
-    mDeviceWrapper->logicalDevice.bindImageMemory2(
-        static_cast<uint32_t>(bindImageMemoryInfos.size()),
-        bindImageMemoryInfos.data());
+    // Get memory requirement for each plane, every plane gets its own range
+    const vk::ImageAspectFlagBits planeAspects[3] = {
+        vk::ImageAspectFlagBits::ePlane0, vk::ImageAspectFlagBits::ePlane1,
+        vk::ImageAspectFlagBits::ePlane2};
+    vk::BindImagePlaneMemoryInfo bindImagePlaneMemoryInfos[3];
+    vk::BindImageMemoryInfo bindImageMemoryInfos[3];
+    for (uint32_t plane = 0; plane < 3; ++plane) {
+      imagePlaneMemoryRequirementsInfo.planeAspect = planeAspects[plane];
+      vk::MemoryRequirements2 memoryRequirements2 = {
+          VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2};
+      mDeviceWrapper->logicalDevice.getImageMemoryRequirements2(
+          &imageMemoryRequirementsInfo2, &memoryRequirements2);
+
+      mPlaneAllocations[plane] = mDeviceWrapper->allocator->allocate(
+          memoryRequirements2.memoryRequirements,
+          vk::MemoryPropertyFlagBits::eDeviceLocal,
+          vks::MemoryAllocator::Tiling::eOptimal);
+      if (!mPlaneAllocations[plane]) {
+        return false;
+      }
+
+      bindImagePlaneMemoryInfos[plane].planeAspect = planeAspects[plane];
+      bindImageMemoryInfos[plane].pNext = &bindImagePlaneMemoryInfos[plane];
+      bindImageMemoryInfos[plane].image = mImage;
+      bindImageMemoryInfos[plane].memory = mPlaneAllocations[plane].memory;
+      bindImageMemoryInfos[plane].memoryOffset =
+          mPlaneAllocations[plane].offset;
+    }
+
+    CALL_VK(mDeviceWrapper->logicalDevice.bindImageMemory2(
+        3, bindImageMemoryInfos));
   } else {
     vk::MemoryRequirements memoryRequirements;
 
     mDeviceWrapper->logicalDevice.getImageMemoryRequirements(
         mImage, &memoryRequirements);
-    uint32_t memoryTypeIndex =
-        mDeviceWrapper->getMemoryType(memoryRequirements.memoryTypeBits,
-                                      vk::MemoryPropertyFlagBits::eDeviceLocal);
-    const vk::MemoryAllocateInfo allocateInfo = {memoryRequirements.size,
-                                                 memoryTypeIndex};
-    CALL_VK(mDeviceWrapper->logicalDevice.allocateMemory(&allocateInfo, nullptr,
-                                                         &mMemory));
-    mDeviceWrapper->logicalDevice.bindImageMemory(mImage, mMemory, 0);
+    mAllocation = mDeviceWrapper->allocator->allocate(
+        memoryRequirements, vk::MemoryPropertyFlagBits::eDeviceLocal,
+        vks::MemoryAllocator::Tiling::eOptimal);
+    if (!mAllocation) {
+      return false;
+    }
+    mDeviceWrapper->logicalDevice.bindImageMemory(mImage, mAllocation.memory,
+                                                  mAllocation.offset);
   }
 
-  // Set layout to mImageInfo.layout
-  vk::CommandBuffer copyCommand;
-  assert(mDeviceWrapper->beginSingleTimeCommand(&copyCommand));
-  vk::ImageSubresourceRange subresourceRange = {};
-  subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
-  subresourceRange.baseMipLevel = 0;
-  subresourceRange.levelCount = mImageInfo.mipLevels;
-  subresourceRange.layerCount = mImageInfo.arrayLayers;
-  setImageLayout(copyCommand, subresourceRange, mImageInfo.layout, false,
-                 vk::ImageLayout::eUndefined);
-  mDeviceWrapper->endAndSubmitSingleTimeCommand(copyCommand, mVkQueue);
+  // The transition to mImageInfo.layout is recorded by the owner in its own
+  // command buffer, see recordPendingTransitions.
+  queueInitialTransition();
 
   return true;
 }
 
+#ifdef __ANDROID__
 bool Image::createSamplerYcbcrConversionFromAHardwareBuffer(
     AHardwareBuffer *buffer) {
-  // Acquire the AHardwareBuffer and get the descriptor
-  //	AHardwareBuffer_acquire(buffer);
   AHardwareBuffer_Desc ahwbDesc{};
   AHardwareBuffer_describe(buffer, &ahwbDesc);
 
-  mHardwareBufferInfo.mBuffer = buffer;
   mImageInfo.extent = vk::Extent3D{ahwbDesc.width, ahwbDesc.height, 1};
 
   // Get AHardwareBuffer properties
@@ -212,7 +173,7 @@ bool Image::createSamplerYcbcrConversionFromAHardwareBuffer(
   properties.pNext = &formatInfo;
   CALL_VK(
       mDeviceWrapper->logicalDevice.getAndroidHardwareBufferPropertiesANDROID(
-          mHardwareBufferInfo.mBuffer, &properties));
+          buffer, &properties));
 
   // Create an image to bind to our AHardwareBuffer
   vk::ExternalMemoryImageCreateInfo externalCreateInfo{};
@@ -272,12 +233,18 @@ bool Image::createSamplerYcbcrConversionFromAHardwareBuffer(
 }
 
 bool Image::setContentFromHardwareBuffer(AHardwareBuffer *buffer) {
-  // Acquire the AHardwareBuffer and get the descriptor
-  //	AHardwareBuffer_acquire(buffer);
+  // Acquire the AHardwareBuffer and get the descriptor. The reference is
+  // dropped when the image is destroyed or bound to another buffer.
+  if (buffer != mHardwareBufferInfo.mBuffer) {
+    AHardwareBuffer_acquire(buffer);
+    if (mHardwareBufferInfo.mBuffer != nullptr) {
+      AHardwareBuffer_release(mHardwareBufferInfo.mBuffer);
+    }
+    mHardwareBufferInfo.mBuffer = buffer;
+  }
   AHardwareBuffer_Desc ahwbDesc{};
   AHardwareBuffer_describe(buffer, &ahwbDesc);
 
-  mHardwareBufferInfo.mBuffer = buffer;
   mImageInfo.extent = vk::Extent3D{ahwbDesc.width, ahwbDesc.height, 1};
 
   // Get AHardwareBuffer properties
@@ -400,24 +367,207 @@ bool Image::setContentFromHardwareBuffer(AHardwareBuffer *buffer) {
 
   mImageView = mDeviceWrapper->logicalDevice.createImageView(img_view_info);
 
-  if (mImageInfo.layout != vk::ImageLayout::eUndefined &&
-      mImageInfo.layout != vk::ImageLayout::ePreinitialized) {
-    // Set layout to mImageInfo.layout
-    vk::CommandBuffer copyCommand;
-    assert(mDeviceWrapper->beginSingleTimeCommand(&copyCommand));
-    vk::ImageSubresourceRange subresourceRange = {};
-    subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
-    subresourceRange.baseMipLevel = 0;
-    subresourceRange.levelCount = mImageInfo.mipLevels;
-    subresourceRange.layerCount = mImageInfo.arrayLayers;
-    setImageLayout(copyCommand, subresourceRange, mImageInfo.layout, false,
-                   vk::ImageLayout::eUndefined);
-    mDeviceWrapper->endAndSubmitSingleTimeCommand(copyCommand, mVkQueue);
+  acquireFromForeignQueue(mDeviceWrapper->queueFamilyIndices.graphics);
+
+  return true;
+}
+
+#else
+bool Image::createSamplerYcbcrConversionFromAHardwareBuffer(
+    AHardwareBuffer *buffer) {
+  AHardwareBuffer_Desc ahwbDesc{};
+  AHardwareBuffer_describe(buffer, &ahwbDesc);
+
+  mImageInfo.extent = vk::Extent3D{ahwbDesc.width, ahwbDesc.height, 1};
+
+  // Host buffers are uploaded as RGBA, no conversion is needed. Keep the
+  // filtering of the camera sampler.
+  vk::SamplerCreateInfo sampler_info = {};
+  sampler_info.magFilter = vk::Filter::eNearest;
+  sampler_info.minFilter = vk::Filter::eNearest;
+  sampler_info.mipmapMode = vk::SamplerMipmapMode::eNearest;
+  sampler_info.addressModeU = vk::SamplerAddressMode::eClampToEdge;
+  sampler_info.addressModeV = vk::SamplerAddressMode::eClampToEdge;
+  sampler_info.addressModeW = vk::SamplerAddressMode::eClampToEdge;
+  sampler_info.maxAnisotropy = 1.0f;
+  sampler_info.compareOp = vk::CompareOp::eNever;
+  sampler_info.borderColor = vk::BorderColor::eFloatOpaqueWhite;
+
+  CALL_VK(mDeviceWrapper->logicalDevice.createSampler(&sampler_info, nullptr,
+                                                      &mSampler));
+  return true;
+}
+
+bool Image::setContentFromHardwareBuffer(AHardwareBuffer *buffer) {
+  if (buffer != mHardwareBufferInfo.mBuffer) {
+    AHardwareBuffer_acquire(buffer);
+    if (mHardwareBufferInfo.mBuffer != nullptr) {
+      AHardwareBuffer_release(mHardwareBufferInfo.mBuffer);
+    }
+    mHardwareBufferInfo.mBuffer = buffer;
   }
 
+  if (!createHostImageFromHardwareBuffer(buffer)) {
+    return false;
+  }
+
+  acquireFromForeignQueue(mDeviceWrapper->queueFamilyIndices.graphics);
+
   return true;
 }
 
+bool Image::createHostImageFromHardwareBuffer(AHardwareBuffer *buffer) {
+  AHardwareBuffer_Desc ahwbDesc{};
+  AHardwareBuffer_describe(buffer, &ahwbDesc);
+
+  // YUV buffers are converted to RGBA on upload
+  const bool yuv = ahwbDesc.format == AHARDWAREBUFFER_FORMAT_Y8Cb8Cr8_420 &&
+                   (ahwbDesc.width & 1) == 0 && (ahwbDesc.height & 1) == 0;
+  if (ahwbDesc.format != AHARDWAREBUFFER_FORMAT_R8G8B8A8_UNORM &&
+      ahwbDesc.format != AHARDWAREBUFFER_FORMAT_R8G8B8X8_UNORM && !yuv) {
+    LOGCATE("Image: host buffers of format 0x%x and size %ux%u can't be "
+            "sampled",
+            ahwbDesc.format, ahwbDesc.width, ahwbDesc.height);
+    return false;
+  }
+
+  mImageInfo.extent = vk::Extent3D{ahwbDesc.width, ahwbDesc.height, 1};
+  mImageInfo.format = vk::Format::eR8G8B8A8Unorm;
+
+  if (mImageView) {
+    mDeviceWrapper->logicalDevice.destroyImageView(mImageView);
+    mImageView = nullptr;
+  }
+  if (mImage) {
+    mDeviceWrapper->logicalDevice.destroyImage(mImage);
+    mImage = nullptr;
+  }
+  mDeviceWrapper->allocator->free(mAllocation);
+
+  vk::ImageCreateInfo createInfo{};
+  createInfo.imageType = vk::ImageType::e2D;
+  createInfo.format = mImageInfo.format;
+  createInfo.extent = mImageInfo.extent;
+  createInfo.mipLevels = 1u;
+  createInfo.arrayLayers = 1u;
+  createInfo.samples = vk::SampleCountFlagBits::e1;
+  createInfo.tiling = vk::ImageTiling::eOptimal;
+  createInfo.usage =
+      vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst;
+  createInfo.sharingMode = vk::SharingMode::eExclusive;
+  createInfo.initialLayout = vk::ImageLayout::eUndefined;
+  CALL_VK(
+      mDeviceWrapper->logicalDevice.createImage(&createInfo, nullptr, &mImage));
+
+  vk::MemoryRequirements memoryRequirements;
+  mDeviceWrapper->logicalDevice.getImageMemoryRequirements(mImage,
+                                                           &memoryRequirements);
+  mAllocation = mDeviceWrapper->allocator->allocate(
+      memoryRequirements, vk::MemoryPropertyFlagBits::eDeviceLocal,
+      vks::MemoryAllocator::Tiling::eOptimal);
+  if (!mAllocation) {
+    return false;
+  }
+  mDeviceWrapper->logicalDevice.bindImageMemory(mImage, mAllocation.memory,
+                                                mAllocation.offset);
+
+  vk::ImageViewCreateInfo viewCreateInfo{};
+  viewCreateInfo.image = mImage;
+  viewCreateInfo.viewType = vk::ImageViewType::e2D;
+  viewCreateInfo.format = mImageInfo.format;
+  viewCreateInfo.subresourceRange = {vk::ImageAspectFlagBits::eColor, 0, 1, 0,
+                                     1};
+  CALL_VK(mDeviceWrapper->logicalDevice.createImageView(&viewCreateInfo,
+                                                        nullptr, &mImageView));
+
+  const uint32_t stagingSize = ahwbDesc.width * ahwbDesc.height * 4;
+  mHostStagingBuffers.clear();
+  for (uint32_t i = 0; i < kHostStagingCount; ++i) {
+    auto staging = vks::Buffer::create(
+        mDeviceWrapper, stagingSize, vk::BufferUsageFlagBits::eTransferSrc,
+        vk::MemoryPropertyFlagBits::eHostVisible |
+            vk::MemoryPropertyFlagBits::eHostCoherent);
+    if (staging == nullptr) {
+      return false;
+    }
+    CALL_VK(staging->map());
+    mHostStagingBuffers.push_back(std::move(staging));
+  }
+  mPendingHostUpload = nullptr;
+
+  return true;
+}
+
+void Image::queueHostUpload() {
+  void *content = nullptr;
+  if (AHardwareBuffer_lock(mHardwareBufferInfo.mBuffer,
+                           AHARDWAREBUFFER_USAGE_CPU_READ_OFTEN, -1, nullptr,
+                           &content) != 0) {
+    LOGCATE("Image: failed to lock host buffer %p",
+            mHardwareBufferInfo.mBuffer);
+    return;
+  }
+
+  vks::Buffer *staging = mHostStagingBuffers[mHostStagingIndex].get();
+  mHostStagingIndex = (mHostStagingIndex + 1) % kHostStagingCount;
+  const uint32_t width = mImageInfo.extent.width;
+  const uint32_t height = mImageInfo.extent.height;
+  AHardwareBuffer_Desc ahwbDesc{};
+  AHardwareBuffer_describe(mHardwareBufferInfo.mBuffer, &ahwbDesc);
+  if (ahwbDesc.format == AHARDWAREBUFFER_FORMAT_Y8Cb8Cr8_420) {
+    const auto *y = static_cast<const uint8_t *>(content);
+    const uint8_t *u = y + width * height;
+    const uint8_t *v = u + (width / 2) * (height / 2);
+    cpukernels::i420ToRgba(y, width, u, width / 2, v, width / 2, width,
+                           height,
+                           static_cast<uint8_t *>(staging->getMappedData()),
+                           width * 4);
+  } else {
+    staging->copyFrom(content, width * height * 4);
+  }
+  AHardwareBuffer_unlock(mHardwareBufferInfo.mBuffer, nullptr);
+
+  // The upload overwrites the whole image, like a transition from eUndefined
+  mPendingTransitions.clear();
+  mPendingHostUpload = staging;
+}
+
+void Image::recordHostUpload(vk::CommandBuffer cmdbuffer,
+                             vk::PipelineStageFlags dstStageMask) {
+  vk::ImageMemoryBarrier imageMemoryBarrier{};
+  imageMemoryBarrier.image = mImage;
+  imageMemoryBarrier.subresourceRange = {vk::ImageAspectFlagBits::eColor, 0, 1,
+                                         0, 1};
+
+  // Earlier frames may still sample the old content at dstStageMask
+  imageMemoryBarrier.srcAccessMask = vk::AccessFlagBits::eNone;
+  imageMemoryBarrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
+  imageMemoryBarrier.oldLayout = vk::ImageLayout::eUndefined;
+  imageMemoryBarrier.newLayout = vk::ImageLayout::eTransferDstOptimal;
+  cmdbuffer.pipelineBarrier(dstStageMask, vk::PipelineStageFlagBits::eTransfer,
+                            vk::DependencyFlags(), 0, nullptr, 0, nullptr, 1,
+                            &imageMemoryBarrier);
+
+  vk::BufferImageCopy region{};
+  region.imageSubresource = {vk::ImageAspectFlagBits::eColor, 0, 0, 1};
+  region.imageExtent = mImageInfo.extent;
+  cmdbuffer.copyBufferToImage(mPendingHostUpload->getBufferHandle(), mImage,
+                              vk::ImageLayout::eTransferDstOptimal, 1,
+                              &region);
+
+  imageMemoryBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+  imageMemoryBarrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+  imageMemoryBarrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+  imageMemoryBarrier.newLayout = mImageInfo.layout;
+  cmdbuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, dstStageMask,
+                            vk::DependencyFlags(), 0, nullptr, 0, nullptr, 1,
+                            &imageMemoryBarrier);
+  mState = vks::ResourceState::afterBarrier(
+      mImageInfo.layout, dstStageMask, imageMemoryBarrier.dstAccessMask,
+      VK_QUEUE_FAMILY_IGNORED);
+}
+#endif
+
 bool Image::createSampler() {
   vk::SamplerCreateInfo samplerCreateInfo{};
   samplerCreateInfo.pNext =
@@ -434,7 +584,8 @@ bool Image::createSampler() {
     samplerCreateInfo.mipmapMode = vk::SamplerMipmapMode::eLinear;
     samplerCreateInfo.minLod = 0.0f;
     samplerCreateInfo.maxLod = (float)mImageInfo.mipLevels;
-    samplerCreateInfo.compareEnable = VK_TRUE;
+    // Color images are filtered, not compared against a reference
+    samplerCreateInfo.compareEnable = VK_FALSE;
   }
   // Use clamp to edge for BLUR filter
   samplerCreateInfo.addressModeU = vk::SamplerAddressMode::eClampToEdge;
@@ -445,9 +596,8 @@ bool Image::createSampler() {
   // 不归一化坐标:默认false，即归一化坐标。
   samplerCreateInfo.unnormalizedCoordinates =
       mImageInfo.unnormalizedCoordinates;
-  auto sam = mSampler;
   CALL_VK(mDeviceWrapper->logicalDevice.createSampler(&samplerCreateInfo,
-                                                      nullptr, &sam));
+                                                      nullptr, &mSampler));
   return true;
 }
 
@@ -561,149 +711,110 @@ bool Image::isYUVFormat() {
   return false;
 }
 
-void Image::setImageLayout(vk::CommandBuffer cmdbuffer,
-                           vk::ImageSubresourceRange subresourceRange,
-                           vk::ImageLayout newImageLayout, bool ignoreOldLayout,
-                           vk::ImageLayout oldImageLayout,
-                           vk::PipelineStageFlags srcStageMask,
-                           vk::PipelineStageFlags dstStageMask) {
-  if (newImageLayout == vk::ImageLayout::eUndefined ||
-      newImageLayout == vk::ImageLayout::ePreinitialized) {
+void Image::queueInitialTransition(uint32_t srcQueueFamilyIndex,
+                                   uint32_t dstQueueFamilyIndex) {
+  if (mImageInfo.layout == vk::ImageLayout::eUndefined ||
+      mImageInfo.layout == vk::ImageLayout::ePreinitialized) {
     return;
   }
 
-  vk::ImageLayout oldLayout;
-  if (ignoreOldLayout) {
-    oldLayout = mImageInfo.layout;
-  } else {
-    oldLayout = oldImageLayout;
-  }
-
-  // Create an image barrier object
   vk::ImageMemoryBarrier imageMemoryBarrier{};
-  imageMemoryBarrier.oldLayout = oldLayout;
-  imageMemoryBarrier.newLayout = newImageLayout;
+  imageMemoryBarrier.srcAccessMask = vk::AccessFlagBits::eNone;
+  imageMemoryBarrier.oldLayout = vk::ImageLayout::eUndefined;
+  imageMemoryBarrier.newLayout = mImageInfo.layout;
+  imageMemoryBarrier.srcQueueFamilyIndex = srcQueueFamilyIndex;
+  imageMemoryBarrier.dstQueueFamilyIndex = dstQueueFamilyIndex;
   imageMemoryBarrier.image = mImage;
-  imageMemoryBarrier.subresourceRange = subresourceRange;
-
-  // Source layouts (old)
-  // Source access mask controls actions that have to be finished on the old
-  // layout before it will be transitioned to the new layout
-  switch (oldLayout) {
-  case vk::ImageLayout::eUndefined:
-    // Image layout is undefined (or does not matter)
-    // Only valid as initial layout
-    // No flags required, listed only for completeness
-    imageMemoryBarrier.srcAccessMask = vk::AccessFlagBits::eNone;
-    break;
-
-  case vk::ImageLayout::ePreinitialized:
-    // Image is preinitialized
-    // Only valid as initial layout for linear images, preserves memory contents
-    // Make sure host writes have been finished
-    imageMemoryBarrier.srcAccessMask = vk::AccessFlagBits::eHostWrite;
-    break;
-
-  case vk::ImageLayout::eColorAttachmentOptimal:
-    // Image is a color attachment
-    // Make sure any writes to the color buffer have been finished
-    imageMemoryBarrier.srcAccessMask =
-        vk::AccessFlagBits::eColorAttachmentWrite;
-    break;
-
-  case vk::ImageLayout::eDepthStencilAttachmentOptimal:
-    // Image is a depth/stencil attachment
-    // Make sure any writes to the depth/stencil buffer have been finished
-    imageMemoryBarrier.srcAccessMask =
-        vk::AccessFlagBits::eDepthStencilAttachmentWrite;
-    break;
-
-  case vk::ImageLayout::eTransferSrcOptimal:
-    // Image is a transfer source
-    // Make sure any reads from the image have been finished
-    imageMemoryBarrier.srcAccessMask = vk::AccessFlagBits::eTransferRead;
-    break;
+  imageMemoryBarrier.subresourceRange = {vk::ImageAspectFlagBits::eColor, 0,
+                                         mImageInfo.mipLevels, 0,
+                                         mImageInfo.arrayLayers};
 
+  switch (mImageInfo.layout) {
   case vk::ImageLayout::eTransferDstOptimal:
-    // Image is a transfer destination
-    // Make sure any writes to the image have been finished
-    imageMemoryBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
-    break;
-
-  case vk::ImageLayout::eShaderReadOnlyOptimal:
-    // Image is read by a shader
-    // Make sure any shader reads from the image have been finished
-    imageMemoryBarrier.srcAccessMask = vk::AccessFlagBits::eShaderRead;
-    break;
-  default:
-    // Other source layouts aren't handled (yet)
-    break;
-  }
-
-  // Target layouts (new)
-  // Destination access mask controls the dependency for the new image layout
-  switch (newImageLayout) {
-  case vk::ImageLayout::eTransferDstOptimal:
-    // Image will be used as a transfer destination
-    // Make sure any writes to the image have been finished
     imageMemoryBarrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
     break;
-
-  case vk::ImageLayout::eTransferSrcOptimal:
-    // Image will be used as a transfer source
-    // Make sure any reads from the image have been finished
-    imageMemoryBarrier.dstAccessMask = vk::AccessFlagBits::eTransferRead;
-    break;
-
   case vk::ImageLayout::eColorAttachmentOptimal:
-    // Image will be used as a color attachment
-    // Make sure any writes to the color buffer have been finished
     imageMemoryBarrier.dstAccessMask =
         vk::AccessFlagBits::eColorAttachmentWrite;
     break;
-
-  case vk::ImageLayout::eDepthStencilAttachmentOptimal:
-    // Image layout will be used as a depth/stencil attachment
-    // Make sure any writes to depth/stencil buffer have been finished
-    imageMemoryBarrier.dstAccessMask =
-        imageMemoryBarrier.dstAccessMask |
-        vk::AccessFlagBits::eDepthStencilAttachmentWrite;
-    break;
-
   case vk::ImageLayout::eShaderReadOnlyOptimal:
-    // Image will be read in a shader (sampler, input attachment)
-    // Make sure any writes to the image have been finished
-    if (imageMemoryBarrier.srcAccessMask == vk::AccessFlagBits::eNone) {
-      imageMemoryBarrier.srcAccessMask =
-          vk::AccessFlagBits::eHostWrite | vk::AccessFlagBits::eTransferWrite;
-    }
     imageMemoryBarrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
     break;
+  case vk::ImageLayout::eGeneral:
+    imageMemoryBarrier.dstAccessMask =
+        vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+    break;
   default:
-    // Other source layouts aren't handled (yet)
     break;
   }
 
-  // Put barrier inside setup command buffer
-  cmdbuffer.pipelineBarrier(srcStageMask, dstStageMask, vk::DependencyFlags(),
-                            0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+  // Queued barriers all cover the whole image, and a transition from
+  // eUndefined supersedes anything queued before it. Keeping both would
+  // record two layout transitions of the same subresource in one barrier.
+  mPendingTransitions.clear();
+  mPendingTransitions.push_back(imageMemoryBarrier);
+}
+
+void Image::acquireFromForeignQueue(uint32_t dstQueueFamilyIndex) {
+#ifdef __ANDROID__
+  // The producer owns the content, so the old layout is eUndefined as
+  // suggested for VK_QUEUE_FAMILY_FOREIGN_EXT; the contents are preserved by
+  // the ownership transfer.
+  queueInitialTransition(VK_QUEUE_FAMILY_FOREIGN_EXT, dstQueueFamilyIndex);
+#else
+  // The host upload is recorded into the command buffer of the queue that
+  // uses the image, there is no ownership to transfer
+  (void)dstQueueFamilyIndex;
+  queueHostUpload();
+#endif
+}
+
+void Image::recordPendingTransitions(vk::CommandBuffer cmdbuffer,
+                                     vk::PipelineStageFlags dstStageMask) {
+#ifndef __ANDROID__
+  if (mPendingHostUpload != nullptr) {
+    recordHostUpload(cmdbuffer, dstStageMask);
+    mPendingHostUpload = nullptr;
+  }
+#endif
+  if (mPendingTransitions.empty()) {
+    return;
+  }
+
+  // Use dstStageMask as the source scope too, so the transitions are ordered
+  // after a semaphore wait on the same stage, e.g. the producer's fence.
+  vks::BarrierBatch batch(*mDeviceWrapper);
+  for (const auto &barrier : mPendingTransitions) {
+    batch.image(barrier, dstStageMask, dstStageMask);
+  }
+  batch.record(cmdbuffer);
+  const vk::ImageMemoryBarrier &last = mPendingTransitions.back();
+  mState = vks::ResourceState::afterBarrier(
+      last.newLayout, dstStageMask, last.dstAccessMask,
+      last.dstQueueFamilyIndex);
+  mPendingTransitions.clear();
+}
 
-  mImageInfo.layout = newImageLayout;
+void Image::transition(vk::CommandBuffer cmdbuffer, vks::ResourceUsage usage,
+                       uint32_t queueFamily) {
+  vks::BarrierBatch batch(*mDeviceWrapper);
+  transition(batch, usage, queueFamily);
+  batch.record(cmdbuffer);
 }
 
-void Image::setImageLayout(vk::CommandBuffer cmdbuffer,
-                           vk::ImageAspectFlags aspectMask,
-                           vk::ImageLayout newImageLayout, bool ignoreOldLayout,
-                           vk::ImageLayout oldImageLayout,
-                           vk::PipelineStageFlags srcStageMask,
-                           vk::PipelineStageFlags dstStageMask) {
-  vk::ImageSubresourceRange subresourceRange = {};
-  subresourceRange.aspectMask = aspectMask;
-  subresourceRange.baseMipLevel = 0;
-  subresourceRange.levelCount = 1;
-  subresourceRange.layerCount = 1;
-  setImageLayout(cmdbuffer, subresourceRange, newImageLayout, ignoreOldLayout,
-                 oldImageLayout, srcStageMask, dstStageMask);
+void Image::transition(vks::BarrierBatch &batch, vks::ResourceUsage usage,
+                       uint32_t queueFamily) {
+  if (hasPendingTransitions()) {
+    LOGCATE("Image::transition: record the pending transitions first");
+  }
+  const vk::ImageSubresourceRange range{
+      vks::formatAspectMask(mImageInfo.format), 0, mImageInfo.mipLevels, 0,
+      mImageInfo.arrayLayers};
+  batch.image(mImage, range, mState, usage, queueFamily);
+  if (mState.layout != vk::ImageLayout::eUndefined) {
+    // Descriptors and later acquires use the new layout
+    mImageInfo.layout = mState.layout;
+  }
 }
 
 Image::Image(const std::shared_ptr<vks::VulkanDeviceWrapper> context,
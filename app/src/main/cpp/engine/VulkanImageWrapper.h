@@ -26,17 +26,14 @@
 #ifndef GAINVULKANSAMPLE_VULKANRESOURCES_H
 #define GAINVULKANSAMPLE_VULKANRESOURCES_H
 
-#include <android/bitmap.h>
-#include <android/hardware_buffer_jni.h>
-#include <jni.h>
-
-#include <android/asset_manager.h>
 #include <memory>
 #include <optional>
 #include <vector>
 
+#include "VulkanBarriers.h"
 #include "VulkanBufferWrapper.h"
 #include "VulkanDeviceWrapper.hpp"
+#include "platform/HardwareBuffer.h"
 #include <vulkan/vulkan_raii.hpp>
 
 namespace gain {
@@ -65,6 +62,15 @@ public:
       const std::shared_ptr<vks::VulkanDeviceWrapper> deviceWrapper,
       vk::Queue queue, AHardwareBuffer *buffer, ImageBasicInfo &imageInfo);
 
+  // Create a image backed by the given AHardwareBuffer that reuses the sampler
+  // and YCbCr conversion of samplerSource instead of creating its own. Views
+  // of all such images can be sampled through one immutable sampler.
+  // samplerSource must outlive the returned image.
+  static std::unique_ptr<Image> createFromAHardwareBuffer(
+      const std::shared_ptr<vks::VulkanDeviceWrapper> deviceWrapper,
+      vk::Queue queue, AHardwareBuffer *buffer, ImageBasicInfo &imageInfo,
+      const Image &samplerSource);
+
   Image(const std::shared_ptr<vks::VulkanDeviceWrapper> deviceWrapper,
         vk::Queue queue, const ImageBasicInfo &imageInfo);
 
@@ -76,8 +82,9 @@ public:
     if (mMemory) {
       mDeviceWrapper->logicalDevice.freeMemory(mMemory, nullptr);
     }
+    mDeviceWrapper->allocator->free(mAllocation);
 
-    if (mSampler) {
+    if (mSampler && mOwnsSampler) {
       mDeviceWrapper->logicalDevice.destroySampler(mSampler, nullptr);
     }
 
@@ -89,16 +96,10 @@ public:
       AHardwareBuffer_release(mHardwareBufferInfo.mBuffer);
     }
 
-    if (mYMemory) {
-      mDeviceWrapper->logicalDevice.freeMemory(mYMemory, nullptr);
-    }
-    if (mUMemory) {
-      mDeviceWrapper->logicalDevice.freeMemory(mUMemory, nullptr);
-    }
-    if (mVMemory) {
-      mDeviceWrapper->logicalDevice.freeMemory(mVMemory, nullptr);
+    for (auto &planeAllocation : mPlaneAllocations) {
+      mDeviceWrapper->allocator->free(planeAllocation);
     }
-    if (mSamplerYcbcrConversion) {
+    if (mSamplerYcbcrConversion && mOwnsSampler) {
       mDeviceWrapper->logicalDevice.destroySamplerYcbcrConversion(mSamplerYcbcrConversion, nullptr);
     }
   }
@@ -117,27 +118,40 @@ public:
 
   bool setContentFromHardwareBuffer(AHardwareBuffer *buffer);
 
-  // Put an image memory barrier for setting an image layout on the sub resource
-  // into the given command buffer
-  void
-  setImageLayout(vk::CommandBuffer cmdbuffer,
-                 vk::ImageSubresourceRange subresourceRange,
-                 vk::ImageLayout newImageLayout, bool ignoreOldLayout = true,
-                 vk::ImageLayout oldImageLayout = vk::ImageLayout::eUndefined,
-                 vk::PipelineStageFlags srcStageMask =
-                     vk::PipelineStageFlagBits::eAllCommands,
-                 vk::PipelineStageFlags dstStageMask =
-                     vk::PipelineStageFlagBits::eAllCommands);
-
-  // Uses a fixed sub resource layout with first mip level and layer
-  void
-  setImageLayout(vk::CommandBuffer cmdbuffer, vk::ImageAspectFlags aspectMask,
-                 vk::ImageLayout newImageLayout, bool ignoreOldLayout = true,
-                 vk::ImageLayout oldImageLayout = vk::ImageLayout::eUndefined,
-                 vk::PipelineStageFlags srcStageMask =
-                     vk::PipelineStageFlagBits::eAllCommands,
-                 vk::PipelineStageFlags dstStageMask =
-                     vk::PipelineStageFlagBits::eAllCommands);
+  // Queue an acquire of the external content from VK_QUEUE_FAMILY_FOREIGN_EXT
+  // to dstQueueFamilyIndex. Needed every time the producer has written new
+  // content into the bound AHardwareBuffer.
+  void acquireFromForeignQueue(uint32_t dstQueueFamilyIndex);
+
+  bool hasPendingTransitions() const {
+#ifndef __ANDROID__
+    if (mPendingHostUpload != nullptr) {
+      return true;
+    }
+#endif
+    return !mPendingTransitions.empty();
+  }
+
+  // Record all queued layout transitions and queue family acquires into
+  // cmdbuffer with a single pipeline barrier and clear the queue. The image
+  // is in mImageInfo.layout for work recorded after this call.
+  // dstStageMask is where the first use after them starts.
+  void recordPendingTransitions(vk::CommandBuffer cmdbuffer,
+                                vk::PipelineStageFlags dstStageMask);
+
+  // Record the barrier the whole image needs before it is used for usage,
+  // derived from its tracked layout and last use. Nothing is recorded if no
+  // barrier is needed. With a queueFamily other than the owning one the
+  // barrier acquires the image. Record pending transitions first.
+  void transition(vk::CommandBuffer cmdbuffer, vks::ResourceUsage usage,
+                  uint32_t queueFamily = VK_QUEUE_FAMILY_IGNORED);
+
+  // Add the barrier to batch instead, to record it together with others
+  void transition(vks::BarrierBatch &batch, vks::ResourceUsage usage,
+                  uint32_t queueFamily = VK_QUEUE_FAMILY_IGNORED);
+
+  // Layout, last use and owner at the end of the work recorded so far
+  const vks::ResourceState &state() const { return mState; }
 
   vk::DescriptorImageInfo getDescriptor() const {
     return {mSampler, mImageView, mImageInfo.layout};
@@ -156,6 +170,31 @@ private:
 
   bool isYUVFormat();
 
+#ifndef __ANDROID__
+  // Host builds can't import the stand-in buffers, see
+  // platform/HardwareBuffer.h. The image gets device local memory of its own
+  // and every acquire copies the buffer content through a staging buffer.
+  bool createHostImageFromHardwareBuffer(AHardwareBuffer *buffer);
+
+  void queueHostUpload();
+
+  void recordHostUpload(vk::CommandBuffer cmdbuffer,
+                        vk::PipelineStageFlags dstStageMask);
+
+  // One staging buffer per frame that can be in flight, so an upload never
+  // overwrites data a previous frame is still copying from
+  static constexpr uint32_t kHostStagingCount = 3;
+  std::vector<std::unique_ptr<vks::Buffer>> mHostStagingBuffers;
+  uint32_t mHostStagingIndex = 0;
+  // Staging buffer with content not recorded yet, nullptr if none
+  vks::Buffer *mPendingHostUpload = nullptr;
+#endif
+
+  // Queue a transition from eUndefined to mImageInfo.layout.
+  void queueInitialTransition(
+      uint32_t srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      uint32_t dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED);
+
   const std::shared_ptr<vks::VulkanDeviceWrapper> mDeviceWrapper;
 
   vk::Queue mVkQueue;
@@ -172,17 +211,29 @@ private:
 
   // Managed handles
   vk::Image mImage = nullptr;
+  // Imported memory of an AHardwareBuffer
   vk::DeviceMemory mMemory = nullptr;
+  // Memory from the device's allocator otherwise
+  vks::Allocation mAllocation;
   vk::Sampler mSampler = nullptr;
   vk::ImageView mImageView = nullptr;
 
-  // DeviceMemory for YUV
-  vk::DeviceMemory mYMemory = nullptr;
-  vk::DeviceMemory mUMemory = nullptr;
-  vk::DeviceMemory mVMemory = nullptr;
+  // Memory of the Y, U and V planes of disjoint YUV images
+  vks::Allocation mPlaneAllocations[3];
 
   vk::SamplerYcbcrConversionKHR mSamplerYcbcrConversion = nullptr;
   vk::SamplerYcbcrConversionInfo mSamplerYcbcrConversionInfo;
+
+  // Barriers queued by queueInitialTransition and acquireFromForeignQueue,
+  // drained by recordPendingTransitions.
+  std::vector<vk::ImageMemoryBarrier> mPendingTransitions;
+
+  // Tracked for transition, as of the last recorded barrier
+  vks::ResourceState mState;
+
+  // False if mSampler and mSamplerYcbcrConversion are borrowed from another
+  // image, see createFromAHardwareBuffer.
+  bool mOwnsSampler = true;
 };
 
 } // namespace gain
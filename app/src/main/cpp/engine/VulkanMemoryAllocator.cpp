@@ -0,0 +1,242 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "VulkanMemoryAllocator.h"
+
+#include <LogUtil.h>
+
+namespace vks {
+namespace {
+// Order of the whole block, kBlockSize == kMinAllocationSize << kMaxOrder
+constexpr uint32_t kMaxOrder = 17;
+static_assert((MemoryAllocator::kMinAllocationSize << kMaxOrder) ==
+                  MemoryAllocator::kBlockSize,
+              "kMaxOrder must cover the block");
+} // namespace
+
+MemoryAllocator::MemoryAllocator(vk::PhysicalDevice physicalDevice,
+                                 vk::Device device)
+    : mDevice(device),
+      mSeparateTilings(physicalDevice.getProperties()
+                           .limits.bufferImageGranularity > 1) {
+  physicalDevice.getMemoryProperties(&mMemoryProperties);
+}
+
+MemoryAllocator::~MemoryAllocator() {
+  for (auto &block : mBlocks) {
+    mDevice.freeMemory(block->memory);
+  }
+}
+
+Allocation MemoryAllocator::allocate(const vk::MemoryRequirements &requirements,
+                                     vk::MemoryPropertyFlags properties,
+                                     Tiling tiling) {
+  uint32_t memoryTypeIndex = 0;
+  if (!findMemoryType(requirements.memoryTypeBits, properties,
+                      &memoryTypeIndex)) {
+    LOGCATE("MemoryAllocator: no memory type for bits 0x%x",
+            requirements.memoryTypeBits);
+    return {};
+  }
+
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  const vk::DeviceSize size =
+      std::max(requirements.size, requirements.alignment);
+  if (size > kDedicatedThreshold ||
+      (properties & vk::MemoryPropertyFlagBits::eLazilyAllocated)) {
+    return allocateDedicated(requirements.size, memoryTypeIndex);
+  }
+
+  if (!mSeparateTilings) {
+    tiling = Tiling::eLinear;
+  }
+  uint32_t order = 0;
+  while ((kMinAllocationSize << order) < size) {
+    ++order;
+  }
+
+  vk::DeviceSize offset = 0;
+  MemoryBlock *block = nullptr;
+  for (auto &candidate : mBlocks) {
+    if (candidate->memoryTypeIndex == memoryTypeIndex &&
+        candidate->tiling == tiling &&
+        allocateFromBlock(*candidate, order, &offset)) {
+      block = candidate.get();
+      break;
+    }
+  }
+  if (block == nullptr) {
+    block = createBlock(memoryTypeIndex, tiling);
+    if (block == nullptr) {
+      // The heap may still have room for the resource alone
+      return allocateDedicated(requirements.size, memoryTypeIndex);
+    }
+    allocateFromBlock(*block, order, &offset);
+  }
+
+  Allocation allocation;
+  allocation.memory = block->memory;
+  allocation.offset = offset;
+  allocation.size = kMinAllocationSize << order;
+  allocation.memoryTypeIndex = memoryTypeIndex;
+  if (block->mapped != nullptr) {
+    allocation.mapped = static_cast<uint8_t *>(block->mapped) + offset;
+  }
+  allocation.block = block;
+  allocation.order = order;
+  mStats.usedBytes += allocation.size;
+  return allocation;
+}
+
+void MemoryAllocator::free(Allocation &allocation) {
+  if (!allocation) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mMutex);
+  if (allocation.block != nullptr) {
+    freeToBlock(*allocation.block, allocation.offset, allocation.order);
+  } else {
+    mDevice.freeMemory(allocation.memory);
+    mStats.deviceMemoryCount--;
+    mStats.allocatedBytes -= allocation.size;
+  }
+  mStats.usedBytes -= allocation.size;
+  allocation = Allocation{};
+}
+
+MemoryAllocator::Stats MemoryAllocator::stats() const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mStats;
+}
+
+bool MemoryAllocator::findMemoryType(uint32_t typeBits,
+                                     vk::MemoryPropertyFlags properties,
+                                     uint32_t *memoryTypeIndex) const {
+  for (uint32_t i = 0; i < mMemoryProperties.memoryTypeCount; i++) {
+    if ((typeBits & (1u << i)) &&
+        (mMemoryProperties.memoryTypes[i].propertyFlags & properties) ==
+            properties) {
+      *memoryTypeIndex = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+Allocation MemoryAllocator::allocateDedicated(vk::DeviceSize size,
+                                              uint32_t memoryTypeIndex) {
+  Allocation allocation;
+  const vk::MemoryAllocateInfo allocateInfo{size, memoryTypeIndex};
+  if (mDevice.allocateMemory(&allocateInfo, nullptr, &allocation.memory) !=
+      vk::Result::eSuccess) {
+    LOGCATE("MemoryAllocator: failed to allocate %llu bytes",
+            static_cast<unsigned long long>(size));
+    return {};
+  }
+  allocation.size = size;
+  allocation.memoryTypeIndex = memoryTypeIndex;
+  allocation.mapped = mapIfHostVisible(allocation.memory, memoryTypeIndex);
+
+  mStats.deviceMemoryCount++;
+  mStats.allocatedBytes += size;
+  mStats.usedBytes += size;
+  return allocation;
+}
+
+MemoryBlock *MemoryAllocator::createBlock(uint32_t memoryTypeIndex,
+                                          Tiling tiling) {
+  auto block = std::make_unique<MemoryBlock>();
+  const vk::MemoryAllocateInfo allocateInfo{kBlockSize, memoryTypeIndex};
+  if (mDevice.allocateMemory(&allocateInfo, nullptr, &block->memory) !=
+      vk::Result::eSuccess) {
+    return nullptr;
+  }
+  block->memoryTypeIndex = memoryTypeIndex;
+  block->tiling = tiling;
+  block->mapped = mapIfHostVisible(block->memory, memoryTypeIndex);
+  block->freeLists.resize(kMaxOrder + 1);
+  block->freeLists[kMaxOrder].insert(0);
+
+  mStats.deviceMemoryCount++;
+  mStats.allocatedBytes += kBlockSize;
+  mBlocks.push_back(std::move(block));
+  return mBlocks.back().get();
+}
+
+bool MemoryAllocator::allocateFromBlock(MemoryBlock &block, uint32_t order,
+                                        vk::DeviceSize *offset) {
+  // Smallest free range that fits
+  uint32_t freeOrder = order;
+  while (freeOrder <= kMaxOrder && block.freeLists[freeOrder].empty()) {
+    ++freeOrder;
+  }
+  if (freeOrder > kMaxOrder) {
+    return false;
+  }
+
+  auto &freeList = block.freeLists[freeOrder];
+  *offset = *freeList.begin();
+  freeList.erase(freeList.begin());
+
+  // Split it, the upper halves stay free
+  while (freeOrder > order) {
+    --freeOrder;
+    block.freeLists[freeOrder].insert(*offset +
+                                      (kMinAllocationSize << freeOrder));
+  }
+  return true;
+}
+
+void MemoryAllocator::freeToBlock(MemoryBlock &block, vk::DeviceSize offset,
+                                  uint32_t order) {
+  // Merge with the buddy as long as it is free too
+  while (order < kMaxOrder) {
+    const vk::DeviceSize buddy = offset ^ (kMinAllocationSize << order);
+    auto it = block.freeLists[order].find(buddy);
+    if (it == block.freeLists[order].end()) {
+      break;
+    }
+    block.freeLists[order].erase(it);
+    offset = std::min(offset, buddy);
+    ++order;
+  }
+  // Empty blocks are kept for the next allocations, e.g. when the swap chain
+  // is resized
+  block.freeLists[order].insert(offset);
+}
+
+void *MemoryAllocator::mapIfHostVisible(vk::DeviceMemory memory,
+                                        uint32_t memoryTypeIndex) const {
+  if (!(mMemoryProperties.memoryTypes[memoryTypeIndex].propertyFlags &
+        vk::MemoryPropertyFlagBits::eHostVisible)) {
+    return nullptr;
+  }
+  void *mapped = nullptr;
+  CALL_VK(mDevice.mapMemory(memory, 0, VK_WHOLE_SIZE, vk::MemoryMapFlags(),
+                            &mapped));
+  return mapped;
+}
+} // namespace vks
@@ -0,0 +1,146 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef GAINVULKANSAMPLE_VULKANMEMORYALLOCATOR_H
+#define GAINVULKANSAMPLE_VULKANMEMORYALLOCATOR_H
+
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+namespace vks {
+struct MemoryBlock;
+
+// A range of device memory handed out by MemoryAllocator. Bind resources at
+// memory + offset.
+struct Allocation {
+  vk::DeviceMemory memory = nullptr;
+  vk::DeviceSize offset = 0;
+  vk::DeviceSize size = 0;
+  // Host address of offset if the memory is host visible, nullptr otherwise
+  void *mapped = nullptr;
+  uint32_t memoryTypeIndex = 0;
+
+  explicit operator bool() const { return static_cast<bool>(memory); }
+
+private:
+  friend class MemoryAllocator;
+  // Owning block, nullptr for a dedicated allocation
+  MemoryBlock *block = nullptr;
+  uint32_t order = 0;
+};
+
+// Sub-allocates device memory from large blocks, so the number of
+// VkDeviceMemory objects stays small however many buffers and images the
+// engines create. Drivers limit it by maxMemoryAllocationCount, often to a
+// few thousand, and allocateMemory itself is slow on mobile.
+//
+// Blocks belong to one memory type and are split with a buddy allocator.
+// Ranges are powers of two starting at kMinAllocationSize and are aligned to
+// their size, which covers any alignment the requirements ask for. If the
+// device has a bufferImageGranularity above 1, linear resources (buffers) and
+// optimal images are kept in separate blocks so they are never neighbours.
+// Host visible blocks stay mapped for their whole lifetime.
+class MemoryAllocator {
+public:
+  enum class Tiling { eLinear, eOptimal };
+
+  struct Stats {
+    // VkDeviceMemory objects currently allocated, blocks and dedicated ones
+    uint32_t deviceMemoryCount = 0;
+    vk::DeviceSize allocatedBytes = 0;
+    // Bytes handed out to resources, including the buddy rounding
+    vk::DeviceSize usedBytes = 0;
+  };
+
+  static constexpr vk::DeviceSize kBlockSize = 32 * 1024 * 1024;
+  static constexpr vk::DeviceSize kMinAllocationSize = 256;
+  // Larger requests get memory of their own. Rounding them up to a power of
+  // two would waste too much of a block.
+  static constexpr vk::DeviceSize kDedicatedThreshold = kBlockSize / 8;
+
+  MemoryAllocator(vk::PhysicalDevice physicalDevice, vk::Device device);
+
+  ~MemoryAllocator();
+
+  // Allocate memory for a resource with the given requirements from a memory
+  // type with all of properties. Returns an empty allocation on failure.
+  // Lazily allocated memory is never sub-allocated, a block of it would be
+  // committed as soon as one of its resources touches memory.
+  Allocation allocate(const vk::MemoryRequirements &requirements,
+                      vk::MemoryPropertyFlags properties, Tiling tiling);
+
+  // Return the allocation's range and reset it. The resource bound to it
+  // must not be in use by the GPU anymore.
+  void free(Allocation &allocation);
+
+  Stats stats() const;
+
+  // Whether one of the memory types in typeBits has all of properties, e.g.
+  // to prefer eLazilyAllocated memory where the device has it
+  bool hasMemoryType(uint32_t typeBits,
+                     vk::MemoryPropertyFlags properties) const {
+    uint32_t memoryTypeIndex = 0;
+    return findMemoryType(typeBits, properties, &memoryTypeIndex);
+  }
+
+private:
+  bool findMemoryType(uint32_t typeBits, vk::MemoryPropertyFlags properties,
+                      uint32_t *memoryTypeIndex) const;
+
+  Allocation allocateDedicated(vk::DeviceSize size, uint32_t memoryTypeIndex);
+
+  MemoryBlock *createBlock(uint32_t memoryTypeIndex, Tiling tiling);
+
+  bool allocateFromBlock(MemoryBlock &block, uint32_t order,
+                         vk::DeviceSize *offset);
+
+  void freeToBlock(MemoryBlock &block, vk::DeviceSize offset, uint32_t order);
+
+  void *mapIfHostVisible(vk::DeviceMemory memory,
+                         uint32_t memoryTypeIndex) const;
+
+  const vk::Device mDevice;
+  vk::PhysicalDeviceMemoryProperties mMemoryProperties;
+  const bool mSeparateTilings;
+
+  mutable std::mutex mMutex;
+  std::vector<std::unique_ptr<MemoryBlock>> mBlocks;
+  Stats mStats;
+};
+
+// One VkDeviceMemory split by MemoryAllocator
+struct MemoryBlock {
+  vk::DeviceMemory memory = nullptr;
+  void *mapped = nullptr;
+  uint32_t memoryTypeIndex = 0;
+  MemoryAllocator::Tiling tiling = MemoryAllocator::Tiling::eLinear;
+  // Offsets of the free ranges of kMinAllocationSize << order, by order
+  std::vector<std::set<vk::DeviceSize>> freeLists;
+};
+} // namespace vks
+
+#endif // GAINVULKANSAMPLE_VULKANMEMORYALLOCATOR_H
@@ -0,0 +1,180 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "VulkanReadbackRing.h"
+
+#include <LogUtil.h>
+
+namespace vks {
+std::unique_ptr<ReadbackRing> ReadbackRing::create(
+    const std::shared_ptr<vks::VulkanDeviceWrapper> deviceWrapper,
+    uint32_t slotCount) {
+  if (slotCount == 0) {
+    return nullptr;
+  }
+  return std::make_unique<ReadbackRing>(deviceWrapper, slotCount);
+}
+
+ReadbackRing::ReadbackRing(
+    const std::shared_ptr<vks::VulkanDeviceWrapper> deviceWrapper,
+    uint32_t slotCount)
+    : mDeviceWrapper(deviceWrapper) {
+  mSlots.reserve(slotCount);
+  for (uint32_t i = 0; i < slotCount; i++) {
+    mSlots.push_back(std::make_unique<Slot>());
+  }
+}
+
+ReadbackRing::~ReadbackRing() { mDeliveries.wait(); }
+
+bool ReadbackRing::supports(vk::Format format, vk::ImageUsageFlags usage) {
+  if (!(usage & vk::ImageUsageFlagBits::eTransferSrc)) {
+    return false;
+  }
+  switch (format) {
+  case vk::Format::eR8G8B8A8Unorm:
+  case vk::Format::eR8G8B8A8Srgb:
+  case vk::Format::eB8G8R8A8Unorm:
+  case vk::Format::eB8G8R8A8Srgb:
+  case vk::Format::eA2B10G10R10UnormPack32:
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool ReadbackRing::reserve(Slot &slot, vk::DeviceSize size) {
+  if (slot.buffer && slot.buffer->getDescriptor().range >= size) {
+    return true;
+  }
+  slot.buffer.reset();
+  // Read by the CPU, so prefer cached memory
+  slot.buffer = vks::Buffer::create(
+      mDeviceWrapper, static_cast<uint32_t>(size),
+      vk::BufferUsageFlagBits::eTransferDst,
+      vk::MemoryPropertyFlagBits::eHostVisible |
+          vk::MemoryPropertyFlagBits::eHostCached);
+  if (!slot.buffer) {
+    slot.buffer = vks::Buffer::create(
+        mDeviceWrapper, static_cast<uint32_t>(size),
+        vk::BufferUsageFlagBits::eTransferDst,
+        vk::MemoryPropertyFlagBits::eHostVisible |
+            vk::MemoryPropertyFlagBits::eHostCoherent);
+  }
+  if (!slot.buffer || slot.buffer->map() != vk::Result::eSuccess) {
+    LOGCATE("ReadbackRing: failed to create a buffer of %llu bytes",
+            static_cast<unsigned long long>(size));
+    slot.buffer.reset();
+    return false;
+  }
+  vks::debug::setBufferName(mDeviceWrapper->logicalDevice,
+                            slot.buffer->getBufferHandle(), "ReadbackRing");
+  return true;
+}
+
+bool ReadbackRing::record(vk::CommandBuffer cmd, vk::Image image,
+                          ResourceState &state, ResourceUsage next,
+                          vk::Format format, uint32_t width, uint32_t height,
+                          Callback callback) {
+  Slot *slot = nullptr;
+  for (size_t i = 0; i < mSlots.size(); i++) {
+    Slot &candidate = *mSlots[(mNext + i) % mSlots.size()];
+    // Acquire: the worker is done with the buffer
+    if (!candidate.busy.load(std::memory_order_acquire)) {
+      slot = &candidate;
+      mNext = static_cast<uint32_t>((mNext + i + 1) % mSlots.size());
+      break;
+    }
+  }
+  const uint32_t rowPitch = width * 4;
+  if (slot == nullptr ||
+      !reserve(*slot, static_cast<vk::DeviceSize>(rowPitch) * height)) {
+    mDropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  const vk::ImageSubresourceRange range{vk::ImageAspectFlagBits::eColor, 0, 1,
+                                        0, 1};
+  const vk::Buffer buffer = slot->buffer->getBufferHandle();
+  BarrierBatch batch(*mDeviceWrapper);
+  batch.image(image, range, state, ResourceUsage::TransferSrc);
+  batch.record(cmd);
+
+  vk::BufferImageCopy region{};
+  region.imageSubresource = {vk::ImageAspectFlagBits::eColor, 0, 0, 1};
+  region.imageExtent = vk::Extent3D{width, height, 1};
+  cmd.copyImageToBuffer(image, vk::ImageLayout::eTransferSrcOptimal, buffer,
+                        1, &region);
+
+  // The host has read the buffer before the slot was free again, so the
+  // copy is its first write and needs no barrier
+  ResourceState bufferState;
+  batch.buffer(buffer, bufferState, ResourceUsage::TransferDst);
+  batch.buffer(buffer, bufferState, ResourceUsage::HostRead);
+  batch.image(image, range, state, next);
+  batch.record(cmd);
+
+  slot->busy.store(true, std::memory_order_relaxed);
+  slot->callback = std::move(callback);
+  slot->pixels = {nullptr, width, height, rowPitch, format};
+  mRecorded.push_back(slot);
+  return true;
+}
+
+void ReadbackRing::submitted(vk::Fence fence) {
+  for (Slot *slot : mRecorded) {
+    slot->fence = fence;
+  }
+  mRecorded.clear();
+}
+
+void ReadbackRing::cancel() {
+  for (Slot *slot : mRecorded) {
+    slot->callback = nullptr;
+    slot->busy.store(false, std::memory_order_release);
+    mDropped.fetch_add(1, std::memory_order_relaxed);
+  }
+  mRecorded.clear();
+}
+
+void ReadbackRing::collect() {
+  for (auto &slotPtr : mSlots) {
+    Slot *slot = slotPtr.get();
+    if (!slot->fence || mDeviceWrapper->logicalDevice.getFenceStatus(
+                            slot->fence) != vk::Result::eSuccess) {
+      continue;
+    }
+    slot->fence = nullptr;
+    // The slot is not touched by this thread again until busy is cleared
+    mDeliveries.run([slot]() {
+      slot->buffer->invalidate();
+      slot->pixels.data = slot->buffer->getMappedData();
+      slot->callback(slot->pixels);
+      slot->callback = nullptr;
+      // Release: record sees the slot free only after the callback is done
+      slot->busy.store(false, std::memory_order_release);
+    });
+  }
+}
+} // namespace vks
@@ -0,0 +1,128 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef GAINVULKANSAMPLE_VULKANREADBACKRING_H
+#define GAINVULKANSAMPLE_VULKANREADBACKRING_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "TaskScheduler.h"
+#include "VulkanBarriers.h"
+#include "VulkanBufferWrapper.h"
+#include "VulkanDeviceWrapper.hpp"
+
+namespace vks {
+// Copies rendered images back to the CPU without ever blocking the render
+// thread. The copy is recorded into the frame's own command buffer, into
+// one of a ring of persistently mapped, host cached buffers. Once the
+// frame's fence has signaled, collect hands the buffer to a worker of
+// gain::TaskScheduler, which invalidates it and calls back. If every buffer
+// is still busy the image is skipped, not waited for.
+class ReadbackRing {
+public:
+  struct Pixels {
+    // Tightly packed rows, valid only during the callback
+    const void *data;
+    uint32_t width;
+    uint32_t height;
+    uint32_t rowPitch;
+    vk::Format format;
+  };
+
+  // Called on a worker thread
+  using Callback = std::function<void(const Pixels &pixels)>;
+
+  static std::unique_ptr<ReadbackRing>
+  create(const std::shared_ptr<vks::VulkanDeviceWrapper> deviceWrapper,
+         uint32_t slotCount);
+
+  // Prefer ReadbackRing::create
+  ReadbackRing(const std::shared_ptr<vks::VulkanDeviceWrapper> deviceWrapper,
+               uint32_t slotCount);
+
+  // The GPU must be idle. Copies recorded but not collected yet are
+  // dropped, deliveries already handed out are waited for.
+  ~ReadbackRing();
+
+  // Whether image can be read back, it needs to be created with
+  // eTransferSrc usage and have 4 bytes per pixel
+  static bool supports(vk::Format format, vk::ImageUsageFlags usage);
+
+  // Record a copy of image, whose state is where the recorded work left it,
+  // into cmd. The copy waits for the last write only, and the image is then
+  // made ready for next, its next use. state is advanced. Returns false if
+  // no buffer is free, nothing is recorded then. The buffer stays reserved
+  // until submitted or cancel.
+  bool record(vk::CommandBuffer cmd, vk::Image image, ResourceState &state,
+              ResourceUsage next, vk::Format format, uint32_t width,
+              uint32_t height, Callback callback);
+
+  // The copies recorded since the last call have been queued, fence is
+  // signaled once their submission has finished
+  void submitted(vk::Fence fence);
+
+  // The copies recorded since the last call will never be submitted, e.g.
+  // because the submission failed. Their buffers are free again and they
+  // count as dropped.
+  void cancel();
+
+  // Deliver the copies whose fence has signaled. Call before those fences
+  // are reset for their next submission. Never blocks.
+  void collect();
+
+  // Images skipped because no buffer was free
+  uint64_t droppedCount() const {
+    return mDropped.load(std::memory_order_relaxed);
+  }
+
+private:
+  struct Slot {
+    std::unique_ptr<vks::Buffer> buffer;
+    // From record until the callback has returned or the copy is canceled
+    std::atomic<bool> busy{false};
+    // Set from submitted until collect hands the slot out
+    vk::Fence fence = nullptr;
+    Callback callback;
+    Pixels pixels;
+  };
+
+  // Make slot's buffer hold at least size bytes
+  bool reserve(Slot &slot, vk::DeviceSize size);
+
+  const std::shared_ptr<vks::VulkanDeviceWrapper> mDeviceWrapper;
+  std::vector<std::unique_ptr<Slot>> mSlots;
+  // Slot record tries first, so slots are used round robin
+  uint32_t mNext = 0;
+  // Recorded, but not submitted or canceled yet
+  std::vector<Slot *> mRecorded;
+  std::atomic<uint64_t> mDropped{0};
+
+  gain::TaskGroup mDeliveries;
+};
+} // namespace vks
+
+#endif // GAINVULKANSAMPLE_VULKANREADBACKRING_H
@@ -25,16 +25,24 @@
 
 #include "VulkanSwapChain.h"
 
-void VulkanSwapChain::initSurface(ANativeWindow *window) {
+void VulkanSwapChain::initSurface(gain::NativeWindow *window) {
   vk::Result err = vk::Result::eSuccess;
 
   // Create the os-specific surface
+#ifdef __ANDROID__
   vk::AndroidSurfaceCreateInfoKHR surfaceCreateInfo = {};
   surfaceCreateInfo.window = window;
   err = instance.createAndroidSurfaceKHR(&surfaceCreateInfo, NULL, &surface);
+#else
+  // The headless surface has no extent of its own, create() uses the size
+  // passed in by the engine
+  (void)window;
+  vk::HeadlessSurfaceCreateInfoEXT surfaceCreateInfo = {};
+  err = instance.createHeadlessSurfaceEXT(&surfaceCreateInfo, NULL, &surface);
+#endif
 
   if (err != vk::Result::eSuccess) {
-    LOGCATE("Could not create surface!", err);
+    LOGCATE("Could not create surface, error %d", static_cast<int>(err));
   }
 
   // Get available queue family properties
@@ -85,13 +93,12 @@ void VulkanSwapChain::initSurface(ANativeWindow *window) {
   // Exit if either a graphics or a presenting queue hasn't been found
   if (graphicsQueueNodeIndex == UINT32_MAX ||
       presentQueueNodeIndex == UINT32_MAX) {
-    LOGCATE("Could not find a graphics and/or presenting queue!", -1);
+    LOGCATE("Could not find a graphics and/or presenting queue!");
   }
 
   // todo : Add support for separate graphics and presenting queue
   if (graphicsQueueNodeIndex != presentQueueNodeIndex) {
-    LOGCATE("Separate graphics and presenting queues are not supported yet!",
-            -1);
+    LOGCATE("Separate graphics and presenting queues are not supported yet!");
   }
 
   queueNodeIndex = graphicsQueueNodeIndex;
@@ -283,6 +290,8 @@ void VulkanSwapChain::create(int32_t *width, int32_t *height, bool vsync) {
     swapchainCI.imageUsage |= vk::ImageUsageFlagBits::eTransferDst;
   }
 
+  imageUsage = swapchainCI.imageUsage;
+  extent = swapchainCI.imageExtent;
   CALL_VK(device.createSwapchainKHR(&swapchainCI, nullptr, &swapChain));
 
   // If an existing swap chain is re-created, destroy the old swap chain
@@ -32,6 +32,7 @@
 #include <vector>
 
 #include "../util/LogUtil.h"
+#include "platform/Platform.h"
 #include <vulkan/vulkan.hpp>
 
 typedef struct _SwapChainBuffers {
@@ -49,13 +50,16 @@ private:
 public:
   vk::Format colorFormat;
   vk::ColorSpaceKHR colorSpace;
+  // Usage and size the images were created with
+  vk::ImageUsageFlags imageUsage;
+  vk::Extent2D extent;
   vk::SwapchainKHR swapChain = VK_NULL_HANDLE;
   uint32_t imageCount;
   std::vector<vk::Image> images;
   std::vector<SwapChainBuffer> buffers;
   uint32_t queueNodeIndex = UINT32_MAX;
 
-  void initSurface(ANativeWindow *window);
+  void initSurface(gain::NativeWindow *window);
   void connect(vk::Instance instance, vk::PhysicalDevice physicalDevice,
                vk::Device device);
   void create(int32_t *width, int32_t *height, bool vsync = false);
@@ -0,0 +1,88 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "VulkanUniformRing.h"
+
+#include <LogUtil.h>
+
+namespace vks {
+namespace {
+vk::DeviceSize alignUp(vk::DeviceSize value, vk::DeviceSize alignment) {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+} // namespace
+
+std::unique_ptr<UniformRing>
+UniformRing::create(const std::shared_ptr<vks::VulkanDeviceWrapper> deviceWrapper,
+                    vk::DeviceSize regionSize, uint32_t regionCount) {
+  auto ring =
+      std::make_unique<UniformRing>(deviceWrapper, regionSize, regionCount);
+  return ring->initialize() ? std::move(ring) : nullptr;
+}
+
+UniformRing::UniformRing(
+    const std::shared_ptr<vks::VulkanDeviceWrapper> deviceWrapper,
+    vk::DeviceSize regionSize, uint32_t regionCount)
+    : mDeviceWrapper(deviceWrapper),
+      mAlignment(std::max<vk::DeviceSize>(
+          deviceWrapper->properties.limits.minUniformBufferOffsetAlignment,
+          1)),
+      mRegionSize(alignUp(regionSize, mAlignment)),
+      mRegionCount(regionCount) {}
+
+bool UniformRing::initialize() {
+  mBuffer = vks::Buffer::create(
+      mDeviceWrapper, static_cast<uint32_t>(mRegionSize * mRegionCount),
+      vk::BufferUsageFlagBits::eUniformBuffer,
+      vk::MemoryPropertyFlagBits::eHostVisible |
+          vk::MemoryPropertyFlagBits::eHostCoherent);
+  if (mBuffer == nullptr) {
+    return false;
+  }
+  // The memory is a shared allocator block, so name the buffer instead
+  vks::debug::setBufferName(mDeviceWrapper->logicalDevice,
+                            mBuffer->getBufferHandle(), "UniformRing");
+  // Host coherent, so the buffer can stay mapped for its whole lifetime
+  return mBuffer->map() == vk::Result::eSuccess;
+}
+
+void UniformRing::beginRegion(uint32_t region) {
+  assert(region < mRegionCount);
+  mRegionBegin = region * mRegionSize;
+  mHead = mRegionBegin;
+}
+
+bool UniformRing::push(const void *data, vk::DeviceSize size,
+                       uint32_t *dynamicOffset) {
+  if (mHead + size > mRegionBegin + mRegionSize) {
+    LOGCATE("UniformRing: region of %llu bytes is full",
+            static_cast<unsigned long long>(mRegionSize));
+    return false;
+  }
+  mBuffer->copyFrom(data, size, mHead);
+  *dynamicOffset = static_cast<uint32_t>(mHead);
+  mHead = alignUp(mHead + size, mAlignment);
+  return true;
+}
+} // namespace vks
@@ -0,0 +1,83 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef GAINVULKANSAMPLE_VULKANUNIFORMRING_H
+#define GAINVULKANSAMPLE_VULKANUNIFORMRING_H
+
+#include <memory>
+
+#include "VulkanBufferWrapper.h"
+#include "VulkanDeviceWrapper.hpp"
+
+namespace vks {
+// Per-frame uniform data without map calls or hazards. One persistently
+// mapped buffer is split into a region per frame slot. Each frame writes
+// only its slot's region, and only once the slot's fence has signaled.
+// Blocks are bump allocated at minUniformBufferOffsetAlignment, and their
+// offsets are passed as dynamic offsets of an eUniformBufferDynamic binding.
+class UniformRing {
+public:
+  static std::unique_ptr<UniformRing>
+  create(const std::shared_ptr<vks::VulkanDeviceWrapper> deviceWrapper,
+         vk::DeviceSize regionSize, uint32_t regionCount);
+
+  // Prefer UniformRing::create
+  UniformRing(const std::shared_ptr<vks::VulkanDeviceWrapper> deviceWrapper,
+              vk::DeviceSize regionSize, uint32_t regionCount);
+
+  // Start writing region from its beginning. Everything pushed into it
+  // before must no longer be in use by the GPU.
+  void beginRegion(uint32_t region);
+
+  // Copy size bytes into the current region. Returns false if the region is
+  // full, otherwise dynamicOffset is the offset to bind the data with.
+  bool push(const void *data, vk::DeviceSize size, uint32_t *dynamicOffset);
+
+  template <typename T> bool push(const T &data, uint32_t *dynamicOffset) {
+    return push(&data, sizeof(T), dynamicOffset);
+  }
+
+  // Descriptor for an eUniformBufferDynamic binding of blocks of range bytes
+  vk::DescriptorBufferInfo descriptor(vk::DeviceSize range) const {
+    return {mBuffer->getBufferHandle(), 0, range};
+  }
+
+private:
+  bool initialize();
+
+  const std::shared_ptr<vks::VulkanDeviceWrapper> mDeviceWrapper;
+  const vk::DeviceSize mAlignment;
+  // Size of a region, a multiple of mAlignment
+  const vk::DeviceSize mRegionSize;
+  const uint32_t mRegionCount;
+
+  std::unique_ptr<vks::Buffer> mBuffer;
+
+  // Bounds of the current region and its first unused byte
+  vk::DeviceSize mRegionBegin = 0;
+  vk::DeviceSize mHead = 0;
+};
+} // namespace vks
+
+#endif // GAINVULKANSAMPLE_VULKANUNIFORMRING_H
@@ -0,0 +1,449 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "VulkanUploadManager.h"
+
+#include <LogUtil.h>
+#include <cstring>
+
+namespace vks {
+namespace {
+// Staging buffers of this size are kept for later batches, bigger uploads get
+// a buffer of their own that is freed with the batch
+constexpr vk::DeviceSize kStagingBlockSize = 1 << 20;
+
+// Offsets of copyBufferToImage have to be a multiple of the texel size and 4
+constexpr vk::DeviceSize kStagingAlignment = 16;
+
+vk::DeviceSize alignUp(vk::DeviceSize value, vk::DeviceSize alignment) {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+vk::DeviceSize capacity(const vks::Buffer &buffer) {
+  return buffer.getDescriptor().range;
+}
+} // namespace
+
+std::unique_ptr<UploadManager> UploadManager::create(
+    const std::shared_ptr<vks::VulkanDeviceWrapper> deviceWrapper,
+    vk::Queue transferQueue, vk::Queue graphicsQueue) {
+  auto manager = std::make_unique<UploadManager>(deviceWrapper, transferQueue,
+                                                 graphicsQueue);
+  return manager->initialize() ? std::move(manager) : nullptr;
+}
+
+UploadManager::UploadManager(
+    const std::shared_ptr<vks::VulkanDeviceWrapper> deviceWrapper,
+    vk::Queue transferQueue, vk::Queue graphicsQueue)
+    : mDeviceWrapper(deviceWrapper), mTransferQueue(transferQueue),
+      mGraphicsQueue(graphicsQueue),
+      mTransferFamily(deviceWrapper->queueFamilyIndices.transfer),
+      mGraphicsFamily(deviceWrapper->queueFamilyIndices.graphics),
+      mTimeline(deviceWrapper->timelineSemaphoreSupported) {}
+
+bool UploadManager::initialize() {
+  const vk::Device device = mDeviceWrapper->logicalDevice;
+
+  mTransferPool = mDeviceWrapper->createCommandPool(
+      mTransferFamily, vk::CommandPoolCreateFlagBits::eTransient);
+  if (hasDedicatedTransferQueue()) {
+    mGraphicsPool = mDeviceWrapper->createCommandPool(
+        mGraphicsFamily, vk::CommandPoolCreateFlagBits::eTransient);
+  }
+
+  if (mTimeline) {
+    vk::SemaphoreTypeCreateInfoKHR typeInfo{};
+    typeInfo.semaphoreType = vk::SemaphoreTypeKHR::eTimeline;
+    typeInfo.initialValue = 0;
+    vk::SemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.pNext = &typeInfo;
+    CALL_VK(device.createSemaphore(&semaphoreInfo, nullptr,
+                                   &mTimelineSemaphore));
+  }
+
+  LOGCATI("UploadManager: transfer family %u, graphics family %u, %s",
+          mTransferFamily, mGraphicsFamily,
+          mTimeline ? "timeline semaphore" : "fences");
+  return true;
+}
+
+UploadManager::~UploadManager() {
+  const vk::Device device = mDeviceWrapper->logicalDevice;
+
+  mTransferQueue.waitIdle();
+  mGraphicsQueue.waitIdle();
+  destroyBatch(mPending);
+  for (auto &batch : mInFlight) {
+    destroyBatch(batch);
+  }
+  mInFlight.clear();
+  mFreeStagingBuffers.clear();
+
+  if (mTimelineSemaphore) {
+    device.destroySemaphore(mTimelineSemaphore);
+  }
+  if (mGraphicsPool) {
+    device.destroyCommandPool(mGraphicsPool);
+  }
+  if (mTransferPool) {
+    device.destroyCommandPool(mTransferPool);
+  }
+}
+
+bool UploadManager::uploadBuffer(vk::Buffer dst, const void *data,
+                                 vk::DeviceSize size, vk::DeviceSize dstOffset,
+                                 vk::PipelineStageFlags dstStage,
+                                 vk::AccessFlags dstAccess) {
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  vk::DeviceSize srcOffset = 0;
+  if (!stage(data, size, &srcOffset) || !beginPending()) {
+    return false;
+  }
+
+  vk::BufferCopy region{srcOffset, dstOffset, size};
+  mPending.transferCommandBuffer.copyBuffer(
+      mPending.stagingBuffers.back()->getBufferHandle(), dst, 1, &region);
+
+  vk::BufferMemoryBarrier barrier{};
+  barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+  barrier.dstAccessMask = dstAccess;
+  barrier.buffer = dst;
+  barrier.offset = dstOffset;
+  barrier.size = size;
+  mBufferBarriers.push_back(barrier);
+  mDstStages |= dstStage;
+  return true;
+}
+
+bool UploadManager::uploadImage(vk::Image dst, vk::Extent3D extent,
+                                const void *data, vk::DeviceSize size,
+                                vk::ImageLayout finalLayout,
+                                vk::PipelineStageFlags dstStage,
+                                vk::AccessFlags dstAccess) {
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  vk::DeviceSize srcOffset = 0;
+  if (!stage(data, size, &srcOffset) || !beginPending()) {
+    return false;
+  }
+  const vk::CommandBuffer cmd = mPending.transferCommandBuffer;
+
+  // The old content is discarded, so the transition needs no ownership
+  // transfer even if the image was used on the graphics queue before
+  vk::ImageMemoryBarrier barrier{};
+  barrier.srcAccessMask = {};
+  barrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
+  barrier.oldLayout = vk::ImageLayout::eUndefined;
+  barrier.newLayout = vk::ImageLayout::eTransferDstOptimal;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = dst;
+  barrier.subresourceRange = {vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1};
+  cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe,
+                      vk::PipelineStageFlagBits::eTransfer, {}, 0, nullptr, 0,
+                      nullptr, 1, &barrier);
+
+  vk::BufferImageCopy region{};
+  region.bufferOffset = srcOffset;
+  region.imageSubresource = {vk::ImageAspectFlagBits::eColor, 0, 0, 1};
+  region.imageExtent = extent;
+  cmd.copyBufferToImage(mPending.stagingBuffers.back()->getBufferHandle(), dst,
+                        vk::ImageLayout::eTransferDstOptimal, 1, &region);
+
+  barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+  barrier.dstAccessMask = dstAccess;
+  barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+  barrier.newLayout = finalLayout;
+  mImageBarriers.push_back(barrier);
+  mDstStages |= dstStage;
+  return true;
+}
+
+uint64_t UploadManager::flush() {
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  if (!mPending.transferCommandBuffer) {
+    return 0;
+  }
+  const vk::Device device = mDeviceWrapper->logicalDevice;
+  const vk::CommandBuffer transferCmd = mPending.transferCommandBuffer;
+
+  if (!mTimeline) {
+    vk::FenceCreateInfo fenceInfo{};
+    CALL_VK(device.createFence(&fenceInfo, nullptr, &mPending.fence));
+  }
+
+  if (!hasDedicatedTransferQueue()) {
+    // Make the uploads visible to everything submitted to the queue later
+    transferCmd.pipelineBarrier(
+        vk::PipelineStageFlagBits::eTransfer, mDstStages, {}, 0, nullptr,
+        static_cast<uint32_t>(mBufferBarriers.size()), mBufferBarriers.data(),
+        static_cast<uint32_t>(mImageBarriers.size()), mImageBarriers.data());
+    transferCmd.end();
+
+    mPending.value = ++mLastValue;
+    vk::TimelineSemaphoreSubmitInfoKHR timelineInfo{};
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &mPending.value;
+    vk::SubmitInfo submitInfo{};
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &transferCmd;
+    if (mTimeline) {
+      submitInfo.pNext = &timelineInfo;
+      submitInfo.signalSemaphoreCount = 1;
+      submitInfo.pSignalSemaphores = &mTimelineSemaphore;
+    }
+    CALL_VK(mTransferQueue.submit(1, &submitInfo, mPending.fence));
+  } else {
+    // Release on the transfer queue. The same barriers acquire the
+    // destinations on the graphics queue, with the access masks of the side
+    // they execute on.
+    for (auto &barrier : mBufferBarriers) {
+      barrier.srcQueueFamilyIndex = mTransferFamily;
+      barrier.dstQueueFamilyIndex = mGraphicsFamily;
+    }
+    for (auto &barrier : mImageBarriers) {
+      barrier.srcQueueFamilyIndex = mTransferFamily;
+      barrier.dstQueueFamilyIndex = mGraphicsFamily;
+    }
+    std::vector<vk::BufferMemoryBarrier> releaseBuffers = mBufferBarriers;
+    std::vector<vk::ImageMemoryBarrier> releaseImages = mImageBarriers;
+    for (auto &barrier : releaseBuffers) {
+      barrier.dstAccessMask = {};
+    }
+    for (auto &barrier : releaseImages) {
+      barrier.dstAccessMask = {};
+    }
+    transferCmd.pipelineBarrier(
+        vk::PipelineStageFlagBits::eTransfer,
+        vk::PipelineStageFlagBits::eBottomOfPipe, {}, 0, nullptr,
+        static_cast<uint32_t>(releaseBuffers.size()), releaseBuffers.data(),
+        static_cast<uint32_t>(releaseImages.size()), releaseImages.data());
+    transferCmd.end();
+
+    vk::CommandBufferAllocateInfo allocateInfo{
+        mGraphicsPool, vk::CommandBufferLevel::ePrimary, 1};
+    CALL_VK(device.allocateCommandBuffers(&allocateInfo,
+                                          &mPending.acquireCommandBuffer));
+    const vk::CommandBuffer acquireCmd = mPending.acquireCommandBuffer;
+    vk::CommandBufferBeginInfo beginInfo{
+        vk::CommandBufferUsageFlagBits::eOneTimeSubmit};
+    CALL_VK(acquireCmd.begin(&beginInfo));
+    for (auto &barrier : mBufferBarriers) {
+      barrier.srcAccessMask = {};
+    }
+    for (auto &barrier : mImageBarriers) {
+      barrier.srcAccessMask = {};
+    }
+    // Chained to the semaphore wait below, which waits at the same stages.
+    // Later submissions to the graphics queue are in the second scope, so
+    // they see the uploads.
+    acquireCmd.pipelineBarrier(
+        mDstStages, mDstStages, {}, 0, nullptr,
+        static_cast<uint32_t>(mBufferBarriers.size()), mBufferBarriers.data(),
+        static_cast<uint32_t>(mImageBarriers.size()), mImageBarriers.data());
+    acquireCmd.end();
+
+    // The transfer hands over to the acquire through a binary semaphore of
+    // its own. Signaling the timeline from both queues could complete the
+    // transfer of a later batch before the acquire of an earlier one, and
+    // timeline values must only go up.
+    mPending.value = ++mLastValue;
+    vk::SemaphoreCreateInfo semaphoreInfo{};
+    CALL_VK(device.createSemaphore(&semaphoreInfo, nullptr,
+                                   &mPending.semaphore));
+
+    vk::SubmitInfo transferSubmit{};
+    transferSubmit.commandBufferCount = 1;
+    transferSubmit.pCommandBuffers = &transferCmd;
+    transferSubmit.signalSemaphoreCount = 1;
+    transferSubmit.pSignalSemaphores = &mPending.semaphore;
+    CALL_VK(mTransferQueue.submit(1, &transferSubmit, nullptr));
+
+    // Work of the graphics queue that does not read the uploads can run
+    // ahead of the transfer
+    const vk::PipelineStageFlags waitStage = mDstStages;
+    vk::TimelineSemaphoreSubmitInfoKHR acquireTimeline{};
+    acquireTimeline.signalSemaphoreValueCount = 1;
+    acquireTimeline.pSignalSemaphoreValues = &mPending.value;
+    vk::SubmitInfo acquireSubmit{};
+    acquireSubmit.pNext = mTimeline ? &acquireTimeline : nullptr;
+    acquireSubmit.waitSemaphoreCount = 1;
+    acquireSubmit.pWaitSemaphores = &mPending.semaphore;
+    acquireSubmit.pWaitDstStageMask = &waitStage;
+    acquireSubmit.commandBufferCount = 1;
+    acquireSubmit.pCommandBuffers = &acquireCmd;
+    if (mTimeline) {
+      acquireSubmit.signalSemaphoreCount = 1;
+      acquireSubmit.pSignalSemaphores = &mTimelineSemaphore;
+    }
+    CALL_VK(mGraphicsQueue.submit(1, &acquireSubmit, mPending.fence));
+  }
+
+  const uint64_t value = mPending.value;
+  mInFlight.push_back(std::move(mPending));
+  mPending = Batch();
+  mStagingHead = 0;
+  mBufferBarriers.clear();
+  mImageBarriers.clear();
+  mDstStages = {};
+
+  collect();
+  return value;
+}
+
+bool UploadManager::isComplete(uint64_t value) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  collect();
+  return value <= mCompletedValue;
+}
+
+void UploadManager::wait(uint64_t value) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  if (value > mLastValue) {
+    LOGCATE("UploadManager: waiting for %llu, which was never submitted",
+            static_cast<unsigned long long>(value));
+    return;
+  }
+
+  const vk::Device device = mDeviceWrapper->logicalDevice;
+  if (mTimeline) {
+    vk::SemaphoreWaitInfoKHR waitInfo{};
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &mTimelineSemaphore;
+    waitInfo.pValues = &value;
+    CALL_VK(device.waitSemaphoresKHR(&waitInfo, UINT64_MAX));
+  } else {
+    // Batches complete in order, so waiting for the batch of value is enough
+    for (const auto &batch : mInFlight) {
+      if (batch.value >= value) {
+        CALL_VK(device.waitForFences(1, &batch.fence, VK_TRUE, UINT64_MAX));
+        break;
+      }
+    }
+  }
+  collect();
+}
+
+bool UploadManager::stage(const void *data, vk::DeviceSize size,
+                          vk::DeviceSize *offset) {
+  auto &buffers = mPending.stagingBuffers;
+  const vk::DeviceSize head = alignUp(mStagingHead, kStagingAlignment);
+  if (buffers.empty() || head + size > capacity(*buffers.back())) {
+    collect();
+    std::unique_ptr<vks::Buffer> buffer;
+    if (size <= kStagingBlockSize && !mFreeStagingBuffers.empty()) {
+      buffer = std::move(mFreeStagingBuffers.back());
+      mFreeStagingBuffers.pop_back();
+    } else {
+      buffer = vks::Buffer::create(
+          mDeviceWrapper,
+          static_cast<uint32_t>(std::max(size, kStagingBlockSize)),
+          vk::BufferUsageFlagBits::eTransferSrc,
+          vk::MemoryPropertyFlagBits::eHostVisible |
+              vk::MemoryPropertyFlagBits::eHostCoherent);
+      // Host coherent, so the buffer can stay mapped for its whole lifetime
+      if (buffer == nullptr || buffer->map() != vk::Result::eSuccess) {
+        LOGCATE("UploadManager: failed to create a staging buffer of %llu "
+                "bytes",
+                static_cast<unsigned long long>(size));
+        return false;
+      }
+    }
+    buffers.push_back(std::move(buffer));
+    *offset = 0;
+  } else {
+    *offset = head;
+  }
+
+  buffers.back()->copyFrom(data, size, *offset);
+  mStagingHead = *offset + size;
+  return true;
+}
+
+bool UploadManager::beginPending() {
+  if (mPending.transferCommandBuffer) {
+    return true;
+  }
+
+  vk::CommandBufferAllocateInfo allocateInfo{
+      mTransferPool, vk::CommandBufferLevel::ePrimary, 1};
+  CALL_VK(mDeviceWrapper->logicalDevice.allocateCommandBuffers(
+      &allocateInfo, &mPending.transferCommandBuffer));
+  vk::CommandBufferBeginInfo beginInfo{
+      vk::CommandBufferUsageFlagBits::eOneTimeSubmit};
+  CALL_VK(mPending.transferCommandBuffer.begin(&beginInfo));
+  return true;
+}
+
+void UploadManager::collect() {
+  const vk::Device device = mDeviceWrapper->logicalDevice;
+
+  if (mTimeline && !mInFlight.empty()) {
+    uint64_t counter = 0;
+    CALL_VK(device.getSemaphoreCounterValueKHR(mTimelineSemaphore, &counter));
+    mCompletedValue = std::max(mCompletedValue, counter);
+  }
+
+  while (!mInFlight.empty()) {
+    Batch &batch = mInFlight.front();
+    if (!mTimeline) {
+      if (device.getFenceStatus(batch.fence) != vk::Result::eSuccess) {
+        break;
+      }
+      mCompletedValue = batch.value;
+    } else if (batch.value > mCompletedValue) {
+      break;
+    }
+
+    for (auto &buffer : batch.stagingBuffers) {
+      if (capacity(*buffer) == kStagingBlockSize) {
+        mFreeStagingBuffers.push_back(std::move(buffer));
+      }
+    }
+    destroyBatch(batch);
+    mInFlight.pop_front();
+  }
+}
+
+void UploadManager::destroyBatch(Batch &batch) {
+  const vk::Device device = mDeviceWrapper->logicalDevice;
+
+  if (batch.transferCommandBuffer) {
+    device.freeCommandBuffers(mTransferPool, 1, &batch.transferCommandBuffer);
+  }
+  if (batch.acquireCommandBuffer) {
+    device.freeCommandBuffers(mGraphicsPool, 1, &batch.acquireCommandBuffer);
+  }
+  if (batch.fence) {
+    device.destroyFence(batch.fence);
+  }
+  if (batch.semaphore) {
+    device.destroySemaphore(batch.semaphore);
+  }
+  batch.stagingBuffers.clear();
+  batch = Batch();
+}
+} // namespace vks
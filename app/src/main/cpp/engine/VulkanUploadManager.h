@@ -0,0 +1,150 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef GAINVULKANSAMPLE_VULKANUPLOADMANAGER_H
+#define GAINVULKANSAMPLE_VULKANUPLOADMANAGER_H
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "VulkanBufferWrapper.h"
+#include "VulkanDeviceWrapper.hpp"
+
+namespace vks {
+// Uploads of static data, e.g. vertices, LUTs and textures, into device
+// local buffers and images. Uploads queued from any thread are recorded into
+// one command buffer and submitted as one batch by flush. The batch runs on
+// the transfer-only queue family if the device has one, and the ownership of
+// the destinations is then transferred to the graphics family.
+//
+// Every batch completes with a value of a timeline semaphore, or of a fence
+// per batch if timeline semaphores are not supported. Only the batch's last
+// submission signals the timeline, so values complete in order. Work
+// submitted to the graphics queue after flush is ordered after the uploads
+// without waiting on anything, so the value is only needed to know when the
+// host may free the source data of an upload to a destination that is
+// destroyed early.
+class UploadManager {
+public:
+  static std::unique_ptr<UploadManager>
+  create(const std::shared_ptr<vks::VulkanDeviceWrapper> deviceWrapper,
+         vk::Queue transferQueue, vk::Queue graphicsQueue);
+
+  // Prefer UploadManager::create
+  UploadManager(const std::shared_ptr<vks::VulkanDeviceWrapper> deviceWrapper,
+                vk::Queue transferQueue, vk::Queue graphicsQueue);
+
+  ~UploadManager();
+
+  // Queue a copy of size bytes of data into dst at dstOffset. data is copied
+  // into a staging buffer right away. dstStage and dstAccess describe the
+  // first use of dst after the upload.
+  bool uploadBuffer(vk::Buffer dst, const void *data, vk::DeviceSize size,
+                    vk::DeviceSize dstOffset, vk::PipelineStageFlags dstStage,
+                    vk::AccessFlags dstAccess);
+
+  // Queue a copy of tightly packed texels into the first mip level and array
+  // layer of the color image dst. The previous content of dst is discarded,
+  // and dst is in finalLayout after the upload.
+  bool uploadImage(vk::Image dst, vk::Extent3D extent, const void *data,
+                   vk::DeviceSize size, vk::ImageLayout finalLayout,
+                   vk::PipelineStageFlags dstStage, vk::AccessFlags dstAccess);
+
+  // Submit all uploads queued since the last flush as one batch. Submits to
+  // the graphics queue, so call it from the thread that renders. Returns the
+  // value the batch completes with, 0 if nothing was queued.
+  uint64_t flush();
+
+  bool isComplete(uint64_t value);
+
+  // Block until the batch of value has completed
+  void wait(uint64_t value);
+
+  bool hasDedicatedTransferQueue() const {
+    return mTransferFamily != mGraphicsFamily;
+  }
+
+private:
+  struct Batch {
+    uint64_t value = 0;
+    vk::CommandBuffer transferCommandBuffer = nullptr;
+    // Acquires on the graphics queue, only with a dedicated transfer queue
+    vk::CommandBuffer acquireCommandBuffer = nullptr;
+    // Without timeline semaphores: signaled by the batch's last submission
+    vk::Fence fence = nullptr;
+    // Between the transfer and the acquire submission, only with a dedicated
+    // transfer queue
+    vk::Semaphore semaphore = nullptr;
+    std::vector<std::unique_ptr<vks::Buffer>> stagingBuffers;
+  };
+
+  bool initialize();
+
+  // Copy size bytes of data into the current staging buffer and return the
+  // offset they were copied to
+  bool stage(const void *data, vk::DeviceSize size, vk::DeviceSize *offset);
+
+  // Begin the transfer command buffer of the pending batch if needed
+  bool beginPending();
+
+  // Recycle the staging buffers and command buffers of completed batches
+  void collect();
+
+  void destroyBatch(Batch &batch);
+
+  const std::shared_ptr<vks::VulkanDeviceWrapper> mDeviceWrapper;
+  const vk::Queue mTransferQueue;
+  const vk::Queue mGraphicsQueue;
+  const uint32_t mTransferFamily;
+  const uint32_t mGraphicsFamily;
+  const bool mTimeline;
+
+  vk::CommandPool mTransferPool = nullptr;
+  vk::CommandPool mGraphicsPool = nullptr;
+  vk::Semaphore mTimelineSemaphore = nullptr;
+
+  std::mutex mMutex;
+
+  // Uploads recorded but not submitted yet
+  Batch mPending;
+  // Ownership acquires and final barriers of the pending batch
+  std::vector<vk::BufferMemoryBarrier> mBufferBarriers;
+  std::vector<vk::ImageMemoryBarrier> mImageBarriers;
+  vk::PipelineStageFlags mDstStages;
+
+  // Submitted batches, oldest first
+  std::deque<Batch> mInFlight;
+  uint64_t mLastValue = 0;
+  uint64_t mCompletedValue = 0;
+
+  // Staging buffers of completed batches, and the head of the pending
+  // batch's current staging buffer
+  std::vector<std::unique_ptr<vks::Buffer>> mFreeStagingBuffers;
+  vk::DeviceSize mStagingHead = 0;
+};
+} // namespace vks
+
+#endif // GAINVULKANSAMPLE_VULKANUPLOADMANAGER_H
@@ -0,0 +1,133 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef GAINVULKANSAMPLE_CPUKERNELTABLE_H
+#define GAINVULKANSAMPLE_CPUKERNELTABLE_H
+
+#include <cstdint>
+
+// The per instruction set implementations behind CpuKernels.h. Every file
+// implementing a table is built with the compiler flags of its instruction
+// set, see engine/CMakeLists.txt, so nothing in here may be inline code that
+// runs on every CPU.
+namespace gain {
+namespace cpukernels {
+
+// YUV to RGB, Q14. Every implementation computes
+//   R = (Y << 14) + kVR * (V - 128)
+//   G = (Y << 14) - kUG * (U - 128) - kVG * (V - 128)
+//   B = (Y << 14) + kUB * (U - 128)
+// in 32 bits, rounds, shifts right arithmetically and clamps to [0, 255].
+constexpr int kYuvShift = 14;
+constexpr int kYuvVR = 22970;
+constexpr int kYuvUG = 5638;
+constexpr int kYuvVG = 11700;
+constexpr int kYuvUB = 29032;
+
+// RGB to YUV, Q15
+//   Y = kRgbYR * R + kRgbYG * G + kRgbYB * B
+//   U = kRgbUR * R + kRgbUG * G + kRgbUB * B + (128 << 15)
+//   V = kRgbVR * R + kRgbVG * G + kRgbVB * B + (128 << 15)
+// rounded, shifted and clamped the same way. The chroma of a 2x2 block is
+// computed from the average of its four pixels, rounded per channel.
+constexpr int kRgbShift = 15;
+constexpr int kRgbYR = 9798;
+constexpr int kRgbYG = 19235;
+constexpr int kRgbYB = 3735;
+constexpr int kRgbUR = -5529;
+constexpr int kRgbUG = -10855;
+constexpr int kRgbUB = 16384;
+constexpr int kRgbVR = 16384;
+constexpr int kRgbVG = -13720;
+constexpr int kRgbVB = -2664;
+constexpr int kRgbChromaOffset = (128 << kRgbShift) + (1 << (kRgbShift - 1));
+
+struct KernelTable {
+  // width pixels of a semi-planar row, chroma holds width / 2 pairs. V comes
+  // first in a pair if vFirst.
+  void (*semiPlanarToRgbaRow)(const uint8_t *y, const uint8_t *chroma,
+                              bool vFirst, uint8_t *rgba, int width);
+
+  void (*planarToRgbaRow)(const uint8_t *y, const uint8_t *u,
+                          const uint8_t *v, uint8_t *rgba, int width);
+
+  // Two rows of width pixels into two luma rows and one VU row
+  void (*rgbaToNv21Rows)(const uint8_t *rgba0, const uint8_t *rgba1,
+                         uint8_t *y0, uint8_t *y1, uint8_t *vu, int width);
+
+  // Rotate a plane of 1 and 2 byte pixels clockwise by 90, 180 or 270
+  // degrees
+  void (*rotatePlane8)(const uint8_t *src, int srcStride, int width,
+                       int height, uint8_t *dst, int dstStride, int degrees);
+  void (*rotatePlane16)(const uint8_t *src, int srcStride, int width,
+                        int height, uint8_t *dst, int dstStride, int degrees);
+
+  // Average factor rows starting at src into dstWidth pixels
+  void (*boxDownscaleRow)(const uint8_t *src, int srcStride, int channels,
+                          int factor, uint8_t *dst, int dstWidth);
+};
+
+// nullptr if the library was built without the instruction set
+const KernelTable *scalarKernels();
+const KernelTable *neonKernels();
+const KernelTable *sse41Kernels();
+const KernelTable *avx2Kernels();
+
+// Scalar kernels, also used by the vector ones for the pixels that don't
+// fill a vector
+namespace scalar {
+void semiPlanarToRgbaRow(const uint8_t *y, const uint8_t *chroma, bool vFirst,
+                         uint8_t *rgba, int width);
+
+void planarToRgbaRow(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                     uint8_t *rgba, int width);
+
+void rgbaToNv21Rows(const uint8_t *rgba0, const uint8_t *rgba1, uint8_t *y0,
+                    uint8_t *y1, uint8_t *vu, int width);
+
+// Rotate the source pixels in [x0, x1) x [y0, y1) of a width x height plane
+// of pixelSize byte pixels into their place in dst
+void rotateRegion(const uint8_t *src, int srcStride, int width, int height,
+                  uint8_t *dst, int dstStride, int degrees, int pixelSize,
+                  int x0, int y0, int x1, int y1);
+
+// Transpose the 8x8 block of pixels at src into dst. The strides may be
+// negative.
+typedef void (*Transpose8x8)(const uint8_t *src, int srcStride, uint8_t *dst,
+                             int dstStride);
+
+// Rotate by 90 or 270 degrees with transpose for every full 8x8 block and
+// rotateRegion for the rest
+void rotateBlocks(const uint8_t *src, int srcStride, int width, int height,
+                  uint8_t *dst, int dstStride, int degrees, int pixelSize,
+                  Transpose8x8 transpose);
+
+void boxDownscaleRow(const uint8_t *src, int srcStride, int channels,
+                     int factor, uint8_t *dst, int dstWidth);
+} // namespace scalar
+
+} // namespace cpukernels
+} // namespace gain
+
+#endif // GAINVULKANSAMPLE_CPUKERNELTABLE_H
@@ -0,0 +1,306 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "CpuKernels.h"
+
+#include "../TaskScheduler.h"
+#include "CpuKernelTable.h"
+#include <LogUtil.h>
+#include <algorithm>
+#include <cstring>
+#include <initializer_list>
+
+#if defined(__arm__) && !defined(__aarch64__)
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+
+namespace gain {
+namespace cpukernels {
+namespace {
+const KernelTable *tableOf(Isa isa) {
+  switch (isa) {
+  case Isa::Neon:
+    return neonKernels();
+  case Isa::Sse41:
+    return sse41Kernels();
+  case Isa::Avx2:
+    return avx2Kernels();
+  default:
+    return scalarKernels();
+  }
+}
+
+bool cpuSupports(Isa isa) {
+  switch (isa) {
+#if defined(__x86_64__) || defined(__i386__)
+  case Isa::Sse41:
+    return __builtin_cpu_supports("sse4.1");
+  case Isa::Avx2:
+    return __builtin_cpu_supports("avx2");
+#elif defined(__aarch64__)
+  case Isa::Neon:
+    return true;
+#elif defined(__arm__)
+  case Isa::Neon:
+    return (getauxval(AT_HWCAP) & HWCAP_NEON) != 0;
+#endif
+  case Isa::Scalar:
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool available(Isa isa) { return tableOf(isa) != nullptr && cpuSupports(isa); }
+
+const KernelTable *&activeTable() {
+  static const KernelTable *table = tableOf(detectIsa());
+  return table;
+}
+
+Isa &activeIsaStorage() {
+  static Isa isa = detectIsa();
+  return isa;
+}
+
+const KernelTable &kernels() { return *activeTable(); }
+
+bool isEven(int value) { return (value & 1) == 0; }
+
+// Pixels per task, enough to hide the cost of handing out a task
+constexpr int kPixelsPerTask = 64 * 1024;
+
+// Split rows into bands of at least kPixelsPerTask pixels and convert them
+// on the shared TaskScheduler. Small images stay on the calling thread.
+void forRows(int rows, int width,
+             const std::function<void(int, int)> &convertRows) {
+  const int grain = std::max(1, kPixelsPerTask / std::max(width, 1));
+  TaskScheduler::shared().parallelFor(0, rows, grain, convertRows);
+}
+
+typedef void (*RotatePlane)(const uint8_t *src, int srcStride, int width,
+                            int height, uint8_t *dst, int dstStride,
+                            int degrees);
+
+// Rotate bands of source rows in parallel. A band is rotated like a plane
+// of its own into the columns (90, 270) or rows (180) it ends up in. Bands
+// are multiples of 8 rows, the block size of the transposes.
+void rotatePlaneInBands(RotatePlane rotate, const uint8_t *src, int srcStride,
+                        int width, int height, uint8_t *dst, int dstStride,
+                        int degrees, int pixelSize) {
+  const int blockRows = (height + 7) / 8;
+  forRows(blockRows, width * 8, [&](int firstBlock, int lastBlock) {
+    const int first = firstBlock * 8;
+    const int last = std::min(lastBlock * 8, height);
+    uint8_t *bandDst = dst;
+    if (degrees == 90) {
+      bandDst += (height - last) * pixelSize;
+    } else if (degrees == 270) {
+      bandDst += first * pixelSize;
+    } else {
+      bandDst += (height - last) * dstStride;
+    }
+    rotate(src + first * srcStride, srcStride, width, last - first, bandDst,
+           dstStride, degrees);
+  });
+}
+
+bool checkNv21Size(const char *name, int width, int height) {
+  if (width <= 0 || height <= 0 || !isEven(width) || !isEven(height)) {
+    LOGCATE("cpukernels::%s: %dx%d, dimensions have to be even and positive",
+            name, width, height);
+    return false;
+  }
+  return true;
+}
+} // namespace
+
+const char *isaName(Isa isa) {
+  switch (isa) {
+  case Isa::Neon:
+    return "NEON";
+  case Isa::Sse41:
+    return "SSE4.1";
+  case Isa::Avx2:
+    return "AVX2";
+  default:
+    return "scalar";
+  }
+}
+
+Isa detectIsa() {
+  for (Isa isa : {Isa::Avx2, Isa::Sse41, Isa::Neon}) {
+    if (available(isa)) {
+      return isa;
+    }
+  }
+  return Isa::Scalar;
+}
+
+Isa activeIsa() { return activeIsaStorage(); }
+
+bool setIsa(Isa isa) {
+  if (!available(isa)) {
+    LOGCATE("cpukernels: %s is not available", isaName(isa));
+    return false;
+  }
+  activeTable() = tableOf(isa);
+  activeIsaStorage() = isa;
+  return true;
+}
+
+bool nv21ToRgba(const uint8_t *y, int yStride, const uint8_t *vu, int vuStride,
+                int width, int height, uint8_t *rgba, int rgbaStride) {
+  if (!checkNv21Size("nv21ToRgba", width, height)) {
+    return false;
+  }
+  forRows(height, width, [&](int first, int last) {
+    for (int row = first; row < last; ++row) {
+      kernels().semiPlanarToRgbaRow(y + row * yStride,
+                                    vu + row / 2 * vuStride, true,
+                                    rgba + row * rgbaStride, width);
+    }
+  });
+  return true;
+}
+
+bool nv12ToRgba(const uint8_t *y, int yStride, const uint8_t *uv, int uvStride,
+                int width, int height, uint8_t *rgba, int rgbaStride) {
+  if (!checkNv21Size("nv12ToRgba", width, height)) {
+    return false;
+  }
+  forRows(height, width, [&](int first, int last) {
+    for (int row = first; row < last; ++row) {
+      kernels().semiPlanarToRgbaRow(y + row * yStride,
+                                    uv + row / 2 * uvStride, false,
+                                    rgba + row * rgbaStride, width);
+    }
+  });
+  return true;
+}
+
+bool i420ToRgba(const uint8_t *y, int yStride, const uint8_t *u, int uStride,
+                const uint8_t *v, int vStride, int width, int height,
+                uint8_t *rgba, int rgbaStride) {
+  if (!checkNv21Size("i420ToRgba", width, height)) {
+    return false;
+  }
+  forRows(height, width, [&](int first, int last) {
+    for (int row = first; row < last; ++row) {
+      kernels().planarToRgbaRow(y + row * yStride, u + row / 2 * uStride,
+                                v + row / 2 * vStride,
+                                rgba + row * rgbaStride, width);
+    }
+  });
+  return true;
+}
+
+bool rgbaToNv21(const uint8_t *rgba, int rgbaStride, int width, int height,
+                uint8_t *y, int yStride, uint8_t *vu, int vuStride) {
+  if (!checkNv21Size("rgbaToNv21", width, height)) {
+    return false;
+  }
+  // In row pairs, they share a chroma row
+  forRows(height / 2, width * 2, [&](int firstPair, int lastPair) {
+    for (int row = firstPair * 2; row < lastPair * 2; row += 2) {
+      kernels().rgbaToNv21Rows(
+          rgba + row * rgbaStride, rgba + (row + 1) * rgbaStride,
+          y + row * yStride, y + (row + 1) * yStride, vu + row / 2 * vuStride,
+          width);
+    }
+  });
+  return true;
+}
+
+bool rotateNv21(const uint8_t *srcY, int srcYStride, const uint8_t *srcVu,
+                int srcVuStride, int width, int height, uint8_t *dstY,
+                int dstYStride, uint8_t *dstVu, int dstVuStride, int degrees) {
+  if (!checkNv21Size("rotateNv21", width, height)) {
+    return false;
+  }
+  if (degrees == 0) {
+    return cropNv21(srcY, srcYStride, srcVu, srcVuStride, width, height, 0, 0,
+                    width, height, dstY, dstYStride, dstVu, dstVuStride);
+  }
+  if (degrees != 90 && degrees != 180 && degrees != 270) {
+    LOGCATE("cpukernels::rotateNv21: can't rotate by %d degrees", degrees);
+    return false;
+  }
+  rotatePlaneInBands(kernels().rotatePlane8, srcY, srcYStride, width, height,
+                     dstY, dstYStride, degrees, 1);
+  // VU pairs rotate as one 2 byte pixel
+  rotatePlaneInBands(kernels().rotatePlane16, srcVu, srcVuStride, width / 2,
+                     height / 2, dstVu, dstVuStride, degrees, 2);
+  return true;
+}
+
+bool cropNv21(const uint8_t *srcY, int srcYStride, const uint8_t *srcVu,
+              int srcVuStride, int srcWidth, int srcHeight, int x, int y,
+              int width, int height, uint8_t *dstY, int dstYStride,
+              uint8_t *dstVu, int dstVuStride) {
+  if (!checkNv21Size("cropNv21", width, height)) {
+    return false;
+  }
+  if (x < 0 || y < 0 || !isEven(x) || !isEven(y) || x + width > srcWidth ||
+      y + height > srcHeight) {
+    LOGCATE("cpukernels::cropNv21: %dx%d at (%d, %d) is not an even "
+            "rectangle within %dx%d",
+            width, height, x, y, srcWidth, srcHeight);
+    return false;
+  }
+  // Row copies, memcpy is already vectorized
+  for (int row = 0; row < height; ++row) {
+    memcpy(dstY + row * dstYStride, srcY + (y + row) * srcYStride + x, width);
+  }
+  for (int row = 0; row < height / 2; ++row) {
+    memcpy(dstVu + row * dstVuStride, srcVu + (y / 2 + row) * srcVuStride + x,
+           width);
+  }
+  return true;
+}
+
+bool boxDownscale(const uint8_t *src, int srcStride, int width, int height,
+                  int channels, int factor, uint8_t *dst, int dstStride) {
+  if ((channels != 1 && channels != 2 && channels != 4) ||
+      (factor != 2 && factor != 4) || width < factor || height < factor) {
+    LOGCATE("cpukernels::boxDownscale: can't downscale %dx%d with %d "
+            "channels by %d",
+            width, height, channels, factor);
+    return false;
+  }
+  const int dstWidth = width / factor;
+  const int dstHeight = height / factor;
+  forRows(dstHeight, width * factor, [&](int first, int last) {
+    for (int row = first; row < last; ++row) {
+      kernels().boxDownscaleRow(src + row * factor * srcStride, srcStride,
+                                channels, factor, dst + row * dstStride,
+                                dstWidth);
+    }
+  });
+  return true;
+}
+
+} // namespace cpukernels
+} // namespace gain
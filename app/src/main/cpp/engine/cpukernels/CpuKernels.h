@@ -0,0 +1,100 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef GAINVULKANSAMPLE_CPUKERNELS_H
+#define GAINVULKANSAMPLE_CPUKERNELS_H
+
+#include <cstdint>
+
+// Color conversion and resampling of camera images on the CPU. This is the
+// fallback for devices whose YCbCr conversion sampler can't be used, and the
+// reference the GPU engines are validated against on the host.
+//
+// Every kernel has a scalar implementation and, depending on the target,
+// NEON, SSE4.1 or AVX2 ones, picked at runtime from the features of the CPU.
+// All implementations use the same fixed point arithmetic and produce the
+// same bytes. YUV is BT.601 full range, like the camera's JPEG output.
+// Large images are split into bands of rows that run on the shared
+// TaskScheduler, the calls return once the whole image is done.
+//
+// Strides are in bytes. NV21 and NV12 images have even dimensions, the
+// chroma plane holds interleaved V and U (NV21) or U and V (NV12) samples
+// of 2x2 pixel blocks. I420 images have separate U and V planes.
+namespace gain {
+namespace cpukernels {
+
+enum class Isa { Scalar, Neon, Sse41, Avx2 };
+
+const char *isaName(Isa isa);
+
+// Best instruction set the CPU supports and the library was built with
+Isa detectIsa();
+
+// Instruction set the kernels currently run with, detectIsa() by default
+Isa activeIsa();
+
+// Run the kernels with isa from now on, e.g. to compare the output of an
+// implementation against the scalar one. Returns false if isa is not
+// available. Not thread safe against concurrent kernel calls.
+bool setIsa(Isa isa);
+
+bool nv21ToRgba(const uint8_t *y, int yStride, const uint8_t *vu, int vuStride,
+                int width, int height, uint8_t *rgba, int rgbaStride);
+
+bool nv12ToRgba(const uint8_t *y, int yStride, const uint8_t *uv, int uvStride,
+                int width, int height, uint8_t *rgba, int rgbaStride);
+
+bool i420ToRgba(const uint8_t *y, int yStride, const uint8_t *u, int uStride,
+                const uint8_t *v, int vStride, int width, int height,
+                uint8_t *rgba, int rgbaStride);
+
+// The chroma of every 2x2 block is converted from the block's average color.
+// Alpha is ignored.
+bool rgbaToNv21(const uint8_t *rgba, int rgbaStride, int width, int height,
+                uint8_t *y, int yStride, uint8_t *vu, int vuStride);
+
+// Rotate clockwise by degrees, one of 0, 90, 180 and 270. The destination
+// is height x width for 90 and 270. Source and destination must not overlap.
+bool rotateNv21(const uint8_t *srcY, int srcYStride, const uint8_t *srcVu,
+                int srcVuStride, int width, int height, uint8_t *dstY,
+                int dstYStride, uint8_t *dstVu, int dstVuStride, int degrees);
+
+// Copy the width x height rectangle at (x, y) of a srcWidth x srcHeight
+// image. x, y, width and height have to be even.
+bool cropNv21(const uint8_t *srcY, int srcYStride, const uint8_t *srcVu,
+              int srcVuStride, int srcWidth, int srcHeight, int x, int y,
+              int width, int height, uint8_t *dstY, int dstYStride,
+              uint8_t *dstVu, int dstVuStride);
+
+// Average every factor x factor block of an image with 1, 2 or 4 interleaved
+// 8 bit channels, e.g. a luma plane, a VU plane or RGBA. factor is 2 or 4.
+// The destination is width / factor x height / factor, remaining source
+// rows and columns are dropped.
+bool boxDownscale(const uint8_t *src, int srcStride, int width, int height,
+                  int channels, int factor, uint8_t *dst, int dstStride);
+
+} // namespace cpukernels
+} // namespace gain
+
+#endif // GAINVULKANSAMPLE_CPUKERNELS_H
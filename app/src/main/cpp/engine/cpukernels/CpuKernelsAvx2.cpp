@@ -0,0 +1,186 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "CpuKernelTable.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+namespace gain {
+namespace cpukernels {
+namespace {
+// Broadcast the int16 pair (a, b) for _mm256_madd_epi16
+__m256i pair16(int a, int b) {
+  return _mm256_set1_epi32(static_cast<int>(
+      static_cast<uint16_t>(a) | (static_cast<uint32_t>(b) << 16)));
+}
+
+// R, G and B of 16 pixels, see yuvToRgb8 of the SSE4.1 kernels. Unpacking
+// and packing again within the 128 bit lanes keeps the pixel order.
+void yuvToRgb16(__m256i y, __m256i d, __m256i e, __m256i *r, __m256i *g,
+                __m256i *b) {
+  const __m256i round = _mm256_set1_epi32(1 << (kYuvShift - 1));
+  const __m256i coefR = pair16(1 << kYuvShift, kYuvVR);
+  const __m256i coefG = pair16(-kYuvUG, -kYuvVG);
+  const __m256i coefB = pair16(1 << kYuvShift, kYuvUB);
+  const __m256i zero = _mm256_setzero_si256();
+
+  *r = _mm256_packs_epi32(
+      _mm256_srai_epi32(
+          _mm256_add_epi32(
+              _mm256_madd_epi16(_mm256_unpacklo_epi16(y, e), coefR), round),
+          kYuvShift),
+      _mm256_srai_epi32(
+          _mm256_add_epi32(
+              _mm256_madd_epi16(_mm256_unpackhi_epi16(y, e), coefR), round),
+          kYuvShift));
+
+  *b = _mm256_packs_epi32(
+      _mm256_srai_epi32(
+          _mm256_add_epi32(
+              _mm256_madd_epi16(_mm256_unpacklo_epi16(y, d), coefB), round),
+          kYuvShift),
+      _mm256_srai_epi32(
+          _mm256_add_epi32(
+              _mm256_madd_epi16(_mm256_unpackhi_epi16(y, d), coefB), round),
+          kYuvShift));
+
+  const __m256i lumaLo = _mm256_add_epi32(
+      _mm256_slli_epi32(_mm256_unpacklo_epi16(y, zero), kYuvShift), round);
+  const __m256i lumaHi = _mm256_add_epi32(
+      _mm256_slli_epi32(_mm256_unpackhi_epi16(y, zero), kYuvShift), round);
+  *g = _mm256_packs_epi32(
+      _mm256_srai_epi32(
+          _mm256_add_epi32(
+              _mm256_madd_epi16(_mm256_unpacklo_epi16(d, e), coefG), lumaLo),
+          kYuvShift),
+      _mm256_srai_epi32(
+          _mm256_add_epi32(
+              _mm256_madd_epi16(_mm256_unpackhi_epi16(d, e), coefG), lumaHi),
+          kYuvShift));
+}
+
+// Convert 32 pixels, d and e hold the chroma differences of their 16 pairs
+void yuvToRgba32(__m256i y, __m256i d, __m256i e, uint8_t *rgba) {
+  // Pairs 0-3 and 8-11 in the low, 4-7 and 12-15 in the high lane, so
+  // unpacking a vector with itself duplicates the pairs in pixel order
+  d = _mm256_permute4x64_epi64(d, _MM_SHUFFLE(3, 1, 2, 0));
+  e = _mm256_permute4x64_epi64(e, _MM_SHUFFLE(3, 1, 2, 0));
+
+  __m256i r0, g0, b0, r1, g1, b1;
+  yuvToRgb16(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(y)),
+             _mm256_unpacklo_epi16(d, d), _mm256_unpacklo_epi16(e, e), &r0,
+             &g0, &b0);
+  yuvToRgb16(_mm256_cvtepu8_epi16(_mm256_extracti128_si256(y, 1)),
+             _mm256_unpackhi_epi16(d, d), _mm256_unpackhi_epi16(e, e), &r1,
+             &g1, &b1);
+  const __m256i r = _mm256_permute4x64_epi64(_mm256_packus_epi16(r0, r1),
+                                             _MM_SHUFFLE(3, 1, 2, 0));
+  const __m256i g = _mm256_permute4x64_epi64(_mm256_packus_epi16(g0, g1),
+                                             _MM_SHUFFLE(3, 1, 2, 0));
+  const __m256i b = _mm256_permute4x64_epi64(_mm256_packus_epi16(b0, b1),
+                                             _MM_SHUFFLE(3, 1, 2, 0));
+  const __m256i a = _mm256_set1_epi8(-1);
+
+  // Pixels 0-7 | 16-23 and 8-15 | 24-31
+  const __m256i rgLo = _mm256_unpacklo_epi8(r, g);
+  const __m256i rgHi = _mm256_unpackhi_epi8(r, g);
+  const __m256i baLo = _mm256_unpacklo_epi8(b, a);
+  const __m256i baHi = _mm256_unpackhi_epi8(b, a);
+  // Pixels 0-3 | 16-19, 4-7 | 20-23, 8-11 | 24-27 and 12-15 | 28-31
+  const __m256i q0 = _mm256_unpacklo_epi16(rgLo, baLo);
+  const __m256i q1 = _mm256_unpackhi_epi16(rgLo, baLo);
+  const __m256i q2 = _mm256_unpacklo_epi16(rgHi, baHi);
+  const __m256i q3 = _mm256_unpackhi_epi16(rgHi, baHi);
+  auto *out = reinterpret_cast<__m256i *>(rgba);
+  _mm256_storeu_si256(out, _mm256_permute2x128_si256(q0, q1, 0x20));
+  _mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(q2, q3, 0x20));
+  _mm256_storeu_si256(out + 2, _mm256_permute2x128_si256(q0, q1, 0x31));
+  _mm256_storeu_si256(out + 3, _mm256_permute2x128_si256(q2, q3, 0x31));
+}
+
+void semiPlanarToRgbaRow(const uint8_t *y, const uint8_t *chroma, bool vFirst,
+                         uint8_t *rgba, int width) {
+  const __m256i bias = _mm256_set1_epi16(128);
+  const __m256i lowBytes = _mm256_set1_epi16(0x00ff);
+  int x = 0;
+  for (; x + 32 <= width; x += 32) {
+    const __m256i luma =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(y + x));
+    const __m256i pairs =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(chroma + x));
+    const __m256i first = _mm256_and_si256(pairs, lowBytes);
+    const __m256i second = _mm256_srli_epi16(pairs, 8);
+    const __m256i u = vFirst ? second : first;
+    const __m256i v = vFirst ? first : second;
+    yuvToRgba32(luma, _mm256_sub_epi16(u, bias), _mm256_sub_epi16(v, bias),
+                rgba + 4 * x);
+  }
+  scalar::semiPlanarToRgbaRow(y + x, chroma + x, vFirst, rgba + 4 * x,
+                              width - x);
+}
+
+void planarToRgbaRow(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                     uint8_t *rgba, int width) {
+  const __m256i bias = _mm256_set1_epi16(128);
+  int x = 0;
+  for (; x + 32 <= width; x += 32) {
+    const __m256i luma =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(y + x));
+    const __m256i u16 = _mm256_cvtepu8_epi16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(u + x / 2)));
+    const __m256i v16 = _mm256_cvtepu8_epi16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(v + x / 2)));
+    yuvToRgba32(luma, _mm256_sub_epi16(u16, bias), _mm256_sub_epi16(v16, bias),
+                rgba + 4 * x);
+  }
+  scalar::planarToRgbaRow(y + x, u + x / 2, v + x / 2, rgba + 4 * x,
+                          width - x);
+}
+} // namespace
+
+// Only the YUV to RGBA conversion, the hot path of the sampling fallback,
+// gains from the wider vectors. The other kernels are the SSE4.1 ones.
+const KernelTable *avx2Kernels() {
+  const KernelTable *sse41 = sse41Kernels();
+  if (sse41 == nullptr) {
+    return nullptr;
+  }
+  static const KernelTable table = {
+      semiPlanarToRgbaRow,   planarToRgbaRow,
+      sse41->rgbaToNv21Rows, sse41->rotatePlane8,
+      sse41->rotatePlane16,  sse41->boxDownscaleRow,
+  };
+  return &table;
+}
+
+} // namespace cpukernels
+} // namespace gain
+#else
+namespace gain {
+namespace cpukernels {
+const KernelTable *avx2Kernels() { return nullptr; }
+} // namespace cpukernels
+} // namespace gain
+#endif
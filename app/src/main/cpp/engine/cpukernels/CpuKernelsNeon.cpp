@@ -0,0 +1,398 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "CpuKernelTable.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+
+namespace gain {
+namespace cpukernels {
+namespace {
+// One channel of 8 pixels from the 32 bit sums of their low and high half,
+// rounded, shifted and clamped to [0, 255]
+uint8x8_t narrowYuv(int32x4_t lo, int32x4_t hi) {
+  return vqmovun_s16(vcombine_s16(vqmovn_s32(vrshrq_n_s32(lo, kYuvShift)),
+                                  vqmovn_s32(vrshrq_n_s32(hi, kYuvShift))));
+}
+
+// R, G and B of 8 pixels from luma and the chroma differences U - 128 and
+// V - 128, all int16
+void yuvToRgb8(int16x8_t y, int16x8_t d, int16x8_t e, uint8x8_t *r,
+               uint8x8_t *g, uint8x8_t *b) {
+  const int32x4_t lumaLo = vshll_n_s16(vget_low_s16(y), kYuvShift);
+  const int32x4_t lumaHi = vshll_n_s16(vget_high_s16(y), kYuvShift);
+
+  *r = narrowYuv(vmlal_n_s16(lumaLo, vget_low_s16(e), kYuvVR),
+                 vmlal_n_s16(lumaHi, vget_high_s16(e), kYuvVR));
+  *g = narrowYuv(
+      vmlal_n_s16(vmlal_n_s16(lumaLo, vget_low_s16(d), -kYuvUG),
+                  vget_low_s16(e), -kYuvVG),
+      vmlal_n_s16(vmlal_n_s16(lumaHi, vget_high_s16(d), -kYuvUG),
+                  vget_high_s16(e), -kYuvVG));
+  *b = narrowYuv(vmlal_n_s16(lumaLo, vget_low_s16(d), kYuvUB),
+                 vmlal_n_s16(lumaHi, vget_high_s16(d), kYuvUB));
+}
+
+// Convert 16 pixels, u and v hold the chroma of their 8 pairs
+void yuvToRgba16(uint8x16_t y, uint8x8_t u, uint8x8_t v, uint8_t *rgba) {
+  const int16x8_t d =
+      vreinterpretq_s16_u16(vsubl_u8(u, vdup_n_u8(128)));
+  const int16x8_t e =
+      vreinterpretq_s16_u16(vsubl_u8(v, vdup_n_u8(128)));
+  // Every pair's chroma for both of its pixels
+  const int16x8x2_t dd = vzipq_s16(d, d);
+  const int16x8x2_t ee = vzipq_s16(e, e);
+
+  uint8x8_t r0, g0, b0, r1, g1, b1;
+  yuvToRgb8(vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(y))), dd.val[0],
+            ee.val[0], &r0, &g0, &b0);
+  yuvToRgb8(vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(y))), dd.val[1],
+            ee.val[1], &r1, &g1, &b1);
+
+  uint8x16x4_t pixels;
+  pixels.val[0] = vcombine_u8(r0, r1);
+  pixels.val[1] = vcombine_u8(g0, g1);
+  pixels.val[2] = vcombine_u8(b0, b1);
+  pixels.val[3] = vdupq_n_u8(255);
+  vst4q_u8(rgba, pixels);
+}
+
+void semiPlanarToRgbaRow(const uint8_t *y, const uint8_t *chroma, bool vFirst,
+                         uint8_t *rgba, int width) {
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    const uint8x8x2_t pairs = vld2_u8(chroma + x);
+    yuvToRgba16(vld1q_u8(y + x), pairs.val[vFirst ? 1 : 0],
+                pairs.val[vFirst ? 0 : 1], rgba + 4 * x);
+  }
+  scalar::semiPlanarToRgbaRow(y + x, chroma + x, vFirst, rgba + 4 * x,
+                              width - x);
+}
+
+void planarToRgbaRow(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                     uint8_t *rgba, int width) {
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    yuvToRgba16(vld1q_u8(y + x), vld1_u8(u + x / 2), vld1_u8(v + x / 2),
+                rgba + 4 * x);
+  }
+  scalar::planarToRgbaRow(y + x, u + x / 2, v + x / 2, rgba + 4 * x,
+                          width - x);
+}
+
+uint8x8_t luma8(uint8x8_t r, uint8x8_t g, uint8x8_t b) {
+  const uint16x8_t r16 = vmovl_u8(r);
+  const uint16x8_t g16 = vmovl_u8(g);
+  const uint16x8_t b16 = vmovl_u8(b);
+  uint32x4_t lo = vmull_n_u16(vget_low_u16(r16), kRgbYR);
+  lo = vmlal_n_u16(lo, vget_low_u16(g16), kRgbYG);
+  lo = vmlal_n_u16(lo, vget_low_u16(b16), kRgbYB);
+  uint32x4_t hi = vmull_n_u16(vget_high_u16(r16), kRgbYR);
+  hi = vmlal_n_u16(hi, vget_high_u16(g16), kRgbYG);
+  hi = vmlal_n_u16(hi, vget_high_u16(b16), kRgbYB);
+  return vqmovn_u16(vcombine_u16(vrshrn_n_u32(lo, kRgbShift),
+                                 vrshrn_n_u32(hi, kRgbShift)));
+}
+
+uint8x16_t luma16(const uint8x16x4_t &pixels) {
+  return vcombine_u8(luma8(vget_low_u8(pixels.val[0]),
+                           vget_low_u8(pixels.val[1]),
+                           vget_low_u8(pixels.val[2])),
+                     luma8(vget_high_u8(pixels.val[0]),
+                           vget_high_u8(pixels.val[1]),
+                           vget_high_u8(pixels.val[2])));
+}
+
+// One chroma component of 8 blocks from the rounded block averages
+uint8x8_t chroma8(int16x8_t r, int16x8_t g, int16x8_t b, int16_t coefR,
+                  int16_t coefG, int16_t coefB) {
+  const int32x4_t offset = vdupq_n_s32(kRgbChromaOffset);
+  int32x4_t lo = vmlal_n_s16(offset, vget_low_s16(r), coefR);
+  lo = vmlal_n_s16(lo, vget_low_s16(g), coefG);
+  lo = vmlal_n_s16(lo, vget_low_s16(b), coefB);
+  int32x4_t hi = vmlal_n_s16(offset, vget_high_s16(r), coefR);
+  hi = vmlal_n_s16(hi, vget_high_s16(g), coefG);
+  hi = vmlal_n_s16(hi, vget_high_s16(b), coefB);
+  return vqmovn_u16(vcombine_u16(vqmovun_s32(vshrq_n_s32(lo, kRgbShift)),
+                                 vqmovun_s32(vshrq_n_s32(hi, kRgbShift))));
+}
+
+// Rounded averages of one channel of the 8 2x2 blocks of 16 pixels of two
+// rows
+int16x8_t blockAverages(uint8x16_t row0, uint8x16_t row1) {
+  return vreinterpretq_s16_u16(
+      vrshrq_n_u16(vpadalq_u8(vpaddlq_u8(row0), row1), 2));
+}
+
+void rgbaToNv21Rows(const uint8_t *rgba0, const uint8_t *rgba1, uint8_t *y0,
+                    uint8_t *y1, uint8_t *vu, int width) {
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    const uint8x16x4_t p0 = vld4q_u8(rgba0 + 4 * x);
+    const uint8x16x4_t p1 = vld4q_u8(rgba1 + 4 * x);
+    vst1q_u8(y0 + x, luma16(p0));
+    vst1q_u8(y1 + x, luma16(p1));
+
+    const int16x8_t r = blockAverages(p0.val[0], p1.val[0]);
+    const int16x8_t g = blockAverages(p0.val[1], p1.val[1]);
+    const int16x8_t b = blockAverages(p0.val[2], p1.val[2]);
+    uint8x8x2_t chroma;
+    chroma.val[0] = chroma8(r, g, b, kRgbVR, kRgbVG, kRgbVB);
+    chroma.val[1] = chroma8(r, g, b, kRgbUR, kRgbUG, kRgbUB);
+    vst2_u8(vu + x, chroma);
+  }
+  scalar::rgbaToNv21Rows(rgba0 + 4 * x, rgba1 + 4 * x, y0 + x, y1 + x, vu + x,
+                         width - x);
+}
+
+void transpose8x8(const uint8_t *src, int srcStride, uint8_t *dst,
+                  int dstStride) {
+  uint8x8_t rows[8];
+  for (int i = 0; i < 8; ++i) {
+    rows[i] = vld1_u8(src + i * srcStride);
+  }
+  const uint8x8x2_t t01 = vtrn_u8(rows[0], rows[1]);
+  const uint8x8x2_t t23 = vtrn_u8(rows[2], rows[3]);
+  const uint8x8x2_t t45 = vtrn_u8(rows[4], rows[5]);
+  const uint8x8x2_t t67 = vtrn_u8(rows[6], rows[7]);
+  // Even columns of rows 0-3 come from the first halves of t01 and t23
+  const uint16x4x2_t s02 = vtrn_u16(vreinterpret_u16_u8(t01.val[0]),
+                                    vreinterpret_u16_u8(t23.val[0]));
+  const uint16x4x2_t s13 = vtrn_u16(vreinterpret_u16_u8(t01.val[1]),
+                                    vreinterpret_u16_u8(t23.val[1]));
+  const uint16x4x2_t s46 = vtrn_u16(vreinterpret_u16_u8(t45.val[0]),
+                                    vreinterpret_u16_u8(t67.val[0]));
+  const uint16x4x2_t s57 = vtrn_u16(vreinterpret_u16_u8(t45.val[1]),
+                                    vreinterpret_u16_u8(t67.val[1]));
+  // Columns 0 and 4, 2 and 6, 1 and 5, 3 and 7
+  const uint32x2x2_t c04 = vtrn_u32(vreinterpret_u32_u16(s02.val[0]),
+                                    vreinterpret_u32_u16(s46.val[0]));
+  const uint32x2x2_t c26 = vtrn_u32(vreinterpret_u32_u16(s02.val[1]),
+                                    vreinterpret_u32_u16(s46.val[1]));
+  const uint32x2x2_t c15 = vtrn_u32(vreinterpret_u32_u16(s13.val[0]),
+                                    vreinterpret_u32_u16(s57.val[0]));
+  const uint32x2x2_t c37 = vtrn_u32(vreinterpret_u32_u16(s13.val[1]),
+                                    vreinterpret_u32_u16(s57.val[1]));
+  vst1_u8(dst, vreinterpret_u8_u32(c04.val[0]));
+  vst1_u8(dst + dstStride, vreinterpret_u8_u32(c15.val[0]));
+  vst1_u8(dst + 2 * dstStride, vreinterpret_u8_u32(c26.val[0]));
+  vst1_u8(dst + 3 * dstStride, vreinterpret_u8_u32(c37.val[0]));
+  vst1_u8(dst + 4 * dstStride, vreinterpret_u8_u32(c04.val[1]));
+  vst1_u8(dst + 5 * dstStride, vreinterpret_u8_u32(c15.val[1]));
+  vst1_u8(dst + 6 * dstStride, vreinterpret_u8_u32(c26.val[1]));
+  vst1_u8(dst + 7 * dstStride, vreinterpret_u8_u32(c37.val[1]));
+}
+
+// Same for 2 byte pixels
+void transpose8x8x16(const uint8_t *src, int srcStride, uint8_t *dst,
+                     int dstStride) {
+  uint16x8_t rows[8];
+  for (int i = 0; i < 8; ++i) {
+    rows[i] = vld1q_u16(reinterpret_cast<const uint16_t *>(src + i * srcStride));
+  }
+  const uint16x8x2_t t01 = vtrnq_u16(rows[0], rows[1]);
+  const uint16x8x2_t t23 = vtrnq_u16(rows[2], rows[3]);
+  const uint16x8x2_t t45 = vtrnq_u16(rows[4], rows[5]);
+  const uint16x8x2_t t67 = vtrnq_u16(rows[6], rows[7]);
+  // Rows 0-3 (s02, s13) and 4-7 (s46, s57) of columns 0 and 4, 2 and 6,
+  // 1 and 5, 3 and 7
+  const uint32x4x2_t s02 = vtrnq_u32(vreinterpretq_u32_u16(t01.val[0]),
+                                     vreinterpretq_u32_u16(t23.val[0]));
+  const uint32x4x2_t s13 = vtrnq_u32(vreinterpretq_u32_u16(t01.val[1]),
+                                     vreinterpretq_u32_u16(t23.val[1]));
+  const uint32x4x2_t s46 = vtrnq_u32(vreinterpretq_u32_u16(t45.val[0]),
+                                     vreinterpretq_u32_u16(t67.val[0]));
+  const uint32x4x2_t s57 = vtrnq_u32(vreinterpretq_u32_u16(t45.val[1]),
+                                     vreinterpretq_u32_u16(t67.val[1]));
+  // Columns 0-3 are in the low halves, 4-7 in the high halves
+  const uint32x4_t upper[4] = {s02.val[0], s13.val[0], s02.val[1],
+                               s13.val[1]};
+  const uint32x4_t lower[4] = {s46.val[0], s57.val[0], s46.val[1],
+                               s57.val[1]};
+  for (int i = 0; i < 4; ++i) {
+    vst1q_u16(reinterpret_cast<uint16_t *>(dst + i * dstStride),
+              vreinterpretq_u16_u32(vcombine_u32(vget_low_u32(upper[i]),
+                                                 vget_low_u32(lower[i]))));
+    vst1q_u16(reinterpret_cast<uint16_t *>(dst + (i + 4) * dstStride),
+              vreinterpretq_u16_u32(vcombine_u32(vget_high_u32(upper[i]),
+                                                 vget_high_u32(lower[i]))));
+  }
+}
+
+uint8x16_t reverse16(uint8x16_t bytes, int pixelSize) {
+  const uint8x16_t reversed =
+      pixelSize == 1
+          ? vrev64q_u8(bytes)
+          : vreinterpretq_u8_u16(vrev64q_u16(vreinterpretq_u16_u8(bytes)));
+  return vcombine_u8(vget_high_u8(reversed), vget_low_u8(reversed));
+}
+
+void rotate180(const uint8_t *src, int srcStride, int width, int height,
+               uint8_t *dst, int dstStride, int pixelSize) {
+  const int rowBytes = width * pixelSize;
+  const int vectorBytes = rowBytes / 16 * 16;
+  for (int y = 0; y < height; ++y) {
+    const uint8_t *srcRow = src + y * srcStride;
+    uint8_t *dstRow = dst + (height - 1 - y) * dstStride;
+    for (int x = 0; x < vectorBytes; x += 16) {
+      vst1q_u8(dstRow + rowBytes - x - 16,
+               reverse16(vld1q_u8(srcRow + x), pixelSize));
+    }
+  }
+  scalar::rotateRegion(src, srcStride, width, height, dst, dstStride, 180,
+                       pixelSize, vectorBytes / pixelSize, 0, width, height);
+}
+
+void rotatePlane8(const uint8_t *src, int srcStride, int width, int height,
+                  uint8_t *dst, int dstStride, int degrees) {
+  if (degrees == 180) {
+    rotate180(src, srcStride, width, height, dst, dstStride, 1);
+  } else {
+    scalar::rotateBlocks(src, srcStride, width, height, dst, dstStride,
+                         degrees, 1, transpose8x8);
+  }
+}
+
+void rotatePlane16(const uint8_t *src, int srcStride, int width, int height,
+                   uint8_t *dst, int dstStride, int degrees) {
+  if (degrees == 180) {
+    rotate180(src, srcStride, width, height, dst, dstStride, 2);
+  } else {
+    scalar::rotateBlocks(src, srcStride, width, height, dst, dstStride,
+                         degrees, 2, transpose8x8x16);
+  }
+}
+
+// Load 32 bytes and split them into the even and the odd pixels. The
+// structure loads do that for pixels of any of the supported sizes.
+void loadPixelPairs(const uint8_t *src, int channels, uint8x16_t *even,
+                    uint8x16_t *odd) {
+  switch (channels) {
+  case 1: {
+    const uint8x16x2_t pixels = vld2q_u8(src);
+    *even = pixels.val[0];
+    *odd = pixels.val[1];
+    break;
+  }
+  case 2: {
+    const uint16x8x2_t pixels =
+        vld2q_u16(reinterpret_cast<const uint16_t *>(src));
+    *even = vreinterpretq_u8_u16(pixels.val[0]);
+    *odd = vreinterpretq_u8_u16(pixels.val[1]);
+    break;
+  }
+  default: {
+    const uint32x4x2_t pixels =
+        vld2q_u32(reinterpret_cast<const uint32_t *>(src));
+    *even = vreinterpretq_u8_u32(pixels.val[0]);
+    *odd = vreinterpretq_u8_u32(pixels.val[1]);
+    break;
+  }
+  }
+}
+
+// Load 64 bytes and split them by pixel index modulo 4
+uint8x16x4_t loadPixelQuads(const uint8_t *src, int channels) {
+  uint8x16x4_t phases;
+  switch (channels) {
+  case 1:
+    phases = vld4q_u8(src);
+    break;
+  case 2: {
+    const uint16x8x4_t pixels =
+        vld4q_u16(reinterpret_cast<const uint16_t *>(src));
+    for (int i = 0; i < 4; ++i) {
+      phases.val[i] = vreinterpretq_u8_u16(pixels.val[i]);
+    }
+    break;
+  }
+  default: {
+    const uint32x4x4_t pixels =
+        vld4q_u32(reinterpret_cast<const uint32_t *>(src));
+    for (int i = 0; i < 4; ++i) {
+      phases.val[i] = vreinterpretq_u8_u32(pixels.val[i]);
+    }
+    break;
+  }
+  }
+  return phases;
+}
+
+void boxDownscaleRow(const uint8_t *src, int srcStride, int channels,
+                     int factor, uint8_t *dst, int dstWidth) {
+  const int srcBytes = dstWidth * factor * channels;
+  // Every step writes 16 bytes
+  const int step = 16 * factor;
+  int x = 0;
+  for (; x + step <= srcBytes; x += step) {
+    uint16x8_t lo = vdupq_n_u16(0);
+    uint16x8_t hi = vdupq_n_u16(0);
+    for (int row = 0; row < factor; ++row) {
+      const uint8_t *rowSrc = src + row * srcStride + x;
+      if (factor == 2) {
+        uint8x16_t even, odd;
+        loadPixelPairs(rowSrc, channels, &even, &odd);
+        lo = vaddq_u16(lo, vaddl_u8(vget_low_u8(even), vget_low_u8(odd)));
+        hi = vaddq_u16(hi, vaddl_u8(vget_high_u8(even), vget_high_u8(odd)));
+      } else {
+        const uint8x16x4_t phases = loadPixelQuads(rowSrc, channels);
+        lo = vaddq_u16(lo, vaddl_u8(vget_low_u8(phases.val[0]),
+                                    vget_low_u8(phases.val[1])));
+        lo = vaddq_u16(lo, vaddl_u8(vget_low_u8(phases.val[2]),
+                                    vget_low_u8(phases.val[3])));
+        hi = vaddq_u16(hi, vaddl_u8(vget_high_u8(phases.val[0]),
+                                    vget_high_u8(phases.val[1])));
+        hi = vaddq_u16(hi, vaddl_u8(vget_high_u8(phases.val[2]),
+                                    vget_high_u8(phases.val[3])));
+      }
+    }
+    const uint8x16_t average =
+        factor == 2 ? vcombine_u8(vrshrn_n_u16(lo, 2), vrshrn_n_u16(hi, 2))
+                    : vcombine_u8(vrshrn_n_u16(lo, 4), vrshrn_n_u16(hi, 4));
+    vst1q_u8(dst + x / factor, average);
+  }
+  const int done = x / (factor * channels);
+  scalar::boxDownscaleRow(src + x, srcStride, channels, factor,
+                          dst + done * channels, dstWidth - done);
+}
+} // namespace
+
+const KernelTable *neonKernels() {
+  static const KernelTable table = {
+      semiPlanarToRgbaRow, planarToRgbaRow, rgbaToNv21Rows,
+      rotatePlane8,        rotatePlane16,   boxDownscaleRow,
+  };
+  return &table;
+}
+
+} // namespace cpukernels
+} // namespace gain
+#else
+namespace gain {
+namespace cpukernels {
+const KernelTable *neonKernels() { return nullptr; }
+} // namespace cpukernels
+} // namespace gain
+#endif
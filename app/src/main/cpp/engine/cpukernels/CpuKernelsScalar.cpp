@@ -0,0 +1,225 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "CpuKernelTable.h"
+
+#include <cstring>
+
+namespace gain {
+namespace cpukernels {
+namespace {
+uint8_t clampToByte(int value) {
+  return static_cast<uint8_t>(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+void yuvToRgba(int y, int u, int v, uint8_t *rgba) {
+  const int luma = y << kYuvShift;
+  const int d = u - 128;
+  const int e = v - 128;
+  const int round = 1 << (kYuvShift - 1);
+  rgba[0] = clampToByte((luma + kYuvVR * e + round) >> kYuvShift);
+  rgba[1] = clampToByte((luma - kYuvUG * d - kYuvVG * e + round) >> kYuvShift);
+  rgba[2] = clampToByte((luma + kYuvUB * d + round) >> kYuvShift);
+  rgba[3] = 255;
+}
+
+uint8_t rgbToY(int r, int g, int b) {
+  return clampToByte(
+      (kRgbYR * r + kRgbYG * g + kRgbYB * b + (1 << (kRgbShift - 1))) >>
+      kRgbShift);
+}
+
+// Source position of destination pixel (dx, dy) of a rotated plane
+void sourceOf(int width, int height, int degrees, int dx, int dy, int *sx,
+              int *sy) {
+  switch (degrees) {
+  case 90:
+    *sx = dy;
+    *sy = height - 1 - dx;
+    break;
+  case 180:
+    *sx = width - 1 - dx;
+    *sy = height - 1 - dy;
+    break;
+  case 270:
+    *sx = width - 1 - dy;
+    *sy = dx;
+    break;
+  default:
+    *sx = dx;
+    *sy = dy;
+    break;
+  }
+}
+
+template <typename Pixel>
+void rotatePlane(const uint8_t *src, int srcStride, int width, int height,
+                 uint8_t *dst, int dstStride, int degrees) {
+  const bool swapped = degrees == 90 || degrees == 270;
+  const int dstWidth = swapped ? height : width;
+  const int dstHeight = swapped ? width : height;
+  // Walk the destination so the writes are sequential
+  for (int dy = 0; dy < dstHeight; ++dy) {
+    auto *dstRow = reinterpret_cast<Pixel *>(dst + dy * dstStride);
+    for (int dx = 0; dx < dstWidth; ++dx) {
+      int sx, sy;
+      sourceOf(width, height, degrees, dx, dy, &sx, &sy);
+      memcpy(&dstRow[dx], src + sy * srcStride + sx * sizeof(Pixel),
+             sizeof(Pixel));
+    }
+  }
+}
+
+void rotatePlane8(const uint8_t *src, int srcStride, int width, int height,
+                  uint8_t *dst, int dstStride, int degrees) {
+  rotatePlane<uint8_t>(src, srcStride, width, height, dst, dstStride,
+                       degrees);
+}
+
+void rotatePlane16(const uint8_t *src, int srcStride, int width, int height,
+                   uint8_t *dst, int dstStride, int degrees) {
+  rotatePlane<uint16_t>(src, srcStride, width, height, dst, dstStride,
+                        degrees);
+}
+} // namespace
+
+namespace scalar {
+void semiPlanarToRgbaRow(const uint8_t *y, const uint8_t *chroma, bool vFirst,
+                         uint8_t *rgba, int width) {
+  const int uIndex = vFirst ? 1 : 0;
+  for (int x = 0; x < width; x += 2) {
+    const int u = chroma[x + uIndex];
+    const int v = chroma[x + 1 - uIndex];
+    yuvToRgba(y[x], u, v, rgba + 4 * x);
+    yuvToRgba(y[x + 1], u, v, rgba + 4 * x + 4);
+  }
+}
+
+void planarToRgbaRow(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                     uint8_t *rgba, int width) {
+  for (int x = 0; x < width; x += 2) {
+    yuvToRgba(y[x], u[x / 2], v[x / 2], rgba + 4 * x);
+    yuvToRgba(y[x + 1], u[x / 2], v[x / 2], rgba + 4 * x + 4);
+  }
+}
+
+void rgbaToNv21Rows(const uint8_t *rgba0, const uint8_t *rgba1, uint8_t *y0,
+                    uint8_t *y1, uint8_t *vu, int width) {
+  for (int x = 0; x < width; x += 2) {
+    const uint8_t *p00 = rgba0 + 4 * x;
+    const uint8_t *p01 = p00 + 4;
+    const uint8_t *p10 = rgba1 + 4 * x;
+    const uint8_t *p11 = p10 + 4;
+    y0[x] = rgbToY(p00[0], p00[1], p00[2]);
+    y0[x + 1] = rgbToY(p01[0], p01[1], p01[2]);
+    y1[x] = rgbToY(p10[0], p10[1], p10[2]);
+    y1[x + 1] = rgbToY(p11[0], p11[1], p11[2]);
+
+    const int r = (p00[0] + p01[0] + p10[0] + p11[0] + 2) >> 2;
+    const int g = (p00[1] + p01[1] + p10[1] + p11[1] + 2) >> 2;
+    const int b = (p00[2] + p01[2] + p10[2] + p11[2] + 2) >> 2;
+    vu[x] = clampToByte(
+        (kRgbVR * r + kRgbVG * g + kRgbVB * b + kRgbChromaOffset) >>
+        kRgbShift);
+    vu[x + 1] = clampToByte(
+        (kRgbUR * r + kRgbUG * g + kRgbUB * b + kRgbChromaOffset) >>
+        kRgbShift);
+  }
+}
+
+void rotateRegion(const uint8_t *src, int srcStride, int width, int height,
+                  uint8_t *dst, int dstStride, int degrees, int pixelSize,
+                  int x0, int y0, int x1, int y1) {
+  for (int sy = y0; sy < y1; ++sy) {
+    for (int sx = x0; sx < x1; ++sx) {
+      int dx, dy;
+      // Rotating by 360 - degrees maps the source position back
+      sourceOf(degrees == 90 || degrees == 270 ? height : width,
+               degrees == 90 || degrees == 270 ? width : height,
+               (360 - degrees) % 360, sx, sy, &dx, &dy);
+      memcpy(dst + dy * dstStride + dx * pixelSize,
+             src + sy * srcStride + sx * pixelSize, pixelSize);
+    }
+  }
+}
+
+// A rotation by 90 or 270 degrees is a transpose with the source rows or
+// the destination rows in reverse order
+void rotateBlocks(const uint8_t *src, int srcStride, int width, int height,
+                  uint8_t *dst, int dstStride, int degrees, int pixelSize,
+                  Transpose8x8 transpose) {
+  const int blockWidth = width / 8 * 8;
+  const int blockHeight = height / 8 * 8;
+  for (int by = 0; by < blockHeight; by += 8) {
+    for (int bx = 0; bx < blockWidth; bx += 8) {
+      const uint8_t *block = src + by * srcStride + bx * pixelSize;
+      if (degrees == 90) {
+        // Source row by + 7 becomes destination column height - 8 - by
+        transpose(block + 7 * srcStride, -srcStride,
+                  dst + bx * dstStride + (height - 8 - by) * pixelSize,
+                  dstStride);
+      } else {
+        // Source column bx becomes destination row width - 1 - bx
+        transpose(block, srcStride,
+                  dst + (width - 1 - bx) * dstStride + by * pixelSize,
+                  -dstStride);
+      }
+    }
+  }
+  rotateRegion(src, srcStride, width, height, dst, dstStride, degrees,
+               pixelSize, blockWidth, 0, width, height);
+  rotateRegion(src, srcStride, width, height, dst, dstStride, degrees,
+               pixelSize, 0, blockHeight, blockWidth, height);
+}
+
+void boxDownscaleRow(const uint8_t *src, int srcStride, int channels,
+                     int factor, uint8_t *dst, int dstWidth) {
+  const int shift = factor == 4 ? 4 : 2;
+  const int round = 1 << (shift - 1);
+  for (int x = 0; x < dstWidth; ++x) {
+    for (int c = 0; c < channels; ++c) {
+      int sum = 0;
+      for (int row = 0; row < factor; ++row) {
+        const uint8_t *pixel = src + row * srcStride + x * factor * channels;
+        for (int i = 0; i < factor; ++i) {
+          sum += pixel[i * channels + c];
+        }
+      }
+      dst[x * channels + c] = static_cast<uint8_t>((sum + round) >> shift);
+    }
+  }
+}
+} // namespace scalar
+
+const KernelTable *scalarKernels() {
+  static const KernelTable table = {
+      scalar::semiPlanarToRgbaRow, scalar::planarToRgbaRow,
+      scalar::rgbaToNv21Rows,      rotatePlane8,
+      rotatePlane16,               scalar::boxDownscaleRow,
+  };
+  return &table;
+}
+
+} // namespace cpukernels
+} // namespace gain
@@ -0,0 +1,395 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "CpuKernelTable.h"
+
+#if defined(__SSE4_1__)
+#include <cstring>
+#include <smmintrin.h>
+
+namespace gain {
+namespace cpukernels {
+namespace {
+// Broadcast the int16 pair (a, b) for _mm_madd_epi16
+__m128i pair16(int a, int b) {
+  return _mm_set1_epi32(static_cast<int>(static_cast<uint16_t>(a) |
+                                         (static_cast<uint32_t>(b) << 16)));
+}
+
+// R, G and B of 8 pixels from luma and the chroma differences U - 128 and
+// V - 128, all int16. The results are neither clamped nor packed yet.
+void yuvToRgb8(__m128i y, __m128i d, __m128i e, __m128i *r, __m128i *g,
+               __m128i *b) {
+  const __m128i round = _mm_set1_epi32(1 << (kYuvShift - 1));
+  const __m128i coefR = pair16(1 << kYuvShift, kYuvVR);
+  const __m128i coefG = pair16(-kYuvUG, -kYuvVG);
+  const __m128i coefB = pair16(1 << kYuvShift, kYuvUB);
+  const __m128i zero = _mm_setzero_si128();
+
+  const __m128i yeLo = _mm_unpacklo_epi16(y, e);
+  const __m128i yeHi = _mm_unpackhi_epi16(y, e);
+  *r = _mm_packs_epi32(
+      _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(yeLo, coefR), round),
+                     kYuvShift),
+      _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(yeHi, coefR), round),
+                     kYuvShift));
+
+  const __m128i ydLo = _mm_unpacklo_epi16(y, d);
+  const __m128i ydHi = _mm_unpackhi_epi16(y, d);
+  *b = _mm_packs_epi32(
+      _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(ydLo, coefB), round),
+                     kYuvShift),
+      _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(ydHi, coefB), round),
+                     kYuvShift));
+
+  const __m128i lumaLo =
+      _mm_add_epi32(_mm_slli_epi32(_mm_unpacklo_epi16(y, zero), kYuvShift),
+                    round);
+  const __m128i lumaHi =
+      _mm_add_epi32(_mm_slli_epi32(_mm_unpackhi_epi16(y, zero), kYuvShift),
+                    round);
+  *g = _mm_packs_epi32(
+      _mm_srai_epi32(
+          _mm_add_epi32(
+              _mm_madd_epi16(_mm_unpacklo_epi16(d, e), coefG), lumaLo),
+          kYuvShift),
+      _mm_srai_epi32(
+          _mm_add_epi32(
+              _mm_madd_epi16(_mm_unpackhi_epi16(d, e), coefG), lumaHi),
+          kYuvShift));
+}
+
+// Convert 16 pixels, d and e hold the chroma differences of their 8 pairs
+void yuvToRgba16(__m128i y, __m128i d, __m128i e, uint8_t *rgba) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i dLo = _mm_unpacklo_epi16(d, d);
+  const __m128i dHi = _mm_unpackhi_epi16(d, d);
+  const __m128i eLo = _mm_unpacklo_epi16(e, e);
+  const __m128i eHi = _mm_unpackhi_epi16(e, e);
+
+  __m128i r0, g0, b0, r1, g1, b1;
+  yuvToRgb8(_mm_cvtepu8_epi16(y), dLo, eLo, &r0, &g0, &b0);
+  yuvToRgb8(_mm_unpackhi_epi8(y, zero), dHi, eHi, &r1, &g1, &b1);
+  const __m128i r = _mm_packus_epi16(r0, r1);
+  const __m128i g = _mm_packus_epi16(g0, g1);
+  const __m128i b = _mm_packus_epi16(b0, b1);
+  const __m128i a = _mm_set1_epi8(-1);
+
+  const __m128i rgLo = _mm_unpacklo_epi8(r, g);
+  const __m128i rgHi = _mm_unpackhi_epi8(r, g);
+  const __m128i baLo = _mm_unpacklo_epi8(b, a);
+  const __m128i baHi = _mm_unpackhi_epi8(b, a);
+  auto *out = reinterpret_cast<__m128i *>(rgba);
+  _mm_storeu_si128(out, _mm_unpacklo_epi16(rgLo, baLo));
+  _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(rgLo, baLo));
+  _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(rgHi, baHi));
+  _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(rgHi, baHi));
+}
+
+void semiPlanarToRgbaRow(const uint8_t *y, const uint8_t *chroma, bool vFirst,
+                         uint8_t *rgba, int width) {
+  const __m128i bias = _mm_set1_epi16(128);
+  const __m128i lowBytes = _mm_set1_epi16(0x00ff);
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    const __m128i luma =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(y + x));
+    const __m128i pairs =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(chroma + x));
+    // First and second sample of every pair as int16
+    const __m128i first = _mm_and_si128(pairs, lowBytes);
+    const __m128i second = _mm_srli_epi16(pairs, 8);
+    const __m128i u = vFirst ? second : first;
+    const __m128i v = vFirst ? first : second;
+    yuvToRgba16(luma, _mm_sub_epi16(u, bias), _mm_sub_epi16(v, bias),
+                rgba + 4 * x);
+  }
+  scalar::semiPlanarToRgbaRow(y + x, chroma + x, vFirst, rgba + 4 * x,
+                              width - x);
+}
+
+void planarToRgbaRow(const uint8_t *y, const uint8_t *u, const uint8_t *v,
+                     uint8_t *rgba, int width) {
+  const __m128i bias = _mm_set1_epi16(128);
+  int x = 0;
+  for (; x + 16 <= width; x += 16) {
+    const __m128i luma =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(y + x));
+    const __m128i u16 = _mm_cvtepu8_epi16(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i *>(u + x / 2)));
+    const __m128i v16 = _mm_cvtepu8_epi16(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i *>(v + x / 2)));
+    yuvToRgba16(luma, _mm_sub_epi16(u16, bias), _mm_sub_epi16(v16, bias),
+                rgba + 4 * x);
+  }
+  scalar::planarToRgbaRow(y + x, u + x / 2, v + x / 2, rgba + 4 * x,
+                          width - x);
+}
+
+// Luma of the 4 RGBA pixels in pixels, as int32
+__m128i luma4(__m128i pixels) {
+  const __m128i coef =
+      _mm_setr_epi16(kRgbYR, kRgbYG, kRgbYB, 0, kRgbYR, kRgbYG, kRgbYB, 0);
+  const __m128i lo = _mm_madd_epi16(_mm_cvtepu8_epi16(pixels), coef);
+  const __m128i hi =
+      _mm_madd_epi16(_mm_cvtepu8_epi16(_mm_srli_si128(pixels, 8)), coef);
+  return _mm_srli_epi32(
+      _mm_add_epi32(_mm_hadd_epi32(lo, hi),
+                    _mm_set1_epi32(1 << (kRgbShift - 1))),
+      kRgbShift);
+}
+
+// Rounded averages of the two 2x2 blocks of 4 pixels of two rows, as
+// int16 R, G, B, A of the first block and then of the second
+__m128i blockAverages(__m128i row0, __m128i row1) {
+  const __m128i first = _mm_add_epi16(_mm_cvtepu8_epi16(row0),
+                                      _mm_cvtepu8_epi16(row1));
+  const __m128i second =
+      _mm_add_epi16(_mm_cvtepu8_epi16(_mm_srli_si128(row0, 8)),
+                    _mm_cvtepu8_epi16(_mm_srli_si128(row1, 8)));
+  const __m128i sums =
+      _mm_unpacklo_epi64(_mm_add_epi16(first, _mm_srli_si128(first, 8)),
+                         _mm_add_epi16(second, _mm_srli_si128(second, 8)));
+  return _mm_srli_epi16(_mm_add_epi16(sums, _mm_set1_epi16(2)), 2);
+}
+
+// One chroma component of 4 blocks as int32
+__m128i chroma4(__m128i averages0, __m128i averages1, __m128i coef) {
+  return _mm_srai_epi32(
+      _mm_add_epi32(_mm_hadd_epi32(_mm_madd_epi16(averages0, coef),
+                                   _mm_madd_epi16(averages1, coef)),
+                    _mm_set1_epi32(kRgbChromaOffset)),
+      kRgbShift);
+}
+
+void rgbaToNv21Rows(const uint8_t *rgba0, const uint8_t *rgba1, uint8_t *y0,
+                    uint8_t *y1, uint8_t *vu, int width) {
+  const __m128i coefU =
+      _mm_setr_epi16(kRgbUR, kRgbUG, kRgbUB, 0, kRgbUR, kRgbUG, kRgbUB, 0);
+  const __m128i coefV =
+      _mm_setr_epi16(kRgbVR, kRgbVG, kRgbVB, 0, kRgbVR, kRgbVG, kRgbVB, 0);
+  const __m128i zero = _mm_setzero_si128();
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    const auto *in0 = reinterpret_cast<const __m128i *>(rgba0 + 4 * x);
+    const auto *in1 = reinterpret_cast<const __m128i *>(rgba1 + 4 * x);
+    const __m128i a0 = _mm_loadu_si128(in0);
+    const __m128i a1 = _mm_loadu_si128(in0 + 1);
+    const __m128i b0 = _mm_loadu_si128(in1);
+    const __m128i b1 = _mm_loadu_si128(in1 + 1);
+
+    _mm_storel_epi64(
+        reinterpret_cast<__m128i *>(y0 + x),
+        _mm_packus_epi16(_mm_packs_epi32(luma4(a0), luma4(a1)), zero));
+    _mm_storel_epi64(
+        reinterpret_cast<__m128i *>(y1 + x),
+        _mm_packus_epi16(_mm_packs_epi32(luma4(b0), luma4(b1)), zero));
+
+    const __m128i averages0 = blockAverages(a0, b0);
+    const __m128i averages1 = blockAverages(a1, b1);
+    // V0..V3 U0..U3, interleaved into V0 U0 V1 U1 ...
+    const __m128i vu16 =
+        _mm_packs_epi32(chroma4(averages0, averages1, coefV),
+                        chroma4(averages0, averages1, coefU));
+    const __m128i interleaved =
+        _mm_unpacklo_epi16(vu16, _mm_srli_si128(vu16, 8));
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(vu + x),
+                     _mm_packus_epi16(interleaved, zero));
+  }
+  scalar::rgbaToNv21Rows(rgba0 + 4 * x, rgba1 + 4 * x, y0 + x, y1 + x, vu + x,
+                         width - x);
+}
+
+// Transpose the 8x8 block of 1 byte pixels at src into dst
+void transpose8x8(const uint8_t *src, int srcStride, uint8_t *dst,
+                  int dstStride) {
+  __m128i rows[8];
+  for (int i = 0; i < 8; ++i) {
+    rows[i] = _mm_loadl_epi64(
+        reinterpret_cast<const __m128i *>(src + i * srcStride));
+  }
+  const __m128i t0 = _mm_unpacklo_epi8(rows[0], rows[1]);
+  const __m128i t1 = _mm_unpacklo_epi8(rows[2], rows[3]);
+  const __m128i t2 = _mm_unpacklo_epi8(rows[4], rows[5]);
+  const __m128i t3 = _mm_unpacklo_epi8(rows[6], rows[7]);
+  const __m128i u0 = _mm_unpacklo_epi16(t0, t1);
+  const __m128i u1 = _mm_unpackhi_epi16(t0, t1);
+  const __m128i u2 = _mm_unpacklo_epi16(t2, t3);
+  const __m128i u3 = _mm_unpackhi_epi16(t2, t3);
+  // Two columns each
+  const __m128i columns[4] = {
+      _mm_unpacklo_epi32(u0, u2), _mm_unpackhi_epi32(u0, u2),
+      _mm_unpacklo_epi32(u1, u3), _mm_unpackhi_epi32(u1, u3)};
+  for (int i = 0; i < 4; ++i) {
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + 2 * i * dstStride),
+                     columns[i]);
+    _mm_storel_epi64(
+        reinterpret_cast<__m128i *>(dst + (2 * i + 1) * dstStride),
+        _mm_unpackhi_epi64(columns[i], columns[i]));
+  }
+}
+
+// Same for 2 byte pixels
+void transpose8x8x16(const uint8_t *src, int srcStride, uint8_t *dst,
+                     int dstStride) {
+  __m128i rows[8];
+  for (int i = 0; i < 8; ++i) {
+    rows[i] = _mm_loadu_si128(
+        reinterpret_cast<const __m128i *>(src + i * srcStride));
+  }
+  __m128i t[8];
+  for (int i = 0; i < 4; ++i) {
+    t[2 * i] = _mm_unpacklo_epi16(rows[2 * i], rows[2 * i + 1]);
+    t[2 * i + 1] = _mm_unpackhi_epi16(rows[2 * i], rows[2 * i + 1]);
+  }
+  // Rows 0-3 and 4-7 of columns 0-1, 2-3, 4-5 and 6-7
+  const __m128i u[8] = {
+      _mm_unpacklo_epi32(t[0], t[2]), _mm_unpackhi_epi32(t[0], t[2]),
+      _mm_unpacklo_epi32(t[1], t[3]), _mm_unpackhi_epi32(t[1], t[3]),
+      _mm_unpacklo_epi32(t[4], t[6]), _mm_unpackhi_epi32(t[4], t[6]),
+      _mm_unpacklo_epi32(t[5], t[7]), _mm_unpackhi_epi32(t[5], t[7])};
+  for (int i = 0; i < 4; ++i) {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 2 * i * dstStride),
+                     _mm_unpacklo_epi64(u[i], u[i + 4]));
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i *>(dst + (2 * i + 1) * dstStride),
+        _mm_unpackhi_epi64(u[i], u[i + 4]));
+  }
+}
+
+// Reverse the pixel order of every row, 16 bytes at a time
+void rotate180(const uint8_t *src, int srcStride, int width, int height,
+               uint8_t *dst, int dstStride, int pixelSize) {
+  const __m128i reverse =
+      pixelSize == 1
+          ? _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+          : _mm_setr_epi8(14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0,
+                          1);
+  const int rowBytes = width * pixelSize;
+  const int vectorBytes = rowBytes / 16 * 16;
+  for (int y = 0; y < height; ++y) {
+    const uint8_t *srcRow = src + y * srcStride;
+    uint8_t *dstRow = dst + (height - 1 - y) * dstStride;
+    for (int x = 0; x < vectorBytes; x += 16) {
+      const __m128i pixels =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(srcRow + x));
+      _mm_storeu_si128(
+          reinterpret_cast<__m128i *>(dstRow + rowBytes - x - 16),
+          _mm_shuffle_epi8(pixels, reverse));
+    }
+  }
+  scalar::rotateRegion(src, srcStride, width, height, dst, dstStride, 180,
+                       pixelSize, vectorBytes / pixelSize, 0, width, height);
+}
+
+void rotatePlane8(const uint8_t *src, int srcStride, int width, int height,
+                  uint8_t *dst, int dstStride, int degrees) {
+  if (degrees == 180) {
+    rotate180(src, srcStride, width, height, dst, dstStride, 1);
+  } else {
+    scalar::rotateBlocks(src, srcStride, width, height, dst, dstStride,
+                         degrees, 1, transpose8x8);
+  }
+}
+
+void rotatePlane16(const uint8_t *src, int srcStride, int width, int height,
+                   uint8_t *dst, int dstStride, int degrees) {
+  if (degrees == 180) {
+    rotate180(src, srcStride, width, height, dst, dstStride, 2);
+  } else {
+    scalar::rotateBlocks(src, srcStride, width, height, dst, dstStride,
+                         degrees, 2, transpose8x8x16);
+  }
+}
+
+// Sums of horizontally adjacent pixels of channels channels: the pixel
+// pairs of lo in the low half, those of hi in the high half
+__m128i pairSums(__m128i lo, __m128i hi, int channels) {
+  switch (channels) {
+  case 1:
+    return _mm_hadd_epi16(lo, hi);
+  case 2:
+    // Pixels 0 2 1 3, so the pairs are in the two halves
+    lo = _mm_shuffle_epi32(lo, _MM_SHUFFLE(3, 1, 2, 0));
+    hi = _mm_shuffle_epi32(hi, _MM_SHUFFLE(3, 1, 2, 0));
+    [[fallthrough]];
+  default:
+    return _mm_unpacklo_epi64(_mm_add_epi16(lo, _mm_srli_si128(lo, 8)),
+                              _mm_add_epi16(hi, _mm_srli_si128(hi, 8)));
+  }
+}
+
+void boxDownscaleRow(const uint8_t *src, int srcStride, int channels,
+                     int factor, uint8_t *dst, int dstWidth) {
+  const __m128i zero = _mm_setzero_si128();
+  const int srcBytes = dstWidth * factor * channels;
+  int x = 0;
+  for (; x + 16 <= srcBytes; x += 16) {
+    // Column sums of the factor rows
+    __m128i lo = zero;
+    __m128i hi = zero;
+    for (int row = 0; row < factor; ++row) {
+      const __m128i pixels = _mm_loadu_si128(
+          reinterpret_cast<const __m128i *>(src + row * srcStride + x));
+      lo = _mm_add_epi16(lo, _mm_cvtepu8_epi16(pixels));
+      hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(pixels, zero));
+    }
+    uint8_t *out = dst + x / factor;
+    const __m128i sums = pairSums(lo, hi, channels);
+    if (factor == 2) {
+      const __m128i average =
+          _mm_srli_epi16(_mm_add_epi16(sums, _mm_set1_epi16(2)), 2);
+      _mm_storel_epi64(reinterpret_cast<__m128i *>(out),
+                       _mm_packus_epi16(average, zero));
+    } else {
+      const __m128i average = _mm_srli_epi16(
+          _mm_add_epi16(pairSums(sums, zero, channels), _mm_set1_epi16(8)),
+          4);
+      const int packed = _mm_cvtsi128_si32(_mm_packus_epi16(average, zero));
+      memcpy(out, &packed, sizeof(packed));
+    }
+  }
+  const int done = x / (factor * channels);
+  scalar::boxDownscaleRow(src + x, srcStride, channels, factor,
+                          dst + done * channels, dstWidth - done);
+}
+} // namespace
+
+const KernelTable *sse41Kernels() {
+  static const KernelTable table = {
+      semiPlanarToRgbaRow, planarToRgbaRow, rgbaToNv21Rows,
+      rotatePlane8,        rotatePlane16,   boxDownscaleRow,
+  };
+  return &table;
+}
+
+} // namespace cpukernels
+} // namespace gain
+#else
+namespace gain {
+namespace cpukernels {
+const KernelTable *sse41Kernels() { return nullptr; }
+} // namespace cpukernels
+} // namespace gain
+#endif
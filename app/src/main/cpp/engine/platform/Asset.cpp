@@ -0,0 +1,74 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "Asset.h"
+
+#include <LogUtil.h>
+
+#ifdef __ANDROID__
+#include <android/configuration.h>
+#else
+#include <fstream>
+#endif
+
+namespace gain {
+#ifdef __ANDROID__
+bool readAsset(AssetManager *assetManager, const char *path,
+               std::vector<char> &data) {
+  AAsset *asset = AAssetManager_open(assetManager, path, AASSET_MODE_BUFFER);
+  if (asset == nullptr) {
+    LOGCATE("readAsset: %s not found", path);
+    return false;
+  }
+  const size_t size = AAsset_getLength(asset);
+  data.resize(size);
+  const int status = AAsset_read(asset, data.data(), size);
+  AAsset_close(asset);
+  return status >= 0;
+}
+
+uint32_t getScreenDensity(AssetManager *assetManager) {
+  AConfiguration *config = AConfiguration_new();
+  AConfiguration_fromAssetManager(config, assetManager);
+  const uint32_t density = AConfiguration_getDensity(config);
+  AConfiguration_delete(config);
+  return density;
+}
+#else
+bool readAsset(AssetManager *assetManager, const char *path,
+               std::vector<char> &data) {
+  const std::string fullPath = assetManager->rootDir + "/" + path;
+  std::ifstream file(fullPath, std::ios::binary | std::ios::ate);
+  if (!file) {
+    LOGCATE("readAsset: %s not found", fullPath.c_str());
+    return false;
+  }
+  data.resize(static_cast<size_t>(file.tellg()));
+  file.seekg(0);
+  return static_cast<bool>(file.read(data.data(), data.size()));
+}
+
+uint32_t getScreenDensity(AssetManager * /*assetManager*/) { return 160; }
+#endif
+} // namespace gain
@@ -0,0 +1,57 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef GAINVULKANSAMPLE_PLATFORM_ASSET_H
+#define GAINVULKANSAMPLE_PLATFORM_ASSET_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifdef __ANDROID__
+#include <android/asset_manager.h>
+#endif
+
+namespace gain {
+#ifdef __ANDROID__
+using AssetManager = AAssetManager;
+#else
+// Assets are plain files below rootDir, laid out like the APK's assets
+// directory, e.g. rootDir + "/shaders/shader_13_camerahwb.vert.spv".
+struct AssetManager {
+  std::string rootDir;
+};
+#endif
+
+// Reads the whole asset at path into data. Returns false if the asset does
+// not exist or can't be read.
+bool readAsset(AssetManager *assetManager, const char *path,
+               std::vector<char> &data);
+
+// Screen density in dpi of the device the assets are loaded for. Host
+// builds report the baseline density of 160.
+uint32_t getScreenDensity(AssetManager *assetManager);
+} // namespace gain
+
+#endif // GAINVULKANSAMPLE_PLATFORM_ASSET_H
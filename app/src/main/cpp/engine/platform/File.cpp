@@ -0,0 +1,85 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "File.h"
+
+#include <LogUtil.h>
+#include <atomic>
+#include <cstdio>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace gain {
+bool readFile(const std::string &path, std::vector<char> &data) {
+  FILE *file = fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    return false;
+  }
+  fseek(file, 0, SEEK_END);
+  const long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  if (size < 0) {
+    fclose(file);
+    return false;
+  }
+  data.resize(size);
+  const size_t read = fread(data.data(), 1, data.size(), file);
+  fclose(file);
+  return read == data.size();
+}
+
+bool writeFileAtomic(const std::string &path, const void *data, size_t size) {
+  // Unique per write, writes of the same path may run on several threads
+  static std::atomic<uint32_t> writeCount{0};
+  const std::string tmpPath =
+      path + ".tmp" + std::to_string(writeCount.fetch_add(1));
+  FILE *file = fopen(tmpPath.c_str(), "wb");
+  if (file == nullptr) {
+    LOGCATE("writeFileAtomic: can't open %s", tmpPath.c_str());
+    return false;
+  }
+  bool success = fwrite(data, 1, size, file) == size;
+  success = success && fflush(file) == 0;
+  // Without the sync the rename may reach the disk before the data
+  success = success && fsync(fileno(file)) == 0;
+  success = (fclose(file) == 0) && success;
+  if (success && rename(tmpPath.c_str(), path.c_str()) == 0) {
+    return true;
+  }
+  LOGCATE("writeFileAtomic: failed to write %s", path.c_str());
+  unlink(tmpPath.c_str());
+  return false;
+}
+
+bool fileStamp(const std::string &path, uint64_t *size, int64_t *modifiedNs) {
+  struct stat status {};
+  if (stat(path.c_str(), &status) != 0) {
+    return false;
+  }
+  *size = static_cast<uint64_t>(status.st_size);
+  *modifiedNs = static_cast<int64_t>(status.st_mtim.tv_sec) * 1000000000 +
+                status.st_mtim.tv_nsec;
+  return true;
+}
+} // namespace gain
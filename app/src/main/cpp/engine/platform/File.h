@@ -0,0 +1,50 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef GAINVULKANSAMPLE_PLATFORM_FILE_H
+#define GAINVULKANSAMPLE_PLATFORM_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gain {
+// Reads the whole file at path into data. Returns false if the file does not
+// exist or can't be read.
+bool readFile(const std::string &path, std::vector<char> &data);
+
+// Replaces the file at path with size bytes of data. The bytes go to a
+// temporary file next to path that is synced and renamed over path, so a
+// crash leaves either the old or the new file, never a partial one. Safe to
+// call from several threads.
+bool writeFileAtomic(const std::string &path, const void *data, size_t size);
+
+// Size and modification time of the file at path, e.g. to tell whether a
+// file derived from it is still up to date. Returns false if there is no
+// such file.
+bool fileStamp(const std::string &path, uint64_t *size, int64_t *modifiedNs);
+} // namespace gain
+
+#endif // GAINVULKANSAMPLE_PLATFORM_FILE_H
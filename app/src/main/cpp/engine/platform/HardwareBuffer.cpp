@@ -0,0 +1,102 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "HardwareBuffer.h"
+
+#ifndef __ANDROID__
+#include <LogUtil.h>
+#include <atomic>
+#include <cerrno>
+#include <vector>
+
+struct AHardwareBuffer {
+  AHardwareBuffer_Desc desc;
+  std::atomic<int> refCount{1};
+  std::vector<uint8_t> data;
+};
+
+int AHardwareBuffer_allocate(const AHardwareBuffer_Desc *desc,
+                             AHardwareBuffer **outBuffer) {
+  if (desc == nullptr || outBuffer == nullptr || desc->width == 0 ||
+      desc->height == 0 || desc->layers != 1) {
+    return -EINVAL;
+  }
+
+  size_t size;
+  switch (desc->format) {
+  case AHARDWAREBUFFER_FORMAT_R8G8B8A8_UNORM:
+  case AHARDWAREBUFFER_FORMAT_R8G8B8X8_UNORM:
+    size = static_cast<size_t>(desc->width) * desc->height * 4;
+    break;
+  case AHARDWAREBUFFER_FORMAT_Y8Cb8Cr8_420:
+    // Full resolution Y plane followed by the half resolution Cb and Cr
+    // planes, I420 order
+    size = static_cast<size_t>(desc->width) * desc->height * 3 / 2;
+    break;
+  default:
+    LOGCATE("AHardwareBuffer_allocate: unsupported format 0x%x", desc->format);
+    return -EINVAL;
+  }
+
+  auto buffer = new AHardwareBuffer();
+  buffer->desc = *desc;
+  // Rows are tightly packed
+  buffer->desc.stride = desc->width;
+  buffer->data.resize(size);
+  *outBuffer = buffer;
+  return 0;
+}
+
+void AHardwareBuffer_acquire(AHardwareBuffer *buffer) {
+  buffer->refCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void AHardwareBuffer_release(AHardwareBuffer *buffer) {
+  if (buffer->refCount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    delete buffer;
+  }
+}
+
+void AHardwareBuffer_describe(const AHardwareBuffer *buffer,
+                              AHardwareBuffer_Desc *outDesc) {
+  *outDesc = buffer->desc;
+}
+
+int AHardwareBuffer_lock(AHardwareBuffer *buffer, uint64_t /*usage*/,
+                         int32_t fence, const ARect * /*rect*/,
+                         void **outVirtualAddress) {
+  if (fence != -1 || outVirtualAddress == nullptr) {
+    return -EINVAL;
+  }
+  *outVirtualAddress = buffer->data.data();
+  return 0;
+}
+
+int AHardwareBuffer_unlock(AHardwareBuffer * /*buffer*/, int32_t *fence) {
+  if (fence != nullptr) {
+    *fence = -1;
+  }
+  return 0;
+}
+#endif
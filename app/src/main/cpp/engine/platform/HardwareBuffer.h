@@ -0,0 +1,90 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef GAINVULKANSAMPLE_PLATFORM_HARDWAREBUFFER_H
+#define GAINVULKANSAMPLE_PLATFORM_HARDWAREBUFFER_H
+
+#ifdef __ANDROID__
+#include <android/hardware_buffer.h>
+#else
+#include <cstdint>
+
+// Host stand-in for the NDK AHardwareBuffer API, so engines can be built and
+// measured off-device with the same buffer handling code. Buffers live in
+// host memory: gain::Image uploads their content instead of importing the
+// memory. Only the subset of the NDK API used by the engines is provided,
+// and only R8G8B8A8 and Y8Cb8Cr8_420 buffers can be sampled.
+
+typedef struct AHardwareBuffer AHardwareBuffer;
+
+typedef struct AHardwareBuffer_Desc {
+  uint32_t width;
+  uint32_t height;
+  uint32_t layers;
+  uint32_t format;
+  uint64_t usage;
+  uint32_t stride;
+  uint32_t rfu0;
+  uint64_t rfu1;
+} AHardwareBuffer_Desc;
+
+typedef struct ARect {
+  int32_t left;
+  int32_t top;
+  int32_t right;
+  int32_t bottom;
+} ARect;
+
+enum AHardwareBuffer_Format {
+  AHARDWAREBUFFER_FORMAT_R8G8B8A8_UNORM = 1,
+  AHARDWAREBUFFER_FORMAT_R8G8B8X8_UNORM = 2,
+  AHARDWAREBUFFER_FORMAT_Y8Cb8Cr8_420 = 0x23,
+};
+
+enum AHardwareBuffer_UsageFlags : uint64_t {
+  AHARDWAREBUFFER_USAGE_CPU_READ_OFTEN = 3UL,
+  AHARDWAREBUFFER_USAGE_CPU_WRITE_OFTEN = 3UL << 4,
+  AHARDWAREBUFFER_USAGE_GPU_SAMPLED_IMAGE = 1UL << 8,
+};
+
+// Returns 0 on success. The new buffer holds one reference.
+int AHardwareBuffer_allocate(const AHardwareBuffer_Desc *desc,
+                             AHardwareBuffer **outBuffer);
+
+void AHardwareBuffer_acquire(AHardwareBuffer *buffer);
+
+void AHardwareBuffer_release(AHardwareBuffer *buffer);
+
+void AHardwareBuffer_describe(const AHardwareBuffer *buffer,
+                              AHardwareBuffer_Desc *outDesc);
+
+// Host buffers are always mapped, fence must be -1 and rect is ignored
+int AHardwareBuffer_lock(AHardwareBuffer *buffer, uint64_t usage,
+                         int32_t fence, const ARect *rect,
+                         void **outVirtualAddress);
+
+int AHardwareBuffer_unlock(AHardwareBuffer *buffer, int32_t *fence);
+#endif
+
+#endif // GAINVULKANSAMPLE_PLATFORM_HARDWAREBUFFER_H
@@ -0,0 +1,53 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef GAINVULKANSAMPLE_PLATFORM_PLATFORM_H
+#define GAINVULKANSAMPLE_PLATFORM_PLATFORM_H
+
+#include "Asset.h"
+#include "File.h"
+#include "HardwareBuffer.h"
+
+#ifdef __ANDROID__
+#include <android/native_window.h>
+#include <jni.h>
+#else
+#include <cstdint>
+
+// Host builds render to a VK_EXT_headless_surface of this size
+struct ANativeWindow {
+  int32_t width;
+  int32_t height;
+};
+
+// Engines only pass the JNI environment through, host builds pass nullptr
+struct _JNIEnv;
+typedef _JNIEnv JNIEnv;
+#endif
+
+namespace gain {
+using NativeWindow = ANativeWindow;
+} // namespace gain
+
+#endif // GAINVULKANSAMPLE_PLATFORM_PLATFORM_H
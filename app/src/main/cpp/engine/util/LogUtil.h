@@ -25,12 +25,14 @@
 #ifndef YUVCROP_LOGUTIL_H
 #define YUVCROP_LOGUTIL_H
 
-#include <android/log.h>
 #include <cassert>
 #include <sys/time.h>
 
 #define LOG_TAG "Vulkan"
 
+#ifdef __ANDROID__
+#include <android/log.h>
+
 #define LOGCATE(...)                                                           \
   __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
 #define LOGCATV(...)                                                           \
@@ -38,7 +40,25 @@
 #define LOGCATD(...)                                                           \
   __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
 #define LOGCATI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#else
+#include <cstdio>
+
+// Host builds log to stderr, one line per message like logcat
+#define LOG_PRINT(LEVEL, ...)                                                  \
+  do {                                                                         \
+    fputs(LEVEL "/" LOG_TAG ": ", stderr);                                     \
+    fprintf(stderr, __VA_ARGS__);                                              \
+    fputc('\n', stderr);                                                       \
+  } while (0)
+
+#define LOGCATE(...) LOG_PRINT("E", __VA_ARGS__)
+#define LOGCATV(...) LOG_PRINT("V", __VA_ARGS__)
+#define LOGCATD(...) LOG_PRINT("D", __VA_ARGS__)
+#define LOGCATI(...) LOG_PRINT("I", __VA_ARGS__)
+#endif
 
+// Log the time a block took. For a timeline of all threads without logging
+// in the hot path use TRACE_SCOPE, see TraceRecorder.h.
 #define FUN_BEGIN_TIME(FUN)                                                    \
   {                                                                            \
     LOGCATE("%s:%s func start", __FILE__, FUN);                                \
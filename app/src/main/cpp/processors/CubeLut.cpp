@@ -0,0 +1,406 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "CubeLut.h"
+
+#include <LogUtil.h>
+#include <TaskScheduler.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <glm/gtc/packing.hpp>
+#include <platform/File.h>
+
+namespace gain {
+namespace {
+// Layout of a cached table, followed by the texels
+struct CacheHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t size;
+  uint32_t reserved;
+  // Stamp of the .cube file the table was parsed from
+  uint64_t sourceSize;
+  int64_t sourceModifiedNs;
+};
+
+constexpr uint32_t kCacheMagic = 0x4C54554C; // "LUTL"
+constexpr uint32_t kCacheVersion = 1;
+
+constexpr double kPow10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                             1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                             1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+void skipBlanks(const char *&p, const char *end) {
+  while (p < end && isBlank(*p)) {
+    ++p;
+  }
+}
+
+void skipLine(const char *&p, const char *end) {
+  const void *newline = memchr(p, '\n', end - p);
+  p = newline != nullptr ? static_cast<const char *>(newline) : end;
+}
+
+// A table has up to 65^3 * 3 numbers, strtof with its locale handling is
+// the bulk of the load time. The values end up as half floats, so
+// accumulating the digits in an integer is precise enough.
+bool parseFloat(const char *&p, const char *end, float *value) {
+  skipBlanks(p, end);
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    ++p;
+  }
+
+  uint64_t mantissa = 0;
+  int exponent = 0;
+  int digits = 0;
+  for (; p < end && isDigit(*p); ++p, ++digits) {
+    if (mantissa < 1000000000000000000ull) {
+      mantissa = mantissa * 10 + (*p - '0');
+    } else {
+      ++exponent;
+    }
+  }
+  if (p < end && *p == '.') {
+    for (++p; p < end && isDigit(*p); ++p, ++digits) {
+      if (mantissa < 1000000000000000000ull) {
+        mantissa = mantissa * 10 + (*p - '0');
+        --exponent;
+      }
+    }
+  }
+  if (digits == 0) {
+    return false;
+  }
+
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    ++p;
+    bool negativeExponent = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+      negativeExponent = *p == '-';
+      ++p;
+    }
+    if (p == end || !isDigit(*p)) {
+      return false;
+    }
+    int explicitExponent = 0;
+    for (; p < end && isDigit(*p); ++p) {
+      explicitExponent = std::min(explicitExponent * 10 + (*p - '0'), 1000);
+    }
+    exponent += negativeExponent ? -explicitExponent : explicitExponent;
+  }
+
+  double result = static_cast<double>(mantissa);
+  const int maxTableExponent = sizeof(kPow10) / sizeof(kPow10[0]) - 1;
+  if (exponent < 0 && exponent >= -maxTableExponent) {
+    result /= kPow10[-exponent];
+  } else if (exponent > 0 && exponent <= maxTableExponent) {
+    result *= kPow10[exponent];
+  } else if (exponent != 0) {
+    result *= std::pow(10.0, exponent);
+  }
+  *value = static_cast<float>(negative ? -result : result);
+  return true;
+}
+
+bool parseUint(const char *&p, const char *end, uint32_t *value) {
+  skipBlanks(p, end);
+  if (p == end || !isDigit(*p)) {
+    return false;
+  }
+  uint32_t result = 0;
+  for (; p < end && isDigit(*p); ++p) {
+    result = std::min(result * 10 + (*p - '0'), 1000000u);
+  }
+  *value = result;
+  return true;
+}
+
+// True if the rest of the line holds nothing but blanks
+bool atLineEnd(const char *&p, const char *end) {
+  skipBlanks(p, end);
+  return p == end || *p == '\n';
+}
+
+void appendTexel(std::vector<uint16_t> &texels, float r, float g, float b) {
+  texels.push_back(glm::packHalf1x16(r));
+  texels.push_back(glm::packHalf1x16(g));
+  texels.push_back(glm::packHalf1x16(b));
+  texels.push_back(glm::packHalf1x16(1.0f));
+}
+
+// Tables past this size are parsed in chunks on the TaskScheduler
+constexpr size_t kParallelParseBytes = 256 * 1024;
+
+// Parse the table lines, comments and blank lines in [p, end). False on
+// anything else, e.g. a keyword.
+bool parseTableLines(const char *p, const char *end,
+                     std::vector<uint16_t> *texels) {
+  for (; p < end; ++p) {
+    skipBlanks(p, end);
+    if (p == end || *p == '\n') {
+      continue;
+    }
+    if (*p == '#') {
+      skipLine(p, end);
+      continue;
+    }
+    float r, g, b;
+    if (!parseFloat(p, end, &r) || !parseFloat(p, end, &g) ||
+        !parseFloat(p, end, &b) || !atLineEnd(p, end)) {
+      return false;
+    }
+    appendTexel(*texels, r, g, b);
+  }
+  return true;
+}
+
+// parseTableLines on chunks of whole lines in parallel, appended to texels
+// in order
+bool parseTableLinesParallel(const char *p, const char *end,
+                             std::vector<uint16_t> *texels) {
+  const size_t length = end - p;
+  const int chunkCount = static_cast<int>(length / (kParallelParseBytes / 4));
+  // Start of the first line at or after offset
+  auto lineStart = [&](size_t offset) {
+    if (offset == 0 || offset >= length) {
+      return std::min(p + offset, end);
+    }
+    const void *newline = memchr(p + offset - 1, '\n', length - offset + 1);
+    return newline != nullptr ? static_cast<const char *>(newline) + 1 : end;
+  };
+
+  std::vector<std::vector<uint16_t>> chunks(chunkCount);
+  std::atomic<bool> valid{true};
+  auto parseChunks = [&](int first, int last) {
+    for (int chunk = first; chunk < last && valid; ++chunk) {
+      const char *chunkBegin =
+          lineStart(static_cast<uint64_t>(length) * chunk / chunkCount);
+      const char *chunkEnd =
+          lineStart(static_cast<uint64_t>(length) * (chunk + 1) / chunkCount);
+      if (!parseTableLines(chunkBegin, chunkEnd, &chunks[chunk])) {
+        valid = false;
+      }
+    }
+  };
+  TaskScheduler::shared().parallelFor(0, chunkCount, 1, parseChunks);
+  if (!valid) {
+    return false;
+  }
+  for (const auto &chunk : chunks) {
+    texels->insert(texels->end(), chunk.begin(), chunk.end());
+  }
+  return true;
+}
+} // namespace
+
+bool CubeLut::load(const std::string &path, const std::string &cachePath,
+                   CubeLut *lut) {
+  uint64_t sourceSize = 0;
+  int64_t sourceModifiedNs = 0;
+  if (!fileStamp(path, &sourceSize, &sourceModifiedNs)) {
+    LOGCATE("CubeLut::load: no such file %s", path.c_str());
+    return false;
+  }
+
+  if (!cachePath.empty() &&
+      lut->readCache(cachePath, sourceSize, sourceModifiedNs)) {
+    return true;
+  }
+
+  std::vector<char> text;
+  if (!readFile(path, text)) {
+    LOGCATE("CubeLut::load: can't read %s", path.c_str());
+    return false;
+  }
+  if (!parse(text.data(), text.size(), lut)) {
+    LOGCATE("CubeLut::load: %s is not a valid 3D .cube file", path.c_str());
+    return false;
+  }
+
+  if (!cachePath.empty()) {
+    lut->writeCache(cachePath, sourceSize, sourceModifiedNs);
+  }
+  return true;
+}
+
+bool CubeLut::parse(const char *text, size_t length, CubeLut *lut) {
+  const char *p = text;
+  const char *end = text + length;
+  uint32_t size = 0;
+  size_t texelCount = 0;
+  std::vector<uint16_t> texels;
+
+  for (; p < end; ++p) {
+    skipBlanks(p, end);
+    if (p == end || *p == '\n') {
+      continue;
+    }
+    if (*p == '#') {
+      skipLine(p, end);
+      continue;
+    }
+
+    if (isDigit(*p) || *p == '-' || *p == '+' || *p == '.') {
+      float r, g, b;
+      if (size == 0) {
+        LOGCATE("CubeLut::parse: table data before LUT_3D_SIZE");
+        return false;
+      }
+      // The table usually runs to the end of the file. If there are
+      // keywords among its lines, it is parsed line by line below.
+      if (texels.empty() &&
+          static_cast<size_t>(end - p) >= kParallelParseBytes &&
+          parseTableLinesParallel(p, end, &texels)) {
+        // The count is checked below
+        break;
+      }
+      if (!parseFloat(p, end, &r) || !parseFloat(p, end, &g) ||
+          !parseFloat(p, end, &b) || !atLineEnd(p, end)) {
+        LOGCATE("CubeLut::parse: malformed table line");
+        return false;
+      }
+      if (texels.size() / 4 == texelCount) {
+        LOGCATE("CubeLut::parse: more than %zu table lines", texelCount);
+        return false;
+      }
+      appendTexel(texels, r, g, b);
+      continue;
+    }
+
+    const char *keyword = p;
+    while (p < end && !isBlank(*p) && *p != '\n') {
+      ++p;
+    }
+    const std::string name(keyword, p - keyword);
+    if (name == "LUT_3D_SIZE") {
+      if (!parseUint(p, end, &size) || size < kMinSize || size > kMaxSize) {
+        LOGCATE("CubeLut::parse: LUT_3D_SIZE must be in [%u, %u]", kMinSize,
+                kMaxSize);
+        return false;
+      }
+      texelCount = static_cast<size_t>(size) * size * size;
+      texels.reserve(texelCount * 4);
+    } else if (name == "DOMAIN_MIN" || name == "DOMAIN_MAX") {
+      const float expected = name == "DOMAIN_MIN" ? 0.0f : 1.0f;
+      float domain[3];
+      for (auto &bound : domain) {
+        if (!parseFloat(p, end, &bound)) {
+          LOGCATE("CubeLut::parse: malformed %s", name.c_str());
+          return false;
+        }
+        if (bound != expected) {
+          LOGCATE("CubeLut::parse: only the default domain is supported");
+          return false;
+        }
+      }
+    } else if (name == "LUT_1D_SIZE") {
+      LOGCATE("CubeLut::parse: 1D tables are not supported");
+      return false;
+    } else if (name != "TITLE") {
+      LOGCATI("CubeLut::parse: ignoring keyword %s", name.c_str());
+    }
+    skipLine(p, end);
+  }
+
+  if (size == 0 || texels.size() / 4 != texelCount) {
+    LOGCATE("CubeLut::parse: expected %zu table lines, got %zu", texelCount,
+            texels.size() / 4);
+    return false;
+  }
+  lut->mSize = size;
+  lut->mTexels = std::move(texels);
+  return true;
+}
+
+CubeLut CubeLut::identity(uint32_t size) {
+  CubeLut lut;
+  lut.mSize = size;
+  lut.mTexels.reserve(static_cast<size_t>(size) * size * size * 4);
+  const float scale = 1.0f / static_cast<float>(size - 1);
+  for (uint32_t b = 0; b < size; ++b) {
+    for (uint32_t g = 0; g < size; ++g) {
+      for (uint32_t r = 0; r < size; ++r) {
+        appendTexel(lut.mTexels, r * scale, g * scale, b * scale);
+      }
+    }
+  }
+  return lut;
+}
+
+bool CubeLut::readCache(const std::string &cachePath, uint64_t sourceSize,
+                        int64_t sourceModifiedNs) {
+  std::vector<char> data;
+  if (!readFile(cachePath, data) || data.size() < sizeof(CacheHeader)) {
+    return false;
+  }
+  CacheHeader header;
+  memcpy(&header, data.data(), sizeof(header));
+  if (header.magic != kCacheMagic || header.version != kCacheVersion ||
+      header.sourceSize != sourceSize ||
+      header.sourceModifiedNs != sourceModifiedNs ||
+      header.size < kMinSize || header.size > kMaxSize) {
+    LOGCATI("CubeLut: cache %s is stale", cachePath.c_str());
+    return false;
+  }
+  const size_t texelValues =
+      static_cast<size_t>(header.size) * header.size * header.size * 4;
+  if (data.size() != sizeof(header) + texelValues * sizeof(uint16_t)) {
+    LOGCATE("CubeLut: cache %s is truncated", cachePath.c_str());
+    return false;
+  }
+  mSize = header.size;
+  mTexels.resize(texelValues);
+  memcpy(mTexels.data(), data.data() + sizeof(header), byteSize());
+  return true;
+}
+
+void CubeLut::writeCache(const std::string &cachePath, uint64_t sourceSize,
+                         int64_t sourceModifiedNs) const {
+  CacheHeader header{};
+  header.magic = kCacheMagic;
+  header.version = kCacheVersion;
+  header.size = mSize;
+  header.sourceSize = sourceSize;
+  header.sourceModifiedNs = sourceModifiedNs;
+
+  std::vector<char> data(sizeof(header) + byteSize());
+  memcpy(data.data(), &header, sizeof(header));
+  memcpy(data.data() + sizeof(header), mTexels.data(), byteSize());
+  // Written in the background, the table can be used right away. A failed
+  // write only costs a parse on the next load.
+  TaskScheduler::shared().submit(
+      [cachePath, data = std::move(data)] {
+        writeFileAtomic(cachePath, data.data(), data.size());
+      },
+      CoreHint::Little);
+}
+} // namespace gain
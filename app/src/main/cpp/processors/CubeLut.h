@@ -0,0 +1,74 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef GAINVULKANSAMPLE_CUBELUT_H
+#define GAINVULKANSAMPLE_CUBELUT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gain {
+// A 3D color lookup table in the .cube format of Adobe/Resolve. The texels
+// are kept as RGBA half floats, red varying fastest, ready to be copied into
+// a 3D image of format R16G16B16A16Sfloat.
+class CubeLut {
+public:
+  static constexpr uint32_t kMinSize = 2;
+  static constexpr uint32_t kMaxSize = 65;
+
+  // Load the .cube file at path. If cachePath is not empty, the binary form
+  // stored there is used while it is newer than the .cube file, and written
+  // after parsing otherwise.
+  static bool load(const std::string &path, const std::string &cachePath,
+                   CubeLut *lut);
+
+  // Parse the text of a .cube file. Only 3D tables over the default [0, 1]
+  // domain are supported.
+  static bool parse(const char *text, size_t length, CubeLut *lut);
+
+  // A size^3 table that maps every color onto itself
+  static CubeLut identity(uint32_t size);
+
+  // Number of texels along each axis
+  uint32_t size() const { return mSize; }
+
+  const std::vector<uint16_t> &texels() const { return mTexels; }
+
+  size_t byteSize() const { return mTexels.size() * sizeof(uint16_t); }
+
+private:
+  bool readCache(const std::string &cachePath, uint64_t sourceSize,
+                 int64_t sourceModifiedNs);
+
+  void writeCache(const std::string &cachePath, uint64_t sourceSize,
+                  int64_t sourceModifiedNs) const;
+
+  uint32_t mSize = 0;
+  std::vector<uint16_t> mTexels;
+};
+} // namespace gain
+
+#endif // GAINVULKANSAMPLE_CUBELUT_H
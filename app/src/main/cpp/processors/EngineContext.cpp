@@ -4,12 +4,7 @@
 
 #include "EngineContext.h"
 
-void EngineContext::initSyncObjects() {
-  presentCompleteSemaphore =
-      vulkanContext()->device().createSemaphore(vk::SemaphoreCreateInfo{});
-  renderCompleteSemaphore =
-      vulkanContext()->device().createSemaphore(vk::SemaphoreCreateInfo{});
-}
+#include <algorithm>
 
 bool EngineContext::createSemaphore(vk::Semaphore *semaphore) const {
   if (semaphore == nullptr)
@@ -26,8 +21,8 @@ void EngineContext::connectSwapChain() {
                      vulkanContext()->device());
 }
 
-void EngineContext::setNativeWindow(ANativeWindow *window, uint32_t width,
-                                    uint32_t height) {
+void EngineContext::setNativeWindow(gain::NativeWindow *window,
+                                    uint32_t width, uint32_t height) {
   mWindow.nativeWindow = window;
   mWindow.windowWidth = width;
   mWindow.windowHeight = height;
@@ -37,6 +32,14 @@ void EngineContext::setNativeWindow(ANativeWindow *window, uint32_t width,
       256.0f);
 }
 
+void EngineContext::setOffscreenTarget(uint32_t width, uint32_t height,
+                                       ReadbackCallback readback) {
+  settings.offscreen = true;
+  mReadbackCallback = std::move(readback);
+  setNativeWindow(nullptr, width, height);
+  windowResize();
+}
+
 void EngineContext::windowResize() {
   if (!mPrepared) {
     return;
@@ -48,13 +51,18 @@ void EngineContext::windowResize() {
   vulkanContext()->device().waitIdle();
 
   // Recreate swap chain
-  setupSwapChain();
+  if (settings.offscreen) {
+    destroyOffscreenTargets();
+    setupOffscreenTargets();
+  } else {
+    setupSwapChain();
+  }
 
   // Recreate the frame buffers
   if (settings.uesDepth) {
     vulkanContext()->device().destroyImageView(depthStencil.view, nullptr);
     vulkanContext()->device().destroyImage(depthStencil.image, nullptr);
-    vulkanContext()->device().freeMemory(depthStencil.mem, nullptr);
+    vulkanContext()->deviceWrapper()->allocator->free(depthStencil.allocation);
     setupDepthStencil();
   }
 
@@ -63,16 +71,8 @@ void EngineContext::windowResize() {
   }
   setupFrameBuffer();
 
-  // Command buffers need to be recreated as they may store
-  // references to the recreated frame buffer
-  vulkanContext()->device().freeCommandBuffers(vulkanContext()->commandPool(),
-                                               drawCmdBuffers.size(),
-                                               drawCmdBuffers.data());
-  drawCmdBuffers.clear();
-
-  createCommandBuffers();
-
-  vulkanContext()->device().waitIdle();
+  // Command buffers recorded once may refer to the old frame buffers
+  buildCommandBuffers();
 
   mPrepared = true;
 }
@@ -103,21 +103,12 @@ void EngineContext::prepareVertices(bool useStagingBuffers, const void *data,
     // - Create another buffer that's local on the device (VRAM) with the same
     // size
     // - Copy the data from the host to the device using a command buffer
-    // - Delete the host visible (staging) buffer
     // - Use the device local buffers for rendering
-
-    auto stagingBuffers =
-        vks::Buffer::create(vulkanContext()->deviceWrapper(), vertexBufferSize,
-                            vk::BufferUsageFlagBits::eTransferSrc,
-                            vk::MemoryPropertyFlagBits::eHostVisible |
-                                vk::MemoryPropertyFlagBits::eHostCoherent);
-    stagingBuffers->map();
-    stagingBuffers->copyFrom(data, vertexBufferSize);
-    stagingBuffers->unmap();
-
-    vks::debug::setDeviceMemoryName(
-        vulkanContext()->device(), stagingBuffers->getMemoryHandle(),
-        "EngineContext-prepareVertices-stagingBuffers");
+    //
+    // The upload manager takes care of the staging buffers and submits the
+    // copy on a dedicated transfer queue if the device has one. Frames
+    // submitted later are ordered after the copy, so there is no need to wait
+    // for it here.
 
     mVerticesBuffer =
         vks::Buffer::create(vulkanContext()->deviceWrapper(), vertexBufferSize,
@@ -125,26 +116,16 @@ void EngineContext::prepareVertices(bool useStagingBuffers, const void *data,
                                 vk::BufferUsageFlagBits::eTransferDst,
                             vk::MemoryPropertyFlagBits::eDeviceLocal);
 
-    vks::debug::setDeviceMemoryName(
-        vulkanContext()->device(), mVerticesBuffer->getMemoryHandle(),
+    vks::debug::setBufferName(
+        vulkanContext()->device(), mVerticesBuffer->getBufferHandle(),
         "EngineContext-prepareVertices-mVerticesBuffer");
 
-    // Buffer copies have to be submitted to a queue, so we need a command
-    // buffer for them Note: Some devices offer a dedicated transfer queue (with
-    // only the transfer bit set) that may be faster when doing lots of copies
-    vk::CommandBuffer copyCmd;
-    assert(vulkanContext()->deviceWrapper()->beginSingleTimeCommand(&copyCmd));
-
-    // Put buffer region copies into command buffer
-    vk::BufferCopy copyRegion = {};
-
-    // Vertex buffer
-    copyRegion.size = vertexBufferSize;
-    copyCmd.copyBuffer(stagingBuffers->getBufferHandle(),
-                       mVerticesBuffer->getBufferHandle(), 1, &copyRegion);
-
-    vulkanContext()->deviceWrapper()->endAndSubmitSingleTimeCommand(
-        copyCmd, vulkanContext()->queue());
+    vks::UploadManager *uploads = vulkanContext()->uploadManager();
+    uploads->uploadBuffer(mVerticesBuffer->getBufferHandle(), data,
+                          vertexBufferSize, 0,
+                          vk::PipelineStageFlagBits::eVertexInput,
+                          vk::AccessFlagBits::eVertexAttributeRead);
+    uploads->flush();
   } else {
     // Don't use staging
     // Create host-visible buffers only and use these for rendering. This is not
@@ -159,44 +140,52 @@ void EngineContext::prepareVertices(bool useStagingBuffers, const void *data,
     mVerticesBuffer->copyFrom(data, vertexBufferSize);
     mVerticesBuffer->unmap();
 
-    vks::debug::setDeviceMemoryName(
-        vulkanContext()->device(), mVerticesBuffer->getMemoryHandle(),
+    vks::debug::setBufferName(
+        vulkanContext()->device(), mVerticesBuffer->getBufferHandle(),
         "EngineContext-prepareVertices-mVerticesBuffer-no-staging");
   }
 }
 
 void EngineContext::setupRenderPass() {
+  // Offscreen targets are copied out after the pass instead of presented
+  const vk::Format colorFormat =
+      settings.offscreen ? mOffscreenFormat : mSwapChain.colorFormat;
+  const vk::ImageLayout colorFinalLayout =
+      settings.offscreen ? vk::ImageLayout::eTransferSrcOptimal
+                         : vk::ImageLayout::ePresentSrcKHR;
+
   std::vector<vk::AttachmentDescription> attachments;
   if (!settings.uesDepth) {
     attachments.resize(1);
     // Color attachment
-    attachments[0].format = mSwapChain.colorFormat;
+    attachments[0].format = colorFormat;
     attachments[0].samples = vk::SampleCountFlagBits::e1;
     attachments[0].loadOp = vk::AttachmentLoadOp::eClear;
     attachments[0].storeOp = vk::AttachmentStoreOp::eStore;
     attachments[0].stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
     attachments[0].stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
     attachments[0].initialLayout = vk::ImageLayout::eUndefined;
-    attachments[0].finalLayout = vk::ImageLayout::ePresentSrcKHR;
+    attachments[0].finalLayout = colorFinalLayout;
   } else {
     attachments.resize(2);
     // Color attachment
-    attachments[0].format = mSwapChain.colorFormat;
+    attachments[0].format = colorFormat;
     attachments[0].samples = vk::SampleCountFlagBits::e1;
     attachments[0].loadOp = vk::AttachmentLoadOp::eClear;
     attachments[0].storeOp = vk::AttachmentStoreOp::eStore;
     attachments[0].stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
     attachments[0].stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
     attachments[0].initialLayout = vk::ImageLayout::eUndefined;
-    attachments[0].finalLayout = vk::ImageLayout::ePresentSrcKHR;
+    attachments[0].finalLayout = colorFinalLayout;
 
-    // Depth attachment
+    // Depth attachment. Nothing reads it after the pass, so it is cleared
+    // in tile memory and never written back, see setupDepthStencil.
     attachments[1].format = depthFormat;
     attachments[1].samples = vk::SampleCountFlagBits::e1;
     attachments[1].loadOp = vk::AttachmentLoadOp::eClear;
-    attachments[1].storeOp = vk::AttachmentStoreOp::eStore;
+    attachments[1].storeOp = vk::AttachmentStoreOp::eDontCare;
     attachments[1].stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
-    attachments[1].stencilStoreOp = vk::AttachmentStoreOp::eStore;
+    attachments[1].stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
     attachments[1].initialLayout = vk::ImageLayout::eUndefined;
     attachments[1].finalLayout =
         vk::ImageLayout::eDepthStencilAttachmentOptimal;
@@ -251,14 +240,14 @@ vk::PipelineShaderStageCreateInfo
 EngineContext::loadShader(const char *shaderFilePath,
                           vk::ShaderStageFlagBits stage) {
   // Read shader file from asset.
-  AAsset *shaderFile = AAssetManager_open(vulkanContext()->_AAssetManager(),
-                                          shaderFilePath, AASSET_MODE_BUFFER);
-  assert(shaderFile != nullptr);
-  const size_t shaderSize = AAsset_getLength(shaderFile);
-  std::vector<char> shader(shaderSize);
-  int status = AAsset_read(shaderFile, shader.data(), shaderSize);
-  AAsset_close(shaderFile);
-  assert(status >= 0);
+  std::vector<char> shader;
+  if (!gain::readAsset(vulkanContext()->assetManager(), shaderFilePath,
+                       shader)) {
+    LOGCATE("EngineContext: failed to read shader %s", shaderFilePath);
+    assert(false);
+    return {};
+  }
+  const size_t shaderSize = shader.size();
 
   // Create shader module.
   const vk::ShaderModuleCreateInfo shaderDesc{
@@ -287,7 +276,10 @@ void EngineContext::initSwapchain() {
   swapChain.initSurface(display, surface);
 #elif defined(VK_USE_PLATFORM_XCB_KHR)
   swapChain.initSurface(connection, window);
-#elif (defined(_DIRECT2DISPLAY) || defined(VK_USE_PLATFORM_HEADLESS_EXT))
+#elif defined(VK_USE_PLATFORM_HEADLESS_EXT)
+  // Host builds, see platform/Platform.h
+  mSwapChain.initSurface(mWindow.nativeWindow);
+#elif defined(_DIRECT2DISPLAY)
   swapChain.initSurface(width, height);
 #endif
 }
@@ -296,32 +288,127 @@ void EngineContext::setupSwapChain() {
   mSwapChain.create(&mWindow.windowWidth, &mWindow.windowHeight);
 }
 
-void EngineContext::createCommandBuffers() {
-  // Create one command buffer for each swap chain image and reuse for rendering
-  for (int i = 0; i < mSwapChain.imageCount; ++i) {
-    vk::CommandBuffer cmdBuffer;
-    vk::CommandBufferAllocateInfo cmdBufAllocateInfo{};
-    cmdBufAllocateInfo.commandPool =
-        vulkanContext()->deviceWrapper()->commandPool;
-    cmdBufAllocateInfo.level = vk::CommandBufferLevel::ePrimary;
-    cmdBufAllocateInfo.commandBufferCount = 1;
+void EngineContext::createFrameSlots() {
+  const uint32_t slotCount =
+      std::clamp<uint32_t>(settings.maxFramesInFlight, 1, 3);
+  frameSlots.resize(slotCount);
+
+  // Created signaled, so the first wait on each slot returns immediately
+  vk::FenceCreateInfo fenceCreateInfo{};
+  fenceCreateInfo.flags = vk::FenceCreateFlagBits::eSignaled;
+
+  vk::CommandBufferAllocateInfo cmdBufAllocateInfo{};
+  cmdBufAllocateInfo.commandPool = vulkanContext()->deviceWrapper()->commandPool;
+  cmdBufAllocateInfo.level = vk::CommandBufferLevel::ePrimary;
+  cmdBufAllocateInfo.commandBufferCount = 1;
+
+  const vk::SemaphoreCreateInfo semaphoreCreateInfo{};
+  for (auto &slot : frameSlots) {
+    CALL_VK(vulkanContext()->device().createSemaphore(
+        &semaphoreCreateInfo, nullptr, &slot.acquireSemaphore));
+    CALL_VK(vulkanContext()->device().createSemaphore(
+        &semaphoreCreateInfo, nullptr, &slot.renderSemaphore));
+    CALL_VK(vulkanContext()->device().createFence(&fenceCreateInfo, nullptr,
+                                                  &slot.fence));
+    if (settings.offscreen) {
+      CALL_VK(vulkanContext()->device().createFence(&fenceCreateInfo, nullptr,
+                                                    &slot.offscreenFence));
+    }
     CALL_VK(vulkanContext()->device().allocateCommandBuffers(
-        &cmdBufAllocateInfo, &cmdBuffer));
+        &cmdBufAllocateInfo, &slot.commandBuffer));
+  }
+  currentFrame = 0;
 
-    drawCmdBuffers.push_back(cmdBuffer);
+  if (settings.staticCommandBuffers) {
+    for (auto &slot : frameSlots) {
+      CALL_VK(vulkanContext()->device().allocateCommandBuffers(
+          &cmdBufAllocateInfo, &slot.endCommandBuffer));
+    }
   }
+
+  prepareGpuProfiler(slotCount);
 }
 
-void EngineContext::createSynchronizationPrimitives() {
-  // Wait fences to sync command buffer access
-  vk::FenceCreateInfo fenceCreateInfo{};
-  fenceCreateInfo.flags = vk::FenceCreateFlagBits::eSignaled;
+void EngineContext::destroyFrameSlots() {
+  for (auto &slot : frameSlots) {
+    for (auto &release : slot.deferredReleases) {
+      release();
+    }
+    if (slot.acquireSemaphore) {
+      vulkanContext()->device().destroySemaphore(slot.acquireSemaphore);
+    }
+    if (slot.renderSemaphore) {
+      vulkanContext()->device().destroySemaphore(slot.renderSemaphore);
+    }
+    if (slot.fence) {
+      vulkanContext()->device().destroyFence(slot.fence);
+    }
+    if (slot.offscreenFence) {
+      vulkanContext()->device().destroyFence(slot.offscreenFence);
+    }
+    if (slot.commandBuffer) {
+      vulkanContext()->device().freeCommandBuffers(
+          vulkanContext()->commandPool(), 1, &slot.commandBuffer);
+    }
+    if (slot.endCommandBuffer) {
+      vulkanContext()->device().freeCommandBuffers(
+          vulkanContext()->commandPool(), 1, &slot.endCommandBuffer);
+    }
+  }
+  frameSlots.clear();
+}
 
-  waitFences.resize(drawCmdBuffers.size());
-  for (auto &fence : waitFences) {
-    CALL_VK(vulkanContext()->device().createFence(&fenceCreateInfo, nullptr,
-                                                  &fence));
+void EngineContext::waitForFrame(FrameSlot &slot) {
+  CALL_VK(vulkanContext()->device().waitForFences(1, &slot.fence, VK_TRUE,
+                                                  UINT64_MAX));
+  if (slot.offscreenFence) {
+    CALL_VK(vulkanContext()->device().waitForFences(1, &slot.offscreenFence,
+                                                    VK_TRUE, UINT64_MAX));
   }
+
+  // A fence signal also covers everything submitted before it, so whatever
+  // was deferred to this frame is no longer in use by the GPU
+  for (auto &release : slot.deferredReleases) {
+    release();
+  }
+  slot.deferredReleases.clear();
+}
+
+void EngineContext::deferRelease(std::function<void()> release) {
+  currentFrameSlot().deferredReleases.push_back(std::move(release));
+}
+
+void EngineContext::prepareUniformRing(vk::DeviceSize bytesPerFrame) {
+  mUniformRing = vks::UniformRing::create(
+      vulkanContext()->deviceWrapper(), bytesPerFrame,
+      static_cast<uint32_t>(frameSlots.size()));
+  assert(mUniformRing);
+}
+
+EngineContext::ColorTarget EngineContext::currentColorTarget() const {
+  // Matches the final layout of setupRenderPass
+  if (settings.offscreen) {
+    const OffscreenTarget &target = mOffscreenTargets[currentBuffer];
+    return {target.image, vk::ImageLayout::eTransferSrcOptimal,
+            mOffscreenFormat,
+            vk::ImageUsageFlagBits::eColorAttachment |
+                vk::ImageUsageFlagBits::eTransferSrc,
+            target.extent};
+  }
+  return {mSwapChain.buffers[currentBuffer].image,
+          vk::ImageLayout::ePresentSrcKHR, mSwapChain.colorFormat,
+          mSwapChain.imageUsage, mSwapChain.extent};
+}
+
+void EngineContext::prepareGpuProfiler(uint32_t frameCount) {
+  if (!settings.gpuProfiling) {
+    return;
+  }
+  // Engines submit to queue(), which is of the graphics family
+  mGpuProfiler = vks::GpuProfiler::create(
+      vulkanContext()->deviceWrapper(),
+      vulkanContext()->deviceWrapper()->queueFamilyIndices.graphics,
+      frameCount);
 }
 
 void EngineContext::setupDepthStencil() {
@@ -339,7 +426,10 @@ void EngineContext::setupDepthStencil() {
   imageCI.queueFamilyIndexCount = 0;
   imageCI.pQueueFamilyIndices = NULL;
   imageCI.sharingMode = vk::SharingMode::eExclusive;
-  imageCI.usage = vk::ImageUsageFlagBits::eDepthStencilAttachment;
+  // Only used within the render pass, so tilers may keep it in tile memory
+  // and back it by lazily allocated memory that is never committed
+  imageCI.usage = vk::ImageUsageFlagBits::eDepthStencilAttachment |
+                  vk::ImageUsageFlagBits::eTransientAttachment;
 
   CALL_VK(vulkanContext()->device().createImage(&imageCI, nullptr,
                                                 &depthStencil.image));
@@ -347,15 +437,25 @@ void EngineContext::setupDepthStencil() {
   vulkanContext()->device().getImageMemoryRequirements(depthStencil.image,
                                                        &memReqs);
 
-  vk::MemoryAllocateInfo memAllloc{};
-  memAllloc.allocationSize = memReqs.size;
-  uint32_t memTypeIdx = vulkanContext()->deviceWrapper()->getMemoryType(
-      memReqs.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal);
-  memAllloc.memoryTypeIndex = memTypeIdx;
-  CALL_VK(vulkanContext()->device().allocateMemory(&memAllloc, nullptr,
-                                                   &depthStencil.mem));
+  auto &allocator = vulkanContext()->deviceWrapper()->allocator;
+  const bool lazy = allocator->hasMemoryType(
+      memReqs.memoryTypeBits, vk::MemoryPropertyFlagBits::eLazilyAllocated);
+  depthStencil.allocation = allocator->allocate(
+      memReqs,
+      lazy ? vk::MemoryPropertyFlagBits::eLazilyAllocated
+           : vk::MemoryPropertyFlagBits::eDeviceLocal,
+      vks::MemoryAllocator::Tiling::eOptimal);
+  assert(depthStencil.allocation);
+  // The store is skipped either way
+  LOGCATI("EngineContext: %dx%d depth in %s memory, %llu bytes not "
+          "committed, %llu bytes per frame not stored",
+          mWindow.windowWidth, mWindow.windowHeight,
+          lazy ? "lazily allocated" : "device local",
+          static_cast<unsigned long long>(lazy ? memReqs.size : 0),
+          static_cast<unsigned long long>(memReqs.size));
   vulkanContext()->device().bindImageMemory(depthStencil.image,
-                                            depthStencil.mem, 0);
+                                            depthStencil.allocation.memory,
+                                            depthStencil.allocation.offset);
 
   vk::ImageViewCreateInfo imageViewCI{};
   imageViewCI.viewType = vk::ImageViewType::e2D;
@@ -380,6 +480,118 @@ void EngineContext::setupDepthStencil() {
                                                     &depthStencil.view));
 }
 
+void EngineContext::setupOffscreenTargets() {
+  vk::Device device = vulkanContext()->device();
+  const uint32_t width = mWindow.windowWidth;
+  const uint32_t height = mWindow.windowHeight;
+
+  vk::CommandBufferAllocateInfo cmdBufAllocateInfo{};
+  cmdBufAllocateInfo.commandPool = vulkanContext()->commandPool();
+  cmdBufAllocateInfo.level = vk::CommandBufferLevel::ePrimary;
+  cmdBufAllocateInfo.commandBufferCount = 1;
+
+  // One target per frame slot, a slot's fences also cover its target
+  mOffscreenTargets.resize(frameSlots.size());
+  for (auto &target : mOffscreenTargets) {
+    vk::ImageCreateInfo imageCI{};
+    imageCI.imageType = vk::ImageType::e2D;
+    imageCI.format = mOffscreenFormat;
+    imageCI.extent = vk::Extent3D{width, height, 1};
+    imageCI.mipLevels = 1;
+    imageCI.arrayLayers = 1;
+    imageCI.samples = vk::SampleCountFlagBits::e1;
+    imageCI.tiling = vk::ImageTiling::eOptimal;
+    imageCI.initialLayout = vk::ImageLayout::eUndefined;
+    imageCI.sharingMode = vk::SharingMode::eExclusive;
+    imageCI.usage = vk::ImageUsageFlagBits::eColorAttachment |
+                    vk::ImageUsageFlagBits::eTransferSrc;
+    CALL_VK(device.createImage(&imageCI, nullptr, &target.image));
+    target.extent = vk::Extent2D{width, height};
+
+    vk::MemoryRequirements memReqs{};
+    device.getImageMemoryRequirements(target.image, &memReqs);
+    target.allocation = vulkanContext()->deviceWrapper()->allocator->allocate(
+        memReqs, vk::MemoryPropertyFlagBits::eDeviceLocal,
+        vks::MemoryAllocator::Tiling::eOptimal);
+    assert(target.allocation);
+    device.bindImageMemory(target.image, target.allocation.memory,
+                           target.allocation.offset);
+
+    vk::ImageViewCreateInfo imageViewCI{};
+    imageViewCI.viewType = vk::ImageViewType::e2D;
+    imageViewCI.image = target.image;
+    imageViewCI.format = mOffscreenFormat;
+    imageViewCI.subresourceRange = {vk::ImageAspectFlagBits::eColor, 0, 1, 0,
+                                    1};
+    CALL_VK(device.createImageView(&imageViewCI, nullptr, &target.view));
+
+    if (!mReadbackCallback) {
+      continue;
+    }
+
+    target.readbackBuffer =
+        vks::Buffer::create(vulkanContext()->deviceWrapper(),
+                            width * height * 4,
+                            vk::BufferUsageFlagBits::eTransferDst,
+                            vk::MemoryPropertyFlagBits::eHostVisible |
+                                vk::MemoryPropertyFlagBits::eHostCoherent);
+    CALL_VK(target.readbackBuffer->map());
+
+    // The copy never changes, so it is recorded once. The render pass leaves
+    // the target in eTransferSrcOptimal.
+    CALL_VK(device.allocateCommandBuffers(&cmdBufAllocateInfo,
+                                          &target.readbackCommandBuffer));
+    vk::CommandBufferBeginInfo cmdBufInfo{};
+    CALL_VK(target.readbackCommandBuffer.begin(&cmdBufInfo));
+
+    vk::BufferImageCopy region{};
+    region.imageSubresource = {vk::ImageAspectFlagBits::eColor, 0, 0, 1};
+    region.imageExtent = imageCI.extent;
+    target.readbackCommandBuffer.copyImageToBuffer(
+        target.image, vk::ImageLayout::eTransferSrcOptimal,
+        target.readbackBuffer->getBufferHandle(), 1, &region);
+
+    vk::BufferMemoryBarrier hostBarrier{};
+    hostBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+    hostBarrier.dstAccessMask = vk::AccessFlagBits::eHostRead;
+    hostBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    hostBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    hostBarrier.buffer = target.readbackBuffer->getBufferHandle();
+    hostBarrier.size = VK_WHOLE_SIZE;
+    target.readbackCommandBuffer.pipelineBarrier(
+        vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost,
+        vk::DependencyFlags(), 0, nullptr, 1, &hostBarrier, 0, nullptr);
+
+    target.readbackCommandBuffer.end();
+  }
+}
+
+void EngineContext::destroyOffscreenTargets() {
+  // Readbacks deferred to the slots still point into the targets' buffers
+  for (auto &slot : frameSlots) {
+    waitForFrame(slot);
+  }
+
+  vk::Device device = vulkanContext()->device();
+  for (auto &target : mOffscreenTargets) {
+    if (target.readbackCommandBuffer) {
+      device.freeCommandBuffers(vulkanContext()->commandPool(), 1,
+                                &target.readbackCommandBuffer);
+    }
+    if (target.readbackBuffer) {
+      target.readbackBuffer->unmap();
+    }
+    if (target.view) {
+      device.destroyImageView(target.view);
+    }
+    if (target.image) {
+      device.destroyImage(target.image);
+    }
+    vulkanContext()->deviceWrapper()->allocator->free(target.allocation);
+  }
+  mOffscreenTargets.clear();
+}
+
 void EngineContext::setupFrameBuffer() {
   std::vector<vk::ImageView> attachments;
 
@@ -400,10 +612,12 @@ void EngineContext::setupFrameBuffer() {
   frameBufferCreateInfo.height = mWindow.windowHeight;
   frameBufferCreateInfo.layers = 1;
 
-  // Create frame buffers for every swap chain image
-  frameBuffers.resize(mSwapChain.imageCount);
+  // Create frame buffers for every swap chain image or offscreen target
+  frameBuffers.resize(settings.offscreen ? mOffscreenTargets.size()
+                                         : mSwapChain.imageCount);
   for (uint32_t i = 0; i < frameBuffers.size(); i++) {
-    attachments[0] = mSwapChain.buffers[i].view;
+    attachments[0] = settings.offscreen ? mOffscreenTargets[i].view
+                                        : mSwapChain.buffers[i].view;
     CALL_VK(vulkanContext()->device().createFramebuffer(
         &frameBufferCreateInfo, nullptr, &frameBuffers[i]));
   }
@@ -414,10 +628,14 @@ void EngineContext::prepare(JNIEnv *env) {
     vulkanContext()->deviceWrapper()->getDepthFormat(depthFormat);
   }
 
-  initSwapchain();
-  setupSwapChain();
-  createCommandBuffers();
-  createSynchronizationPrimitives();
+  if (settings.offscreen) {
+    createFrameSlots();
+    setupOffscreenTargets();
+  } else {
+    initSwapchain();
+    setupSwapChain();
+    createFrameSlots();
+  }
 
   if (settings.uesDepth) {
     setupDepthStencil();
@@ -428,42 +646,95 @@ void EngineContext::prepare(JNIEnv *env) {
 }
 
 void EngineContext::prepareFrame() {
-  CALL_VK(
-      mSwapChain.acquireNextImage(presentCompleteSemaphore, &currentBuffer));
+  // Use the slot's fence to wait until its command buffer has finished
+  // execution before using it again. Only a frame that is maxFramesInFlight
+  // frames old is waited on, later frames keep running on the GPU.
+  FrameSlot &slot = currentFrameSlot();
+  waitForFrame(slot);
+
+  // The slot's uniforms are no longer read by the GPU either
+  if (mUniformRing) {
+    mUniformRing->beginRegion(currentFrame);
+  }
+
+  if (settings.offscreen) {
+    // The slot's target is free once its fences are signaled, there is
+    // nothing to acquire. Engines leave out the acquire semaphore wait.
+    currentBuffer = currentFrame;
+    return;
+  }
+
+  CALL_VK(mSwapChain.acquireNextImage(slot.acquireSemaphore, &currentBuffer));
 }
 
 void EngineContext::submitFrame() {
+  if (settings.offscreen) {
+    submitOffscreenFrame();
+    currentFrame = (currentFrame + 1) % frameSlots.size();
+    return;
+  }
+
   // Present the current buffer to the swap chain
   // Pass the semaphore signaled by the command buffer submission from the
   // submit info as the wait semaphore for swap chain presentation This ensures
   // that the image is not presented to the windowing system until all commands
   // have been submitted
-  vk::Result present = mSwapChain.queuePresent(
-      vulkanContext()->queue(), currentBuffer, renderCompleteSemaphore);
+  vk::Result present =
+      mSwapChain.queuePresent(vulkanContext()->queue(), currentBuffer,
+                              currentFrameSlot().renderSemaphore);
   if (!((present == vk::Result::eSuccess) ||
         (present == vk::Result::eSuboptimalKHR))) {
     CALL_VK(present);
   }
+
+  currentFrame = (currentFrame + 1) % frameSlots.size();
+}
+
+void EngineContext::submitOffscreenFrame() {
+  FrameSlot &slot = currentFrameSlot();
+  const OffscreenTarget &target = mOffscreenTargets[currentBuffer];
+
+  // Nothing presents the frame, so this batch waits on the render semaphore
+  // in place of present and copies the target out if a readback is set
+  const vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eTransfer;
+  vk::SubmitInfo submitInfo{};
+  submitInfo.waitSemaphoreCount = 1;
+  submitInfo.pWaitSemaphores = &slot.renderSemaphore;
+  submitInfo.pWaitDstStageMask = &waitStage;
+  if (target.readbackCommandBuffer) {
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &target.readbackCommandBuffer;
+  }
+
+  CALL_VK(vulkanContext()->device().resetFences(1, &slot.offscreenFence));
+  CALL_VK(vulkanContext()->queue().submit(1, &submitInfo, slot.offscreenFence));
+
+  if (target.readbackBuffer) {
+    // Delivered once the slot's fences are signaled, see waitForFrame
+    const vks::Buffer *buffer = target.readbackBuffer.get();
+    const uint32_t width = mWindow.windowWidth;
+    const uint32_t height = mWindow.windowHeight;
+    deferRelease([callback = mReadbackCallback, buffer, width, height]() {
+      callback(buffer->getMappedData(), width, height, width * 4);
+    });
+  }
 }
 
 EngineContext::~EngineContext() {
   vulkanContext()->device().waitIdle();
 
-  if (presentCompleteSemaphore) {
-    vulkanContext()->device().destroySemaphore(presentCompleteSemaphore);
+  if (mUniformBuffer) {
+    mUniformBuffer->unmap();
   }
 
-  if (renderCompleteSemaphore) {
-    vulkanContext()->device().destroySemaphore(renderCompleteSemaphore);
-  }
+  destroyOffscreenTargets();
+  destroyFrameSlots();
 
-  for (auto &fence : waitFences) {
-    vulkanContext()->device().destroyFence(fence);
+  if (depthStencil.image) {
+    vulkanContext()->device().destroyImageView(depthStencil.view);
+    vulkanContext()->device().destroyImage(depthStencil.image);
+    vulkanContext()->deviceWrapper()->allocator->free(depthStencil.allocation);
   }
 
-  vulkanContext()->device().freeCommandBuffers(vulkanContext()->commandPool(),
-                                               drawCmdBuffers.size(),
-                                               drawCmdBuffers.data());
-
   mSwapChain.cleanup();
 }
\ No newline at end of file
@@ -8,23 +8,56 @@
 #include <VulkanBufferWrapper.h>
 #include <VulkanContext.h>
 #include <VulkanDeviceWrapper.hpp>
+#include <VulkanGpuProfiler.h>
 #include <VulkanSwapChain.h>
-#include <android/native_window.h>
+#include <VulkanUniformRing.h>
 #include <camera.hpp>
 #include <chrono>
-#include <jni.h>
+#include <functional>
+#include <platform/Platform.h>
 #include <vulkan/vulkan.hpp>
 
 class EngineContext {
+public:
+  // Everything a frame needs while it is recorded and executed. Slots are
+  // used round robin, so the CPU can record one frame while the GPU is still
+  // executing the previous ones.
+  struct FrameSlot {
+    // Signaled when the swap chain image acquired for this frame is ready.
+    // Never signaled in offscreen mode, submissions must not wait on it.
+    vk::Semaphore acquireSemaphore = nullptr;
+    // Signaled when the frame's commands have finished, waited on by present
+    vk::Semaphore renderSemaphore = nullptr;
+    // Signaled when the GPU is done with everything submitted for this slot
+    vk::Fence fence = nullptr;
+    // Offscreen mode only: signaled when the end of frame batch, and with it
+    // the readback of the slot's target, has finished
+    vk::Fence offscreenFence = nullptr;
+    vk::CommandBuffer commandBuffer = nullptr;
+    // Static command buffer mode only: recorded per frame and submitted
+    // after the recorded draw, e.g. for the GPU profiler's end timestamps
+    vk::CommandBuffer endCommandBuffer = nullptr;
+    // Releases waiting for fence, e.g. camera buffers and images still
+    // referenced by the slot's command buffer
+    std::vector<std::function<void()>> deferredReleases;
+  };
+
+  /** @brief Called with the pixels of a finished offscreen frame. pixels is
+   * only valid during the call. */
+  using ReadbackCallback =
+      std::function<void(const void *pixels, uint32_t width, uint32_t height,
+                          uint32_t rowPitch)>;
+
 private:
-  void createSynchronizationPrimitives();
+  void createFrameSlots();
+  void destroyFrameSlots();
   void initSwapchain();
   void setupSwapChain();
-  void createCommandBuffers();
+  void setupOffscreenTargets();
+  void destroyOffscreenTargets();
+  void submitOffscreenFrame();
 
 protected:
-  void initSyncObjects();
-
   virtual void createPipelines();
 
   virtual void prepareUniformBuffers();
@@ -48,12 +81,45 @@ protected:
   vk::PipelineShaderStageCreateInfo loadShader(const char *shaderFilePath,
                                                vk::ShaderStageFlagBits stage);
 
-  /** Prepare the next frame for workload submission by acquiring the next swap
-   * chain image */
+  /** Prepare the next frame for workload submission: wait until the current
+   * frame slot is free and acquire the next swap chain image */
   void prepareFrame();
-  /** @brief Presents the current image to the swap chain */
+  /** @brief Presents the current image to the swap chain and moves on to the
+   * next frame slot */
   void submitFrame();
 
+  /** @brief Waits until the GPU has finished the work last submitted from
+   * the slot and runs the releases deferred for it */
+  void waitForFrame(FrameSlot &slot);
+
+  /** @brief Defers release until the GPU has finished the frame recorded into
+   * the current frame slot */
+  void deferRelease(std::function<void()> release);
+
+  FrameSlot &currentFrameSlot() { return frameSlots[currentFrame]; }
+
+  /** @brief The image the current frame renders into and the layout the
+   * render pass leaves it in. Valid after prepareFrame. */
+  struct ColorTarget {
+    vk::Image image;
+    vk::ImageLayout layout;
+    vk::Format format;
+    vk::ImageUsageFlags usage;
+    // The size the image was created with
+    vk::Extent2D extent;
+  };
+  ColorTarget currentColorTarget() const;
+
+  /** @brief Creates mUniformRing with bytesPerFrame bytes per frame slot.
+   * prepareFrame starts the current slot's region, so engines can push their
+   * uniforms right after it. */
+  void prepareUniformRing(vk::DeviceSize bytesPerFrame);
+
+  /** @brief Creates mGpuProfiler with frameCount query pools if
+   * settings.gpuProfiling is set and the graphics queue has timestamps.
+   * Called for the frame slots by prepare. */
+  void prepareGpuProfiler(uint32_t frameCount);
+
   std::shared_ptr<VulkanContext> mVulkanContext;
 
   const std::shared_ptr<VulkanContext> vulkanContext() const {
@@ -61,7 +127,7 @@ protected:
   }
 
   struct {
-    ANativeWindow *nativeWindow;
+    gain::NativeWindow *nativeWindow;
     int32_t windowWidth;
     int32_t windowHeight;
   } mWindow;
@@ -70,7 +136,7 @@ protected:
 
   struct {
     vk::Image image;
-    vk::DeviceMemory mem;
+    vks::Allocation allocation;
     vk::ImageView view;
   } depthStencil;
 
@@ -92,23 +158,40 @@ protected:
   // Synchronization primitives
   // Synchronization is an important concept of Vulkan that OpenGL mostly hid
   // away. Getting this right is crucial to using Vulkan.
+  // Each frame slot owns its semaphores, fence and command buffer, see
+  // FrameSlot.
+  std::vector<FrameSlot> frameSlots;
 
-  // Semaphores
-  // Used to coordinate operations within the graphics queue and ensure correct
-  // command ordering
-  vk::Semaphore presentCompleteSemaphore = nullptr;
-  vk::Semaphore renderCompleteSemaphore = nullptr;
+  // Active frame slot index
+  uint32_t currentFrame = 0;
 
-  // Fences
-  // Used to check the completion of queue operations (e.g. command buffer
-  // execution)
-  std::vector<vk::Fence> waitFences;
-
-  // Active frame buffer index
+  // Active frame buffer (swap chain image) index
   uint32_t currentBuffer = 0;
 
-  // Command buffers used for rendering
-  std::vector<vk::CommandBuffer> drawCmdBuffers;
+  // Per-frame uniform data, see prepareUniformRing
+  std::unique_ptr<vks::UniformRing> mUniformRing;
+
+  // Times the engine's passes, nullptr if profiling is off or unsupported.
+  // Engines start its frame with the slot, see GpuProfiler::beginFrame.
+  std::unique_ptr<vks::GpuProfiler> mGpuProfiler;
+
+  // Engine owned color targets used instead of swap chain images in offscreen
+  // mode, one per frame slot
+  struct OffscreenTarget {
+    vk::Image image = nullptr;
+    vk::Extent2D extent;
+    vks::Allocation allocation;
+    vk::ImageView view = nullptr;
+    // Host visible copy of the image and the command buffer filling it. Only
+    // created if a readback callback is set.
+    std::unique_ptr<vks::Buffer> readbackBuffer;
+    vk::CommandBuffer readbackCommandBuffer = nullptr;
+  };
+  std::vector<OffscreenTarget> mOffscreenTargets;
+
+  const vk::Format mOffscreenFormat = vk::Format::eR8G8B8A8Unorm;
+
+  ReadbackCallback mReadbackCallback;
 
   /** @brief Last frame time measured using a high performance timer (if
    * available) */
@@ -151,12 +234,37 @@ public:
   struct Settings {
     /** @brief Enable UI overlay */
     bool overlay = true;
-    bool uesDepth = true;
+    /** @brief Give the render pass a depth attachment. Only for pipelines
+     * that test depth, it costs a full size image otherwise. */
+    bool uesDepth = false;
+    /** @brief Number of frames the CPU may record ahead of the GPU, 1 to 3 */
+    uint32_t maxFramesInFlight = 2;
+    /** @brief Record the draw command buffers once per swap chain image in
+     * buildCommandBuffers and reuse them, instead of recording every frame */
+    bool staticCommandBuffers = false;
+    /** @brief Render into engine owned images instead of a swap chain. Nothing
+     * is presented and frames are not paced by vsync. */
+    bool offscreen = false;
+    /** @brief Time the engine's passes with GPU timestamps, see
+     * gpuProfiler. Off by default, it costs timestamp writes, a query pool
+     * reset and an extra command buffer per frame. */
+    bool gpuProfiling = false;
   } settings;
 
+  /** @brief Rolling GPU durations of the engine's passes, nullptr if they
+   * are not measured */
+  const vks::GpuProfiler *gpuProfiler() const { return mGpuProfiler.get(); }
+
   void connectSwapChain();
 
-  void setNativeWindow(ANativeWindow *window, uint32_t width, uint32_t height);
+  void setNativeWindow(gain::NativeWindow *window, uint32_t width,
+                       uint32_t height);
+
+  /** @brief Switches to offscreen mode with targets of the given size.
+   * readback, if set, receives every rendered frame. Call before prepare;
+   * calling it again later resizes the targets like windowResize. */
+  void setOffscreenTarget(uint32_t width, uint32_t height,
+                          ReadbackCallback readback = nullptr);
 
   void windowResize();
 
@@ -11,29 +11,50 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
-void Engine_CameraHwb::setHdwImage(AHardwareBuffer *buffer, int orientation) {
-  mBuffer = buffer;
-  mOrientation = orientation;
+void Engine_CameraHwb::setHdwImage(AHardwareBuffer *buffer, int orientation,
+                                   SyncFence fence, int64_t timestampNs) {
+  const int64_t originNs = mLatency.frameOrigin(timestampNs);
+
+  // The caller closes its HardwareBuffer as soon as this returns, the frame
+  // keeps the buffer alive until it has been drawn or dropped
+  AHardwareBuffer_acquire(buffer);
+
+  if (!mHasFormatBuffer) {
+    // prepare follows on this thread, before the first frame is drawn
+    AHardwareBuffer_acquire(buffer);
+    mFormatBuffer = buffer;
+    mHasFormatBuffer = true;
+    mOrientation = orientation;
+  }
+
+  mFrameMailbox.publish(
+      FrameMailbox::Frame(buffer, std::move(fence), orientation, originNs));
+  mLatency.record(LatencyTracker::Stage::Ingest, originNs);
 }
 
 void Engine_CameraHwb::prepareHdwImage() {
   Image::ImageBasicInfo imageInfo = {
-    usage : vk::ImageUsageFlagBits::eSampled,
-    layout : vk::ImageLayout::eShaderReadOnlyOptimal,
-    format : vk::Format::eR8G8B8A8Unorm
-  };
-  mImage = Image::createFromAHardwareBuffer(vulkanContext()->deviceWrapper(),
-                                            vulkanContext()->queue(), mBuffer,
-                                            imageInfo);
-  vks::debug::setImageName(vulkanContext()->device(), mImage->getImageHandle(),
-                           "HDW-Image");
-
-  Image::ImageBasicInfo compImageInfo = {
-    usage : vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled,
-    layout : vk::ImageLayout::eGeneral,
     format : vk::Format::eR8G8B8A8Unorm,
-    extent : {mImage->width(), mImage->height(), 1}
+    layout : vk::ImageLayout::eShaderReadOnlyOptimal,
+    extent : vk::Extent3D(),
+    usage : vk::ImageUsageFlagBits::eSampled
   };
+  mImageCache = std::make_unique<ImageCache>(vulkanContext()->deviceWrapper(),
+                                             vulkanContext()->queue(),
+                                             imageInfo);
+  // Evicted images may still be sampled by a frame in flight
+  mImageCache->setRetireCallback([this](std::unique_ptr<Image> image) {
+    releaseImportBinding(image.get());
+    std::shared_ptr<Image> retired(std::move(image));
+    deferRelease([retired]() {});
+  });
+
+  // Importing only binds memory, the content is not touched until the first
+  // frame waits on the buffer's fence
+  mImage = mImageCache->acquire(mFormatBuffer);
+  // The import holds a reference of its own
+  AHardwareBuffer_release(mFormatBuffer);
+  mFormatBuffer = nullptr;
 }
 
 void Engine_CameraHwb::prepare(JNIEnv *env) {
@@ -48,7 +69,6 @@ void Engine_CameraHwb::prepare(JNIEnv *env) {
     setupDescriptorPool();
     setupDescriptorSetLayout();
     prepareUniformBuffers();
-    createDescriptorSet();
     createPipelines();
 
     mPrepared = true;
@@ -56,19 +76,110 @@ void Engine_CameraHwb::prepare(JNIEnv *env) {
 }
 
 void Engine_CameraHwb::updateTexture() {
-  // 确保更新数据的时候上一帧绘制已经完成
+  mWaitBufferReady = false;
+  mFrameOriginNs = 0;
+
+  FrameMailbox::Frame frame;
+  if (!mFrameMailbox.consume(&frame)) {
+    // No new camera frame, draw the last one again
+    return;
+  }
+  mOrientation = frame.orientation;
+  mFrameOriginNs = frame.originNs;
+  TRACE_COUNTER("Camera frames dropped", mFrameMailbox.droppedCount());
+
+  if (frame.fence.isValid()) {
+    // Let the GPU wait for the camera instead of blocking the render thread
+    if (vulkanContext()->deviceWrapper()->syncFdImportSupported &&
+        frame.fence.importToSemaphore(vulkanContext()->device(),
+                                      mBufferReadySemaphores[currentFrame])) {
+      mWaitBufferReady = true;
+    } else {
+      frame.fence.wait();
+    }
+  }
+
+  // Buffers the ImageReader hands out again are served from the cache
+  Image *image = mImageCache->acquire(frame.buffer);
+
+  // The frame owns the buffer until its fence has signaled. Earlier frames
+  // keep their own buffers, so there is no need to wait for them here.
+  AHardwareBuffer *buffer = frame.releaseBuffer();
+  deferRelease([buffer]() { AHardwareBuffer_release(buffer); });
+
+  if (image == nullptr) {
+    // Draw the previous frame again. A fence imported above is still waited
+    // on by the submit, which restores the semaphore.
+    LOGCATE("Engine_CameraHwb: failed to import the camera buffer, frame "
+            "skipped");
+    mFrameOriginNs = 0;
+    return;
+  }
+  mImage = image;
+
+  if (mImageCache->getSamplerHandle() != mPipelineSampler) {
+    rebuildForNewSampler();
+  }
+}
+
+void Engine_CameraHwb::rebuildForNewSampler() {
+  // A new buffer description retired every import along with the sampler
+  // and YCbCr conversion the set layout was created with. The retired
+  // images are kept until the current slot is waited on again, so the old
+  // sampler outlives the layout and pipelines destroyed here.
+  LOGCATI("Engine_CameraHwb: camera buffer description changed, rebuilding "
+          "the pipelines");
   vulkanContext()->device().waitIdle();
-  mImage->setContentFromHardwareBuffer(mBuffer);
+
+  std::vector<const Image *> bound;
+  for (const auto &binding : mImportBindings) {
+    bound.push_back(binding.first);
+  }
+  for (const Image *image : bound) {
+    releaseImportBinding(image);
+  }
+
+  destroyPipelines();
+  setupDescriptorSetLayout();
+  createPipelines();
+  vulkanContext()->savePipelineCache();
+
+  // The static command buffers of the new import are recorded by
+  // importBinding with the new pipeline, its size may differ as well
+  mStaticOrientation = -1;
+}
+
+void Engine_CameraHwb::destroyPipelines() {
+  vk::Device device = vulkanContext()->device();
+  if (mPipeline) {
+    device.destroyPipeline(mPipeline);
+    mPipeline = nullptr;
+  }
+  if (mPipelineLayout) {
+    device.destroyPipelineLayout(mPipelineLayout);
+    mPipelineLayout = nullptr;
+  }
+  if (mDescriptorSetLayout) {
+    device.destroyDescriptorSetLayout(mDescriptorSetLayout);
+    mDescriptorSetLayout = nullptr;
+  }
+  mPipelineSampler = nullptr;
 }
 
 void Engine_CameraHwb::setupDescriptorPool() {
   vk::DescriptorPoolSize typeCounts[2];
 
-  typeCounts[0].type = vk::DescriptorType::eUniformBuffer;
-  typeCounts[0].descriptorCount = 1;
+  // One set per cached import. Sets of retired imports are freed only after
+  // the frames using them, and a format change retires the whole cache at
+  // once, so leave room for twice the capacity.
+  const auto setCount =
+      static_cast<uint32_t>(2 * ImageCache::kDefaultCapacity);
+
+  typeCounts[0].type = vk::DescriptorType::eUniformBufferDynamic;
+  typeCounts[0].descriptorCount = setCount;
 
   typeCounts[1].type = vk::DescriptorType::eCombinedImageSampler;
-  typeCounts[1].descriptorCount = 2;
+  typeCounts[1].descriptorCount = setCount;
 
   // Create the global descriptor pool
   // All descriptors used in this example are allocated from this pool
@@ -78,7 +189,9 @@ void Engine_CameraHwb::setupDescriptorPool() {
   descriptorPoolInfo.pPoolSizes = typeCounts;
   // Set the max. number of descriptor sets that can be requested from this pool
   // (requesting beyond this limit will result in an error)
-  descriptorPoolInfo.maxSets = 2;
+  descriptorPoolInfo.maxSets = setCount;
+  // Sets of retired imports are given back to the pool
+  descriptorPoolInfo.flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet;
 
   CALL_VK(vulkanContext()->device().createDescriptorPool(
       &descriptorPoolInfo, nullptr, &mDescriptorPool));
@@ -89,9 +202,9 @@ void Engine_CameraHwb::setupDescriptorSetLayout() {
   vk::DescriptorSetLayoutCreateInfo descriptorLayout = {};
 
   vk::DescriptorSetLayoutBinding layoutBinding[2];
-  // Binding 0: Uniform buffer (Vertex shader)
+  // Binding 0: Uniform buffer (Vertex shader), bound with a dynamic offset
   layoutBinding[0] = {{0},
-                      vk::DescriptorType::eUniformBuffer,
+                      vk::DescriptorType::eUniformBufferDynamic,
                       1,
                       vk::ShaderStageFlagBits::eVertex};
 
@@ -102,6 +215,7 @@ void Engine_CameraHwb::setupDescriptorSetLayout() {
                       vk::ShaderStageFlagBits::eFragment};
   auto sampler = mImage->getSamplerHandle();
   layoutBinding[1].pImmutableSamplers = &sampler;
+  mPipelineSampler = sampler;
 
   descriptorLayout.bindingCount = 2;
   descriptorLayout.pBindings = layoutBinding;
@@ -115,77 +229,61 @@ void Engine_CameraHwb::setupDescriptorSetLayout() {
   // that are based on this descriptor set layout In a more complex scenario you
   // would have different pipeline layouts for different descriptor set layouts
   // that could be reused
+  std::vector<vk::DescriptorSetLayout> setLayouts = {mDescriptorSetLayout};
+  setLayouts.insert(setLayouts.end(), mAdditionalSetLayouts.begin(),
+                    mAdditionalSetLayouts.end());
   vk::PipelineLayoutCreateInfo pPipelineLayoutCreateInfo = {};
-  pPipelineLayoutCreateInfo.setLayoutCount = 1;
-  pPipelineLayoutCreateInfo.pSetLayouts = &mDescriptorSetLayout;
+  pPipelineLayoutCreateInfo.setLayoutCount =
+      static_cast<uint32_t>(setLayouts.size());
+  pPipelineLayoutCreateInfo.pSetLayouts = setLayouts.data();
 
   CALL_VK(vulkanContext()->device().createPipelineLayout(
       &pPipelineLayoutCreateInfo, nullptr, &mPipelineLayout));
 }
 
-void Engine_CameraHwb::createDescriptorSet() {
-  // Allocate a new descriptor set from the global descriptor pool
-  vk::DescriptorSetAllocateInfo allocInfo = {};
-  allocInfo.descriptorPool = mDescriptorPool;
-  allocInfo.descriptorSetCount = 1;
-  allocInfo.pSetLayouts = &mDescriptorSetLayout;
-
-  CALL_VK(vulkanContext()->device().allocateDescriptorSets(&allocInfo,
-                                                           &mDescriptorSet));
-  vks::debug::setDescriptorSetName(vulkanContext()->device(), mDescriptorSet,
-                                   "mDescriptorSet");
-}
-
-void Engine_CameraHwb::updateDescriptorSets() {
-  std::vector<vk::WriteDescriptorSet> writeDescriptorSet = {};
-
-  // Binding 0 : Uniform buffer
-  auto uboDescriptor = mUniformBuffer->getDescriptor();
-  writeDescriptorSet.push_back(vk::WriteDescriptorSet(
-      mDescriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr,
-      &uboDescriptor, nullptr));
-
-  // Binding 1 : Combined Image Sampler
-  const auto inputImageInfo = mImage->getDescriptor();
-  writeDescriptorSet.push_back(vk::WriteDescriptorSet(
-      mDescriptorSet, 1, 0, 1, vk::DescriptorType::eCombinedImageSampler,
-      &inputImageInfo, nullptr, nullptr));
-
-  mVulkanContext->device().updateDescriptorSets(
-      static_cast<uint32_t>(writeDescriptorSet.size()),
-      writeDescriptorSet.data(), 0, nullptr);
-}
-
 void Engine_CameraHwb::prepareSynchronizationPrimitives() {
-  // Semaphores (Used for correct command ordering)
+  // The acquire and render semaphores are owned by the frame slots
   vk::SemaphoreCreateInfo semaphoreCreateInfo = {};
   semaphoreCreateInfo.pNext = nullptr;
 
-  // Semaphore used to ensures that image presentation is complete before
-  // starting to submit again
-  CALL_VK(vulkanContext()->device().createSemaphore(
-      &semaphoreCreateInfo, nullptr, &presentCompleteSemaphore));
-
-  // Semaphore used to ensures that all commands submitted have been finished
-  // before submitting the image to the queue
-  CALL_VK(vulkanContext()->device().createSemaphore(
-      &semaphoreCreateInfo, nullptr, &renderCompleteSemaphore));
+  // Semaphores the camera buffer's acquire fence is imported into. Imports
+  // are temporary, every wait restores the semaphore for the next import.
+  mBufferReadySemaphores.resize(frameSlots.size());
+  for (auto &semaphore : mBufferReadySemaphores) {
+    CALL_VK(vulkanContext()->device().createSemaphore(&semaphoreCreateInfo,
+                                                      nullptr, &semaphore));
+  }
 }
 
 void Engine_CameraHwb::prepareUniformBuffers() {
   // Prepare and initialize a uniform buffer block containing shader uniforms
   // Single uniforms like in OpenGL are no longer present in Vulkan. All Shader
-  // uniforms are passed via uniform buffer blocks
-  mUniformBuffer =
-      vks::Buffer::create(vulkanContext()->deviceWrapper(), sizeof(uboVS),
-                          vk::BufferUsageFlagBits::eUniformBuffer,
-                          vk::MemoryPropertyFlagBits::eHostVisible |
-                              vk::MemoryPropertyFlagBits::eHostCoherent);
-
-  updateUniformBuffers();
+  // uniforms are passed via uniform buffer blocks.
+  if (settings.staticCommandBuffers) {
+    // The recorded command buffers all bind this one block
+    mUniformBuffer =
+        vks::Buffer::create(vulkanContext()->deviceWrapper(), sizeof(uboVS),
+                            vk::BufferUsageFlagBits::eUniformBuffer,
+                            vk::MemoryPropertyFlagBits::eHostVisible |
+                                vk::MemoryPropertyFlagBits::eHostCoherent);
+    CALL_VK(mUniformBuffer->map());
+  } else {
+    // Every frame pushes its matrices into its slot's region, so a frame in
+    // flight never sees the next frame's matrices
+    prepareUniformRing(sizeof(uboVS));
+  }
 }
 
-void Engine_CameraHwb::updateUniformBuffers() {
+vk::DescriptorBufferInfo Engine_CameraHwb::uniformDescriptor() const {
+  if (settings.staticCommandBuffers) {
+    return {mUniformBuffer->getBufferHandle(), 0, sizeof(uboVS)};
+  }
+  return mUniformRing->descriptor(sizeof(uboVS));
+}
+
+int Engine_CameraHwb::currentOrientation() { return mOrientation; }
+
+void Engine_CameraHwb::updateUniformBuffers(int orientation) {
   float winRatio = static_cast<float>(mWindow.windowWidth) /
                    static_cast<float>(mWindow.windowHeight);
 
@@ -196,7 +294,7 @@ void Engine_CameraHwb::updateUniformBuffers() {
   uboVS.projectionMatrix = glm::mat4(1.0f);
   uboVS.viewMatrix = glm::mat4(1.0f);
 
-  if (mOrientation % 180 != 0) {
+  if (orientation % 180 != 0) {
     uint32_t temp = bmpWidth;
     bmpWidth = bmpHeight;
     bmpHeight = temp;
@@ -217,16 +315,36 @@ void Engine_CameraHwb::updateUniformBuffers() {
   }
 
   uboVS.modelMatrix =
-      glm::rotate(uboVS.modelMatrix, glm::radians((float)mOrientation),
+      glm::rotate(uboVS.modelMatrix, glm::radians((float)orientation),
                   glm::vec3(0.0f, 0.0f, 1.0f));
+}
 
-  mUniformBuffer->map();
+void Engine_CameraHwb::updateStaticUniforms() {
+  const int orientation = currentOrientation();
+  const vk::Extent2D imageExtent = {mImage->width(), mImage->height()};
+  if (orientation == mStaticOrientation && imageExtent == mStaticImageExtent) {
+    return;
+  }
+
+  // All static command buffers read the same block. Orientation and camera
+  // size changes are rare, so simply wait for the frames in flight instead
+  // of keeping a copy per slot.
+  if (mStaticOrientation != -1) {
+    vulkanContext()->device().waitIdle();
+  }
+  updateUniformBuffers(orientation);
   mUniformBuffer->copyFrom(&uboVS, sizeof(uboVS));
-  mUniformBuffer->unmap();
+  mStaticOrientation = orientation;
+  mStaticImageExtent = imageExtent;
 }
 
 void Engine_CameraHwb::createPipelines() {
+  createPipeline(nullptr, &mPipeline);
+}
 
+void Engine_CameraHwb::createPipeline(
+    const vk::SpecializationInfo *fragmentSpecialization,
+    vk::Pipeline *pipeline) {
   vk::GraphicsPipelineCreateInfo pipelineCreateInfo = {};
   // The layout used for this pipeline (can be shared among multiple pipelines
   // using the same layout)
@@ -347,6 +465,7 @@ void Engine_CameraHwb::createPipelines() {
   // Fragment shader
   shaderStages[1] =
       loadShader(fragFilePath, vk::ShaderStageFlagBits::eFragment);
+  shaderStages[1].pSpecializationInfo = fragmentSpecialization;
 
   // Set pipeline shader stage info
   pipelineCreateInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
@@ -359,14 +478,15 @@ void Engine_CameraHwb::createPipelines() {
   pipelineCreateInfo.pColorBlendState = &colorBlendState;
   pipelineCreateInfo.pMultisampleState = &multisampleState;
   pipelineCreateInfo.pViewportState = &viewportState;
-  pipelineCreateInfo.pDepthStencilState = &depthStencilState;
+  // Without a depth attachment the state is ignored
+  pipelineCreateInfo.pDepthStencilState =
+      settings.uesDepth ? &depthStencilState : nullptr;
   pipelineCreateInfo.renderPass = mRenderPass;
   pipelineCreateInfo.pDynamicState = &dynamicState;
 
   // Create rendering pipeline using the specified states
-  CALL_VK(vulkanContext()->device().createGraphicsPipelines(
-      vulkanContext()->pipelineCache(), 1, &pipelineCreateInfo, nullptr,
-      &mPipeline));
+  CALL_VK(vulkanContext()->createGraphicsPipeline(pipelineCreateInfo,
+                                                  pipeline));
 
   // Shader modules are no longer needed once the graphics pipeline has been
   // created
@@ -376,10 +496,13 @@ void Engine_CameraHwb::createPipelines() {
                                                 nullptr);
 }
 
-void Engine_CameraHwb::buildCommandBuffers(int i) {
+void Engine_CameraHwb::recordRenderPass(vk::CommandBuffer cmdBuffer,
+                                        vk::Framebuffer frameBuffer,
+                                        vk::DescriptorSet descriptorSet,
+                                        uint32_t uniformOffset) {
   // Set clear values for all framebuffer attachments with loadOp set to clear
-  // We use two attachments (color and depth) that are cleared at the start of
-  // the subpass and as such we need to set clear values for both
+  // The color attachment and, if settings.uesDepth is set, the depth
+  // attachment are cleared at the start of the subpass
   vk::ClearValue clearValues[2];
   clearValues[0].color =
       vk::ClearColorValue(std::array<float, 4>({{0.0f, 0.0f, 0.2f, 1.0f}}));
@@ -392,20 +515,15 @@ void Engine_CameraHwb::buildCommandBuffers(int i) {
   renderPassBeginInfo.renderArea.offset.y = 0;
   renderPassBeginInfo.renderArea.extent.width = mWindow.windowWidth;
   renderPassBeginInfo.renderArea.extent.height = mWindow.windowHeight;
-  renderPassBeginInfo.clearValueCount = 2;
+  renderPassBeginInfo.clearValueCount = settings.uesDepth ? 2 : 1;
   renderPassBeginInfo.pClearValues = clearValues;
 
   // Set target frame buffer
-  renderPassBeginInfo.framebuffer = frameBuffers[i];
-
-  vk::CommandBufferBeginInfo cmdBufInfo = {};
-  cmdBufInfo.pNext = nullptr;
-  CALL_VK(drawCmdBuffers[i].begin(&cmdBufInfo));
+  renderPassBeginInfo.framebuffer = frameBuffer;
 
   // Start the first sub pass specified in our default prepare pass setup by the
-  // base class This will clear the color and depth attachment
-  drawCmdBuffers[i].beginRenderPass(&renderPassBeginInfo,
-                                    vk::SubpassContents::eInline);
+  // base class This will clear the attachments
+  cmdBuffer.beginRenderPass(&renderPassBeginInfo, vk::SubpassContents::eInline);
 
   // Update dynamic viewport state
   vk::Viewport viewport = {};
@@ -413,7 +531,7 @@ void Engine_CameraHwb::buildCommandBuffers(int i) {
   viewport.width = (float)mWindow.windowWidth;
   viewport.minDepth = (float)0.0f;
   viewport.maxDepth = (float)1.0f;
-  drawCmdBuffers[i].setViewport(0, 1, &viewport);
+  cmdBuffer.setViewport(0, 1, &viewport);
 
   // Update dynamic scissor state
   vk::Rect2D scissor = {};
@@ -421,164 +539,416 @@ void Engine_CameraHwb::buildCommandBuffers(int i) {
   scissor.extent.height = mWindow.windowHeight;
   scissor.offset.x = 0;
   scissor.offset.y = 0;
-  drawCmdBuffers[i].setScissor(0, 1, &scissor);
+  cmdBuffer.setScissor(0, 1, &scissor);
 
   // Bind descriptor sets describing shader binding points
-  drawCmdBuffers[i].bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
-                                       mPipelineLayout, 0, 1, &mDescriptorSet,
-                                       0, nullptr);
+  cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
+                               mPipelineLayout, 0, 1, &descriptorSet, 1,
+                               &uniformOffset);
+  bindAdditionalDescriptorSets(cmdBuffer);
 
   // Bind the rendering pipeline
   // The pipeline (state object) contains all states of the rendering pipeline,
   // binding it will set all the states specified at pipeline creation time
-  drawCmdBuffers[i].bindPipeline(vk::PipelineBindPoint::eGraphics, mPipeline);
+  cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, currentPipeline());
 
   // Bind vertex buffer (contains position and colors)
   vk::DeviceSize offsets[1] = {0};
   auto verticesBuf = mVerticesBuffer->getBufferHandle();
-  drawCmdBuffers[i].bindVertexBuffers(0, 1, &verticesBuf, offsets);
+  cmdBuffer.bindVertexBuffers(0, 1, &verticesBuf, offsets);
 
   // Draw
-  drawCmdBuffers[i].draw(sizeof(g_vb_bitmap_texture_Data) /
-                             sizeof(g_vb_bitmap_texture_Data[0]),
-                         1, 0, 0);
+  cmdBuffer.draw(sizeof(g_vb_bitmap_texture_Data) /
+                     sizeof(g_vb_bitmap_texture_Data[0]),
+                 1, 0, 0);
 
-  drawCmdBuffers[i].endRenderPass();
+  cmdBuffer.endRenderPass();
 
   // Ending the prepare pass will add an implicit barrier transitioning the
   // frame buffer color attachment to VK_IMAGE_LAYOUT_PRESENT_SRC_KHR for
   // presenting it to the windowing system
-
-  drawCmdBuffers[i].end();
 }
 
-void Engine_CameraHwb::buildCommandBuffers() {
+void Engine_CameraHwb::buildCommandBuffer(
+    uint32_t frame, uint32_t uniformOffset,
+    vks::ReadbackRing::Callback readback) {
+  vk::CommandBuffer cmdBuffer = frameSlots[frame].commandBuffer;
+
   vk::CommandBufferBeginInfo cmdBufInfo = {};
   cmdBufInfo.pNext = nullptr;
+  CALL_VK(cmdBuffer.begin(&cmdBufInfo));
+  if (mGpuProfiler) {
+    mGpuProfiler->beginFrame(cmdBuffer, frame);
+  }
 
-  // Set clear values for all framebuffer attachments with loadOp set to clear
-  // We use two attachments (color and depth) that are cleared at the start of
-  // the subpass and as such we need to set clear values for both
-  vk::ClearValue clearValues[2];
-  clearValues[0].color =
-      vk::ClearColorValue(std::array<float, 4>({{0.0f, 0.0f, 0.2f, 1.0f}}));
-  clearValues[1].depthStencil = vk::ClearDepthStencilValue(1.0f, 0);
+  // Acquire the camera content from the foreign queue family before it is
+  // sampled, no separate submit is needed for the ownership transfer
+  if (mImage->hasPendingTransitions()) {
+    vks::GpuProfileScope scope(mGpuProfiler.get(), cmdBuffer,
+                               "Camera acquire");
+    mImage->recordPendingTransitions(
+        cmdBuffer, vk::PipelineStageFlagBits::eFragmentShader);
+  }
 
-  vk::RenderPassBeginInfo renderPassBeginInfo = {};
-  renderPassBeginInfo.pNext = nullptr;
-  renderPassBeginInfo.renderPass = mRenderPass;
-  renderPassBeginInfo.renderArea.offset.x = 0;
-  renderPassBeginInfo.renderArea.offset.y = 0;
-  renderPassBeginInfo.renderArea.extent.width = mWindow.windowWidth;
-  renderPassBeginInfo.renderArea.extent.height = mWindow.windowHeight;
-  renderPassBeginInfo.clearValueCount = 2;
-  renderPassBeginInfo.pClearValues = clearValues;
+  {
+    vks::GpuProfileScope scope(mGpuProfiler.get(), cmdBuffer, passName());
+    recordRenderPass(cmdBuffer, frameBuffers[currentBuffer],
+                     importBinding(mImage).descriptorSet, uniformOffset);
+  }
+
+  if (readback) {
+    recordFrameReadback(cmdBuffer, std::move(readback));
+  }
+
+  cmdBuffer.end();
+}
+
+void Engine_CameraHwb::buildCommandBuffers() {
+  if (!settings.staticCommandBuffers) {
+    return;
+  }
+
+  // The swap chain or the pipeline changed, re-record every import. The
+  // uniform region has to follow the new window size as well.
+  for (auto &binding : mImportBindings) {
+    recordImportCommandBuffers(binding.second);
+  }
+  mStaticOrientation = -1;
+}
+
+Engine_CameraHwb::ImportBinding &
+Engine_CameraHwb::importBinding(const Image *image) {
+  auto it = mImportBindings.find(image);
+  if (it != mImportBindings.end()) {
+    return it->second;
+  }
+
+  ImportBinding &binding = mImportBindings[image];
+
+  vk::DescriptorSetAllocateInfo allocInfo = {};
+  allocInfo.descriptorPool = mDescriptorPool;
+  allocInfo.descriptorSetCount = 1;
+  allocInfo.pSetLayouts = &mDescriptorSetLayout;
+  CALL_VK(vulkanContext()->device().allocateDescriptorSets(
+      &allocInfo, &binding.descriptorSet));
+  vks::debug::setDescriptorSetName(vulkanContext()->device(),
+                                   binding.descriptorSet, "ImportBinding");
+
+  // Binding 0 : Uniform buffer, shared by all imports
+  auto uboDescriptor = uniformDescriptor();
+  // Binding 1 : Combined Image Sampler
+  const auto inputImageInfo = image->getDescriptor();
+  std::array<vk::WriteDescriptorSet, 2> writeDescriptorSet = {
+      vk::WriteDescriptorSet(binding.descriptorSet, 0, 0, 1,
+                             vk::DescriptorType::eUniformBufferDynamic,
+                             nullptr, &uboDescriptor, nullptr),
+      vk::WriteDescriptorSet(binding.descriptorSet, 1, 0, 1,
+                             vk::DescriptorType::eCombinedImageSampler,
+                             &inputImageInfo, nullptr, nullptr)};
+  mVulkanContext->device().updateDescriptorSets(
+      static_cast<uint32_t>(writeDescriptorSet.size()),
+      writeDescriptorSet.data(), 0, nullptr);
+
+  if (settings.staticCommandBuffers) {
+    recordImportCommandBuffers(binding);
+  }
+  return binding;
+}
+
+void Engine_CameraHwb::recordImportCommandBuffers(ImportBinding &binding) {
+  if (binding.commandBuffers.size() != frameBuffers.size()) {
+    if (!binding.commandBuffers.empty()) {
+      vulkanContext()->device().freeCommandBuffers(
+          vulkanContext()->commandPool(),
+          static_cast<uint32_t>(binding.commandBuffers.size()),
+          binding.commandBuffers.data());
+    }
+    binding.commandBuffers.resize(frameBuffers.size());
+
+    vk::CommandBufferAllocateInfo cmdBufAllocateInfo{};
+    cmdBufAllocateInfo.commandPool = vulkanContext()->commandPool();
+    cmdBufAllocateInfo.level = vk::CommandBufferLevel::ePrimary;
+    cmdBufAllocateInfo.commandBufferCount =
+        static_cast<uint32_t>(binding.commandBuffers.size());
+    CALL_VK(vulkanContext()->device().allocateCommandBuffers(
+        &cmdBufAllocateInfo, binding.commandBuffers.data()));
+  }
+
+  // Frames in flight may present the same swap chain image back to back, so
+  // a command buffer can be submitted again before the previous submission
+  // has completed
+  vk::CommandBufferBeginInfo cmdBufInfo = {};
+  cmdBufInfo.flags = vk::CommandBufferUsageFlagBits::eSimultaneousUse;
+
+  for (uint32_t i = 0; i < binding.commandBuffers.size(); ++i) {
+    CALL_VK(binding.commandBuffers[i].begin(&cmdBufInfo));
+    recordRenderPass(binding.commandBuffers[i], frameBuffers[i],
+                     binding.descriptorSet, 0);
+    binding.commandBuffers[i].end();
+  }
+}
 
-  for (int32_t i = 0; i < drawCmdBuffers.size(); ++i) {
-    // Set target frame buffer
-    renderPassBeginInfo.framebuffer = frameBuffers[i];
-
-    CALL_VK(drawCmdBuffers[i].begin(&cmdBufInfo));
-
-    // Start the first sub pass specified in our default prepare pass setup by
-    // the base class This will clear the color and depth attachment
-    drawCmdBuffers[i].beginRenderPass(&renderPassBeginInfo,
-                                      vk::SubpassContents::eInline);
-
-    // Update dynamic viewport state
-    vk::Viewport viewport = {};
-    viewport.height = (float)mWindow.windowHeight;
-    viewport.width = (float)mWindow.windowWidth;
-    viewport.minDepth = (float)0.0f;
-    viewport.maxDepth = (float)1.0f;
-    drawCmdBuffers[i].setViewport(0, 1, &viewport);
-
-    // Update dynamic scissor state
-    vk::Rect2D scissor = {};
-    scissor.extent.width = mWindow.windowWidth;
-    scissor.extent.height = mWindow.windowHeight;
-    scissor.offset.x = 0;
-    scissor.offset.y = 0;
-    drawCmdBuffers[i].setScissor(0, 1, &scissor);
-
-    // Bind descriptor sets describing shader binding points
-    drawCmdBuffers[i].bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
-                                         mPipelineLayout, 0, 1, &mDescriptorSet,
-                                         0, nullptr);
-
-    // Bind the rendering pipeline
-    // The pipeline (state object) contains all states of the rendering
-    // pipeline, binding it will set all the states specified at pipeline
-    // creation time
-    drawCmdBuffers[i].bindPipeline(vk::PipelineBindPoint::eGraphics, mPipeline);
-
-    // Bind vertex buffer
-    vk::DeviceSize offsets[1] = {0};
-    auto verticesBuf = mVerticesBuffer->getBufferHandle();
-    drawCmdBuffers[i].bindVertexBuffers(0, 1, &verticesBuf, offsets);
-
-    // Draw triangle
-    drawCmdBuffers[i].draw(sizeof(g_vb_bitmap_texture_Data) /
-                               sizeof(g_vb_bitmap_texture_Data[0]),
-                           1, 0, 0);
-
-    drawCmdBuffers[i].endRenderPass();
-
-    // Ending the prepare pass will add an implicit barrier transitioning the
-    // frame buffer color attachment to VK_IMAGE_LAYOUT_PRESENT_SRC_KHR for
-    // presenting it to the windowing system
-
-    drawCmdBuffers[i].end();
+void Engine_CameraHwb::releaseImportBinding(const Image *image) {
+  auto it = mImportBindings.find(image);
+  if (it == mImportBindings.end()) {
+    return;
   }
+
+  // The set and command buffers may still be in use by a frame in flight
+  auto device = vulkanContext()->device();
+  auto commandPool = vulkanContext()->commandPool();
+  auto descriptorPool = mDescriptorPool;
+  ImportBinding binding = std::move(it->second);
+  mImportBindings.erase(it);
+  deferRelease([device, commandPool, descriptorPool, binding]() {
+    if (!binding.commandBuffers.empty()) {
+      device.freeCommandBuffers(
+          commandPool, static_cast<uint32_t>(binding.commandBuffers.size()),
+          binding.commandBuffers.data());
+    }
+    device.freeDescriptorSets(descriptorPool, 1, &binding.descriptorSet);
+  });
 }
 
 void Engine_CameraHwb::draw() {
-  EngineContext::prepareFrame();
+  TRACE_SCOPE("Draw");
+  // Waits until the current frame slot is free again. This also releases the
+  // camera buffer the slot rendered last time.
+  {
+    TRACE_SCOPE("Prepare frame");
+    EngineContext::prepareFrame();
+  }
+  // The current slot was waited for, others may have finished meanwhile.
+  // Readbacks have to be collected and the completion watcher has to be
+  // done with the slot's fence before it is reset.
+  if (mReadbackRing) {
+    mReadbackRing->collect();
+  }
 
-  updateTexture();
+  FrameSlot &slot = currentFrameSlot();
+  if (mGpuCompletions) {
+    mGpuCompletions->release(slot.fence);
+  }
 
-  // Use a fence to wait until the command buffer has finished execution before
-  // using it again
-  CALL_VK(vulkanContext()->device().waitForFences(1, &waitFences[currentBuffer],
-                                                  VK_TRUE, UINT64_MAX));
+  updateTexture();
+  if (mFrameOriginNs) {
+    mLatency.record(LatencyTracker::Stage::Acquire, mFrameOriginNs);
+  }
+  vks::ReadbackRing::Callback readback = currentFrameReadback();
+
+  // Command buffers to execute in this batch (submission)
+  std::array<vk::CommandBuffer, 3> cmdBuffers;
+  uint32_t cmdBufferCount = 0;
+
+  if (settings.staticCommandBuffers) {
+    updateStaticUniforms();
+
+    vk::CommandBufferBeginInfo cmdBufInfo = {};
+    cmdBufInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+
+    // Only the queued acquire of the camera content is recorded per frame,
+    // into the slot's own command buffer ahead of the recorded draw. The
+    // profiler's timestamps of the draw go around it the same way, the
+    // readback follows it in the slot's end command buffer.
+    uint32_t drawScope = vks::GpuProfiler::kNoScope;
+    if (mImage->hasPendingTransitions() || mGpuProfiler) {
+      CALL_VK(slot.commandBuffer.begin(&cmdBufInfo));
+      if (mGpuProfiler) {
+        mGpuProfiler->beginFrame(slot.commandBuffer, currentFrame);
+      }
+      if (mImage->hasPendingTransitions()) {
+        vks::GpuProfileScope scope(mGpuProfiler.get(), slot.commandBuffer,
+                                   "Camera acquire");
+        mImage->recordPendingTransitions(
+            slot.commandBuffer, vk::PipelineStageFlagBits::eFragmentShader);
+      }
+      if (mGpuProfiler) {
+        drawScope = mGpuProfiler->beginScope(slot.commandBuffer, passName());
+      }
+      slot.commandBuffer.end();
+      cmdBuffers[cmdBufferCount++] = slot.commandBuffer;
+    }
+    cmdBuffers[cmdBufferCount++] =
+        importBinding(mImage).commandBuffers[currentBuffer];
+    if (mGpuProfiler || readback) {
+      CALL_VK(slot.endCommandBuffer.begin(&cmdBufInfo));
+      if (mGpuProfiler) {
+        mGpuProfiler->endScope(slot.endCommandBuffer, drawScope);
+      }
+      if (readback) {
+        recordFrameReadback(slot.endCommandBuffer, std::move(readback));
+      }
+      slot.endCommandBuffer.end();
+      cmdBuffers[cmdBufferCount++] = slot.endCommandBuffer;
+    }
+  } else {
+    updateUniformBuffers(currentOrientation());
+    uint32_t uniformOffset = 0;
+    mUniformRing->push(uboVS, &uniformOffset);
 
-  updateDescriptorSets();
+    buildCommandBuffer(currentFrame, uniformOffset, std::move(readback));
 
-  buildCommandBuffers(currentBuffer);
+    cmdBuffers[cmdBufferCount++] = slot.commandBuffer;
+  }
 
-  CALL_VK(vulkanContext()->device().resetFences(1, &waitFences[currentBuffer]));
+  CALL_VK(vulkanContext()->device().resetFences(1, &slot.fence));
 
+  // Semaphores the queue submission waits on: the swapchain image unless
+  // rendering offscreen and, if the camera handed in a fence, the camera
+  // buffer. The buffer is first read by the fragment shader.
+  std::array<vk::Semaphore, 2> waitSemaphores;
   // Pipeline stage at which the queue submission will wait (via
   // pWaitSemaphores)
-  vk::PipelineStageFlags waitStageMask =
-      vk::PipelineStageFlagBits::eColorAttachmentOutput;
+  std::array<vk::PipelineStageFlags, 2> waitStageMasks;
+  uint32_t waitSemaphoreCount = 0;
+  if (!settings.offscreen) {
+    waitSemaphores[waitSemaphoreCount] = slot.acquireSemaphore;
+    waitStageMasks[waitSemaphoreCount++] =
+        vk::PipelineStageFlagBits::eColorAttachmentOutput;
+  }
+  if (mWaitBufferReady) {
+    waitSemaphores[waitSemaphoreCount] = mBufferReadySemaphores[currentFrame];
+    waitStageMasks[waitSemaphoreCount++] =
+        vk::PipelineStageFlagBits::eFragmentShader;
+  }
   // The submit info structure specifies a command buffer queue submission batch
   vk::SubmitInfo submitInfo = {};
   submitInfo.pWaitDstStageMask =
-      &waitStageMask; // Pointer to the list of pipeline stages that
+      waitStageMasks.data(); // Pointer to the list of pipeline stages that
   // the semaphore waits will occur at
   submitInfo.pWaitSemaphores =
-      &presentCompleteSemaphore; // Semaphore(s) to wait upon before the
-                                 // submitted
+      waitSemaphores.data(); // Semaphore(s) to wait upon before the submitted
   // command buffer starts executing
-  submitInfo.waitSemaphoreCount = 1; // One wait semaphore
+  submitInfo.waitSemaphoreCount = waitSemaphoreCount;
   submitInfo.pSignalSemaphores =
-      &renderCompleteSemaphore;        // Semaphore(s) to be signaled when
+      &slot.renderSemaphore;           // Semaphore(s) to be signaled when
                                        // command buffers have completed
   submitInfo.signalSemaphoreCount = 1; // One signal semaphore
-  submitInfo.pCommandBuffers =
-      &drawCmdBuffers[currentBuffer]; // Command buffers(s) to execute
-                                      // in this batch (submission)
-  submitInfo.commandBufferCount = 1;  // One command buffer
-
-  // Submit to the graphics queue passing a wait fence
-  CALL_VK(vulkanContext()->queue().submit(1, &submitInfo,
-                                          waitFences[currentBuffer]));
+  submitInfo.pCommandBuffers = cmdBuffers.data();
+  submitInfo.commandBufferCount = cmdBufferCount;
+
+  // Submit to the graphics queue passing the slot's fence
+  vk::Result submitResult;
+  {
+    TRACE_SCOPE("Submit");
+    submitResult = vulkanContext()->queue().submit(1, &submitInfo, slot.fence);
+  }
+  // A readback recorded into the batch is only in flight if it was queued
+  if (mReadbackRing) {
+    if (submitResult == vk::Result::eSuccess) {
+      mReadbackRing->submitted(slot.fence);
+    } else {
+      mReadbackRing->cancel();
+    }
+  }
+  CALL_VK(submitResult);
+  if (mFrameOriginNs && submitResult == vk::Result::eSuccess) {
+    mLatency.record(LatencyTracker::Stage::Submit, mFrameOriginNs);
+
+    if (!mGpuCompletions) {
+      mGpuCompletions =
+          std::make_unique<vks::FenceWatcher>(vulkanContext()->device());
+    }
+    const int64_t originNs = mFrameOriginNs;
+    mGpuCompletions->watch(slot.fence, [this, originNs] {
+      mLatency.record(LatencyTracker::Stage::GpuComplete, originNs);
+    });
+  }
 
+  TRACE_SCOPE("Present");
   EngineContext::submitFrame();
+  if (mFrameOriginNs) {
+    mLatency.record(LatencyTracker::Stage::Present, mFrameOriginNs);
+  }
+}
+
+void Engine_CameraHwb::setFrameReadback(
+    vks::ReadbackRing::Callback callback) {
+  std::lock_guard<std::mutex> lock(mFrameReadbackMutex);
+  mFrameReadback = std::move(callback);
+}
+
+vks::ReadbackRing::Callback Engine_CameraHwb::currentFrameReadback() {
+  if (!mFrameOriginNs) {
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> lock(mFrameReadbackMutex);
+  return mFrameReadback;
+}
+
+void Engine_CameraHwb::recordFrameReadback(
+    vk::CommandBuffer cmd, vks::ReadbackRing::Callback callback) {
+  const ColorTarget target = currentColorTarget();
+  if (!vks::ReadbackRing::supports(target.format, target.usage)) {
+    return;
+  }
+  if (!mReadbackRing) {
+    // One buffer per frame in flight, and two for the callbacks still
+    // running on the workers
+    mReadbackRing = vks::ReadbackRing::create(
+        vulkanContext()->deviceWrapper(),
+        static_cast<uint32_t>(frameSlots.size()) + 2);
+    if (!mReadbackRing) {
+      return;
+    }
+  }
+
+  // The render pass drew the image and left it in the target layout
+  vks::ResourceState state;
+  state.layout = target.layout;
+  state.writeStages = vk::PipelineStageFlagBits2KHR::eColorAttachmentOutput;
+  state.writeAccess = vk::AccessFlagBits2KHR::eColorAttachmentWrite;
+  const vks::ResourceUsage next = settings.offscreen
+                                      ? vks::ResourceUsage::TransferSrc
+                                      : vks::ResourceUsage::Present;
+
+  vks::GpuProfileScope scope(mGpuProfiler.get(), cmd, "Frame readback");
+  mReadbackRing->record(cmd, target.image, state, next, target.format,
+                        target.extent.width, target.extent.height,
+                        std::move(callback));
 }
 
 Engine_CameraHwb::~Engine_CameraHwb() {
+  // Cached imports may still be referenced by in-flight command buffers
+  vulkanContext()->device().waitIdle();
+  if (mReadbackRing) {
+    // Deliver what the GPU has finished, then wait for the callbacks
+    mReadbackRing->collect();
+    LOGCATI("Frame readback skipped %llu frames",
+            static_cast<unsigned long long>(mReadbackRing->droppedCount()));
+    mReadbackRing.reset();
+  }
+  if (mImageCache) {
+    mImageCache->setRetireCallback(nullptr);
+    mImageCache.reset();
+  }
+
+  // Run the deferred frees while the descriptor pool is still alive
+  for (auto &slot : frameSlots) {
+    waitForFrame(slot);
+  }
+  for (auto &binding : mImportBindings) {
+    if (!binding.second.commandBuffers.empty()) {
+      vulkanContext()->device().freeCommandBuffers(
+          vulkanContext()->commandPool(),
+          static_cast<uint32_t>(binding.second.commandBuffers.size()),
+          binding.second.commandBuffers.data());
+    }
+  }
+  mImportBindings.clear();
+
+  if (mFormatBuffer != nullptr) {
+    AHardwareBuffer_release(mFormatBuffer);
+  }
+  LOGCATI("Engine_CameraHwb: %llu camera frames, %llu drawn, %llu dropped",
+          static_cast<unsigned long long>(mFrameMailbox.publishedCount()),
+          static_cast<unsigned long long>(mFrameMailbox.consumedCount()),
+          static_cast<unsigned long long>(mFrameMailbox.droppedCount()));
+
+  for (auto &semaphore : mBufferReadySemaphores) {
+    vulkanContext()->device().destroySemaphore(semaphore);
+  }
+
   if (mPipeline) {
     vulkanContext()->device().destroyPipeline(mPipeline);
   }
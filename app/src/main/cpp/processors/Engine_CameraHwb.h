@@ -6,21 +6,87 @@
 #define GAINVULKANSAMPLE_SAMPLE_13_CAMERAHWB_H
 
 #include "EngineContext.h"
+#include <FrameMailbox.h>
+#include <LatencyTracker.h>
+#include <VulkanImageCache.h>
+#include <SyncFence.h>
+#include <TraceRecorder.h>
+#include <VulkanFenceWatcher.h>
 #include <VulkanImageWrapper.h>
+#include <VulkanReadbackRing.h>
+#include <mutex>
+#include <unordered_map>
 
 using namespace gain;
 
 class Engine_CameraHwb : public EngineContext {
 private:
-  std::unique_ptr<Image> mImage;
-
-  AHardwareBuffer *mBuffer;
-
-  int mOrientation;
-
-  virtual void createPipelines() override;
-
-  virtual void createDescriptorSet() override;
+  // Images imported from the camera's AHardwareBuffers
+  std::unique_ptr<ImageCache> mImageCache;
+
+  // Image of the current camera frame, owned by mImageCache
+  Image *mImage = nullptr;
+
+  // The immutable sampler mDescriptorSetLayout was created with. Imports of
+  // a new buffer description come with a new one.
+  vk::Sampler mPipelineSampler = nullptr;
+
+  // Camera frames handed in by setHdwImage, taken by draw
+  FrameMailbox mFrameMailbox;
+
+  // First camera buffer, the sampler and pipeline are built for its format.
+  // Holds a reference until prepare has imported it.
+  AHardwareBuffer *mFormatBuffer = nullptr;
+  // Set by the first setHdwImage, camera thread only
+  bool mHasFormatBuffer = false;
+
+  // Orientation of the camera frame drawn last
+  int mOrientation = 0;
+
+  // Age of the camera frames at each stage of draw
+  LatencyTracker mLatency;
+  // Latency origin of the frame draw is drawing, 0 if it draws the previous
+  // frame again
+  int64_t mFrameOriginNs = 0;
+  // Records GpuComplete the moment a frame's fence signals. Created with
+  // the first frame that has an origin.
+  std::unique_ptr<vks::FenceWatcher> mGpuCompletions;
+
+  // Copies of drawn frames for setFrameReadback, created on first use
+  std::unique_ptr<vks::ReadbackRing> mReadbackRing;
+  std::mutex mFrameReadbackMutex;
+  vks::ReadbackRing::Callback mFrameReadback;
+
+  // The readback callback if the current frame is to be read back, i.e. a
+  // callback is set and draw draws a new camera frame
+  vks::ReadbackRing::Callback currentFrameReadback();
+
+  // Record the copy of the current frame's color target into cmd. draw
+  // hands it to mReadbackRing as in flight once cmd has been submitted.
+  void recordFrameReadback(vk::CommandBuffer cmd,
+                           vks::ReadbackRing::Callback callback);
+
+  // One semaphore per frame slot that the camera's acquire fence is
+  // imported into, and whether the current frame has to wait on it
+  std::vector<vk::Semaphore> mBufferReadySemaphores;
+  bool mWaitBufferReady = false;
+
+  // Descriptor set and command buffers of one cached import. The image view
+  // of a cached import never changes, and the uniforms are bound with a
+  // dynamic offset, so the set is written once. The command buffers are only
+  // recorded with settings.staticCommandBuffers, and again when the swap chain
+  // changes.
+  struct ImportBinding {
+    vk::DescriptorSet descriptorSet = nullptr;
+    // One command buffer per swap chain image
+    std::vector<vk::CommandBuffer> commandBuffers;
+  };
+  std::unordered_map<const Image *, ImportBinding> mImportBindings;
+
+  // Orientation and camera size mUniformBuffer, the uniforms of the static
+  // command buffers, was last written with, -1 if it was never written
+  int mStaticOrientation = -1;
+  vk::Extent2D mStaticImageExtent;
 
   virtual void buildCommandBuffers() override;
 
@@ -28,34 +94,101 @@ private:
 
   void prepareSynchronizationPrimitives();
 
-  void updateUniformBuffers();
+  // Computes uboVS for the current window, camera size and orientation
+  void updateUniformBuffers(int orientation);
 
-  void setupDescriptorSetLayout();
+  // Descriptor of the uniforms the import sets are written with
+  vk::DescriptorBufferInfo uniformDescriptor() const;
 
-  void setupDescriptorPool();
+  int currentOrientation();
 
-  void updateDescriptorSets();
+  void setupDescriptorPool();
 
   void prepareHdwImage();
 
   void updateTexture();
 
-  void buildCommandBuffers(int index);
+  // Recreate the set layout and pipelines for the sampler of the current
+  // import, waiting for the frames in flight first
+  void rebuildForNewSampler();
 
-public:
-  Engine_CameraHwb(std::shared_ptr<VulkanContext> vulkanContext)
-      : mBuffer(nullptr),
-        EngineContext(vulkanContext, "shaders/shader_13_camerahwb.vert.spv",
-                      "shaders/shader_13_camerahwb.frag.spv") {
+  void buildCommandBuffer(uint32_t frame, uint32_t uniformOffset,
+                          vks::ReadbackRing::Callback readback);
+
+  void recordRenderPass(vk::CommandBuffer cmdBuffer, vk::Framebuffer frameBuffer,
+                        vk::DescriptorSet descriptorSet,
+                        uint32_t uniformOffset);
+
+  // Returns the binding of image, creating and recording it on first use
+  ImportBinding &importBinding(const Image *image);
+
+  void recordImportCommandBuffers(ImportBinding &binding);
+
+  // Frees the binding of a retired image once no frame in flight uses it
+  void releaseImportBinding(const Image *image);
+
+  // Keeps the uniform block of the static command buffers in sync with the
+  // camera orientation
+  void updateStaticUniforms();
+
+protected:
+  // Layouts of sets 1 and up, appended to the pipeline layout after the
+  // camera set. Filled in by subclasses before prepare.
+  std::vector<vk::DescriptorSetLayout> mAdditionalSetLayouts;
+
+  Engine_CameraHwb(std::shared_ptr<VulkanContext> vulkanContext,
+                   const char *vertFilePath, const char *fragFilePath)
+      : EngineContext(vulkanContext, vertFilePath, fragFilePath) {
     settings.overlay = false;
-    settings.uesDepth = false;
+    settings.staticCommandBuffers = true;
   }
 
+  virtual void createPipelines() override;
+
+  // Create a camera pipeline, with fragmentSpecialization applied to the
+  // fragment shader if not nullptr
+  void createPipeline(const vk::SpecializationInfo *fragmentSpecialization,
+                      vk::Pipeline *pipeline);
+
+  void setupDescriptorSetLayout();
+
+  // Destroy what setupDescriptorSetLayout and createPipelines created. The
+  // GPU must be done with them.
+  virtual void destroyPipelines();
+
+  // Pipeline the camera pass is drawn with
+  virtual vk::Pipeline currentPipeline() { return mPipeline; }
+
+  // Name the camera pass is profiled and labeled with
+  virtual const char *passName() const { return "Camera draw"; }
+
+  // Bind the sets of mAdditionalSetLayouts, called after the camera set is
+  // bound
+  virtual void bindAdditionalDescriptorSets(vk::CommandBuffer /*cmdBuffer*/) {}
+
+public:
+  Engine_CameraHwb(std::shared_ptr<VulkanContext> vulkanContext)
+      : Engine_CameraHwb(vulkanContext, "shaders/shader_13_camerahwb.vert.spv",
+                         "shaders/shader_13_camerahwb.frag.spv") {}
+
   virtual void prepare(JNIEnv *env) override;
 
   virtual void draw();
 
-  void setHdwImage(AHardwareBuffer *buffer, int orientation);
+  // Hand in a camera frame, from the thread the camera delivers frames on.
+  // Never blocks, a frame not drawn before the next one arrives is dropped.
+  // timestampNs is the camera's sensor timestamp of the frame, the latency
+  // stats are measured from it, 0 to measure from now.
+  void setHdwImage(AHardwareBuffer *buffer, int orientation,
+                   SyncFence fence = SyncFence(), int64_t timestampNs = 0);
+
+  const FrameMailbox &frameMailbox() const { return mFrameMailbox; }
+
+  const LatencyTracker &latencyTracker() const { return mLatency; }
+
+  // Read every new camera frame back once drawn, nullptr to stop. callback
+  // runs on a worker thread, frames are skipped while it can't keep up.
+  void setFrameReadback(vks::ReadbackRing::Callback callback);
 
   ~Engine_CameraHwb();
 };
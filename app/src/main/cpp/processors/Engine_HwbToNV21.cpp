@@ -0,0 +1,460 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "Engine_HwbToNV21.h"
+
+#include <array>
+#include <cstring>
+
+namespace {
+struct PushConstants {
+  uint32_t width;
+  uint32_t height;
+};
+
+// Pixels converted by one invocation, see shader_14_hwbtonv21.comp
+constexpr uint32_t kBlockWidth = 4;
+constexpr uint32_t kBlockHeight = 2;
+} // namespace
+
+void Engine_HwbToNV21::prepare(JNIEnv * /*env*/) {
+  // A failed prepare is not retried, it would leak what it created before
+  // failing. Conversions keep returning false instead.
+  if (mPrepared || mPrepareFailed) {
+    return;
+  }
+
+  Image::ImageBasicInfo imageInfo;
+  imageInfo.format = vk::Format::eR8G8B8A8Unorm;
+  imageInfo.layout = vk::ImageLayout::eShaderReadOnlyOptimal;
+  imageInfo.usage = vk::ImageUsageFlagBits::eSampled;
+  mImageCache = std::make_unique<ImageCache>(vulkanContext()->deviceWrapper(),
+                                             vulkanContext()->queue(),
+                                             imageInfo);
+  // Every conversion has finished before the next one imports, but the
+  // descriptor set layout may still hold the sampler of an evicted image
+  mImageCache->setRetireCallback([this](std::unique_ptr<Image> image) {
+    if (mFrameGraph) {
+      mFrameGraph->releaseView(image->getImageViewHandle());
+    }
+    mRetiredImages.push_back(std::move(image));
+  });
+
+  setupDescriptorPool();
+
+  vk::CommandBufferAllocateInfo cmdBufAllocateInfo{};
+  cmdBufAllocateInfo.commandPool = vulkanContext()->commandPool();
+  cmdBufAllocateInfo.level = vk::CommandBufferLevel::ePrimary;
+  cmdBufAllocateInfo.commandBufferCount = 1;
+  CALL_VK(vulkanContext()->device().allocateCommandBuffers(&cmdBufAllocateInfo,
+                                                           &mCommandBuffer));
+
+  vk::FenceCreateInfo fenceCreateInfo{};
+  CALL_VK(vulkanContext()->device().createFence(&fenceCreateInfo, nullptr,
+                                                &mFence));
+
+  // Every conversion waits for its fence, so one query pool is enough
+  prepareGpuProfiler(1);
+
+  if (!setupFrameGraph()) {
+    LOGCATE("Engine_HwbToNV21: failed to set up the frame graph");
+    mPrepareFailed = true;
+    return;
+  }
+
+  mPrepared = true;
+}
+
+bool Engine_HwbToNV21::setupFrameGraph() {
+  mFrameGraph =
+      std::make_unique<vks::FrameGraph>(vulkanContext()->deviceWrapper());
+  mCameraResource = mFrameGraph->importImage("Camera");
+  mOutputResource = mFrameGraph->importBuffer("NV21");
+
+  // Acquire the camera content written since the last conversion
+  const auto acquire = mFrameGraph->addPass(
+      "Camera acquire", vks::FrameGraph::PassType::eImport,
+      [this](vk::CommandBuffer cmd) {
+        if (mSourceImage->hasPendingTransitions()) {
+          mSourceImage->recordPendingTransitions(
+              cmd, vk::PipelineStageFlagBits::eComputeShader);
+        }
+      });
+  mFrameGraph->write(acquire, mCameraResource,
+                     vks::ResourceUsage::SampledCompute);
+
+  const auto convert = mFrameGraph->addPass(
+      "NV21 convert", vks::FrameGraph::PassType::eCompute,
+      [this](vk::CommandBuffer cmd) { recordConvert(cmd); });
+  mFrameGraph->read(convert, mCameraResource,
+                    vks::ResourceUsage::SampledCompute);
+  mFrameGraph->write(convert, mOutputResource,
+                     vks::ResourceUsage::StorageWriteCompute);
+
+  // The result is read by the host once the fence signals
+  mFrameGraph->setFinalUsage(mOutputResource, vks::ResourceUsage::HostRead);
+  mFrameGraph->setProfiler(mGpuProfiler.get());
+  return mFrameGraph->compile();
+}
+
+void Engine_HwbToNV21::recordConvert(vk::CommandBuffer cmd) {
+  cmd.bindPipeline(vk::PipelineBindPoint::eCompute, mPipeline);
+  cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, mPipelineLayout, 0,
+                         1, &mDescriptorSet, 0, nullptr);
+  const PushConstants pushConstants{mSourceWidth, mSourceHeight};
+  cmd.pushConstants(mPipelineLayout, vk::ShaderStageFlagBits::eCompute, 0,
+                    sizeof(pushConstants), &pushConstants);
+
+  const uint32_t workGroupSize =
+      vulkanContext()->deviceWrapper()->workGroupSize;
+  const uint32_t blocksX = mSourceWidth / kBlockWidth;
+  const uint32_t blocksY = mSourceHeight / kBlockHeight;
+  cmd.dispatch((blocksX + workGroupSize - 1) / workGroupSize,
+               (blocksY + workGroupSize - 1) / workGroupSize, 1);
+}
+
+void Engine_HwbToNV21::setupDescriptorPool() {
+  // A combined image sampler with a YCbCr conversion may take one descriptor
+  // per plane
+  std::array<vk::DescriptorPoolSize, 2> typeCounts = {
+      vk::DescriptorPoolSize{vk::DescriptorType::eCombinedImageSampler, 3},
+      vk::DescriptorPoolSize{vk::DescriptorType::eStorageBuffer, 1}};
+
+  vk::DescriptorPoolCreateInfo descriptorPoolInfo = {};
+  descriptorPoolInfo.poolSizeCount = static_cast<uint32_t>(typeCounts.size());
+  descriptorPoolInfo.pPoolSizes = typeCounts.data();
+  descriptorPoolInfo.maxSets = 1;
+
+  CALL_VK(vulkanContext()->device().createDescriptorPool(
+      &descriptorPoolInfo, nullptr, &mDescriptorPool));
+}
+
+void Engine_HwbToNV21::setupDescriptorSetLayout(vk::Sampler sampler) {
+  std::array<vk::DescriptorSetLayoutBinding, 2> layoutBinding;
+
+  // Binding 0: The camera image, sampled through its YCbCr conversion. Such
+  // samplers have to be immutable.
+  layoutBinding[0] = {0, vk::DescriptorType::eCombinedImageSampler, 1,
+                      vk::ShaderStageFlagBits::eCompute, &sampler};
+  // Binding 1: The NV21 output
+  layoutBinding[1] = {1, vk::DescriptorType::eStorageBuffer, 1,
+                      vk::ShaderStageFlagBits::eCompute, nullptr};
+
+  vk::DescriptorSetLayoutCreateInfo descriptorLayout = {};
+  descriptorLayout.bindingCount = static_cast<uint32_t>(layoutBinding.size());
+  descriptorLayout.pBindings = layoutBinding.data();
+  CALL_VK(vulkanContext()->device().createDescriptorSetLayout(
+      &descriptorLayout, nullptr, &mDescriptorSetLayout));
+
+  const vk::PushConstantRange pushConstantRange{
+      vk::ShaderStageFlagBits::eCompute, 0, sizeof(PushConstants)};
+  vk::PipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
+  pipelineLayoutCreateInfo.setLayoutCount = 1;
+  pipelineLayoutCreateInfo.pSetLayouts = &mDescriptorSetLayout;
+  pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+  pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+  CALL_VK(vulkanContext()->device().createPipelineLayout(
+      &pipelineLayoutCreateInfo, nullptr, &mPipelineLayout));
+
+  vk::DescriptorSetAllocateInfo allocInfo = {};
+  allocInfo.descriptorPool = mDescriptorPool;
+  allocInfo.descriptorSetCount = 1;
+  allocInfo.pSetLayouts = &mDescriptorSetLayout;
+  CALL_VK(vulkanContext()->device().allocateDescriptorSets(&allocInfo,
+                                                           &mDescriptorSet));
+
+  mPipelineSampler = sampler;
+}
+
+void Engine_HwbToNV21::createPipelines() {
+  // Square work groups of the size chosen for the device
+  const std::array<uint32_t, 2> workGroupSize = {
+      vulkanContext()->deviceWrapper()->workGroupSize,
+      vulkanContext()->deviceWrapper()->workGroupSize};
+  const std::array<vk::SpecializationMapEntry, 2> specializationEntries = {
+      vk::SpecializationMapEntry{0, 0, sizeof(uint32_t)},
+      vk::SpecializationMapEntry{1, sizeof(uint32_t), sizeof(uint32_t)}};
+  vk::SpecializationInfo specializationInfo{
+      static_cast<uint32_t>(specializationEntries.size()),
+      specializationEntries.data(), sizeof(workGroupSize),
+      workGroupSize.data()};
+
+  vk::ComputePipelineCreateInfo pipelineCreateInfo = {};
+  pipelineCreateInfo.layout = mPipelineLayout;
+  pipelineCreateInfo.stage =
+      loadShader(compFilePath, vk::ShaderStageFlagBits::eCompute);
+  pipelineCreateInfo.stage.pSpecializationInfo = &specializationInfo;
+
+  CALL_VK(vulkanContext()->createComputePipeline(pipelineCreateInfo,
+                                                 &mPipeline));
+
+  vulkanContext()->device().destroyShaderModule(pipelineCreateInfo.stage.module,
+                                                nullptr);
+}
+
+void Engine_HwbToNV21::destroyPipelines() {
+  vk::Device device = vulkanContext()->device();
+  if (mPipeline) {
+    device.destroyPipeline(mPipeline);
+    mPipeline = nullptr;
+  }
+  if (mPipelineLayout) {
+    device.destroyPipelineLayout(mPipelineLayout);
+    mPipelineLayout = nullptr;
+  }
+  if (mDescriptorSetLayout) {
+    device.destroyDescriptorSetLayout(mDescriptorSetLayout);
+    mDescriptorSetLayout = nullptr;
+  }
+  if (mDescriptorPool) {
+    device.resetDescriptorPool(mDescriptorPool);
+  }
+  mDescriptorSet = nullptr;
+  mPipelineSampler = nullptr;
+}
+
+bool Engine_HwbToNV21::getNV21FromHardwareBuffer(AHardwareBuffer *buffer,
+                                                 void *output,
+                                                 size_t outputSize) {
+  TRACE_SCOPE("NV21 convert");
+  if (!mPrepared || buffer == nullptr || output == nullptr) {
+    return false;
+  }
+
+  AHardwareBuffer_Desc desc{};
+  AHardwareBuffer_describe(buffer, &desc);
+  if (desc.width % kBlockWidth != 0 || desc.height % kBlockHeight != 0) {
+    LOGCATE("Engine_HwbToNV21: unsupported size %ux%u", desc.width,
+            desc.height);
+    return false;
+  }
+  const vk::DeviceSize size =
+      static_cast<vk::DeviceSize>(desc.width) * desc.height * 3 / 2;
+  if (outputSize < size) {
+    LOGCATE("Engine_HwbToNV21: output of %zu bytes is too small for %ux%u",
+            outputSize, desc.width, desc.height);
+    return false;
+  }
+
+  Image *image = mImageCache->acquire(buffer);
+  if (image == nullptr) {
+    return false;
+  }
+  if (mImageCache->getSamplerHandle() != mPipelineSampler) {
+    // A new buffer description, the pipeline has to use its sampler
+    destroyPipelines();
+    mRetiredImages.clear();
+    setupDescriptorSetLayout(mImageCache->getSamplerHandle());
+    createPipelines();
+    vulkanContext()->savePipelineCache();
+  }
+  mRetiredImages.clear();
+
+  const vk::Buffer dst = prepareOutput(output, outputSize, size);
+  if (!dst) {
+    return false;
+  }
+
+  const vk::DescriptorImageInfo imageDescriptor = image->getDescriptor();
+  const vk::DescriptorBufferInfo bufferDescriptor{dst, 0, size};
+  std::array<vk::WriteDescriptorSet, 2> writeDescriptorSet = {
+      vk::WriteDescriptorSet(mDescriptorSet, 0, 0, 1,
+                             vk::DescriptorType::eCombinedImageSampler,
+                             &imageDescriptor, nullptr, nullptr),
+      vk::WriteDescriptorSet(mDescriptorSet, 1, 0, 1,
+                             vk::DescriptorType::eStorageBuffer, nullptr,
+                             &bufferDescriptor, nullptr)};
+  vulkanContext()->device().updateDescriptorSets(
+      static_cast<uint32_t>(writeDescriptorSet.size()),
+      writeDescriptorSet.data(), 0, nullptr);
+
+  vk::CommandBufferBeginInfo cmdBufInfo = {};
+  cmdBufInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+  CALL_VK(mCommandBuffer.begin(&cmdBufInfo));
+  if (mGpuProfiler) {
+    mGpuProfiler->beginFrame(mCommandBuffer, 0);
+  }
+
+  mSourceImage = image;
+  mSourceWidth = desc.width;
+  mSourceHeight = desc.height;
+  mFrameGraph->bindImage(mCameraResource, image);
+  mFrameGraph->bindBuffer(mOutputResource, dst);
+  mFrameGraph->execute(mCommandBuffer);
+  mCommandBuffer.end();
+
+  vk::SubmitInfo submitInfo = {};
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &mCommandBuffer;
+  CALL_VK(vulkanContext()->device().resetFences(1, &mFence));
+  {
+    TRACE_SCOPE("Submit");
+    CALL_VK(vulkanContext()->queue().submit(1, &submitInfo, mFence));
+  }
+  {
+    TRACE_SCOPE("Wait for GPU");
+    CALL_VK(vulkanContext()->device().waitForFences(1, &mFence, VK_TRUE,
+                                                    UINT64_MAX));
+  }
+
+  if (mHostImport.buffer) {
+    // The shader wrote straight into output
+    releaseHostImport();
+  } else {
+    CALL_VK(mOutputBuffer->invalidate());
+    memcpy(output, mOutputBuffer->getMappedData(), size);
+  }
+  return true;
+}
+
+vk::Buffer Engine_HwbToNV21::prepareOutput(void *output, size_t outputSize,
+                                           vk::DeviceSize size) {
+  if (importHostPointer(output, outputSize, size)) {
+    return mHostImport.buffer;
+  }
+
+  if (!mOutputBuffer || mOutputBuffer->getDescriptor().range < size) {
+    mOutputBuffer.reset();
+    // Read by the CPU, so prefer cached memory
+    mOutputBuffer = vks::Buffer::create(
+        vulkanContext()->deviceWrapper(), static_cast<uint32_t>(size),
+        vk::BufferUsageFlagBits::eStorageBuffer,
+        vk::MemoryPropertyFlagBits::eHostVisible |
+            vk::MemoryPropertyFlagBits::eHostCached);
+    if (!mOutputBuffer) {
+      mOutputBuffer = vks::Buffer::create(
+          vulkanContext()->deviceWrapper(), static_cast<uint32_t>(size),
+          vk::BufferUsageFlagBits::eStorageBuffer,
+          vk::MemoryPropertyFlagBits::eHostVisible |
+              vk::MemoryPropertyFlagBits::eHostCoherent);
+    }
+    if (!mOutputBuffer || mOutputBuffer->map() != vk::Result::eSuccess) {
+      LOGCATE("Engine_HwbToNV21: failed to create the output buffer");
+      mOutputBuffer.reset();
+      return nullptr;
+    }
+  }
+  return mOutputBuffer->getBufferHandle();
+}
+
+bool Engine_HwbToNV21::importHostPointer(void *output, size_t outputSize,
+                                         vk::DeviceSize size) {
+  // The imported range has to be aligned and must stay within output
+  const vk::DeviceSize alignment =
+      vulkanContext()->deviceWrapper()->hostPointerImportAlignment;
+  if (alignment == 0 || reinterpret_cast<uintptr_t>(output) % alignment != 0) {
+    return false;
+  }
+  const vk::DeviceSize importSize = outputSize / alignment * alignment;
+  if (importSize < size) {
+    return false;
+  }
+
+  vk::Device device = vulkanContext()->device();
+  vk::MemoryHostPointerPropertiesEXT pointerProperties{};
+  if (device.getMemoryHostPointerPropertiesEXT(
+          vk::ExternalMemoryHandleTypeFlagBits::eHostAllocationEXT, output,
+          &pointerProperties) != vk::Result::eSuccess) {
+    return false;
+  }
+
+  vk::ExternalMemoryBufferCreateInfo externalCreateInfo{};
+  externalCreateInfo.handleTypes =
+      vk::ExternalMemoryHandleTypeFlagBits::eHostAllocationEXT;
+  vk::BufferCreateInfo bufferCreateInfo{};
+  bufferCreateInfo.pNext = &externalCreateInfo;
+  bufferCreateInfo.size = importSize;
+  bufferCreateInfo.usage = vk::BufferUsageFlagBits::eStorageBuffer;
+  bufferCreateInfo.sharingMode = vk::SharingMode::eExclusive;
+  CALL_VK(device.createBuffer(&bufferCreateInfo, nullptr, &mHostImport.buffer));
+
+  // Host coherent, so the result is visible without mapping the memory
+  vk::MemoryRequirements memoryRequirements;
+  device.getBufferMemoryRequirements(mHostImport.buffer, &memoryRequirements);
+  const uint32_t typeBits =
+      memoryRequirements.memoryTypeBits & pointerProperties.memoryTypeBits;
+  const auto &memoryProperties =
+      vulkanContext()->deviceWrapper()->memoryProperties;
+  uint32_t memoryTypeIndex = VK_MAX_MEMORY_TYPES;
+  for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+    if ((typeBits & (1u << i)) &&
+        (memoryProperties.memoryTypes[i].propertyFlags &
+         vk::MemoryPropertyFlagBits::eHostCoherent)) {
+      memoryTypeIndex = i;
+      break;
+    }
+  }
+
+  vk::ImportMemoryHostPointerInfoEXT importInfo{
+      vk::ExternalMemoryHandleTypeFlagBits::eHostAllocationEXT, output};
+  vk::MemoryAllocateInfo allocateInfo{importSize, memoryTypeIndex};
+  allocateInfo.pNext = &importInfo;
+  if (memoryTypeIndex == VK_MAX_MEMORY_TYPES ||
+      device.allocateMemory(&allocateInfo, nullptr, &mHostImport.memory) !=
+          vk::Result::eSuccess) {
+    releaseHostImport();
+    return false;
+  }
+  device.bindBufferMemory(mHostImport.buffer, mHostImport.memory, 0);
+  return true;
+}
+
+void Engine_HwbToNV21::releaseHostImport() {
+  vk::Device device = vulkanContext()->device();
+  if (mHostImport.buffer) {
+    device.destroyBuffer(mHostImport.buffer);
+    mHostImport.buffer = nullptr;
+  }
+  if (mHostImport.memory) {
+    device.freeMemory(mHostImport.memory);
+    mHostImport.memory = nullptr;
+  }
+}
+
+Engine_HwbToNV21::~Engine_HwbToNV21() {
+  vulkanContext()->device().waitIdle();
+
+  // Refers to the camera image bound last
+  mFrameGraph.reset();
+
+  // Retired images own the sampler of the descriptor set layout
+  mImageCache.reset();
+  destroyPipelines();
+  mRetiredImages.clear();
+
+  releaseHostImport();
+  mOutputBuffer.reset();
+
+  vk::Device device = vulkanContext()->device();
+  if (mDescriptorPool) {
+    device.destroyDescriptorPool(mDescriptorPool);
+  }
+  if (mFence) {
+    device.destroyFence(mFence);
+  }
+  if (mCommandBuffer) {
+    device.freeCommandBuffers(vulkanContext()->commandPool(), 1,
+                              &mCommandBuffer);
+  }
+}
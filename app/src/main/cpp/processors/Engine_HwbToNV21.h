@@ -0,0 +1,121 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef GAINVULKANSAMPLE_ENGINE_HWBTONV21_H
+#define GAINVULKANSAMPLE_ENGINE_HWBTONV21_H
+
+#include "EngineContext.h"
+#include <TraceRecorder.h>
+#include <VulkanFrameGraph.h>
+#include <VulkanImageCache.h>
+#include <VulkanImageWrapper.h>
+
+using namespace gain;
+
+// Converts camera AHardwareBuffers into NV21 with a compute shader. The
+// buffer is sampled through the YCbCr conversion sampler of its import, and
+// luma and the downsampled chroma are written in the same dispatch. Nothing
+// is presented, so the engine has no swap chain and no frame slots.
+class Engine_HwbToNV21 : public EngineContext {
+private:
+  // Images imported from the camera's AHardwareBuffers
+  std::unique_ptr<ImageCache> mImageCache;
+
+  // Evicted images, destroyed once the pipeline no longer refers to their
+  // sampler
+  std::vector<std::unique_ptr<Image>> mRetiredImages;
+
+  // The immutable sampler mDescriptorSetLayout was created with. Imports of
+  // a new buffer description come with a new one.
+  vk::Sampler mPipelineSampler = nullptr;
+
+  // Host visible destination, used when the output can't be imported
+  std::unique_ptr<vks::Buffer> mOutputBuffer;
+
+  // Output memory imported with VK_EXT_external_memory_host, so the shader
+  // writes straight into it. The caller's memory may be freed after the
+  // call, so the import only lives for one conversion.
+  struct {
+    vk::Buffer buffer = nullptr;
+    vk::DeviceMemory memory = nullptr;
+  } mHostImport;
+
+  vk::CommandBuffer mCommandBuffer = nullptr;
+  vk::Fence mFence = nullptr;
+
+  // Camera acquire and NV21 convert, with the barriers between them and the
+  // host read of the output
+  std::unique_ptr<vks::FrameGraph> mFrameGraph;
+  vks::FrameGraph::ResourceId mCameraResource = 0;
+  vks::FrameGraph::ResourceId mOutputResource = 0;
+
+  // Image and size of the conversion being recorded
+  Image *mSourceImage = nullptr;
+  uint32_t mSourceWidth = 0;
+  uint32_t mSourceHeight = 0;
+
+  const char *compFilePath;
+
+  // Set when prepare failed, see prepare
+  bool mPrepareFailed = false;
+
+  void setupDescriptorPool();
+
+  void setupDescriptorSetLayout(vk::Sampler sampler);
+
+  virtual void createPipelines() override;
+
+  void destroyPipelines();
+
+  bool setupFrameGraph();
+
+  void recordConvert(vk::CommandBuffer cmd);
+
+  // Returns the buffer the shader writes size bytes of NV21 into
+  vk::Buffer prepareOutput(void *output, size_t outputSize,
+                           vk::DeviceSize size);
+
+  bool importHostPointer(void *output, size_t outputSize, vk::DeviceSize size);
+
+  void releaseHostImport();
+
+public:
+  Engine_HwbToNV21(std::shared_ptr<VulkanContext> vulkanContext)
+      : EngineContext(vulkanContext, nullptr, nullptr),
+        compFilePath("shaders/shader_14_hwbtonv21.comp.spv") {
+    settings.overlay = false;
+  }
+
+  virtual void prepare(JNIEnv *env) override;
+
+  // Write the content of buffer as NV21 into output, which has room for
+  // outputSize bytes, at least width * height * 3 / 2. The width has to be a
+  // multiple of 4 and the height even. Blocks until the GPU is done.
+  bool getNV21FromHardwareBuffer(AHardwareBuffer *buffer, void *output,
+                                 size_t outputSize);
+
+  ~Engine_HwbToNV21();
+};
+
+#endif // GAINVULKANSAMPLE_ENGINE_HWBTONV21_H
@@ -0,0 +1,223 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "Engine_Lut.h"
+
+#include <TaskScheduler.h>
+#include <VulkanUploadManager.h>
+
+void Engine_Lut::prepare(JNIEnv *env) {
+  if (mPrepared) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mLutMutex);
+    setupLutDescriptors();
+    if (mLuts.empty()) {
+      // Until a table is selected the camera is drawn unchanged
+      addLut(CubeLut::identity(CubeLut::kMinSize));
+    }
+  }
+  mAdditionalSetLayouts = {mLutSetLayout};
+
+  Engine_CameraHwb::prepare(env);
+}
+
+void Engine_Lut::setupLutDescriptors() {
+  if (mLutSetLayout) {
+    return;
+  }
+
+  // Binding 0: the table (Fragment shader)
+  vk::DescriptorSetLayoutBinding layoutBinding = {
+      {0}, vk::DescriptorType::eCombinedImageSampler, 1,
+      vk::ShaderStageFlagBits::eFragment};
+  vk::DescriptorSetLayoutCreateInfo descriptorLayout = {};
+  descriptorLayout.bindingCount = 1;
+  descriptorLayout.pBindings = &layoutBinding;
+  CALL_VK(vulkanContext()->device().createDescriptorSetLayout(
+      &descriptorLayout, nullptr, &mLutSetLayout));
+  vks::debug::setDescriptorSetLayoutName(vulkanContext()->device(),
+                                         mLutSetLayout, "mLutSetLayout");
+
+  vk::DescriptorPoolSize typeCount = {vk::DescriptorType::eCombinedImageSampler,
+                                      kMaxLuts};
+  vk::DescriptorPoolCreateInfo descriptorPoolInfo = {};
+  descriptorPoolInfo.poolSizeCount = 1;
+  descriptorPoolInfo.pPoolSizes = &typeCount;
+  descriptorPoolInfo.maxSets = kMaxLuts;
+  CALL_VK(vulkanContext()->device().createDescriptorPool(
+      &descriptorPoolInfo, nullptr, &mLutDescriptorPool));
+
+  mLuts.reserve(kMaxLuts);
+}
+
+int Engine_Lut::addLut(const CubeLut &cube) {
+  if (mLuts.size() == kMaxLuts) {
+    LOGCATE("Engine_Lut: no room for more than %u tables", kMaxLuts);
+    return -1;
+  }
+
+  Image::ImageBasicInfo imageInfo = {
+    imageType : vk::ImageType::e3D,
+    format : vk::Format::eR16G16B16A16Sfloat,
+    extent : {cube.size(), cube.size(), cube.size()},
+    usage : vk::ImageUsageFlagBits::eSampled |
+        vk::ImageUsageFlagBits::eTransferDst
+  };
+  Lut lut;
+  lut.image = Image::createDeviceLocal(vulkanContext()->deviceWrapper(),
+                                       vulkanContext()->queue(), imageInfo);
+  if (!lut.image) {
+    return -1;
+  }
+  // The first draw after the load flushes the upload, see draw
+  if (!vulkanContext()->uploadManager()->uploadImage(
+          lut.image->getImageHandle(), imageInfo.extent, cube.texels().data(),
+          cube.byteSize(), vk::ImageLayout::eShaderReadOnlyOptimal,
+          vk::PipelineStageFlagBits::eFragmentShader,
+          vk::AccessFlagBits::eShaderRead)) {
+    return -1;
+  }
+  mLutUploadsPending = true;
+
+  vk::DescriptorSetAllocateInfo allocInfo = {};
+  allocInfo.descriptorPool = mLutDescriptorPool;
+  allocInfo.descriptorSetCount = 1;
+  allocInfo.pSetLayouts = &mLutSetLayout;
+  CALL_VK(vulkanContext()->device().allocateDescriptorSets(
+      &allocInfo, &lut.descriptorSet));
+
+  vk::DescriptorImageInfo imageDescriptor = {
+      lut.image->getSamplerHandle(), lut.image->getImageViewHandle(),
+      vk::ImageLayout::eShaderReadOnlyOptimal};
+  vk::WriteDescriptorSet writeDescriptorSet = {};
+  writeDescriptorSet.dstSet = lut.descriptorSet;
+  writeDescriptorSet.descriptorCount = 1;
+  writeDescriptorSet.descriptorType = vk::DescriptorType::eCombinedImageSampler;
+  writeDescriptorSet.pImageInfo = &imageDescriptor;
+  writeDescriptorSet.dstBinding = 0;
+  vulkanContext()->device().updateDescriptorSets(1, &writeDescriptorSet, 0,
+                                                 nullptr);
+
+  mLuts.push_back(std::move(lut));
+  return static_cast<int>(mLuts.size() - 1);
+}
+
+int Engine_Lut::loadLut(const std::string &path, const std::string &cachePath) {
+  // Parse outside of the lock, the render thread keeps drawing meanwhile
+  CubeLut cube;
+  if (!CubeLut::load(path, cachePath, &cube)) {
+    return -1;
+  }
+
+  std::lock_guard<std::mutex> lock(mLutMutex);
+  setupLutDescriptors();
+  if (mLuts.empty()) {
+    addLut(CubeLut::identity(CubeLut::kMinSize));
+  }
+  const int id = addLut(cube);
+  if (id >= 0) {
+    LOGCATI("Engine_Lut: loaded %s as table %d, size %u", path.c_str(), id,
+            cube.size());
+  }
+  return id;
+}
+
+void Engine_Lut::createPipelines() {
+  // Same pipeline with the tetrahedral lookup, see shader_15_lut.frag
+  const VkBool32 tetrahedral = VK_TRUE;
+  vk::SpecializationMapEntry mapEntry = {0, 0, sizeof(tetrahedral)};
+  vk::SpecializationInfo specializationInfo = {1, &mapEntry,
+                                               sizeof(tetrahedral),
+                                               &tetrahedral};
+
+  // The driver compiles both variants at once on a cold pipeline cache
+  TaskGroup group;
+  group.run([this] { Engine_CameraHwb::createPipelines(); }, CoreHint::Big);
+  group.run(
+      [&] { createPipeline(&specializationInfo, &mTetrahedralPipeline); },
+      CoreHint::Big);
+  group.wait();
+}
+
+void Engine_Lut::destroyPipelines() {
+  if (mTetrahedralPipeline) {
+    vulkanContext()->device().destroyPipeline(mTetrahedralPipeline);
+    mTetrahedralPipeline = nullptr;
+  }
+  Engine_CameraHwb::destroyPipelines();
+}
+
+vk::Pipeline Engine_Lut::currentPipeline() {
+  return mActiveTetrahedral ? mTetrahedralPipeline : mPipeline;
+}
+
+void Engine_Lut::bindAdditionalDescriptorSets(vk::CommandBuffer cmdBuffer) {
+  cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
+                               mPipelineLayout, 1, 1, &mActiveLutSet, 0,
+                               nullptr);
+}
+
+void Engine_Lut::draw() {
+  {
+    std::lock_guard<std::mutex> lock(mLutMutex);
+    if (mLutUploadsPending) {
+      // Frames submitted after the flush are ordered after the uploads
+      vulkanContext()->uploadManager()->flush();
+      mLutUploadsPending = false;
+    }
+    const int selected = mSelectedLut;
+    if (selected >= 0 && selected < static_cast<int>(mLuts.size())) {
+      mActiveLutSet = mLuts[selected].descriptorSet;
+    } else if (!mActiveLutSet) {
+      mActiveLutSet = mLuts.front().descriptorSet;
+    }
+  }
+  mActiveTetrahedral = mTetrahedral;
+
+  Engine_CameraHwb::draw();
+}
+
+Engine_Lut::~Engine_Lut() {
+  // Uploads of tables loaded since the last draw may be queued still, and
+  // the tables may be read by frames in flight
+  vulkanContext()->uploadManager()->flush();
+  vulkanContext()->device().waitIdle();
+
+  if (mTetrahedralPipeline) {
+    vulkanContext()->device().destroyPipeline(mTetrahedralPipeline);
+  }
+
+  mLuts.clear();
+
+  if (mLutDescriptorPool) {
+    vulkanContext()->device().destroyDescriptorPool(mLutDescriptorPool);
+  }
+
+  if (mLutSetLayout) {
+    vulkanContext()->device().destroyDescriptorSetLayout(mLutSetLayout);
+  }
+}
@@ -0,0 +1,110 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef GAINVULKANSAMPLE_ENGINE_LUT_H
+#define GAINVULKANSAMPLE_ENGINE_LUT_H
+
+#include "CubeLut.h"
+#include "Engine_CameraHwb.h"
+#include <atomic>
+#include <mutex>
+
+using namespace gain;
+
+// Renders the camera through a 3D color lookup table. Every loaded table
+// has its own image and descriptor set, bound as set 1 of the camera pass,
+// so switching tables only binds another set. The hardware trilinear filter
+// does the interpolation by default, the tetrahedral variant of the pipeline
+// is built at prepare time as well.
+class Engine_Lut : public Engine_CameraHwb {
+private:
+  static constexpr uint32_t kMaxLuts = 16;
+
+  struct Lut {
+    std::unique_ptr<Image> image;
+    vk::DescriptorSet descriptorSet = nullptr;
+  };
+
+  // Guards the tables and their descriptor pool, tables are loaded from
+  // any thread
+  std::mutex mLutMutex;
+  std::vector<Lut> mLuts;
+  // Uploads of tables loaded since the last draw have not been flushed
+  bool mLutUploadsPending = false;
+
+  vk::DescriptorSetLayout mLutSetLayout = nullptr;
+  vk::DescriptorPool mLutDescriptorPool = nullptr;
+
+  std::atomic<int> mSelectedLut{0};
+  std::atomic<bool> mTetrahedral{false};
+
+  // State of the frame being recorded
+  vk::DescriptorSet mActiveLutSet = nullptr;
+  bool mActiveTetrahedral = false;
+
+  vk::Pipeline mTetrahedralPipeline = nullptr;
+
+  // Create mLutSetLayout and mLutDescriptorPool if not done yet. Called with
+  // mLutMutex held.
+  void setupLutDescriptors();
+
+  // Returns the id of the new table, -1 on failure. Called with mLutMutex
+  // held.
+  int addLut(const CubeLut &cube);
+
+  virtual void createPipelines() override;
+
+  virtual void destroyPipelines() override;
+
+  virtual vk::Pipeline currentPipeline() override;
+
+  virtual const char *passName() const override { return "LUT draw"; }
+
+  virtual void bindAdditionalDescriptorSets(vk::CommandBuffer cmdBuffer) override;
+
+public:
+  Engine_Lut(std::shared_ptr<VulkanContext> vulkanContext)
+      : Engine_CameraHwb(vulkanContext, "shaders/shader_13_camerahwb.vert.spv",
+                         "shaders/shader_15_lut.frag.spv") {
+    // The bound table changes between frames
+    settings.staticCommandBuffers = false;
+  }
+
+  virtual void prepare(JNIEnv *env) override;
+
+  virtual void draw() override;
+
+  // Load the .cube file at path, see CubeLut::load for cachePath. Returns the
+  // id to select the table with, -1 on failure. Table 0 is the identity.
+  int loadLut(const std::string &path, const std::string &cachePath);
+
+  // Takes effect with the next frame, unknown ids are ignored
+  void selectLut(int id) { mSelectedLut = id; }
+
+  void setTetrahedral(bool tetrahedral) { mTetrahedral = tetrahedral; }
+
+  ~Engine_Lut();
+};
+
+#endif // GAINVULKANSAMPLE_ENGINE_LUT_H
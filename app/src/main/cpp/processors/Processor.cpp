@@ -25,9 +25,11 @@
 #include "Processor.h"
 #include "../util/LogUtil.h"
 #include "Engine_CameraHwb.h"
+#include "Engine_HwbToNV21.h"
+#include "Engine_Lut.h"
 #include "includes/cube_data.h"
-#include "jni.h"
 #include <VulkanContext.h>
+#include <cstring>
 #include <stdexcept>
 #include <vector>
 #include <vulkan/vulkan.hpp>
@@ -35,71 +37,241 @@
 #include <chrono>
 #include <thread>
 
-std::unique_ptr<Processor> Processor::create(AAssetManager *assetManager) {
+std::unique_ptr<Processor>
+Processor::create(AssetManager *assetManager,
+                  const std::string &pipelineCachePath) {
   auto sample = std::make_unique<Processor>();
-  sample->initialize(assetManager);
+  sample->initialize(assetManager, pipelineCachePath);
   return std::move(sample);
 }
 
 Processor::Processor() {}
 
 void Processor::configEngine(uint32_t type) {
+  mEnginePrepared = false;
   switch (type) {
   case EngineType::CAMERA_HARDWAREBUFFER: {
     mEngineContext = std::make_unique<Engine_CameraHwb>(mVulkanContext);
     break;
   }
   case EngineType::HWB_TO_NV21: {
-    //			mEngineContext =
-    //std::make_unique<Engine_HwbToNV21>(mVulkanContext);
+    mEngineContext = std::make_unique<Engine_HwbToNV21>(mVulkanContext);
+    break;
+  }
+  case EngineType::LUT: {
+    mEngineContext = std::make_unique<Engine_Lut>(mVulkanContext);
     break;
   }
   }
 }
 
-void Processor::initialize(AAssetManager *assetManager) {
+void Processor::initialize(AssetManager *assetManager,
+                           const std::string &pipelineCachePath) {
   mVulkanContext = std::make_shared<VulkanContext>();
 
-  const bool success = mVulkanContext->create(assetManager);
-  assert(success);
+  if (!mVulkanContext->create(assetManager, pipelineCachePath)) {
+    LOGCATE("Processor: failed to create the Vulkan context");
+    assert(false);
+  }
 }
 
-void Processor::setWindow(ANativeWindow *window, uint32_t w, uint32_t h) {
+void Processor::setWindow(NativeWindow *window, uint32_t w, uint32_t h) {
   // init swapchain
   mEngineContext->connectSwapChain();
   mEngineContext->setNativeWindow(window, w, h);
 }
 
-void Processor::onWindowSizeChanged(ANativeWindow *window, uint32_t w,
+void Processor::onWindowSizeChanged(NativeWindow *window, uint32_t w,
                                     uint32_t h) {
+  {
+    std::lock_guard<std::mutex> lock(mWindowMutex);
+    mPendingWindow = {true, window, w, h};
+  }
+  // The swap chain belongs to the render thread while the loop runs
+  if (!mRenderLoop.post(RenderLoop::kResize)) {
+    applyPendingWindow();
+  }
+}
+
+void Processor::applyPendingWindow() {
+  PendingWindow window;
+  {
+    std::lock_guard<std::mutex> lock(mWindowMutex);
+    window = mPendingWindow;
+    mPendingWindow.pending = false;
+  }
+  if (!window.pending) {
+    return;
+  }
   // Recreate swap chain
-  mEngineContext->setNativeWindow(window, w, h);
+  mEngineContext->setNativeWindow(window.window, window.width, window.height);
   mEngineContext->windowResize();
 }
 
+void Processor::setOffscreen(uint32_t w, uint32_t h,
+                             EngineContext::ReadbackCallback readback) {
+  mEngineContext->setOffscreenTarget(w, h, std::move(readback));
+}
+
 void Processor::prepareHardwareBuffer(JNIEnv *env, AHardwareBuffer *buffer,
-                                      int orientation) {
+                                      int orientation, int fenceFd,
+                                      int64_t timestampNs) {
+  TRACE_SCOPE("Ingest camera frame");
+  Engine_CameraHwb *context =
+      dynamic_cast<Engine_CameraHwb *>(mEngineContext.get());
+  context->setHdwImage(buffer, orientation, SyncFence(fenceFd), timestampNs);
+
+  if (!mEnginePrepared) {
+    mEngineContext->prepare(env);
+
+    // The app may be killed without a clean shutdown, keep what was compiled
+    mVulkanContext->savePipelineCache();
+    mEnginePrepared = true;
+  }
+
+  mRenderLoop.post(RenderLoop::kNewFrame);
+}
+
+bool Processor::getNV21FromHardwareBuffer(JNIEnv *env, AHardwareBuffer *buffer,
+                                          void *outputData,
+                                          size_t outputSize) {
+  Engine_HwbToNV21 *context =
+      dynamic_cast<Engine_HwbToNV21 *>(mEngineContext.get());
+  if (context == nullptr) {
+    LOGCATE("getNV21FromHardwareBuffer needs the HWB_TO_NV21 engine");
+    return false;
+  }
+  // Only the first call prepares. After a failed prepare every conversion
+  // returns false.
+  context->prepare(env);
+  return context->getNV21FromHardwareBuffer(buffer, outputData, outputSize);
+}
+
+int Processor::loadLut(const std::string &path, const std::string &cachePath) {
+  Engine_Lut *context = dynamic_cast<Engine_Lut *>(mEngineContext.get());
+  if (context == nullptr) {
+    LOGCATE("loadLut needs the LUT engine");
+    return -1;
+  }
+  return context->loadLut(path, cachePath);
+}
+
+void Processor::selectLut(int id) {
+  Engine_Lut *context = dynamic_cast<Engine_Lut *>(mEngineContext.get());
+  if (context != nullptr) {
+    context->selectLut(id);
+    mRenderLoop.post(RenderLoop::kConfigChanged);
+  }
+}
+
+void Processor::setLutTetrahedral(bool tetrahedral) {
+  Engine_Lut *context = dynamic_cast<Engine_Lut *>(mEngineContext.get());
+  if (context != nullptr) {
+    context->setTetrahedral(tetrahedral);
+    mRenderLoop.post(RenderLoop::kConfigChanged);
+  }
+}
+
+bool Processor::getFrameStats(uint64_t *published, uint64_t *consumed,
+                              uint64_t *dropped) {
   Engine_CameraHwb *context =
       dynamic_cast<Engine_CameraHwb *>(mEngineContext.get());
-  context->setHdwImage(buffer, orientation);
+  if (context == nullptr) {
+    return false;
+  }
+  const FrameMailbox &mailbox = context->frameMailbox();
+  *published = mailbox.publishedCount();
+  *consumed = mailbox.consumedCount();
+  *dropped = mailbox.droppedCount();
+  return true;
+}
 
-  mEngineContext->prepare(env);
+bool Processor::getLatencyStats(std::vector<LatencyTracker::Stats> *stats) {
+  Engine_CameraHwb *context =
+      dynamic_cast<Engine_CameraHwb *>(mEngineContext.get());
+  if (context == nullptr) {
+    return false;
+  }
+  *stats = context->latencyTracker().stats();
+  return true;
 }
 
-void Processor::getNV21FromHardwareBuffer(JNIEnv *env, AHardwareBuffer *buffer,
-                                          void *outputData) {
-  //	Engine_HwbToNV21 *context = dynamic_cast<Engine_HwbToNV21
-  //*>(mEngineContext.get()); 	context->getNV21FromHardwareBuffer(buffer,
-  //outputData);
+bool Processor::setFrameReadback(bool enabled) {
+  Engine_CameraHwb *context =
+      dynamic_cast<Engine_CameraHwb *>(mEngineContext.get());
+  if (context == nullptr) {
+    return false;
+  }
+  if (!enabled) {
+    context->setFrameReadback(nullptr);
+    return true;
+  }
+  context->setFrameReadback([this](const vks::ReadbackRing::Pixels &pixels) {
+    const size_t size = static_cast<size_t>(pixels.rowPitch) * pixels.height;
+    std::lock_guard<std::mutex> lock(mLatestFrameMutex);
+    mLatestFrame.data.resize(size);
+    memcpy(mLatestFrame.data.data(), pixels.data, size);
+    mLatestFrame.info = {pixels.width, pixels.height, pixels.rowPitch,
+                         pixels.format};
+    mLatestFrame.fresh = true;
+  });
+  return true;
+}
+
+bool Processor::readLatestFrame(void *dst, size_t size, FrameInfo *info) {
+  std::lock_guard<std::mutex> lock(mLatestFrameMutex);
+  if (!mLatestFrame.fresh || mLatestFrame.data.size() > size) {
+    return false;
+  }
+  memcpy(dst, mLatestFrame.data.data(), mLatestFrame.data.size());
+  *info = mLatestFrame.info;
+  mLatestFrame.fresh = false;
+  return true;
+}
+
+bool Processor::setGpuProfiling(bool enabled) {
+  // The profiler is created with the engine's frame slots
+  if (mEngineContext == nullptr || mEnginePrepared) {
+    LOGCATE("Processor: GPU profiling has to be set before the first frame");
+    return false;
+  }
+  mEngineContext->settings.gpuProfiling = enabled;
+  return true;
+}
+
+bool Processor::getGpuPassStats(
+    std::vector<vks::GpuProfiler::PassStats> *stats) {
+  const vks::GpuProfiler *profiler = mEngineContext->gpuProfiler();
+  if (profiler == nullptr) {
+    return false;
+  }
+  *stats = profiler->passStats();
+  return true;
 }
 
 void Processor::render(bool loop) {
-  mLoopDraw = loop;
-  do {
+  if (!loop) {
     mEngineContext->draw();
-  } while (mLoopDraw);
+    return;
+  }
+
+  mRenderLoop.run([this](uint32_t events) {
+    if (events & RenderLoop::kResize) {
+      applyPendingWindow();
+    }
+    // Nothing to draw before the first camera frame
+    if (mEnginePrepared) {
+      mEngineContext->draw();
+    }
+  });
 }
 
-void Processor::stopLoopRender() { mLoopDraw = false; }
+void Processor::stopLoopRender() { mRenderLoop.stop(); }
+
+void Processor::setRenderPolicy(bool onNewContentOnly, float maxFrameRate) {
+  mRenderLoop.setPolicy(onNewContentOnly ? RenderLoop::Policy::OnNewContent
+                                         : RenderLoop::Policy::Continuous,
+                        maxFrameRate);
+}
 
-void Processor::unInit(JNIEnv *env) {}
\ No newline at end of file
+void Processor::unInit(JNIEnv * /*env*/) { mRenderLoop.stop(); }
\ No newline at end of file
@@ -28,9 +28,15 @@
 #include "../engine/VulkanContext.h"
 #include "../engine/VulkanImageWrapper.h"
 #include "EngineContext.h"
-#include <android/native_window_jni.h>
+#include <LatencyTracker.h>
+#include <RenderLoop.h>
+#include <TraceRecorder.h>
+#include <atomic>
 #include <glm/vec2.hpp>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 #include <vulkan/vulkan.hpp>
 
 using namespace gain;
@@ -42,34 +48,128 @@ class Processor {
 public:
   explicit Processor();
 
-  static std::unique_ptr<Processor> create(AAssetManager *assetManager);
+  // pipelineCachePath is where the pipeline cache is kept across runs, empty
+  // to not persist it
+  static std::unique_ptr<Processor>
+  create(AssetManager *assetManager, const std::string &pipelineCachePath = "");
 
   void configEngine(uint32_t type);
 
-  void initialize(AAssetManager *assetManager);
+  void initialize(AssetManager *assetManager,
+                  const std::string &pipelineCachePath);
 
   void unInit(JNIEnv *env);
 
+  // fenceFd is the producer's acquire fence for buffer, or -1 if the buffer
+  // is ready. Ownership of the fd is transferred. timestampNs is the sensor
+  // timestamp of the frame, 0 if unknown, see getLatencyStats.
   void prepareHardwareBuffer(JNIEnv *env, AHardwareBuffer *buffer,
-                             int orientation);
-
-  void getNV21FromHardwareBuffer(JNIEnv *env, AHardwareBuffer *buffer,
-                                 void *outputData);
-
+                             int orientation, int fenceFd = -1,
+                             int64_t timestampNs = 0);
+
+  // Needs the HWB_TO_NV21 engine. outputData has room for outputSize bytes,
+  // at least width * height * 3 / 2.
+  bool getNV21FromHardwareBuffer(JNIEnv *env, AHardwareBuffer *buffer,
+                                 void *outputData, size_t outputSize);
+
+  // Needs the LUT engine. Load the .cube file at path, cachePath is where its
+  // parsed form is kept, empty to parse it every time. Returns the id to
+  // select the table with, -1 on failure.
+  int loadLut(const std::string &path, const std::string &cachePath);
+
+  void selectLut(int id);
+
+  void setLutTetrahedral(bool tetrahedral);
+
+  // Camera frames handed in, drawn and dropped because a newer one arrived
+  // before they were drawn. False if the engine takes no camera frames.
+  bool getFrameStats(uint64_t *published, uint64_t *consumed,
+                     uint64_t *dropped);
+
+  // Time the engine's passes with GPU timestamps for getGpuPassStats. Call
+  // after configEngine and before the first frame. False if the engine is
+  // already prepared.
+  bool setGpuProfiling(bool enabled);
+
+  // Rolling GPU durations of the engine's passes over the last frames. False
+  // if profiling is off or the device can't time them.
+  bool getGpuPassStats(std::vector<vks::GpuProfiler::PassStats> *stats);
+
+  // Age of the camera frames at each stage from ingestion to the GPU being
+  // done, over the last seconds. False if the engine takes no camera frames.
+  bool getLatencyStats(std::vector<LatencyTracker::Stats> *stats);
+
+  // Keep a copy of the latest drawn camera frame for readLatestFrame. The
+  // copy is made off the render thread. False if the engine takes no camera
+  // frames.
+  bool setFrameReadback(bool enabled);
+
+  struct FrameInfo {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t rowPitch = 0;
+    vk::Format format = vk::Format::eUndefined;
+  };
+
+  // Copy the latest frame read back into dst, which has room for size
+  // bytes. False if there is no frame newer than the last one read or dst is
+  // too small.
+  bool readLatestFrame(void *dst, size_t size, FrameInfo *info);
+
+  // Draw one frame, or with loop run the render loop on the calling thread
+  // until stopLoopRender. The loop draws when a camera frame arrives, the
+  // window is resized or a setting changes, see setRenderPolicy.
   void render(bool loop);
 
+  // Returns once the render loop has finished its last frame
   void stopLoopRender();
 
-  void setWindow(ANativeWindow *window, uint32_t w, uint32_t h);
+  // With onNewContentOnly the render loop sleeps until there is something
+  // new to draw, otherwise it draws continuously. maxFrameRate 0 does not
+  // limit the rate.
+  void setRenderPolicy(bool onNewContentOnly, float maxFrameRate);
+
+  void setWindow(NativeWindow *window, uint32_t w, uint32_t h);
+
+  // Applied by the render loop before its next frame if it is running
+  void onWindowSizeChanged(NativeWindow *window, uint32_t w, uint32_t h);
 
-  void onWindowSizeChanged(ANativeWindow *window, uint32_t w, uint32_t h);
+  // Render into offscreen targets instead of a window, e.g. to process
+  // captures in batches. Call instead of setWindow.
+  void setOffscreen(uint32_t w, uint32_t h,
+                    EngineContext::ReadbackCallback readback = nullptr);
 
 private:
+  // Resize the swap chain if onWindowSizeChanged left a new size
+  void applyPendingWindow();
+
   std::shared_ptr<VulkanContext> mVulkanContext;
 
+  // Latest frame read back, see setFrameReadback.
+  // Declared before the engine, whose readbacks write it until it is gone
+  struct LatestFrame {
+    std::vector<uint8_t> data;
+    FrameInfo info;
+    // Not handed out by readLatestFrame yet
+    bool fresh = false;
+  } mLatestFrame;
+  std::mutex mLatestFrameMutex;
+
   std::unique_ptr<EngineContext> mEngineContext;
 
-  bool mLoopDraw;
+  // Set once the camera engine is prepared by the first camera frame, the
+  // render loop draws nothing before
+  std::atomic<bool> mEnginePrepared{false};
+
+  RenderLoop mRenderLoop;
+
+  struct PendingWindow {
+    bool pending = false;
+    NativeWindow *window = nullptr;
+    uint32_t width = 0;
+    uint32_t height = 0;
+  } mPendingWindow;
+  std::mutex mWindowMutex;
 };
 
 #endif // GAINVULKANSAMPLE_SAMPLE_H
@@ -0,0 +1,420 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "TestUtil.h"
+
+#include <cpukernels/CpuKernels.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <vector>
+
+using gain::cpukernels::Isa;
+namespace cpukernels = gain::cpukernels;
+
+namespace {
+struct Size {
+  int width;
+  int height;
+};
+
+// NV21 sizes from the smallest image up to a 1080p frame with a border.
+// The widths leave tails of every length behind the 8, 16 and 32 pixel
+// vectors, and the chroma planes of the larger ones have odd dimensions.
+const Size kNv21Sizes[] = {{2, 2},   {4, 2},    {2, 6},    {6, 6},
+                           {14, 4},  {16, 16},  {18, 10},  {30, 2},
+                           {34, 8},  {46, 14},  {62, 30},  {66, 18},
+                           {130, 6}, {638, 478}, {1922, 1082}};
+
+// Any size of at least factor x factor can be downscaled
+const Size kBoxSizes[] = {{2, 2},   {3, 3},   {5, 4},   {4, 7},
+                          {9, 9},   {17, 5},  {31, 33}, {35, 6},
+                          {63, 65}, {67, 11}, {1921, 1081}};
+
+// Rows are padded so a kernel that runs past the end of a row shows up
+constexpr int kPadding = 7;
+constexpr uint8_t kUnwritten = 0xcd;
+
+std::vector<uint8_t> randomBytes(size_t count) {
+  static std::mt19937 generator(2022);
+  std::uniform_int_distribution<int> byte(0, 255);
+  std::vector<uint8_t> bytes(count);
+  for (uint8_t &value : bytes) {
+    value = static_cast<uint8_t>(byte(generator));
+  }
+  return bytes;
+}
+
+// The vector instruction sets this build and CPU can run
+std::vector<Isa> vectorIsas() {
+  std::vector<Isa> isas;
+  for (Isa isa : {Isa::Neon, Isa::Sse41, Isa::Avx2}) {
+    if (cpukernels::setIsa(isa)) {
+      isas.push_back(isa);
+    }
+  }
+  cpukernels::setIsa(Isa::Scalar);
+  return isas;
+}
+
+const std::vector<Isa> &availableIsas() {
+  static const std::vector<Isa> isas = vectorIsas();
+  return isas;
+}
+
+// Run convert into out with the scalar kernels and with every vector
+// instruction set, all of them have to produce the same bytes
+void compareIsas(const char *kernel, Size size, std::vector<uint8_t> &out,
+                 const std::function<bool()> &convert) {
+  cpukernels::setIsa(Isa::Scalar);
+  std::fill(out.begin(), out.end(), kUnwritten);
+  CHECK(convert());
+  const std::vector<uint8_t> expected = out;
+
+  for (Isa isa : availableIsas()) {
+    CHECK(cpukernels::setIsa(isa));
+    std::fill(out.begin(), out.end(), kUnwritten);
+    CHECK(convert());
+    if (out != expected) {
+      const size_t offset =
+          std::mismatch(out.begin(), out.end(), expected.begin()).first -
+          out.begin();
+      fprintf(stderr, "%s %dx%d: %s differs from scalar at byte %zu\n",
+              kernel, size.width, size.height, cpukernels::isaName(isa),
+              offset);
+    }
+    CHECK(out == expected);
+  }
+  cpukernels::setIsa(Isa::Scalar);
+}
+
+// Run check with the scalar kernels and with every vector instruction set
+void forEachIsa(const std::function<void()> &check) {
+  cpukernels::setIsa(Isa::Scalar);
+  check();
+  for (Isa isa : availableIsas()) {
+    CHECK(cpukernels::setIsa(isa));
+    check();
+  }
+  cpukernels::setIsa(Isa::Scalar);
+}
+
+// 4 bytes of rgba at pixel x
+std::vector<uint8_t> pixelAt(const std::vector<uint8_t> &rgba, int x) {
+  return std::vector<uint8_t>(rgba.begin() + 4 * x, rgba.begin() + 4 * x + 4);
+}
+
+// BT.601 full range: R = Y + 1.402 (V - 128),
+// G = Y - 0.344 (U - 128) - 0.714 (V - 128), B = Y + 1.772 (U - 128).
+// A 4x2 image of two chroma blocks, one with only V and one with only U
+// off neutral, so a swapped chroma order or matrix entry shows up.
+void testYuvToRgbaValues() {
+  const std::vector<uint8_t> y = {128, 128, 128, 128, 60, 60, 60, 60};
+  const std::vector<uint8_t> vu = {178, 128, 128, 178};
+  const std::vector<uint8_t> uv = {128, 178, 178, 128};
+  const std::vector<uint8_t> u = {128, 178};
+  const std::vector<uint8_t> v = {178, 128};
+  // Rows 0 and 1 of the V block, then of the U block
+  const std::vector<uint8_t> vBlock0 = {198, 92, 128, 255};
+  const std::vector<uint8_t> vBlock1 = {130, 24, 60, 255};
+  const std::vector<uint8_t> uBlock0 = {128, 111, 217, 255};
+  const std::vector<uint8_t> uBlock1 = {60, 43, 149, 255};
+
+  forEachIsa([&] {
+    std::vector<std::vector<uint8_t>> outputs;
+    std::vector<uint8_t> rgba(4 * 4 * 2);
+    CHECK(cpukernels::nv21ToRgba(y.data(), 4, vu.data(), 4, 4, 2,
+                                 rgba.data(), 16));
+    outputs.push_back(rgba);
+    CHECK(cpukernels::nv12ToRgba(y.data(), 4, uv.data(), 4, 4, 2,
+                                 rgba.data(), 16));
+    outputs.push_back(rgba);
+    CHECK(cpukernels::i420ToRgba(y.data(), 4, u.data(), 2, v.data(), 2, 4, 2,
+                                 rgba.data(), 16));
+    outputs.push_back(rgba);
+
+    for (const auto &out : outputs) {
+      CHECK(pixelAt(out, 0) == vBlock0 && pixelAt(out, 1) == vBlock0);
+      CHECK(pixelAt(out, 2) == uBlock0 && pixelAt(out, 3) == uBlock0);
+      CHECK(pixelAt(out, 4) == vBlock1 && pixelAt(out, 5) == vBlock1);
+      CHECK(pixelAt(out, 6) == uBlock1 && pixelAt(out, 7) == uBlock1);
+    }
+  });
+}
+
+// Y = 0.299 R + 0.587 G + 0.114 B, U = 128 - 0.169 R - 0.331 G + 0.5 B,
+// V = 128 + 0.5 R - 0.419 G - 0.081 B. A red and a blue 2x2 block.
+void testRgbaToNv21Values() {
+  std::vector<uint8_t> rgba(4 * 4 * 2);
+  for (int row = 0; row < 2; ++row) {
+    for (int x = 0; x < 4; ++x) {
+      uint8_t *pixel = rgba.data() + row * 16 + x * 4;
+      pixel[0] = x < 2 ? 255 : 0;
+      pixel[1] = 0;
+      pixel[2] = x < 2 ? 0 : 255;
+      pixel[3] = 255;
+    }
+  }
+
+  forEachIsa([&] {
+    std::vector<uint8_t> y(4 * 2, kUnwritten);
+    std::vector<uint8_t> vu(4, kUnwritten);
+    CHECK(cpukernels::rgbaToNv21(rgba.data(), 16, 4, 2, y.data(), 4,
+                                 vu.data(), 4));
+    CHECK(y == std::vector<uint8_t>({76, 76, 29, 29, 76, 76, 29, 29}));
+    // V comes first, U of red and V of blue are below neutral
+    CHECK(vu == std::vector<uint8_t>({255, 85, 107, 255}));
+  });
+}
+
+// A 4x2 index pattern rotated clockwise into 2x4, the VU pairs move as a
+// whole
+void testRotateNv21Values() {
+  const std::vector<uint8_t> y = {0, 1, 2, 3, 4, 5, 6, 7};
+  const std::vector<uint8_t> vu = {10, 11, 20, 21};
+
+  forEachIsa([&] {
+    std::vector<uint8_t> dstY(8, kUnwritten);
+    std::vector<uint8_t> dstVu(4, kUnwritten);
+    CHECK(cpukernels::rotateNv21(y.data(), 4, vu.data(), 4, 4, 2,
+                                 dstY.data(), 2, dstVu.data(), 2, 90));
+    CHECK(dstY == std::vector<uint8_t>({4, 0, 5, 1, 6, 2, 7, 3}));
+    CHECK(dstVu == std::vector<uint8_t>({10, 11, 20, 21}));
+
+    CHECK(cpukernels::rotateNv21(y.data(), 4, vu.data(), 4, 4, 2,
+                                 dstY.data(), 2, dstVu.data(), 2, 270));
+    CHECK(dstY == std::vector<uint8_t>({3, 7, 2, 6, 1, 5, 0, 4}));
+    CHECK(dstVu == std::vector<uint8_t>({20, 21, 10, 11}));
+
+    CHECK(cpukernels::rotateNv21(y.data(), 4, vu.data(), 4, 4, 2,
+                                 dstY.data(), 4, dstVu.data(), 4, 180));
+    CHECK(dstY == std::vector<uint8_t>({7, 6, 5, 4, 3, 2, 1, 0}));
+    CHECK(dstVu == std::vector<uint8_t>({20, 21, 10, 11}));
+  });
+}
+
+// The 2x2 rectangle at (4, 2) of a 6x4 index pattern. Its chroma is the
+// third VU pair of the second chroma row.
+void testCropNv21Values() {
+  std::vector<uint8_t> y(6 * 4);
+  std::vector<uint8_t> vu(6 * 2);
+  for (size_t i = 0; i < y.size(); ++i) {
+    y[i] = static_cast<uint8_t>(i);
+  }
+  for (size_t i = 0; i < vu.size(); ++i) {
+    vu[i] = static_cast<uint8_t>(100 + i);
+  }
+
+  forEachIsa([&] {
+    std::vector<uint8_t> dstY(4, kUnwritten);
+    std::vector<uint8_t> dstVu(2, kUnwritten);
+    CHECK(cpukernels::cropNv21(y.data(), 6, vu.data(), 6, 6, 4, 4, 2, 2, 2,
+                               dstY.data(), 2, dstVu.data(), 2));
+    CHECK(dstY == std::vector<uint8_t>({16, 17, 22, 23}));
+    CHECK(dstVu == std::vector<uint8_t>({110, 111}));
+  });
+}
+
+// Averages round half up and channels stay apart
+void testBoxDownscaleValues() {
+  const std::vector<uint8_t> gray = {1, 2, 4, 6, 2, 2, 6, 8};
+  const std::vector<uint8_t> pairs = {0, 100, 2, 100, 1, 200, 2, 201};
+
+  forEachIsa([&] {
+    std::vector<uint8_t> dst(2, kUnwritten);
+    CHECK(cpukernels::boxDownscale(gray.data(), 4, 4, 2, 1, 2, dst.data(),
+                                   2));
+    CHECK(dst == std::vector<uint8_t>({2, 6}));
+
+    CHECK(cpukernels::boxDownscale(pairs.data(), 4, 2, 2, 2, 2, dst.data(),
+                                   2));
+    CHECK(dst == std::vector<uint8_t>({1, 150}));
+  });
+}
+
+void testSemiPlanarToRgba() {
+  for (Size size : kNv21Sizes) {
+    const int yStride = size.width + kPadding;
+    const int chromaStride = size.width + kPadding;
+    const int rgbaStride = size.width * 4 + kPadding;
+    const std::vector<uint8_t> y = randomBytes(yStride * size.height);
+    const std::vector<uint8_t> chroma =
+        randomBytes(chromaStride * size.height / 2);
+    std::vector<uint8_t> rgba(rgbaStride * size.height);
+
+    compareIsas("nv21ToRgba", size, rgba, [&] {
+      return cpukernels::nv21ToRgba(y.data(), yStride, chroma.data(),
+                                    chromaStride, size.width, size.height,
+                                    rgba.data(), rgbaStride);
+    });
+    compareIsas("nv12ToRgba", size, rgba, [&] {
+      return cpukernels::nv12ToRgba(y.data(), yStride, chroma.data(),
+                                    chromaStride, size.width, size.height,
+                                    rgba.data(), rgbaStride);
+    });
+  }
+}
+
+void testI420ToRgba() {
+  for (Size size : kNv21Sizes) {
+    const int yStride = size.width + kPadding;
+    const int chromaStride = size.width / 2 + kPadding;
+    const int rgbaStride = size.width * 4 + kPadding;
+    const std::vector<uint8_t> y = randomBytes(yStride * size.height);
+    const std::vector<uint8_t> u = randomBytes(chromaStride * size.height / 2);
+    const std::vector<uint8_t> v = randomBytes(chromaStride * size.height / 2);
+    std::vector<uint8_t> rgba(rgbaStride * size.height);
+
+    compareIsas("i420ToRgba", size, rgba, [&] {
+      return cpukernels::i420ToRgba(y.data(), yStride, u.data(), chromaStride,
+                                    v.data(), chromaStride, size.width,
+                                    size.height, rgba.data(), rgbaStride);
+    });
+  }
+}
+
+void testRgbaToNv21() {
+  for (Size size : kNv21Sizes) {
+    const int rgbaStride = size.width * 4 + kPadding;
+    const int yStride = size.width + kPadding;
+    const int vuStride = size.width + kPadding;
+    const std::vector<uint8_t> rgba = randomBytes(rgbaStride * size.height);
+    // Both planes in one buffer, the luma plane first
+    const size_t ySize = yStride * size.height;
+    std::vector<uint8_t> nv21(ySize + vuStride * size.height / 2);
+
+    compareIsas("rgbaToNv21", size, nv21, [&] {
+      return cpukernels::rgbaToNv21(rgba.data(), rgbaStride, size.width,
+                                    size.height, nv21.data(), yStride,
+                                    nv21.data() + ySize, vuStride);
+    });
+  }
+}
+
+void testRotateNv21() {
+  for (Size size : kNv21Sizes) {
+    const int srcStride = size.width + kPadding;
+    const std::vector<uint8_t> y = randomBytes(srcStride * size.height);
+    const std::vector<uint8_t> vu = randomBytes(srcStride * size.height / 2);
+
+    for (int degrees : {0, 90, 180, 270}) {
+      const bool swapped = degrees == 90 || degrees == 270;
+      const int dstWidth = swapped ? size.height : size.width;
+      const int dstHeight = swapped ? size.width : size.height;
+      const int dstStride = dstWidth + kPadding;
+      const size_t ySize = dstStride * dstHeight;
+      std::vector<uint8_t> nv21(ySize + dstStride * dstHeight / 2);
+
+      compareIsas("rotateNv21", size, nv21, [&] {
+        return cpukernels::rotateNv21(y.data(), srcStride, vu.data(),
+                                      srcStride, size.width, size.height,
+                                      nv21.data(), dstStride,
+                                      nv21.data() + ySize, dstStride, degrees);
+      });
+    }
+  }
+}
+
+void testCropNv21() {
+  for (Size size : kNv21Sizes) {
+    const int srcStride = size.width + kPadding;
+    const std::vector<uint8_t> y = randomBytes(srcStride * size.height);
+    const std::vector<uint8_t> vu = randomBytes(srcStride * size.height / 2);
+    // The largest even rectangle that leaves a border, if there is room
+    const int x = size.width > 4 ? 2 : 0;
+    const int top = size.height > 4 ? 2 : 0;
+    const int width = size.width > 4 ? size.width - 4 : size.width;
+    const int height = size.height > 4 ? size.height - 4 : size.height;
+    const int dstStride = width + kPadding;
+    const size_t ySize = dstStride * height;
+    std::vector<uint8_t> nv21(ySize + dstStride * height / 2);
+
+    compareIsas("cropNv21", size, nv21, [&] {
+      return cpukernels::cropNv21(y.data(), srcStride, vu.data(), srcStride,
+                                  size.width, size.height, x, top, width,
+                                  height, nv21.data(), dstStride,
+                                  nv21.data() + ySize, dstStride);
+    });
+  }
+}
+
+void testBoxDownscale() {
+  for (Size size : kBoxSizes) {
+    for (int channels : {1, 2, 4}) {
+      const int srcStride = size.width * channels + kPadding;
+      const std::vector<uint8_t> src = randomBytes(srcStride * size.height);
+
+      for (int factor : {2, 4}) {
+        if (size.width < factor || size.height < factor) {
+          continue;
+        }
+        const int dstStride = size.width / factor * channels + kPadding;
+        std::vector<uint8_t> dst(dstStride * (size.height / factor));
+
+        compareIsas("boxDownscale", size, dst, [&] {
+          return cpukernels::boxDownscale(src.data(), srcStride, size.width,
+                                          size.height, channels, factor,
+                                          dst.data(), dstStride);
+        });
+      }
+    }
+  }
+}
+
+void testOddNv21SizesAreRejected() {
+  std::vector<uint8_t> plane(64 * 64 * 4, 0);
+  for (Size size : {Size{3, 2}, Size{2, 3}, Size{1921, 1080}, Size{0, 2}}) {
+    CHECK(!cpukernels::nv21ToRgba(plane.data(), 64, plane.data(), 64,
+                                  size.width, size.height, plane.data(), 256));
+    CHECK(!cpukernels::rgbaToNv21(plane.data(), 256, size.width, size.height,
+                                  plane.data(), 64, plane.data(), 64));
+  }
+}
+} // namespace
+
+int main() {
+  const std::vector<Isa> &isas = availableIsas();
+  fprintf(stderr, "Comparing scalar with");
+  for (Isa isa : isas) {
+    fprintf(stderr, " %s", cpukernels::isaName(isa));
+  }
+  fprintf(stderr, "%s\n", isas.empty() ? " nothing" : "");
+
+  RUN_TEST(testYuvToRgbaValues);
+  RUN_TEST(testRgbaToNv21Values);
+  RUN_TEST(testRotateNv21Values);
+  RUN_TEST(testCropNv21Values);
+  RUN_TEST(testBoxDownscaleValues);
+  RUN_TEST(testSemiPlanarToRgba);
+  RUN_TEST(testI420ToRgba);
+  RUN_TEST(testRgbaToNv21);
+  RUN_TEST(testRotateNv21);
+  RUN_TEST(testCropNv21);
+  RUN_TEST(testBoxDownscale);
+  RUN_TEST(testOddNv21SizesAreRejected);
+  return TEST_RESULT();
+}
@@ -0,0 +1,123 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "TestUtil.h"
+
+#include <VulkanFenceWatcher.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using vks::FenceWatcher;
+
+namespace {
+// Stand-in for the driver's vkWaitForFences. Fence 1 and 2 signal when the
+// test says so, every other fence is lost with the device.
+std::atomic<int> gSignaled{0};
+
+VKAPI_ATTR VkResult VKAPI_CALL waitForFences(VkDevice, uint32_t count,
+                                             const VkFence *fences, VkBool32,
+                                             uint64_t) {
+  for (uint32_t i = 0; i < count; i++) {
+    const auto fence = reinterpret_cast<uintptr_t>(fences[i]);
+    if (fence > 2) {
+      return VK_ERROR_DEVICE_LOST;
+    }
+    while (gSignaled < static_cast<int>(fence)) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+  return VK_SUCCESS;
+}
+
+vk::Device fakeDevice() {
+  return vk::Device(reinterpret_cast<VkDevice>(uintptr_t(0x1)));
+}
+
+vk::Fence fakeFence(uintptr_t handle) {
+  return vk::Fence(reinterpret_cast<VkFence>(handle));
+}
+
+void testCallsBackWhenSignaled() {
+  gSignaled = 0;
+  std::atomic<int> completed{0};
+  FenceWatcher watcher(fakeDevice());
+  watcher.watch(fakeFence(1), [&] { completed = 1; });
+  watcher.watch(fakeFence(2), [&] { completed = 2; });
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  CHECK(completed == 0);
+
+  gSignaled = 1;
+  watcher.release(fakeFence(1));
+  // Done with the first fence, still waiting for the second
+  CHECK(completed == 1);
+
+  gSignaled = 2;
+  watcher.release(fakeFence(2));
+  CHECK(completed == 2);
+}
+
+void testReleaseOfUnwatchedFence() {
+  FenceWatcher watcher(fakeDevice());
+  watcher.release(fakeFence(1));
+}
+
+void testFailedWaitSkipsCallback() {
+  gSignaled = 2;
+  bool called = false;
+  bool next = false;
+  FenceWatcher watcher(fakeDevice());
+  watcher.watch(fakeFence(3), [&] { called = true; });
+  watcher.watch(fakeFence(1), [&] { next = true; });
+  watcher.release(fakeFence(1));
+  CHECK(!called);
+  CHECK(next);
+}
+
+void testDestructorWaitsForFences() {
+  gSignaled = 0;
+  std::atomic<bool> completed{false};
+  std::thread signal([] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    gSignaled = 1;
+  });
+  {
+    FenceWatcher watcher(fakeDevice());
+    watcher.watch(fakeFence(1), [&] { completed = true; });
+  }
+  CHECK(completed);
+  signal.join();
+}
+} // namespace
+
+int main() {
+  VULKAN_HPP_DEFAULT_DISPATCHER.vkWaitForFences = waitForFences;
+  RUN_TEST(testCallsBackWhenSignaled);
+  RUN_TEST(testReleaseOfUnwatchedFence);
+  RUN_TEST(testFailedWaitSkipsCallback);
+  RUN_TEST(testDestructorWaitsForFences);
+  return TEST_RESULT();
+}
@@ -0,0 +1,571 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "TestUtil.h"
+
+#include <VulkanFrameGraph.h>
+
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <vector>
+
+using vks::FrameGraph;
+using vks::ResourceUsage;
+
+namespace {
+// A device that only keeps track of what the graph creates and records.
+// Every handle is a new number.
+uint64_t gNextHandle = 0x100;
+
+template <typename Handle> Handle newHandle() {
+  return reinterpret_cast<Handle>(static_cast<uintptr_t>(gNextHandle++));
+}
+
+struct Binding {
+  VkDeviceMemory memory;
+  VkDeviceSize offset;
+};
+
+struct Barriers {
+  VkPipelineStageFlags srcStages;
+  VkPipelineStageFlags dstStages;
+  std::vector<VkImageMemoryBarrier> images;
+};
+
+bool gLazyMemory = false;
+std::map<VkImage, VkImageCreateInfo> gImages;
+std::map<VkImage, Binding> gBindings;
+std::map<VkDeviceMemory, uint32_t> gMemoryTypes;
+std::map<VkRenderPass, std::vector<VkAttachmentDescription>> gRenderPasses;
+int gFramebufferCount = 0;
+std::vector<Barriers> gBarriers;
+std::vector<VkRenderPass> gBegunRenderPasses;
+
+VKAPI_ATTR void VKAPI_CALL
+getProperties(VkPhysicalDevice, VkPhysicalDeviceProperties *properties) {
+  *properties = {};
+  properties->limits.bufferImageGranularity = 1;
+}
+
+VKAPI_ATTR void VKAPI_CALL getFeatures(VkPhysicalDevice,
+                                       VkPhysicalDeviceFeatures *features) {
+  *features = {};
+}
+
+// Type 0 is device local, type 1 lazily allocated if gLazyMemory
+VKAPI_ATTR void VKAPI_CALL
+getMemoryProperties(VkPhysicalDevice,
+                    VkPhysicalDeviceMemoryProperties *properties) {
+  *properties = {};
+  properties->memoryHeapCount = 1;
+  properties->memoryHeaps[0].size = 1u << 30;
+  properties->memoryHeaps[0].flags = VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+  properties->memoryTypeCount = gLazyMemory ? 2 : 1;
+  properties->memoryTypes[0].propertyFlags =
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+  properties->memoryTypes[1].propertyFlags =
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+      VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+}
+
+VKAPI_ATTR void VKAPI_CALL
+getQueueFamilyProperties(VkPhysicalDevice, uint32_t *count,
+                         VkQueueFamilyProperties *properties) {
+  if (properties != nullptr) {
+    properties[0] = {};
+    properties[0].queueFlags = VK_QUEUE_GRAPHICS_BIT;
+    properties[0].queueCount = 1;
+  }
+  *count = 1;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL enumerateExtensions(VkPhysicalDevice,
+                                                   const char *,
+                                                   uint32_t *count,
+                                                   VkExtensionProperties *) {
+  *count = 0;
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL createImage(VkDevice,
+                                           const VkImageCreateInfo *info,
+                                           const VkAllocationCallbacks *,
+                                           VkImage *image) {
+  *image = newHandle<VkImage>();
+  gImages[*image] = *info;
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL destroyImage(VkDevice, VkImage image,
+                                        const VkAllocationCallbacks *) {
+  gImages.erase(image);
+  gBindings.erase(image);
+}
+
+// 4 bytes per pixel whatever the format, in any memory type
+VKAPI_ATTR void VKAPI_CALL
+getImageMemoryRequirements(VkDevice, VkImage image,
+                           VkMemoryRequirements *requirements) {
+  const VkExtent3D &extent = gImages[image].extent;
+  requirements->size = VkDeviceSize(extent.width) * extent.height * 4;
+  requirements->alignment = 256;
+  requirements->memoryTypeBits = 0x3;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL allocateMemory(VkDevice,
+                                              const VkMemoryAllocateInfo *info,
+                                              const VkAllocationCallbacks *,
+                                              VkDeviceMemory *memory) {
+  *memory = newHandle<VkDeviceMemory>();
+  gMemoryTypes[*memory] = info->memoryTypeIndex;
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL freeMemory(VkDevice, VkDeviceMemory memory,
+                                      const VkAllocationCallbacks *) {
+  gMemoryTypes.erase(memory);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL bindImageMemory(VkDevice, VkImage image,
+                                               VkDeviceMemory memory,
+                                               VkDeviceSize offset) {
+  gBindings[image] = {memory, offset};
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL createImageView(VkDevice,
+                                               const VkImageViewCreateInfo *,
+                                               const VkAllocationCallbacks *,
+                                               VkImageView *view) {
+  *view = newHandle<VkImageView>();
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL destroyImageView(VkDevice, VkImageView,
+                                            const VkAllocationCallbacks *) {}
+
+VKAPI_ATTR VkResult VKAPI_CALL
+createRenderPass(VkDevice, const VkRenderPassCreateInfo *info,
+                 const VkAllocationCallbacks *, VkRenderPass *renderPass) {
+  *renderPass = newHandle<VkRenderPass>();
+  gRenderPasses[*renderPass].assign(info->pAttachments,
+                                    info->pAttachments +
+                                        info->attachmentCount);
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL destroyRenderPass(VkDevice,
+                                             VkRenderPass renderPass,
+                                             const VkAllocationCallbacks *) {
+  gRenderPasses.erase(renderPass);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL createFramebuffer(
+    VkDevice, const VkFramebufferCreateInfo *, const VkAllocationCallbacks *,
+    VkFramebuffer *framebuffer) {
+  *framebuffer = newHandle<VkFramebuffer>();
+  gFramebufferCount++;
+  return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL destroyFramebuffer(VkDevice, VkFramebuffer,
+                                              const VkAllocationCallbacks *) {
+  gFramebufferCount--;
+}
+
+VKAPI_ATTR void VKAPI_CALL cmdPipelineBarrier(
+    VkCommandBuffer, VkPipelineStageFlags srcStages,
+    VkPipelineStageFlags dstStages, VkDependencyFlags, uint32_t,
+    const VkMemoryBarrier *, uint32_t, const VkBufferMemoryBarrier *,
+    uint32_t imageBarrierCount, const VkImageMemoryBarrier *imageBarriers) {
+  gBarriers.push_back({srcStages, dstStages,
+                       std::vector<VkImageMemoryBarrier>(
+                           imageBarriers, imageBarriers + imageBarrierCount)});
+}
+
+VKAPI_ATTR void VKAPI_CALL cmdBeginRenderPass(VkCommandBuffer,
+                                              const VkRenderPassBeginInfo *info,
+                                              VkSubpassContents) {
+  gBegunRenderPasses.push_back(info->renderPass);
+}
+
+VKAPI_ATTR void VKAPI_CALL cmdEndRenderPass(VkCommandBuffer) {}
+
+VKAPI_ATTR void VKAPI_CALL destroyDevice(VkDevice,
+                                         const VkAllocationCallbacks *) {}
+
+void installFakeDevice() {
+  auto &dispatcher = VULKAN_HPP_DEFAULT_DISPATCHER;
+  dispatcher.vkGetPhysicalDeviceProperties = getProperties;
+  dispatcher.vkGetPhysicalDeviceFeatures = getFeatures;
+  dispatcher.vkGetPhysicalDeviceMemoryProperties = getMemoryProperties;
+  dispatcher.vkGetPhysicalDeviceQueueFamilyProperties =
+      getQueueFamilyProperties;
+  dispatcher.vkEnumerateDeviceExtensionProperties = enumerateExtensions;
+  dispatcher.vkCreateImage = createImage;
+  dispatcher.vkDestroyImage = destroyImage;
+  dispatcher.vkGetImageMemoryRequirements = getImageMemoryRequirements;
+  dispatcher.vkAllocateMemory = allocateMemory;
+  dispatcher.vkFreeMemory = freeMemory;
+  dispatcher.vkBindImageMemory = bindImageMemory;
+  dispatcher.vkCreateImageView = createImageView;
+  dispatcher.vkDestroyImageView = destroyImageView;
+  dispatcher.vkCreateRenderPass = createRenderPass;
+  dispatcher.vkDestroyRenderPass = destroyRenderPass;
+  dispatcher.vkCreateFramebuffer = createFramebuffer;
+  dispatcher.vkDestroyFramebuffer = destroyFramebuffer;
+  dispatcher.vkCmdPipelineBarrier = cmdPipelineBarrier;
+  dispatcher.vkCmdBeginRenderPass = cmdBeginRenderPass;
+  dispatcher.vkCmdEndRenderPass = cmdEndRenderPass;
+  dispatcher.vkDestroyDevice = destroyDevice;
+}
+
+std::shared_ptr<vks::VulkanDeviceWrapper> fakeDeviceWrapper() {
+  const vk::PhysicalDevice physicalDevice(
+      reinterpret_cast<VkPhysicalDevice>(uintptr_t(0x1)));
+  const vk::Device device(reinterpret_cast<VkDevice>(uintptr_t(0x2)));
+  auto deviceWrapper =
+      std::make_shared<vks::VulkanDeviceWrapper>(physicalDevice);
+  deviceWrapper->logicalDevice = device;
+  deviceWrapper->allocator =
+      std::make_unique<vks::MemoryAllocator>(physicalDevice, device);
+  return deviceWrapper;
+}
+
+const vk::CommandBuffer kCommandBuffer(
+    reinterpret_cast<VkCommandBuffer>(uintptr_t(0x3)));
+
+// The barrier of image in batch, nullptr if there is none
+const VkImageMemoryBarrier *barrierOf(const Barriers &batch, VkImage image) {
+  for (const auto &barrier : batch.images) {
+    if (barrier.image == image) {
+      return &barrier;
+    }
+  }
+  return nullptr;
+}
+
+// A scene rendered with depth and composed into the swap chain image:
+//
+//   Scene    writes Scene and SceneDepth
+//   Debug    reads Scene, writes DebugView which nobody reads: culled
+//   Compose  reads Scene, writes Target and ComposeDepth
+//   Present  reads Target
+//
+// SceneDepth and ComposeDepth live in one pass each and can share memory,
+// Scene lives across both graphics passes.
+struct SceneGraph {
+  std::shared_ptr<vks::VulkanDeviceWrapper> deviceWrapper;
+  std::unique_ptr<FrameGraph> graph;
+  FrameGraph::ResourceId scene, sceneDepth, debugView, composeDepth, target;
+  FrameGraph::PassId scenePass, debugPass, composePass, presentPass;
+  int sceneRecords = 0;
+  int debugRecords = 0;
+  int composeRecords = 0;
+
+  SceneGraph() {
+    deviceWrapper = fakeDeviceWrapper();
+    graph = std::make_unique<FrameGraph>(deviceWrapper);
+    const vk::Extent2D extent{64, 64};
+    const FrameGraph::ImageDesc color{vk::Format::eR8G8B8A8Unorm, extent};
+    const FrameGraph::ImageDesc depth{vk::Format::eD32Sfloat, extent};
+
+    scene = graph->createImage("Scene", color);
+    sceneDepth = graph->createImage("SceneDepth", depth);
+    debugView = graph->createImage("DebugView", color);
+    composeDepth = graph->createImage("ComposeDepth", depth);
+    target = graph->importImage("Target", color);
+
+    using Type = FrameGraph::PassType;
+    scenePass = graph->addPass("Scene", Type::eGraphics,
+                               [this](vk::CommandBuffer) { sceneRecords++; });
+    graph->write(scenePass, scene, ResourceUsage::ColorAttachment);
+    graph->write(scenePass, sceneDepth, ResourceUsage::DepthStencilAttachment);
+    graph->setClearColor(scenePass, vk::ClearColorValue());
+
+    debugPass = graph->addPass("Debug", Type::eGraphics,
+                               [this](vk::CommandBuffer) { debugRecords++; });
+    graph->read(debugPass, scene, ResourceUsage::SampledFragment);
+    graph->write(debugPass, debugView, ResourceUsage::ColorAttachment);
+
+    composePass =
+        graph->addPass("Compose", Type::eGraphics,
+                       [this](vk::CommandBuffer) { composeRecords++; });
+    graph->read(composePass, scene, ResourceUsage::SampledFragment);
+    graph->write(composePass, target, ResourceUsage::ColorAttachment);
+    graph->write(composePass, composeDepth,
+                 ResourceUsage::DepthStencilAttachment);
+
+    presentPass = graph->addPass("Present", Type::ePresent);
+    graph->read(presentPass, target, ResourceUsage::Present);
+  }
+
+  VkImage image(FrameGraph::ResourceId resource) const {
+    // Transients are created in declaration order, so the n-th image
+    // created is the n-th transient that is used at all
+    std::vector<VkImage> images;
+    for (const auto &entry : gImages) {
+      images.push_back(entry.first);
+    }
+    if (resource == scene) {
+      return images[0];
+    }
+    if (resource == sceneDepth) {
+      return images[1];
+    }
+    return resource == composeDepth ? images[2] : VK_NULL_HANDLE;
+  }
+};
+
+void reset() {
+  gLazyMemory = false;
+  gImages.clear();
+  gBindings.clear();
+  gMemoryTypes.clear();
+  gRenderPasses.clear();
+  gFramebufferCount = 0;
+  gBarriers.clear();
+  gBegunRenderPasses.clear();
+}
+
+void testCulling() {
+  reset();
+  SceneGraph graph;
+  CHECK(graph.graph->compile());
+  CHECK(!graph.graph->isCulled(graph.scenePass));
+  CHECK(graph.graph->isCulled(graph.debugPass));
+  CHECK(!graph.graph->isCulled(graph.composePass));
+  CHECK(!graph.graph->isCulled(graph.presentPass));
+  CHECK(graph.graph->stats().passCount == 4);
+  CHECK(graph.graph->stats().culledPassCount == 1);
+  // Nothing is created for the culled pass
+  CHECK(graph.graph->stats().transientImageCount == 3);
+  CHECK(gImages.size() == 3);
+  CHECK(gRenderPasses.size() == 2);
+
+  const vk::Image target(newHandle<VkImage>());
+  const vk::ImageView targetView(newHandle<VkImageView>());
+  graph.graph->bindImage(graph.target, target, targetView,
+                         vks::ResourceState());
+  graph.graph->execute(kCommandBuffer);
+  CHECK(graph.sceneRecords == 1);
+  CHECK(graph.debugRecords == 0);
+  CHECK(graph.composeRecords == 1);
+  CHECK(gBegunRenderPasses.size() == 2);
+}
+
+void testAliasing() {
+  reset();
+  SceneGraph graph;
+  CHECK(graph.graph->compile());
+
+  const Binding scene = gBindings[graph.image(graph.scene)];
+  const Binding sceneDepth = gBindings[graph.image(graph.sceneDepth)];
+  const Binding composeDepth = gBindings[graph.image(graph.composeDepth)];
+  // The depth buffers never live at the same time, Scene overlaps both
+  CHECK(sceneDepth.memory == composeDepth.memory);
+  CHECK(sceneDepth.offset == composeDepth.offset);
+  CHECK(scene.memory != sceneDepth.memory ||
+        scene.offset != sceneDepth.offset);
+
+  const vk::DeviceSize imageBytes = 64 * 64 * 4;
+  CHECK(graph.graph->stats().transientBytes == 3 * imageBytes);
+  CHECK(graph.graph->stats().aliasedBytes == 2 * imageBytes);
+  CHECK(graph.graph->stats().lazyImageCount == 0);
+}
+
+void testBarriers() {
+  reset();
+  SceneGraph graph;
+  CHECK(graph.graph->compile());
+  const VkImage scene = graph.image(graph.scene);
+  const VkImage sceneDepth = graph.image(graph.sceneDepth);
+  const VkImage composeDepth = graph.image(graph.composeDepth);
+  const vk::Image target(newHandle<VkImage>());
+  const vk::ImageView targetView(newHandle<VkImageView>());
+  graph.graph->bindImage(graph.target, target, targetView,
+                         vks::ResourceState());
+  graph.graph->execute(kCommandBuffer);
+
+  // Before Scene, Compose and Present. Nothing is left for the final usage.
+  CHECK(gBarriers.size() == 3);
+  if (gBarriers.size() != 3) {
+    return;
+  }
+
+  const VkImageMemoryBarrier *barrier = barrierOf(gBarriers[0], scene);
+  CHECK(barrier != nullptr && barrier->oldLayout == VK_IMAGE_LAYOUT_UNDEFINED &&
+        barrier->newLayout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+  barrier = barrierOf(gBarriers[0], sceneDepth);
+  CHECK(barrier != nullptr &&
+        barrier->newLayout ==
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+
+  // Compose samples what Scene rendered
+  const Barriers &compose = gBarriers[1];
+  barrier = barrierOf(compose, scene);
+  CHECK(barrier != nullptr &&
+        barrier->oldLayout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL &&
+        barrier->newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL &&
+        (barrier->srcAccessMask & VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT) &&
+        (barrier->dstAccessMask & VK_ACCESS_SHADER_READ_BIT));
+  CHECK(compose.srcStages & VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+  CHECK(compose.dstStages & VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+  // ComposeDepth reuses the memory of SceneDepth, whose writes it waits for
+  barrier = barrierOf(compose, composeDepth);
+  CHECK(barrier != nullptr && barrier->oldLayout == VK_IMAGE_LAYOUT_UNDEFINED &&
+        (barrier->srcAccessMask &
+         VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT));
+  CHECK(compose.srcStages & VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT);
+  CHECK(barrierOf(compose, target) != nullptr);
+  CHECK(barrierOf(compose, sceneDepth) == nullptr);
+
+  barrier = barrierOf(gBarriers[2], target);
+  CHECK(barrier != nullptr &&
+        barrier->oldLayout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL &&
+        barrier->newLayout == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+}
+
+// The attachments of pass in the order the pass wrote them
+std::vector<VkAttachmentDescription> attachmentsOf(size_t pass) {
+  if (gRenderPasses.size() <= pass) {
+    return {};
+  }
+  // Render passes are created in pass order
+  return std::next(gRenderPasses.begin(), pass)->second;
+}
+
+void testAttachmentOps() {
+  reset();
+  SceneGraph graph;
+  CHECK(graph.graph->compile());
+
+  // Scene is cleared and stored for Compose. Its depth buffer is cleared
+  // and dropped, nothing reads it after the pass.
+  const auto scene = attachmentsOf(0);
+  CHECK(scene.size() == 2);
+  if (scene.size() == 2) {
+    CHECK(scene[0].loadOp == VK_ATTACHMENT_LOAD_OP_CLEAR);
+    CHECK(scene[0].storeOp == VK_ATTACHMENT_STORE_OP_STORE);
+    CHECK(scene[1].loadOp == VK_ATTACHMENT_LOAD_OP_CLEAR);
+    CHECK(scene[1].storeOp == VK_ATTACHMENT_STORE_OP_DONT_CARE);
+    // D32 has no stencil
+    CHECK(scene[1].stencilLoadOp == VK_ATTACHMENT_LOAD_OP_DONT_CARE);
+    CHECK(scene[1].stencilStoreOp == VK_ATTACHMENT_STORE_OP_DONT_CARE);
+  }
+
+  // The imported target keeps its content and is stored for presenting
+  const auto compose = attachmentsOf(1);
+  CHECK(compose.size() == 2);
+  if (compose.size() == 2) {
+    CHECK(compose[0].loadOp == VK_ATTACHMENT_LOAD_OP_LOAD);
+    CHECK(compose[0].storeOp == VK_ATTACHMENT_STORE_OP_STORE);
+    CHECK(compose[1].loadOp == VK_ATTACHMENT_LOAD_OP_CLEAR);
+    CHECK(compose[1].storeOp == VK_ATTACHMENT_STORE_OP_DONT_CARE);
+  }
+
+  const vk::DeviceSize imageBytes = 64 * 64 * 4;
+  CHECK(graph.graph->stats().skippedStoreBytes == 2 * imageBytes);
+}
+
+void testLazyMemory() {
+  reset();
+  gLazyMemory = true;
+  SceneGraph graph;
+  CHECK(graph.graph->compile());
+  const VkImage scene = graph.image(graph.scene);
+  const VkImage sceneDepth = graph.image(graph.sceneDepth);
+  const VkImage composeDepth = graph.image(graph.composeDepth);
+
+  // Only the depth buffers live within one pass
+  CHECK(!(gImages[scene].usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT));
+  CHECK(gImages[sceneDepth].usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT);
+  CHECK(gImages[composeDepth].usage &
+        VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT);
+
+  // Each gets its own lazily allocated memory instead of a shared bucket
+  CHECK(gMemoryTypes[gBindings[scene].memory] == 0);
+  CHECK(gMemoryTypes[gBindings[sceneDepth].memory] == 1);
+  CHECK(gMemoryTypes[gBindings[composeDepth].memory] == 1);
+  CHECK(gBindings[sceneDepth].memory != gBindings[composeDepth].memory);
+
+  const vk::DeviceSize imageBytes = 64 * 64 * 4;
+  CHECK(graph.graph->stats().lazyImageCount == 2);
+  CHECK(graph.graph->stats().lazyBytes == 2 * imageBytes);
+  CHECK(graph.graph->stats().aliasedBytes == imageBytes);
+
+  // Lazily allocated memory is freed with the graph
+  graph.graph.reset();
+  for (const auto &memory : gMemoryTypes) {
+    CHECK(memory.second != 1);
+  }
+}
+
+void testFramebuffersFollowBoundViews() {
+  reset();
+  SceneGraph graph;
+  CHECK(graph.graph->compile());
+  const vk::Image target(newHandle<VkImage>());
+  const vk::ImageView firstView(newHandle<VkImageView>());
+  const vk::ImageView secondView(newHandle<VkImageView>());
+
+  graph.graph->bindImage(graph.target, target, firstView,
+                         vks::ResourceState());
+  graph.graph->execute(kCommandBuffer);
+  CHECK(gFramebufferCount == 2);
+  // Cached for the same views
+  graph.graph->execute(kCommandBuffer);
+  CHECK(gFramebufferCount == 2);
+
+  graph.graph->bindImage(graph.target, target, secondView,
+                         vks::ResourceState());
+  graph.graph->execute(kCommandBuffer);
+  CHECK(gFramebufferCount == 3);
+
+  // Only Compose renders into the target
+  graph.graph->releaseView(firstView);
+  CHECK(gFramebufferCount == 2);
+  graph.graph->releaseView(secondView);
+  CHECK(gFramebufferCount == 1);
+
+  graph.graph.reset();
+  CHECK(gFramebufferCount == 0);
+  CHECK(gImages.empty());
+  CHECK(gRenderPasses.empty());
+}
+} // namespace
+
+int main() {
+  installFakeDevice();
+  // The fake device has no debug utils to name objects with
+  vks::debug::debuggable = false;
+  RUN_TEST(testCulling);
+  RUN_TEST(testAliasing);
+  RUN_TEST(testBarriers);
+  RUN_TEST(testAttachmentOps);
+  RUN_TEST(testLazyMemory);
+  RUN_TEST(testFramebuffersFollowBoundViews);
+  return TEST_RESULT();
+}
@@ -0,0 +1,160 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "TestUtil.h"
+
+#include <LatencyTracker.h>
+
+#include <cmath>
+
+using gain::LatencyHistogram;
+using gain::LatencyTracker;
+using gain::SyntheticClock;
+using Stage = gain::LatencyTracker::Stage;
+
+namespace {
+constexpr int64_t kMs = 1000000;
+constexpr int64_t kSecond = 1000 * kMs;
+
+// Within the histogram's precision of 1/64 of the value
+bool near(double actual, double expected) {
+  return std::fabs(actual - expected) <= expected / 64.0 + 0.001;
+}
+
+LatencyTracker::Stats statsOf(const LatencyTracker &tracker, Stage stage) {
+  return tracker.stats()[static_cast<size_t>(stage)];
+}
+
+void testHistogramPercentiles() {
+  LatencyHistogram histogram;
+  CHECK(histogram.percentile(50.0) == 0);
+  for (uint64_t micros = 1; micros <= 1000; micros++) {
+    histogram.record(micros);
+  }
+  CHECK(histogram.count() == 1000);
+  CHECK(histogram.min() == 1);
+  CHECK(histogram.max() == 1000);
+  CHECK(near(histogram.percentile(50.0), 500.0));
+  CHECK(near(histogram.percentile(99.0), 990.0));
+  CHECK(histogram.percentile(100.0) == 1000);
+
+  // Clamped rather than dropped
+  histogram.record(LatencyHistogram::kMaxMicros * 2);
+  CHECK(histogram.max() == LatencyHistogram::kMaxMicros);
+}
+
+void testFrameOrigin() {
+  SyntheticClock clock(100 * kSecond);
+  LatencyTracker tracker(clock);
+  const int64_t now = clock.nowNs();
+
+  CHECK(tracker.frameOrigin(now - 20 * kMs) == now - 20 * kMs);
+  // Unknown, in the future or too old for the same clock base
+  CHECK(tracker.frameOrigin(0) == now);
+  CHECK(tracker.frameOrigin(now + kMs) == now);
+  CHECK(tracker.frameOrigin(now - 5 * kSecond) == now);
+}
+
+void testStagesOfAFrame() {
+  SyntheticClock clock(100 * kSecond);
+  LatencyTracker tracker(clock);
+  const int64_t origin = tracker.frameOrigin(clock.nowNs() - 8 * kMs);
+
+  tracker.record(Stage::Ingest, origin);
+  clock.advance(2 * kMs);
+  tracker.record(Stage::Acquire, origin);
+  clock.advance(1 * kMs);
+  tracker.record(Stage::Submit, origin);
+  tracker.record(Stage::Present, origin);
+  clock.advance(6 * kMs);
+  tracker.record(Stage::GpuComplete, origin);
+
+  const double expectedMs[] = {8.0, 10.0, 11.0, 11.0, 17.0};
+  const std::vector<LatencyTracker::Stats> stats = tracker.stats();
+  CHECK(stats.size() == static_cast<size_t>(Stage::Count));
+  for (size_t stage = 0; stage < stats.size(); stage++) {
+    CHECK(stats[stage].stage == static_cast<Stage>(stage));
+    CHECK(stats[stage].count == 1);
+    CHECK(stats[stage].minMs == expectedMs[stage]);
+    CHECK(stats[stage].maxMs == expectedMs[stage]);
+    CHECK(near(stats[stage].p50Ms, expectedMs[stage]));
+  }
+}
+
+void testPercentilesOverFrames() {
+  SyntheticClock clock(100 * kSecond);
+  LatencyTracker tracker(clock);
+  // 100 frames at 30 fps, 1 to 100 ms old when submitted
+  for (int64_t latencyMs = 1; latencyMs <= 100; latencyMs++) {
+    clock.advance(33 * kMs);
+    tracker.record(Stage::Submit, clock.nowNs() - latencyMs * kMs);
+  }
+  const LatencyTracker::Stats stats = statsOf(tracker, Stage::Submit);
+  CHECK(stats.count == 100);
+  CHECK(stats.minMs == 1.0);
+  CHECK(stats.maxMs == 100.0);
+  CHECK(near(stats.p50Ms, 50.0));
+  CHECK(near(stats.p90Ms, 90.0));
+  CHECK(near(stats.p99Ms, 99.0));
+  CHECK(statsOf(tracker, Stage::Present).count == 0);
+}
+
+void testWindowForgetsOldFrames() {
+  SyntheticClock clock(100 * kSecond);
+  LatencyTracker tracker(clock);
+  tracker.record(Stage::Present, clock.nowNs() - 50 * kMs);
+
+  clock.advance(LatencyTracker::kWindowSeconds * kSecond / 2);
+  tracker.record(Stage::Present, clock.nowNs() - 10 * kMs);
+  CHECK(statsOf(tracker, Stage::Present).count == 2);
+  CHECK(statsOf(tracker, Stage::Present).maxMs == 50.0);
+
+  // The first frame has left the window, the second one hasn't
+  clock.advance(LatencyTracker::kWindowSeconds * kSecond / 2 + kSecond);
+  CHECK(statsOf(tracker, Stage::Present).count == 1);
+  CHECK(statsOf(tracker, Stage::Present).maxMs == 10.0);
+
+  clock.advance(LatencyTracker::kWindowSeconds * kSecond);
+  CHECK(statsOf(tracker, Stage::Present).count == 0);
+}
+
+void testOriginAfterNow() {
+  // A frame can't be younger than 0
+  SyntheticClock clock(100 * kSecond);
+  LatencyTracker tracker(clock);
+  tracker.record(Stage::Ingest, clock.nowNs() + kMs);
+  CHECK(statsOf(tracker, Stage::Ingest).count == 1);
+  CHECK(statsOf(tracker, Stage::Ingest).maxMs == 0.0);
+}
+} // namespace
+
+int main() {
+  RUN_TEST(testHistogramPercentiles);
+  RUN_TEST(testFrameOrigin);
+  RUN_TEST(testStagesOfAFrame);
+  RUN_TEST(testPercentilesOverFrames);
+  RUN_TEST(testWindowForgetsOldFrames);
+  RUN_TEST(testOriginAfterNow);
+  return TEST_RESULT();
+}
@@ -0,0 +1,152 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "TestUtil.h"
+
+#include <SyncFence.h>
+
+#include <cerrno>
+#include <chrono>
+#include <fcntl.h>
+#include <thread>
+#include <unistd.h>
+
+using gain::SyncFence;
+
+namespace {
+// Stand-ins for the driver's vkImportSemaphoreFdKHR. A successful import
+// takes ownership of the descriptor, which the fake closes right away.
+int gImportedFd = -1;
+
+VKAPI_ATTR VkResult VKAPI_CALL
+rejectImport(VkDevice, const VkImportSemaphoreFdInfoKHR *) {
+  return VK_ERROR_INVALID_EXTERNAL_HANDLE;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL
+acceptImport(VkDevice, const VkImportSemaphoreFdInfoKHR *info) {
+  gImportedFd = info->fd;
+  close(info->fd);
+  return VK_SUCCESS;
+}
+
+bool isOpen(int fd) { return fcntl(fd, F_GETFD) != -1 || errno != EBADF; }
+
+// The handles are only passed through to the fakes
+vk::Device fakeDevice() {
+  return vk::Device(reinterpret_cast<VkDevice>(uintptr_t(0x1)));
+}
+
+void testWaitOnInvalidFd() {
+  // Nothing to wait for
+  SyncFence fence(-1);
+  CHECK(!fence.isValid());
+  CHECK(fence.wait(0));
+  CHECK(fence.wait());
+}
+
+void testWaitOnSignaledFd() {
+  SyncFence fence = SyncFence::createSignalable();
+  CHECK(fence.isValid());
+  CHECK(fence.signal());
+  CHECK(fence.wait(0));
+  // Still signaled for a second wait
+  CHECK(fence.wait(0));
+}
+
+void testWaitTimesOut() {
+  SyncFence fence = SyncFence::createSignalable();
+  CHECK(!fence.wait(0));
+  CHECK(!fence.wait(10));
+}
+
+void testWaitForSignalFromAnotherThread() {
+  SyncFence fence = SyncFence::createSignalable();
+  std::thread producer([&fence] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    fence.signal();
+  });
+  CHECK(fence.wait());
+  producer.join();
+}
+
+void testWaitOnClosedFdFails() {
+  int fd = SyncFence::createSignalable().release();
+  close(fd);
+  SyncFence fence(fd);
+  CHECK(!fence.wait(0));
+  fence.release();
+}
+
+void testImportInvalidFd() {
+  VULKAN_HPP_DEFAULT_DISPATCHER.vkImportSemaphoreFdKHR = acceptImport;
+  gImportedFd = -1;
+  SyncFence fence(-1);
+  CHECK(!fence.importToSemaphore(fakeDevice(), vk::Semaphore()));
+  // The driver is not asked
+  CHECK(gImportedFd == -1);
+}
+
+void testImportSignaledFd() {
+  VULKAN_HPP_DEFAULT_DISPATCHER.vkImportSemaphoreFdKHR = acceptImport;
+  SyncFence fence = SyncFence::createSignalable();
+  CHECK(fence.signal());
+  const int fd = fence.get();
+  CHECK(fence.importToSemaphore(fakeDevice(), vk::Semaphore()));
+  CHECK(gImportedFd == fd);
+  // The driver owns the descriptor, the fence must not close it again
+  CHECK(!fence.isValid());
+  CHECK(fence.wait(0));
+}
+
+void testFailedImportFallsBackToWait() {
+  VULKAN_HPP_DEFAULT_DISPATCHER.vkImportSemaphoreFdKHR = rejectImport;
+  int fd = -1;
+  {
+    SyncFence fence = SyncFence::createSignalable();
+    fd = fence.get();
+    CHECK(!fence.importToSemaphore(fakeDevice(), vk::Semaphore()));
+    // Left untouched for the CPU wait
+    CHECK(fence.isValid());
+    CHECK(fence.get() == fd);
+    CHECK(fence.signal());
+    CHECK(fence.wait(0));
+    CHECK(isOpen(fd));
+  }
+  // Closed with the fence on the error path
+  CHECK(!isOpen(fd));
+}
+} // namespace
+
+int main() {
+  RUN_TEST(testWaitOnInvalidFd);
+  RUN_TEST(testWaitOnSignaledFd);
+  RUN_TEST(testWaitTimesOut);
+  RUN_TEST(testWaitForSignalFromAnotherThread);
+  RUN_TEST(testWaitOnClosedFdFails);
+  RUN_TEST(testImportInvalidFd);
+  RUN_TEST(testImportSignaledFd);
+  RUN_TEST(testFailedImportFallsBackToWait);
+  return TEST_RESULT();
+}
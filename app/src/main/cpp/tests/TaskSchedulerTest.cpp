@@ -0,0 +1,132 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "TestUtil.h"
+
+#include <TaskScheduler.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using gain::TaskGroup;
+using gain::TaskScheduler;
+
+namespace {
+// Occupies the only worker of a scheduler until released
+class BusyWorker {
+public:
+  explicit BusyWorker(TaskScheduler &scheduler) {
+    scheduler.submit([this] {
+      mStarted = true;
+      while (!mReleased) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    });
+    while (!mStarted) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+  void release() { mReleased = true; }
+
+private:
+  std::atomic<bool> mStarted{false};
+  std::atomic<bool> mReleased{false};
+};
+
+void testWaitRunsOwnTasks() {
+  TaskScheduler scheduler(1);
+  BusyWorker busy(scheduler);
+
+  // The worker is busy, the waiting thread has to run the task itself
+  std::thread::id ranOn;
+  TaskGroup group(scheduler);
+  group.run([&] { ranOn = std::this_thread::get_id(); });
+  group.wait();
+  CHECK(ranOn == std::this_thread::get_id());
+  busy.release();
+}
+
+void testWaitLeavesOtherWorkAlone() {
+  TaskScheduler scheduler(1);
+  BusyWorker busy(scheduler);
+
+  std::atomic<bool> unrelatedRan{false};
+  scheduler.submit([&] { unrelatedRan = true; });
+  TaskGroup other(scheduler);
+  other.run([&] { unrelatedRan = true; });
+
+  bool ran = false;
+  TaskGroup group(scheduler);
+  group.run([&] { ran = true; });
+  group.wait();
+  CHECK(ran);
+  // Queued before the group's task, but not the waiting thread's business
+  CHECK(!unrelatedRan);
+
+  busy.release();
+  other.wait();
+  CHECK(unrelatedRan);
+}
+
+void testNestedWaitOnWorker() {
+  // Every level waits on a worker for tasks queued behind it
+  TaskScheduler scheduler(1);
+  std::atomic<int> sum{0};
+  scheduler.parallelFor(0, 8, 1, [&](int first, int last) {
+    scheduler.parallelFor(first * 8, last * 8, 1, [&](int begin, int end) {
+      for (int i = begin; i < end; ++i) {
+        sum += i;
+      }
+    });
+  });
+  CHECK(sum == 63 * 64 / 2);
+}
+
+void testGraphOnBusyScheduler() {
+  // Successors are queued by the group's own tasks while wait() polls
+  TaskScheduler scheduler(1);
+  BusyWorker busy(scheduler);
+
+  std::atomic<int> order{0};
+  int first = -1, second = -1;
+  gain::TaskGraph graph;
+  const auto a = graph.add([&] { first = order++; });
+  const auto b = graph.add([&] { second = order++; });
+  graph.precede(a, b);
+  CHECK(graph.run(scheduler));
+  CHECK(first == 0);
+  CHECK(second == 1);
+  busy.release();
+}
+} // namespace
+
+int main() {
+  RUN_TEST(testWaitRunsOwnTasks);
+  RUN_TEST(testWaitLeavesOtherWorkAlone);
+  RUN_TEST(testNestedWaitOnWorker);
+  RUN_TEST(testGraphOnBusyScheduler);
+  return TEST_RESULT();
+}
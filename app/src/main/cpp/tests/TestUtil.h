@@ -0,0 +1,60 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2022 by Gain
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef GAINVULKANSAMPLE_TESTUTIL_H
+#define GAINVULKANSAMPLE_TESTUTIL_H
+
+#include <cstdio>
+
+// Just enough of a test framework for the host tests: every CHECK that
+// fails is reported and counted, and main returns the count, so ctest sees
+// a failure.
+namespace test {
+inline int &failureCount() {
+  static int count = 0;
+  return count;
+}
+} // namespace test
+
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__,        \
+              #condition);                                                     \
+      ++test::failureCount();                                                  \
+    }                                                                          \
+  } while (0)
+
+#define RUN_TEST(function)                                                     \
+  do {                                                                         \
+    const int failuresBefore = test::failureCount();                           \
+    function();                                                                \
+    fprintf(stderr, "%s %s\n",                                                 \
+            test::failureCount() == failuresBefore ? "PASS" : "FAIL",          \
+            #function);                                                        \
+  } while (0)
+
+#define TEST_RESULT() (test::failureCount() == 0 ? 0 : 1)
+
+#endif // GAINVULKANSAMPLE_TESTUTIL_H
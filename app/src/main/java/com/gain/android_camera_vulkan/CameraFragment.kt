@@ -71,8 +71,9 @@ class CameraFragment : Fragment() {
         mCameraCore.init()
 
         vulkan = NativeVulkan()
-        vulkan.init(requireActivity().assets)
+        vulkan.init(requireActivity().assets, requireContext().cacheDir.absolutePath)
         vulkan.configEngine(NativeVulkan.EngineType.CAMERA_HARDWAREBUFFER)
+        vulkan.setGpuProfiling(BuildConfig.DEBUG)
 
         if (ContextCompat.checkSelfPermission(requireContext(), Manifest.permission.CAMERA)
             == PackageManager.PERMISSION_DENIED) {
@@ -160,7 +161,8 @@ class CameraFragment : Fragment() {
         },  {imageReader ->
             var image = imageReader.acquireNextImage()
 
-            vulkan.prepareHardwareBuffer(image.hardwareBuffer, mCameraCore.getOrientation())
+            vulkan.prepareHardwareBuffer(image.hardwareBuffer, mCameraCore.getOrientation(), -1,
+                image.timestamp)
 
             vulkan.startRender(false)
 
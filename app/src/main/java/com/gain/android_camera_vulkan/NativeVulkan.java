@@ -32,6 +32,7 @@ import android.util.Log;
 import android.view.Surface;
 
 import java.nio.ByteBuffer;
+import java.util.concurrent.atomic.AtomicBoolean;
 
 import androidx.annotation.NonNull;
 import androidx.annotation.Nullable;
@@ -57,8 +58,12 @@ public class NativeVulkan {
 
     private boolean mDrawing = false;
 
+    // A single render posted to the render thread draws the newest camera frame, so frames
+    // arriving while it is queued don't post another one
+    private final AtomicBoolean mRenderPending = new AtomicBoolean(false);
+
     // Return a non-zero handle on success, and 0L if failed.
-    private native long nativeInit(AssetManager assetManager);
+    private native long nativeInit(AssetManager assetManager, String cacheDir);
 
     private native void nativeConfigEngine(long handle, int sampleType);
 
@@ -66,17 +71,44 @@ public class NativeVulkan {
     // must not be used in any way.
     private native void nativeUnInit(long handle);
 
-    private native void nativePrepareHardwareBuffer(long handle, HardwareBuffer buffer, int orientation);
+    private native void nativePrepareHardwareBuffer(long handle, HardwareBuffer buffer, int orientation, int fenceFd, long timestampNs);
 
     private native void nativeStartRender(long handle, boolean loop);
 
     private native void nativeStopLoopRender(long handle);
 
+    private native void nativeSetRenderPolicy(long handle, boolean onNewContentOnly, float maxFrameRate);
+
     private native void nativeSetWindow(long handle, Surface surface, int width, int height);
 
     private native void nativeOnWindowSizeChanged(long handle, Surface surface, int width, int height);
 
-    public void init(AssetManager assetManager) {
+    private native boolean nativeGetNV21FromHardwareBuffer(long handle, HardwareBuffer buffer, ByteBuffer output);
+
+    private native int nativeLoadLut(long handle, String path, String cachePath);
+
+    private native void nativeSelectLut(long handle, int id);
+
+    private native void nativeSetLutTetrahedral(long handle, boolean tetrahedral);
+
+    private native long[] nativeGetFrameStats(long handle);
+
+    private native boolean nativeSetGpuProfiling(long handle, boolean enabled);
+
+    private native GpuPassStats[] nativeGetGpuPassStats(long handle);
+
+    private native LatencyStats[] nativeGetLatencyStats(long handle);
+
+    private native boolean nativeSetFrameReadback(long handle, boolean enabled);
+
+    private native int[] nativeReadLatestFrame(long handle, ByteBuffer output);
+
+    private native boolean nativeStartTrace(String path);
+
+    private native void nativeStopTrace();
+
+    // cacheDir keeps the compiled pipelines across runs, may be null
+    public void init(AssetManager assetManager, String cacheDir) {
         if (mRenderThread != null) {
             mRenderThread.quitSafely();
             mRenderThread = null;
@@ -87,7 +119,7 @@ public class NativeVulkan {
         mRenderThread.start();
         mRenderHandler = new Handler(mRenderThread.getLooper());
 
-        mVulkanHandle = nativeInit(assetManager);
+        mVulkanHandle = nativeInit(assetManager, cacheDir);
     }
 
     public void unInit() {
@@ -119,18 +151,184 @@ public class NativeVulkan {
         nativeOnWindowSizeChanged(mVulkanHandle, surface, width, height);
     }
 
+    // Hands hardwareBuffer to the renderer without blocking, it keeps a reference of its own so
+    // the caller can close the buffer right away. A frame not drawn before the next one arrives
+    // is dropped.
     public void prepareHardwareBuffer(HardwareBuffer hardwareBuffer, int orientation) {
-        nativePrepareHardwareBuffer(mVulkanHandle, hardwareBuffer, orientation);
+        prepareHardwareBuffer(hardwareBuffer, orientation, -1);
+    }
+
+    // fenceFd is the producer's acquire fence for hardwareBuffer, or -1 if the buffer is ready.
+    // Ownership of the fd is transferred, the GPU waits on it before sampling the buffer.
+    public void prepareHardwareBuffer(HardwareBuffer hardwareBuffer, int orientation, int fenceFd) {
+        prepareHardwareBuffer(hardwareBuffer, orientation, fenceFd, 0L);
+    }
+
+    // timestampNs is the frame's Image.getTimestamp(), the latency stats measure the age of the
+    // frame from it. 0 measures from the call instead.
+    public void prepareHardwareBuffer(HardwareBuffer hardwareBuffer, int orientation, int fenceFd,
+                                      long timestampNs) {
+        nativePrepareHardwareBuffer(mVulkanHandle, hardwareBuffer, orientation, fenceFd, timestampNs);
+    }
+
+    // Needs EngineType.HARDWAREBUFFER_TO_NV21. Converts hardwareBuffer on the GPU and writes the
+    // NV21 data into output, which must be a direct buffer with room for width * height * 3 / 2
+    // bytes. The width must be a multiple of 4 and the height even. Blocks until the data is
+    // written, returns false if the conversion failed.
+    @WorkerThread
+    public boolean getNV21(@NonNull HardwareBuffer hardwareBuffer, @NonNull ByteBuffer output) {
+        if (mVulkanHandle == 0L || !output.isDirect()) {
+            return false;
+        }
+        return nativeGetNV21FromHardwareBuffer(mVulkanHandle, hardwareBuffer, output);
+    }
+
+    // Needs EngineType.LUT. Loads the .cube file at cubePath, 17^3 to 65^3 tables are typical.
+    // cachePath is where the parsed table is kept for the next load, may be null. Returns the id
+    // to select the table with, or -1 if it could not be loaded. Id 0 is the identity.
+    @WorkerThread
+    public int loadLut(@NonNull String cubePath, String cachePath) {
+        if (mVulkanHandle == 0L) {
+            return -1;
+        }
+        return nativeLoadLut(mVulkanHandle, cubePath, cachePath);
+    }
+
+    // Takes effect with the next frame, no pipeline is rebuilt
+    public void selectLut(int id) {
+        nativeSelectLut(mVulkanHandle, id);
+    }
+
+    // Interpolate tetrahedrally in the shader instead of with the trilinear texture filter
+    public void setLutTetrahedral(boolean tetrahedral) {
+        nativeSetLutTetrahedral(mVulkanHandle, tetrahedral);
+    }
+
+    // Camera frames handed in, drawn, and dropped in favor of a newer frame, or null if the
+    // engine takes no camera frames
+    @Nullable
+    public long[] getFrameStats() {
+        if (mVulkanHandle == 0L) {
+            return null;
+        }
+        return nativeGetFrameStats(mVulkanHandle);
+    }
+
+    // GPU durations of a pass over the last frames, in milliseconds
+    public static final class GpuPassStats {
+        public final String name;
+        public final int samples;
+        public final double minMs;
+        public final double avgMs;
+        public final double p99Ms;
+
+        GpuPassStats(String name, int samples, double minMs, double avgMs, double p99Ms) {
+            this.name = name;
+            this.samples = samples;
+            this.minMs = minMs;
+            this.avgMs = avgMs;
+            this.p99Ms = p99Ms;
+        }
+    }
+
+    // Time the engine's passes on the GPU for getGpuPassStats. Off by default since the timestamps
+    // cost every frame. Call after configEngine and before the first frame, returns false
+    // otherwise.
+    public boolean setGpuProfiling(boolean enabled) {
+        if (mVulkanHandle == 0L) {
+            return false;
+        }
+        return nativeSetGpuProfiling(mVulkanHandle, enabled);
+    }
+
+    // Timings of every pass the engine has drawn, or null if profiling is off or the device can't
+    // time them
+    @Nullable
+    public GpuPassStats[] getGpuPassStats() {
+        if (mVulkanHandle == 0L) {
+            return null;
+        }
+        return nativeGetGpuPassStats(mVulkanHandle);
+    }
+
+    // Age of the camera frames when they reach a stage of the renderer, over the last 10 seconds.
+    // Stages are ingest, acquire, submit, present and gpu complete.
+    public static final class LatencyStats {
+        public final String stage;
+        public final long count;
+        public final double minMs;
+        public final double p50Ms;
+        public final double p90Ms;
+        public final double p99Ms;
+        public final double maxMs;
+
+        LatencyStats(String stage, long count, double minMs, double p50Ms, double p90Ms,
+                     double p99Ms, double maxMs) {
+            this.stage = stage;
+            this.count = count;
+            this.minMs = minMs;
+            this.p50Ms = p50Ms;
+            this.p90Ms = p90Ms;
+            this.p99Ms = p99Ms;
+            this.maxMs = maxMs;
+        }
+    }
+
+    // Null if the engine takes no camera frames
+    @Nullable
+    public LatencyStats[] getLatencyStats() {
+        if (mVulkanHandle == 0L) {
+            return null;
+        }
+        return nativeGetLatencyStats(mVulkanHandle);
+    }
+
+    // Keep a copy of the latest drawn camera frame for readLatestFrame. The GPU copies the frame
+    // out without stalling the renderer, frames are skipped while the copies can't keep up.
+    // Returns false if the engine takes no camera frames.
+    public boolean setFrameReadback(boolean enabled) {
+        if (mVulkanHandle == 0L) {
+            return false;
+        }
+        return nativeSetFrameReadback(mVulkanHandle, enabled);
+    }
+
+    // Copies the latest frame read back into output, a direct buffer with room for
+    // rowPitch * height bytes. Returns {width, height, rowPitch, VkFormat}, or null if there is
+    // no frame newer than the last one read or output is too small.
+    @Nullable
+    public int[] readLatestFrame(@NonNull ByteBuffer output) {
+        if (mVulkanHandle == 0L || !output.isDirect()) {
+            return null;
+        }
+        return nativeReadLatestFrame(mVulkanHandle, output);
+    }
+
+    // Record the CPU timeline of all native threads into a Chrome JSON trace at path, which
+    // chrome://tracing and ui.perfetto.dev open. Only has events if the library was built with
+    // VK_ENGINE_TRACING.
+    public boolean startTrace(String path) {
+        return nativeStartTrace(path);
+    }
+
+    public void stopTrace() {
+        nativeStopTrace();
     }
 
     public void startRender(boolean loop) {
         if (mDrawing) {
             return;
         }
+        if (!loop && !mRenderPending.compareAndSet(false, true)) {
+            return;
+        }
 
         mRenderHandler.post(() -> {
             if(loop) {
                 mDrawing = true;
+            } else {
+                // Frames handed in from now on need another render
+                mRenderPending.set(false);
             }
             nativeStartRender(mVulkanHandle, loop);
         });
@@ -138,10 +336,20 @@ public class NativeVulkan {
 //        nativeStartRender(mVulkanHandle, loop);
     }
 
+    // The render loop of startRender(true) draws when a camera frame arrives, the window is
+    // resized or a setting changes with onNewContentOnly, which is the default, and continuously
+    // otherwise. maxFrameRate 0 does not limit the frame rate.
+    public void setRenderPolicy(boolean onNewContentOnly, float maxFrameRate) {
+        nativeSetRenderPolicy(mVulkanHandle, onNewContentOnly, maxFrameRate);
+    }
+
+    // Returns once the render loop has finished its last frame. The render thread stays usable,
+    // it is quit by unInit.
     public void stopLoopRender() {
+        // A loop posted but not started yet
+        mRenderHandler.removeCallbacksAndMessages(null);
         nativeStopLoopRender(mVulkanHandle);
-
-        mRenderThread.quitSafely();
-        mRenderThread = null;
+        mRenderPending.set(false);
+        mDrawing = false;
     }
 }
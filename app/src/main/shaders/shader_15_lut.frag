@@ -0,0 +1,70 @@
+#version 450
+
+// Nearest texel taps with tetrahedral interpolation instead of the hardware
+// trilinear filter. Four taps instead of eight and no blurring of the hue
+// across the cube diagonal, at the cost of a few ALU operations.
+layout (constant_id = 0) const bool kTetrahedral = false;
+
+layout (set = 0, binding = 1) uniform sampler2D samplerImg;
+// The LUT, red along x, green along y and blue along z
+layout (set = 1, binding = 0) uniform sampler3D samplerLut;
+
+layout (location = 0) in vec2 texturePos;
+layout (location = 0) out vec4 outColor;
+
+vec3 lookupTrilinear(vec3 color)
+{
+    // Map [0, 1] to the centers of the first and last texels
+    float size = float(textureSize(samplerLut, 0).x);
+    vec3 coord = color * ((size - 1.0) / size) + 0.5 / size;
+    return textureLod(samplerLut, coord, 0.0).rgb;
+}
+
+vec3 lutTexel(ivec3 base, ivec3 offset)
+{
+    return texelFetch(samplerLut, base + offset, 0).rgb;
+}
+
+vec3 lookupTetrahedral(vec3 color)
+{
+    int size = textureSize(samplerLut, 0).x;
+    vec3 position = color * float(size - 1);
+    ivec3 base = min(ivec3(position), ivec3(size - 2));
+    vec3 f = position - vec3(base);
+
+    // The unit cube splits into six tetrahedra along its diagonal, pick the
+    // one f falls into by the order of its components
+    vec3 c000 = lutTexel(base, ivec3(0, 0, 0));
+    vec3 c111 = lutTexel(base, ivec3(1, 1, 1));
+    if (f.r > f.g) {
+        if (f.g > f.b) {
+            return (1.0 - f.r) * c000 + (f.r - f.g) * lutTexel(base, ivec3(1, 0, 0)) +
+                   (f.g - f.b) * lutTexel(base, ivec3(1, 1, 0)) + f.b * c111;
+        } else if (f.r > f.b) {
+            return (1.0 - f.r) * c000 + (f.r - f.b) * lutTexel(base, ivec3(1, 0, 0)) +
+                   (f.b - f.g) * lutTexel(base, ivec3(1, 0, 1)) + f.g * c111;
+        } else {
+            return (1.0 - f.b) * c000 + (f.b - f.r) * lutTexel(base, ivec3(0, 0, 1)) +
+                   (f.r - f.g) * lutTexel(base, ivec3(1, 0, 1)) + f.g * c111;
+        }
+    } else {
+        if (f.b > f.g) {
+            return (1.0 - f.b) * c000 + (f.b - f.g) * lutTexel(base, ivec3(0, 0, 1)) +
+                   (f.g - f.r) * lutTexel(base, ivec3(0, 1, 1)) + f.r * c111;
+        } else if (f.b > f.r) {
+            return (1.0 - f.g) * c000 + (f.g - f.b) * lutTexel(base, ivec3(0, 1, 0)) +
+                   (f.b - f.r) * lutTexel(base, ivec3(0, 1, 1)) + f.r * c111;
+        } else {
+            return (1.0 - f.g) * c000 + (f.g - f.r) * lutTexel(base, ivec3(0, 1, 0)) +
+                   (f.r - f.b) * lutTexel(base, ivec3(1, 1, 0)) + f.b * c111;
+        }
+    }
+}
+
+void main()
+{
+    vec4 color = texture(samplerImg, texturePos, 0.0);
+    vec3 graded = kTetrahedral ? lookupTetrahedral(clamp(color.rgb, 0.0, 1.0))
+                               : lookupTrilinear(clamp(color.rgb, 0.0, 1.0));
+    outColor = vec4(graded, color.a);
+}